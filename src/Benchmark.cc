@@ -0,0 +1,405 @@
+// Simulator speed benchmarks.
+//
+// Microbenchmarks time the hot helpers in isolation (Memory, decode, ALU,
+// recordStage, printPipelineDiagram); the end-to-end runs time complete
+// simulations of every program in the input directory. Each run simulates the
+// program up to its last cycle of work, repeated until the cycle count is
+// reached, so idle cycles after it ends are not timed. Results go to a JSON
+// file so runs can be compared over time.
+//
+// The functional runs execute each program architecturally, one
+// FunctionalCore::step() at a time, through the TranslationCache and with its
+// JIT, and check that all of them end in the same state.
+//
+// Usage: ./benchmark [--inputs DIR] [--cycles N] [--out FILE]
+#include "ForwardingProcessor.hpp"
+#include "TranslationCache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct MicroResult {
+    std::string name;
+    uint64_t operations;
+    double seconds;
+};
+
+struct EndToEndResult {
+    std::string program;
+    std::string processor;
+    bool diagram;
+    int64_t cycles;  // Instructions for the functional runs
+    uint64_t instructions;
+    double seconds;
+};
+
+// How long a program keeps the pipeline busy
+struct ProgramLength {
+    int cycles;             // Until it halts, or leaves its text with every latch empty
+    uint64_t instructions;  // Committed in those cycles
+};
+
+// Keeps results observable so the optimiser cannot drop the measured work
+volatile int64_t sink = 0;
+
+// Runs 'body' (which performs 'operationsPerCall' operations) until at least
+// minSeconds have elapsed, and reports the total.
+MicroResult timeMicro(const std::string& name, uint64_t operationsPerCall, const std::function<void()>& body,
+                      double minSeconds = 0.2) {
+    body();  // Warm up caches and page tables
+    uint64_t calls = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    do {
+        body();
+        calls++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    return MicroResult{name, calls * operationsPerCall, elapsed};
+}
+
+// Simple xorshift so the benchmarks do not depend on <random> implementation speed
+uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+std::vector<std::string> listPrograms(const std::string& directory) {
+    std::vector<std::string> programs;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".txt")
+            programs.push_back(entry.path().string());
+    }
+    std::sort(programs.begin(), programs.end());
+    return programs;
+}
+
+// Every valid instruction word found in the input programs, used as decode input
+std::vector<uint32_t> collectInstructions(const std::vector<std::string>& programs) {
+    std::vector<uint32_t> words;
+    for (const std::string& program : programs) {
+        NoForwardingProcessor processor;
+        if (!processor.loadInstructionsFast(program))
+            continue;
+        for (uint32_t word : processor.instructionMemory) {
+            uint32_t opcode = word & 0x7F;
+            if (opcode == 0x33 || opcode == 0x13 || opcode == 0x03 || opcode == 0x23 || opcode == 0x63 ||
+                opcode == 0x6F || opcode == 0x67 || opcode == 0x37 || opcode == 0x17)
+                words.push_back(word);
+        }
+    }
+    if (words.empty())
+        words.push_back(0x00000293);  // addi x5 x0 0
+    return words;
+}
+
+std::vector<MicroResult> runMicrobenchmarks(const std::vector<uint32_t>& instructions) {
+    std::vector<MicroResult> results;
+    const uint32_t memoryBytes = 1 << 20;
+
+    {
+        Memory memory;
+        results.push_back(timeMicro("memory_write_word_sequential", memoryBytes / 4, [&]() {
+            for (uint32_t address = 0; address < memoryBytes; address += 4)
+                memory.writeWord(0x10000000 + address, static_cast<int32_t>(address));
+        }));
+        results.push_back(timeMicro("memory_read_word_sequential", memoryBytes / 4, [&]() {
+            int64_t sum = 0;
+            for (uint32_t address = 0; address < memoryBytes; address += 4)
+                sum += memory.readWord(0x10000000 + address);
+            sink = sink + sum;
+        }));
+        results.push_back(timeMicro("memory_read_byte_random", 1 << 16, [&]() {
+            uint32_t state = 12345;
+            int64_t sum = 0;
+            for (int i = 0; i < (1 << 16); i++)
+                sum += memory.readByte(0x10000000 + (nextRandom(state) & (memoryBytes - 1)));
+            sink = sink + sum;
+        }));
+        results.push_back(timeMicro("memory_write_byte_random", 1 << 16, [&]() {
+            uint32_t state = 54321;
+            for (int i = 0; i < (1 << 16); i++)
+                memory.writeByte(0x10000000 + (nextRandom(state) & (memoryBytes - 1)), static_cast<uint8_t>(i));
+        }));
+        std::vector<uint8_t> block(memoryBytes);
+        results.push_back(timeMicro("memory_write_block_1MiB", memoryBytes, [&]() {
+            memory.writeBlock(0x20000000, block.data(), block.size());
+        }));
+    }
+
+    NoForwardingProcessor processor;
+    results.push_back(timeMicro("decodeControlSignals", instructions.size(), [&]() {
+        int64_t sum = 0;
+        for (uint32_t word : instructions)
+            sum += processor.decodeControlSignals(word).aluOp;
+        sink = sink + sum;
+    }));
+    results.push_back(timeMicro("extractImmediate", instructions.size(), [&]() {
+        int64_t sum = 0;
+        for (uint32_t word : instructions)
+            sum += processor.extractImmediate(word, word & 0x7F);
+        sink = sink + sum;
+    }));
+    results.push_back(timeMicro("executeALU", 18 * 1024, [&]() {
+        uint32_t state = 777;
+        int64_t sum = 0;
+        for (int i = 0; i < 1024; i++) {
+            int32_t a = static_cast<int32_t>(nextRandom(state));
+            int32_t b = static_cast<int32_t>(nextRandom(state) | 1);
+            for (uint32_t aluOp = 0; aluOp < 18; aluOp++)
+                sum += processor.executeALU(a, b, aluOp);
+        }
+        sink = sink + sum;
+    }));
+
+    // recordStage over a matrix of realistic shape: 64 instructions x 4096 cycles
+    {
+        NoForwardingProcessor matrixProcessor;
+        matrixProcessor.instructionMemory.assign(64, 0x00000293);
+        matrixProcessor.instructionStrings.assign(64, "addi x5 x0 0");
+        matrixProcessor.run(0);  // Resets state without simulating
+        matrixProcessor.matrixRows = 64;
+        matrixProcessor.matrixCols = 4096;
+        matrixProcessor.pipelineMatrix3D.assign(64, std::vector<std::vector<PipelineStage>>(
+                                                        4096, std::vector<PipelineStage>(1, SPACE)));
+        results.push_back(timeMicro("recordStage", 5 * 4096, [&]() {
+            for (int cycle = 0; cycle < 4096; cycle++) {
+                int row = cycle % 64;
+                for (int stage = IF; stage <= WB; stage++)
+                    matrixProcessor.recordStage(row, cycle, static_cast<PipelineStage>(stage));
+            }
+            // Put the touched cells back to SPACE so every repetition does the same work
+            for (int cycle = 0; cycle < 4096; cycle++)
+                matrixProcessor.pipelineMatrix3D[cycle % 64][cycle].assign(1, SPACE);
+        }));
+
+        std::string diagramName = "benchmark_diagram.txt";
+        results.push_back(timeMicro("printPipelineDiagram_64x4096", 64 * 4096, [&]() {
+            matrixProcessor.printPipelineDiagram(diagramName, true);
+        }));
+        std::remove("../outputfiles/benchmark_diagram_forward_out.txt");
+    }
+    return results;
+}
+
+NoForwardingProcessor* createProcessor(bool forwarding) {
+    if (forwarding)
+        return new ForwardingProcessor();
+    return new NoForwardingProcessor();
+}
+
+// Untimed run of at most 'cycles' cycles, one cycle at a time
+ProgramLength measureProgram(const std::string& program, bool forwarding, int cycles) {
+    std::unique_ptr<NoForwardingProcessor> processor(createProcessor(forwarding));
+    processor->recordDiagram = false;
+    processor->loadProgram(program);
+    processor->beginRun(cycles);
+    ProgramLength length{cycles, 0};
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        processor->runCycles(cycle, cycle + 1);
+        // memwb holds each instruction for exactly the cycle before its WB
+        if (!processor->memwb.isEmpty)
+            length.instructions++;
+        bool drained = processor->ifid.isEmpty && processor->idex.isEmpty && processor->exmem.isEmpty &&
+                       processor->memwb.isEmpty && processor->getInstructionIndex(processor->pc) == -1;
+        if (processor->halted || drained) {
+            length.cycles = cycle + 1;
+            break;
+        }
+    }
+    return length;
+}
+
+// The program run to its end as often as fits in 'cycles' cycles
+EndToEndResult runEndToEnd(const std::string& program, bool forwarding, bool diagram, int cycles) {
+    ProgramLength length = measureProgram(program, forwarding, cycles);
+    int repetitions = std::max(1, cycles / length.cycles);
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < repetitions; i++) {
+        std::unique_ptr<NoForwardingProcessor> processor(createProcessor(forwarding));
+        processor->recordDiagram = diagram;
+        processor->loadProgram(program);
+        processor->run(length.cycles);
+        if (diagram) {
+            std::string name = "benchmark_e2e.txt";
+            processor->printPipelineDiagram(name, forwarding);
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (diagram)
+        std::remove(forwarding ? "../outputfiles/benchmark_e2e_forward_out.txt"
+                               : "../outputfiles/benchmark_e2e_noforward_out.txt");
+
+    std::string name = std::filesystem::path(program).filename().string();
+    return EndToEndResult{name, forwarding ? "forward" : "noforward", diagram,
+                          static_cast<int64_t>(repetitions) * length.cycles,
+                          static_cast<uint64_t>(repetitions) * length.instructions, seconds};
+}
+
+// Architectural execution of up to 'instructions' instructions: decoding every
+// instruction, translated, and translated with the JIT
+std::vector<EndToEndResult> runFunctional(const std::string& program, int instructions) {
+    NoForwardingProcessor stepped;
+    stepped.loadProgram(program);
+    Clock::time_point start = Clock::now();
+    FunctionalCore core(stepped);
+    RetiredInstruction retired;
+    int32_t steppedPc = stepped.entryPC;
+    StepStatus steppedStatus = STEP_OK;
+    uint64_t steppedCount = 0;
+    while (steppedCount < static_cast<uint64_t>(instructions) &&
+           (steppedStatus = core.step(steppedPc, retired)) == STEP_OK)
+        steppedCount++;
+    double steppedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::string name = std::filesystem::path(program).filename().string();
+    int count = static_cast<int>(steppedCount);
+    std::vector<EndToEndResult> results;
+    results.push_back(EndToEndResult{name, "functional_step", false, count, steppedCount, steppedSeconds});
+    for (bool jit : {false, true}) {
+        NoForwardingProcessor translated;
+        translated.loadProgram(program);
+        start = Clock::now();
+        TranslationCache cache(translated);
+        if (jit && !cache.enableJit())
+            break;
+        int32_t translatedPc = translated.entryPC;
+        uint64_t translatedCount = 0;
+        StepStatus translatedStatus = cache.run(translatedPc, static_cast<uint64_t>(instructions), translatedCount);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        bool same = steppedPc == translatedPc && steppedCount == translatedCount && steppedStatus == translatedStatus &&
+                    stepped.vector.sameState(translated.vector);
+        for (uint32_t reg = 0; reg < 32; reg++)
+            same = same && stepped.registers.read(reg) == translated.registers.read(reg);
+        if (!same)
+            std::cerr << "  MISMATCH: " << name << " ends differently when " << (jit ? "compiled" : "translated")
+                      << std::endl;
+        results.push_back(EndToEndResult{name, jit ? "functional_jit" : "functional_translated", false, count,
+                                         steppedCount, seconds});
+    }
+    return results;
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void writeJson(std::ostream& out, const std::vector<MicroResult>& micro, const std::vector<EndToEndResult>& endToEnd) {
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << "{\n";
+    out << "  \"timestamp\": \"" << timestamp << "\",\n";
+#ifdef __VERSION__
+    out << "  \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n";
+#endif
+    out << "  \"microbenchmarks\": [\n";
+    for (size_t i = 0; i < micro.size(); i++) {
+        const MicroResult& r = micro[i];
+        out << "    {\"name\": \"" << r.name << "\", \"operations\": " << r.operations
+            << ", \"seconds\": " << r.seconds
+            << ", \"ns_per_op\": " << (r.seconds * 1e9 / static_cast<double>(r.operations)) << "}"
+            << (i + 1 < micro.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+    out << "  \"end_to_end\": [\n";
+    for (size_t i = 0; i < endToEnd.size(); i++) {
+        const EndToEndResult& r = endToEnd[i];
+        out << "    {\"program\": \"" << jsonEscape(r.program) << "\", \"processor\": \"" << r.processor
+            << "\", \"diagram\": " << (r.diagram ? "true" : "false") << ", \"cycles\": " << r.cycles
+            << ", \"seconds\": " << r.seconds
+            << ", \"cycles_per_second\": " << (r.cycles / r.seconds) << ", \"instructions\": " << r.instructions
+            << ", \"instructions_per_second\": " << (r.instructions / r.seconds) << "}"
+            << (i + 1 < endToEnd.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string inputDir = "../inputfiles";
+    std::string outFile = "bench_results.json";
+    int cycles = 200000;
+    int diagramCycles = 2000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--inputs")
+            inputDir = argv[i + 1];
+        else if (arg == "--cycles")
+            cycles = std::stoi(argv[i + 1]);
+        else if (arg == "--out")
+            outFile = argv[i + 1];
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--inputs DIR] [--cycles N] [--out FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> programs = listPrograms(inputDir);
+    std::cerr << "Benchmarking with " << programs.size() << " programs from " << inputDir << std::endl;
+
+    // The simulators log every cycle to stdout; a failed stream skips all formatting
+    std::cout.setstate(std::ios_base::failbit);
+
+    std::vector<uint32_t> instructions = collectInstructions(programs);
+    std::vector<MicroResult> micro = runMicrobenchmarks(instructions);
+    for (const MicroResult& r : micro)
+        std::cerr << "  " << r.name << ": " << (r.seconds * 1e9 / static_cast<double>(r.operations)) << " ns/op" << std::endl;
+
+    std::vector<EndToEndResult> endToEnd;
+    for (const std::string& program : programs) {
+        for (bool forwarding : {false, true}) {
+            endToEnd.push_back(runEndToEnd(program, forwarding, false, cycles));
+            endToEnd.push_back(runEndToEnd(program, forwarding, true, diagramCycles));
+            const EndToEndResult& r = endToEnd[endToEnd.size() - 2];
+            std::cerr << "  " << r.program << " (" << r.processor << "): "
+                      << static_cast<int64_t>(r.cycles / r.seconds) << " cycles/s, "
+                      << static_cast<int64_t>(r.instructions / r.seconds) << " instructions/s" << std::endl;
+        }
+    }
+
+    for (const std::string& program : programs) {
+        std::vector<EndToEndResult> functional = runFunctional(program, cycles);
+        std::cerr << "  " << functional[0].program << " (functional):";
+        for (const EndToEndResult& r : functional) {
+            std::cerr << " " << r.processor.substr(11) << " " << static_cast<int64_t>(r.cycles / r.seconds);
+            endToEnd.push_back(r);
+        }
+        std::cerr << " instructions/s" << std::endl;
+    }
+
+    std::ofstream out(outFile);
+    if (!out.is_open()) {
+        std::cerr << "Error: Unable to open " << outFile << " for writing" << std::endl;
+        return 1;
+    }
+    writeJson(out, micro, endToEnd);
+    std::cerr << "Results written to " << outFile << std::endl;
+    return 0;
+}
@@ -0,0 +1,322 @@
+#include "CriticalPath.hpp"
+#include "InstructionDecode.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+std::string describePc(int32_t pc, const std::vector<std::string_view>& instructionStrings, int32_t textBase) {
+    std::string text = "pc " + std::to_string(pc);
+    if (pc < textBase || (pc - textBase) / 4 >= static_cast<int32_t>(instructionStrings.size()))
+        return text;
+    std::string_view instruction = instructionStrings[static_cast<size_t>((pc - textBase) / 4)];
+    while (!instruction.empty() && (instruction.back() == '\n' || instruction.back() == '\r' || instruction.back() == ' '))
+        instruction.remove_suffix(1);
+    text += " (";
+    text.append(instruction.data(), instruction.size());
+    text += ")";
+    return text;
+}
+
+// Largest entries first, ties by key so the report is stable
+template <typename Map>
+std::vector<typename Map::const_iterator> topEntries(const Map& map, size_t limit) {
+    std::vector<typename Map::const_iterator> entries;
+    entries.reserve(map.size());
+    for (typename Map::const_iterator it = map.begin(); it != map.end(); ++it)
+        entries.push_back(it);
+    std::sort(entries.begin(), entries.end(), [](typename Map::const_iterator a, typename Map::const_iterator b) {
+        if (a->second.cycles != b->second.cycles)
+            return a->second.cycles > b->second.cycles;
+        return a->first < b->first;
+    });
+    if (entries.size() > limit)
+        entries.resize(limit);
+    return entries;
+}
+
+void appendShare(std::string& out, const char* label, uint64_t cycles, uint64_t total) {
+    char line[128];
+    std::snprintf(line, sizeof(line), "  %-14s %12llu  %5.1f%%\n", label, static_cast<unsigned long long>(cycles),
+                  total ? 100.0 * static_cast<double>(cycles) / static_cast<double>(total) : 0.0);
+    out += line;
+}
+
+} // namespace
+
+CriticalPathAnalyzer::CriticalPathAnalyzer()
+    : instructions(0), firstNode(0), nextNode(0), lastPc(0), lastOpcode(0), forcedPath(false), fillCycles(0),
+      issueCycles(0), dependenceCycles(0), flushCycles(0), structuralCycles(0), extrapolatedCycles(0),
+      pathStallCycles(0), totalStallCycles(0), totalFlushCycles(0), totalStructuralCycles(0), chainLength(0),
+      chainCycles(0), longestChain(0), longestChainCycles(0), chainStartPc(0), longestChainStartPc(0),
+      longestChainEndPc(0) {
+    for (uint64_t& writer : regWriter)
+        writer = NONE;
+}
+
+void CriticalPathAnalyzer::commit(int cycle, int32_t pc, uint32_t instruction) {
+    Node added;
+    added.issueCycle = static_cast<int64_t>(cycle) - DRAIN_CYCLES;
+    added.pc = pc;
+    added.stall = 0;
+    added.flush = 0;
+
+    if (nextNode == 0) {
+        // Fetched in cycle 0, or as soon as the pipeline started
+        added.kind = EDGE_START;
+        added.parent = NONE;
+        added.fromPc = pc;
+        added.weight = static_cast<uint32_t>(std::max<int64_t>(added.issueCycle + 1, 0));
+    } else {
+        const Node& previous = node(nextNode - 1);
+        if (isControlTransfer(lastOpcode) && (lastOpcode != 0x63 || pc != lastPc + 4))
+            added.flush = 1;
+        int64_t fetchCycle = previous.issueCycle + added.flush;
+        added.stall = static_cast<uint32_t>(std::max<int64_t>(added.issueCycle - fetchCycle - 1, 0));
+
+        // A stall is explained by the youngest source producer still in flight
+        uint64_t producer = NONE;
+        if (added.stall > 0) {
+            uint32_t sources[2];
+            int count = sourceRegisters(instruction, sources);
+            for (int i = 0; i < count; i++) {
+                uint64_t writer = (sources[i] != 0) ? regWriter[sources[i]] : NONE;
+                if (writer == NONE || writer < firstNode || writer + WINDOW < nextNode)
+                    continue;
+                if (added.issueCycle - node(writer).issueCycle > MAX_PRODUCER_LATENCY)
+                    continue;
+                if (producer == NONE || writer > producer)
+                    producer = writer;
+            }
+        }
+        if (producer != NONE) {
+            const Node& binding = node(producer);
+            added.kind = EDGE_DEPENDENCE;
+            added.parent = producer;
+            added.fromPc = binding.pc;
+            added.weight = static_cast<uint32_t>(added.issueCycle - binding.issueCycle);
+            totalStallCycles += added.stall;
+        } else {
+            // No producer in flight: ID was held by something else (a scoreboard entry not yet released)
+            added.kind = EDGE_SEQUENTIAL;
+            added.parent = nextNode - 1;
+            added.fromPc = previous.pc;
+            added.weight = static_cast<uint32_t>(std::max<int64_t>(added.issueCycle - previous.issueCycle, 0));
+            totalStructuralCycles += added.stall;
+        }
+        totalFlushCycles += added.flush;
+    }
+
+    nodes.push_back(added);
+    if (nextNode == 0)
+        countEdge(nodes.back());
+    if (writesRegister(instruction))
+        regWriter[(instruction >> 7) & 0x1F] = nextNode;
+    nextNode++;
+    instructions++;
+    lastPc = pc;
+    lastOpcode = instruction & 0x7F;
+
+    if (nextNode % WINDOW == 0 && nextNode - firstNode >= 2 * WINDOW)
+        prune();
+}
+
+void CriticalPathAnalyzer::skip(int cycles) {
+    // The pipeline is in the same state after the skipped iterations, only later
+    for (Node& pending : nodes)
+        pending.issueCycle += cycles;
+    extrapolatedCycles += static_cast<uint64_t>(cycles);
+}
+
+uint64_t CriticalPathAnalyzer::parentOf(uint64_t index) {
+    // Lineages cut off by a forced path continue from the oldest kept instruction
+    return std::max(node(index).parent, firstNode);
+}
+
+void CriticalPathAnalyzer::countEdge(const Node& edge) {
+    if (edge.kind == EDGE_START) {
+        fillCycles += edge.weight;
+        return;
+    }
+    if (edge.kind == EDGE_DEPENDENCE) {
+        dependenceCycles += edge.weight;
+        pathStallCycles += edge.stall;
+        EdgeStat& stat = dependenceEdges[(static_cast<uint64_t>(static_cast<uint32_t>(edge.fromPc)) << 32) |
+                                         static_cast<uint32_t>(edge.pc)];
+        stat.cycles += edge.weight;
+        stat.count++;
+        if (chainLength == 0) {
+            chainLength = 1;
+            chainCycles = 0;
+            chainStartPc = edge.fromPc;
+        }
+        chainLength++;
+        chainCycles += edge.weight;
+        if (chainCycles > longestChainCycles) {
+            longestChain = chainLength;
+            longestChainCycles = chainCycles;
+            longestChainStartPc = chainStartPc;
+            longestChainEndPc = edge.pc;
+        }
+        return;
+    }
+    chainLength = 0;
+    // Sequential: one issue cycle, the flush bubble and any unexplained stall
+    uint32_t rest = edge.weight;
+    uint32_t flush = std::min(edge.flush, rest);
+    rest -= flush;
+    issueCycles += std::min<uint32_t>(rest, 1);
+    structuralCycles += rest - std::min<uint32_t>(rest, 1);
+    pathStallCycles += edge.stall;
+    flushCycles += flush;
+    if (flush) {
+        EdgeStat& stat = flushEdges[edge.fromPc];
+        stat.cycles += flush;
+        stat.count++;
+    }
+    if (rest > 1) {
+        EdgeStat& stat = structuralEdges[edge.pc];
+        stat.cycles += rest - 1;
+        stat.count++;
+    }
+}
+
+// Counts the path edges from firstNode (exclusive) to 'last' and makes 'last' the first kept node
+void CriticalPathAnalyzer::commitPath(uint64_t last) {
+    std::vector<uint64_t> path;
+    for (uint64_t index = last; index > firstNode; index = parentOf(index))
+        path.push_back(index);
+    for (size_t i = path.size(); i-- > 0;)
+        countEdge(node(path[i]));
+    while (firstNode < last) {
+        nodes.pop_front();
+        firstNode++;
+    }
+}
+
+void CriticalPathAnalyzer::prune() {
+    // Every later instruction descends from one in [low, nextNode). Map each of
+    // them to its first ancestor below 'low', then merge those ancestors
+    uint64_t low = nextNode - WINDOW;
+    std::vector<uint64_t> below(WINDOW);
+    for (uint64_t index = low; index < nextNode; index++) {
+        uint64_t parent = parentOf(index);
+        below[index - low] = (parent < low) ? parent : below[parent - low];
+    }
+    uint64_t newest = below[WINDOW - 1];
+    std::sort(below.begin(), below.end());
+    below.erase(std::unique(below.begin(), below.end()), below.end());
+    while (below.size() > 1) {
+        // Replace the youngest candidate by its parent until they meet
+        uint64_t youngest = below.back();
+        below.pop_back();
+        uint64_t parent = parentOf(youngest);
+        std::vector<uint64_t>::iterator at = std::lower_bound(below.begin(), below.end(), parent);
+        if (at == below.end() || *at != parent)
+            below.insert(at, parent);
+    }
+    uint64_t common = below.front();
+    if (common == firstNode && nextNode - firstNode > MAX_HISTORY) {
+        // Independent chains that never merge: keep the newest instruction's
+        common = newest;
+        forcedPath = true;
+    }
+    if (common > firstNode)
+        commitPath(common);
+}
+
+bool CriticalPathAnalyzer::writeReport(const std::string& filename,
+                                       const std::vector<std::string_view>& instructionStrings, int32_t textBase,
+                                       int cycles) {
+    std::string out;
+    char line[256];
+    out += "Critical path analysis\n";
+    if (nextNode == 0) {
+        out += "No instructions committed\n";
+    } else {
+        int64_t lastCommit = node(nextNode - 1).issueCycle + DRAIN_CYCLES;
+        commitPath(nextNode - 1);
+        uint64_t pathCycles = static_cast<uint64_t>(lastCommit) + 1;
+        std::snprintf(line, sizeof(line), "Instructions committed: %llu\nCycles simulated: %d, last commit in cycle %lld\n",
+                      static_cast<unsigned long long>(instructions), cycles, static_cast<long long>(lastCommit));
+        out += line;
+        if (static_cast<int64_t>(cycles) > lastCommit + 1) {
+            // Drained, or an instruction that never left ID
+            std::snprintf(line, sizeof(line), "Cycles after the last commit: %lld\n",
+                          static_cast<long long>(cycles - lastCommit - 1));
+            out += line;
+        }
+        std::snprintf(line, sizeof(line), "Critical path: %llu cycles\n", static_cast<unsigned long long>(pathCycles));
+        out += line;
+        appendShare(out, "fill/drain", fillCycles + DRAIN_CYCLES, pathCycles);
+        appendShare(out, "issue", issueCycles, pathCycles);
+        appendShare(out, "dependence", dependenceCycles, pathCycles);
+        appendShare(out, "branch flush", flushCycles, pathCycles);
+        appendShare(out, "structural", structuralCycles, pathCycles);
+        if (extrapolatedCycles)
+            appendShare(out, "extrapolated", extrapolatedCycles, pathCycles);
+        std::snprintf(line, sizeof(line),
+                      "ID stall cycles: %llu on dependences, %llu structural; %llu of them on the critical path\n"
+                      "Flushed fetch slots: %llu\n",
+                      static_cast<unsigned long long>(totalStallCycles),
+                      static_cast<unsigned long long>(totalStructuralCycles),
+                      static_cast<unsigned long long>(pathStallCycles),
+                      static_cast<unsigned long long>(totalFlushCycles));
+        out += line;
+        if (extrapolatedCycles)
+            out += "Extrapolated loop iterations repeat the analysed ones and are not broken down\n";
+        if (forcedPath)
+            out += "Dependence chains did not merge within the analysis history; the path follows the newest one\n";
+        if (longestChain) {
+            std::snprintf(line, sizeof(line), "Longest dependence chain on the path: %llu instructions, %llu cycles, ",
+                          static_cast<unsigned long long>(longestChain),
+                          static_cast<unsigned long long>(longestChainCycles));
+            out += line;
+            out += describePc(longestChainStartPc, instructionStrings, textBase) + " -> " +
+                   describePc(longestChainEndPc, instructionStrings, textBase) + "\n";
+        }
+
+        out += "\nDependences on the critical path (cycles, count, producer -> consumer):\n";
+        for (std::unordered_map<uint64_t, EdgeStat>::const_iterator it : topEntries(dependenceEdges, 10)) {
+            std::snprintf(line, sizeof(line), "  %12llu %10llu  ", static_cast<unsigned long long>(it->second.cycles),
+                          static_cast<unsigned long long>(it->second.count));
+            out += line;
+            out += describePc(static_cast<int32_t>(it->first >> 32), instructionStrings, textBase) + " -> " +
+                   describePc(static_cast<int32_t>(it->first & 0xFFFFFFFFu), instructionStrings, textBase) + "\n";
+        }
+        out += "\nBranch flushes on the critical path (cycles, count, branch):\n";
+        for (std::unordered_map<int32_t, EdgeStat>::const_iterator it : topEntries(flushEdges, 10)) {
+            std::snprintf(line, sizeof(line), "  %12llu %10llu  ", static_cast<unsigned long long>(it->second.cycles),
+                          static_cast<unsigned long long>(it->second.count));
+            out += line;
+            out += describePc(it->first, instructionStrings, textBase) + "\n";
+        }
+        if (!structuralEdges.empty()) {
+            out += "\nStructural stalls on the critical path (cycles, count, stalled instruction):\n";
+            for (std::unordered_map<int32_t, EdgeStat>::const_iterator it : topEntries(structuralEdges, 10)) {
+                std::snprintf(line, sizeof(line), "  %12llu %10llu  ",
+                              static_cast<unsigned long long>(it->second.cycles),
+                              static_cast<unsigned long long>(it->second.count));
+                out += line;
+                out += describePc(it->first, instructionStrings, textBase) + "\n";
+            }
+        }
+    }
+
+    if (filename == "-") {
+        // Wanted on stdout in --quiet mode too
+        std::ios_base::iostate state = std::cout.rdstate();
+        std::cout.clear();
+        std::cout << out << std::flush;
+        std::cout.setstate(state);
+        return true;
+    }
+    std::ofstream file(filename);
+    if (!file.is_open() || !(file << out)) {
+        std::cerr << "Error: Unable to write critical path report " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Critical path analysis of a run (--critical-path), fed with the commit
+// stream at WB.
+//
+// EX, MEM and WB never stall for scalar instructions with the flat memory, so
+// an instruction committing in cycle W left ID in cycle I = W - 3, and it was
+// fetched in the cycle its predecessor left ID (one later after a taken branch
+// or jump, whose fetch slot is flushed). Any cycle beyond that spent in ID is
+// a stall. With the sources and destination of every instruction this gives
+// the dynamic dependence graph: each instruction's issue is bound either by
+// its predecessor (one issue cycle, plus the flush bubble) or, when it
+// stalled, by the in-flight producer of one of its sources. Following the
+// binding edges back from the last commit gives the critical path; its edges
+// are summed per cause and per producer/consumer or branch pc.
+//
+// The memory timing models stall MEM and vector instructions stay several
+// cycles in EX and MEM, so --critical-path rejects both.
+//
+// Only the last WINDOW instructions can bind a new one, so every later
+// instruction descends from one of them and their common ancestor is final.
+// Everything up to it is folded into the totals and dropped, which keeps
+// memory bounded for runs of any length.
+class CriticalPathAnalyzer {
+public:
+    CriticalPathAnalyzer();
+    // Instruction leaving WB in 'cycle'
+    void commit(int cycle, int32_t pc, uint32_t instruction);
+    // The loop extrapolator skipped 'cycles' cycles of identical iterations
+    void skip(int cycles);
+    // Writes the report; 'cycles' is the length of the run
+    bool writeReport(const std::string& filename, const std::vector<std::string_view>& instructionStrings,
+                     int32_t textBase, int cycles);
+    // Cycles instructions spent stalled in ID, on the path or not
+    uint64_t stallCycles() const { return totalStallCycles + totalStructuralCycles; }
+
+    uint64_t instructions;
+
+private:
+    enum EdgeKind { EDGE_START, EDGE_SEQUENTIAL, EDGE_DEPENDENCE };
+
+    // One committed instruction and the edge that bound its issue
+    struct Node {
+        uint64_t parent;      // Binding predecessor
+        int64_t issueCycle;   // Cycle it left ID
+        int32_t pc;
+        int32_t fromPc;       // pc of the producer (dependence) or the previous instruction
+        uint32_t weight;      // issueCycle - parent's issueCycle
+        uint32_t stall;       // Cycles stalled in ID
+        uint32_t flush;       // Flush bubble in a sequential edge
+        EdgeKind kind;
+    };
+    struct EdgeStat {
+        uint64_t cycles;
+        uint64_t count;
+    };
+
+    static const uint64_t WINDOW = 64;            // Farthest producer looked at
+    static const uint64_t MAX_HISTORY = 1 << 16;  // Pending instructions before the path is forced
+    static const int MAX_PRODUCER_LATENCY = 3;    // Issue to WB, the longest a producer holds back ID
+    static const int DRAIN_CYCLES = 3;            // EX, MEM and WB of the last instruction
+    static const uint64_t NONE = ~0ull;
+
+    std::deque<Node> nodes;   // Instructions firstNode .. nextNode-1
+    uint64_t firstNode;       // Its edge and all earlier path edges are already counted
+    uint64_t nextNode;
+    uint64_t regWriter[32];   // Last instruction writing each register
+    int32_t lastPc;
+    uint32_t lastOpcode;
+    bool forcedPath;          // MAX_HISTORY was hit, the path was cut at the newest instruction's ancestry
+
+    // Path totals
+    uint64_t fillCycles;
+    uint64_t issueCycles;
+    uint64_t dependenceCycles;
+    uint64_t flushCycles;
+    uint64_t structuralCycles;
+    uint64_t extrapolatedCycles;
+    uint64_t pathStallCycles;
+    // All instructions, on the path or not
+    uint64_t totalStallCycles;
+    uint64_t totalFlushCycles;
+    uint64_t totalStructuralCycles;
+    // Longest run of consecutive dependence edges on the path
+    uint64_t chainLength;
+    uint64_t chainCycles;
+    uint64_t longestChain;
+    uint64_t longestChainCycles;
+    int32_t chainStartPc;
+    int32_t longestChainStartPc;
+    int32_t longestChainEndPc;
+
+    std::unordered_map<uint64_t, EdgeStat> dependenceEdges;  // producer pc << 32 | consumer pc
+    std::unordered_map<int32_t, EdgeStat> flushEdges;        // branch pc
+    std::unordered_map<int32_t, EdgeStat> structuralEdges;   // stalled pc
+
+    Node& node(uint64_t index) { return nodes[index - firstNode]; }
+    uint64_t parentOf(uint64_t index);
+    void countEdge(const Node& edge);
+    void commitPath(uint64_t last);
+    void prune();
+};
@@ -0,0 +1,162 @@
+#include "DiagramRenderer.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+namespace {
+
+// ";" plus the text of a cell holding exactly one stage, indexed by PipelineStage,
+// padded to 4 bytes so every token is copied with one fixed-size memcpy
+struct CellToken {
+    char text[4];
+    size_t length;
+};
+const CellToken SINGLE_CELL[] = {{{';', ' ', ' '}, 3}, {{';', '-'}, 2}, {{';', '/'}, 2}, {{';', 'I', 'F'}, 3},
+                                 {{';', 'I', 'D'}, 3}, {{';', 'E', 'X'}, 3}, {{';', 'M', 'E', 'M'}, 4},
+                                 {{';', 'W', 'B'}, 3}};
+const CellToken REPEATED_CELL = {{';', '-'}, 2};
+const size_t MAX_CELL_BYTES_PER_STAGE = 4;
+
+const size_t CHUNK_BYTES = 1 << 22;            // Rows formatted per chunk before writing
+const uint64_t PARALLEL_MIN_CELLS = 1 << 20;   // Smaller diagrams are formatted on one thread
+const unsigned MAX_RENDER_THREADS = 8;
+
+const CellToken& singleToken(PipelineStage stage) {
+    return (stage >= SPACE && stage <= WB) ? SINGLE_CELL[stage] : SINGLE_CELL[SPACE];
+}
+
+// Formats one cell at 'cursor', which has room for MAX_CELL_BYTES_PER_STAGE
+// bytes per stage (at least one), and returns the new end
+char* formatCell(char* cursor, const PipelineStage* stages, size_t count, PipelineStage& prevStage) {
+    if (count <= 1) {
+        PipelineStage stage = (count == 0) ? SPACE : stages[0];
+        const CellToken& token = (stage == prevStage && stage != SPACE) ? REPEATED_CELL : singleToken(stage);
+        memcpy(cursor, token.text, sizeof(token.text));
+        prevStage = stage;
+        return cursor + token.length;
+    }
+    // Newest stage first, then the earlier ones separated by "/"
+    const CellToken& newest = singleToken(stages[count - 1]);
+    memcpy(cursor, newest.text, sizeof(newest.text));
+    cursor += newest.length;
+    for (size_t k = count - 1; k-- > 0;) {
+        const CellToken& token = singleToken(stages[k]);
+        memcpy(cursor, token.text, sizeof(token.text));
+        *cursor = '/';
+        cursor += token.length;
+    }
+    prevStage = SPACE;
+    return cursor;
+}
+
+void appendRows(std::string& out, const std::vector<std::string_view>& instructionStrings, const PipelineMatrix& matrix,
+                int firstRow, int lastRow, int cols, size_t columnWidth) {
+    out.clear();
+    for (int row = firstRow; row < lastRow; row++) {
+        appendInstructionColumn(out, instructionStrings[row], columnWidth);
+        const std::vector<std::vector<PipelineStage>>& cells = matrix[row];
+        // Format straight into the string, growing it only when a cell might not fit
+        size_t used = out.size();
+        out.resize(used + MAX_CELL_BYTES_PER_STAGE * static_cast<size_t>(cols) + 1);
+        char* cursor = &out[used];
+        char* limit = &out[0] + out.size();
+        PipelineStage prevStage = SPACE;
+        for (int cycle = 0; cycle < cols; cycle++) {
+            const std::vector<PipelineStage>& stages = cells[cycle];
+            size_t need = MAX_CELL_BYTES_PER_STAGE * std::max<size_t>(stages.size(), 1);
+            if (static_cast<size_t>(limit - cursor) < need + 1) {
+                used = static_cast<size_t>(cursor - &out[0]);
+                out.resize(out.size() + need + MAX_CELL_BYTES_PER_STAGE * static_cast<size_t>(cols - cycle) + 1);
+                cursor = &out[used];
+                limit = &out[0] + out.size();
+            }
+            cursor = formatCell(cursor, stages.data(), stages.size(), prevStage);
+        }
+        *cursor++ = '\n';
+        out.resize(static_cast<size_t>(cursor - &out[0]));
+    }
+}
+
+} // namespace
+
+size_t diagramColumnWidth(const std::vector<std::string_view>& instructionStrings) {
+    size_t width = 20;
+    for (std::string_view text : instructionStrings) {
+        size_t length = text.size() - static_cast<size_t>(std::count(text.begin(), text.end(), '\n')) -
+                        static_cast<size_t>(std::count(text.begin(), text.end(), '\r'));
+        width = std::max(width, length);
+    }
+    return width;
+}
+
+void appendDiagramHeader(std::string& out, size_t columnWidth, int firstCycle, int lastCycle) {
+    appendInstructionColumn(out, "Instruction", columnWidth);
+    char digits[16];
+    for (int cycle = firstCycle; cycle <= lastCycle; cycle++) {
+        out += ';';
+        std::to_chars_result printed = std::to_chars(digits, digits + sizeof(digits), cycle);
+        out.append(digits, printed.ptr);
+    }
+    out += '\n';
+}
+
+void appendInstructionColumn(std::string& out, std::string_view instruction, size_t columnWidth) {
+    size_t start = out.size();
+    if (instruction.find_first_of("\r\n") == std::string_view::npos) {
+        out.append(instruction.data(), instruction.size());
+    } else {
+        for (char c : instruction) {
+            if (c != '\n' && c != '\r')
+                out += c;
+        }
+    }
+    if (out.size() - start < columnWidth)
+        out.append(columnWidth - (out.size() - start), ' ');
+}
+
+void appendDiagramCell(std::string& out, const PipelineStage* stages, size_t count, PipelineStage& prevStage) {
+    size_t used = out.size();
+    out.resize(used + MAX_CELL_BYTES_PER_STAGE * std::max<size_t>(count, 1));
+    char* end = formatCell(&out[used], stages, count, prevStage);
+    out.resize(static_cast<size_t>(end - &out[0]));
+}
+
+bool writePipelineDiagram(std::FILE* out, const std::vector<std::string_view>& instructionStrings,
+                          const PipelineMatrix& matrix, int rows, int cols) {
+    size_t columnWidth = diagramColumnWidth(instructionStrings);
+    std::string header;
+    appendDiagramHeader(header, columnWidth, 0, cols - 1);
+    bool ok = std::fwrite(header.data(), 1, header.size(), out) == header.size();
+
+    // A single-stage cell is at most 4 bytes
+    size_t rowBytes = columnWidth + 1 + 4 * static_cast<size_t>(std::max(cols, 0));
+    int rowsPerChunk = static_cast<int>(std::max<size_t>(1, CHUNK_BYTES / rowBytes));
+    unsigned threads = 1;
+    if (static_cast<uint64_t>(std::max(rows, 0)) * static_cast<uint64_t>(std::max(cols, 0)) >= PARALLEL_MIN_CELLS)
+        threads = std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_RENDER_THREADS));
+
+    std::vector<std::string> chunks(threads);
+    for (int first = 0; first < rows; first += rowsPerChunk * static_cast<int>(threads)) {
+        // Each thread formats one chunk of consecutive rows, then the chunks are written in order
+        std::vector<std::thread> workers;
+        unsigned used = 0;
+        for (; used < threads; used++) {
+            int chunkFirst = first + static_cast<int>(used) * rowsPerChunk;
+            if (chunkFirst >= rows)
+                break;
+            int chunkLast = std::min(rows, chunkFirst + rowsPerChunk);
+            if (used == 0)
+                continue;
+            workers.emplace_back(appendRows, std::ref(chunks[used]), std::cref(instructionStrings), std::cref(matrix),
+                                 chunkFirst, chunkLast, cols, columnWidth);
+        }
+        appendRows(chunks[0], instructionStrings, matrix, first, std::min(rows, first + rowsPerChunk), cols, columnWidth);
+        for (std::thread& worker : workers)
+            worker.join();
+        for (unsigned i = 0; i < used; i++)
+            ok = (std::fwrite(chunks[i].data(), 1, chunks[i].size(), out) == chunks[i].size()) && ok;
+    }
+    return ok;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "PipelineStages.hpp"
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Pipeline diagram formatting into byte buffers. The layout is the one
+// printPipelineDiagram has always produced:
+//
+//   Instruction<pad>;0;1;2...          header, first column padded to the width
+//   <instruction><pad>;IF;ID;-;EX...   one row per instruction
+//
+// The first column is max(longest instruction without \r\n, 20) wide. A cell
+// holding one stage prints "-" when it repeats the previous cell's stage,
+// several stages in one cycle print newest first ("WB/MEM"), an empty cell
+// prints two spaces.
+
+using PipelineMatrix = std::vector<std::vector<std::vector<PipelineStage>>>;
+
+size_t diagramColumnWidth(const std::vector<std::string_view>& instructionStrings);
+void appendDiagramHeader(std::string& out, size_t columnWidth, int firstCycle, int lastCycle);
+void appendInstructionColumn(std::string& out, std::string_view instruction, size_t columnWidth);
+
+// Appends ";" and the cell text; 'prevStage' carries the "-" rule from cell to cell
+void appendDiagramCell(std::string& out, const PipelineStage* stages, size_t count, PipelineStage& prevStage);
+
+// Writes the whole diagram for rows x cols of 'matrix'. Rows are formatted in
+// chunks of a few MiB, by several threads when the matrix is large, and the
+// chunks are written in order. Returns false on a write error.
+bool writePipelineDiagram(std::FILE* out, const std::vector<std::string_view>& instructionStrings,
+                          const PipelineMatrix& matrix, int rows, int cols);
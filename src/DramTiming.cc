@@ -0,0 +1,70 @@
+#include "DramTiming.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+namespace {
+
+uint32_t log2Of(uint32_t value) {
+    uint32_t bits = 0;
+    while ((1u << bits) < value)
+        bits++;
+    return bits;
+}
+
+} // namespace
+
+DramTiming::DramTiming(const DramConfig& config)
+    : config(config), reads(0), writes(0), rowHits(0), rowMisses(0), rowConflicts(0), queueCycles(0),
+      totalLatency(0), columnBits(log2Of(config.rowBytes)), bankBits(log2Of(config.banks)) {
+    reset();
+}
+
+void DramTiming::reset() {
+    bankState.assign(config.banks, Bank{false, 0, 0});
+    busFreeAt = 0;
+}
+
+uint32_t DramTiming::access(uint32_t address, bool write, uint64_t cycle) {
+    Bank& bank = bankState[(address >> columnBits) & (config.banks - 1)];
+    uint32_t row = address >> (columnBits + bankBits);
+    (write ? writes : reads)++;
+
+    uint64_t start = std::max(cycle, bank.readyAt);
+    uint32_t commandCycles = config.tCAS;
+    if (bank.open && bank.row == row) {
+        rowHits++;
+    } else if (bank.open) {
+        rowConflicts++;
+        commandCycles += config.tRP + config.tRCD;
+    } else {
+        rowMisses++;
+        commandCycles += config.tRCD;
+    }
+    uint64_t dataStart = std::max(start + commandCycles, busFreeAt);
+    uint64_t done = dataStart + config.tBurst;
+    busFreeAt = done;
+    queueCycles += (start - cycle) + (dataStart - start - commandCycles);
+
+    // The next command to an open row can follow once this one has its data;
+    // a closed-page bank precharges first
+    bank.open = config.openRow;
+    bank.row = row;
+    bank.readyAt = config.openRow ? dataStart : done + config.tRP;
+
+    uint32_t latency = static_cast<uint32_t>(std::max<uint64_t>(1, done - cycle));
+    totalLatency += latency;
+    return latency;
+}
+
+void DramTiming::printSummary(std::ostream& out) const {
+    uint64_t accesses = reads + writes;
+    if (accesses == 0)
+        return;
+    out << "DRAM (" << config.banks << " banks, " << config.rowBytes << "-byte rows, "
+        << (config.openRow ? "open" : "closed") << " page): " << accesses << " accesses (" << reads << " reads, "
+        << writes << " writes), " << rowHits << " row hits, " << rowMisses << " misses, " << rowConflicts
+        << " conflicts, row hit rate " << std::fixed << std::setprecision(1) << 100.0 * rowHits / accesses
+        << "%, average latency " << std::setprecision(2) << static_cast<double>(totalLatency) / accesses
+        << " cycles, " << queueCycles << " cycles queued" << std::defaultfloat << std::endl;
+}
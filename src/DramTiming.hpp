@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+// Geometry and latencies of the DRAM channel behind the data memory, in
+// processor cycles
+struct DramConfig {
+    bool openRow;       // Keep the row open after an access (open-page policy), else precharge it at once
+    uint32_t banks;     // Power of two
+    uint32_t rowBytes;  // Row buffer size, a power of two
+    uint32_t tRCD;      // Activate to column command
+    uint32_t tCAS;      // Column command to data
+    uint32_t tRP;       // Precharge
+    uint32_t tBurst;    // Data bus cycles of one transfer
+
+    DramConfig() : openRow(true), banks(8), rowBytes(2048), tRCD(14), tCAS(14), tRP(14), tBurst(4) {}
+};
+
+// Timing of one DRAM channel (--dram): the functional data still lives in
+// Memory, this only says how long each access takes.
+//
+// An address maps to | row | bank | column |, so sequential accesses stay in
+// one row and a row's worth of bytes later move on to the next bank. With the
+// open-page policy a bank keeps its last row in the row buffer: an access to
+// that row is a hit (tCAS), to an idle bank an activate first (tRCD + tCAS),
+// and to another row a precharge as well (tRP + tRCD + tCAS). The closed-page
+// policy precharges after every access, so each one costs tRCD + tCAS and the
+// bank is busy for tRP after it. Requests queue for their bank, which takes
+// one command sequence at a time, and then for the data bus (tBurst per
+// transfer), so accesses that arrive while others are in flight wait.
+class DramTiming {
+public:
+    explicit DramTiming(const DramConfig& config);
+
+    // Cycles from 'cycle', the one the request is made in, until the data of
+    // the access is back or written (at least 1)
+    uint32_t access(uint32_t address, bool write, uint64_t cycle);
+    // Forgets the open rows and the queues, keeps the counters
+    void reset();
+    // Accesses, row buffer outcomes and latency
+    void printSummary(std::ostream& out) const;
+
+    DramConfig config;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t rowHits;       // The row was open
+    uint64_t rowMisses;     // The bank was precharged (always, with the closed-page policy)
+    uint64_t rowConflicts;  // Another row was open and had to be closed first
+    uint64_t queueCycles;   // Cycles requests waited for their bank or the data bus
+    uint64_t totalLatency;
+
+private:
+    struct Bank {
+        bool open;
+        uint32_t row;
+        uint64_t readyAt;  // First cycle the bank takes a new command sequence
+    };
+
+    std::vector<Bank> bankState;
+    uint64_t busFreeAt;   // First cycle the data bus is free
+    uint32_t columnBits;
+    uint32_t bankBits;
+};
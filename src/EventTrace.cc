@@ -0,0 +1,407 @@
+#include "EventTrace.hpp"
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char EVENT_MAGIC[8] = {'R', 'V', 'E', 'V', 'T', '1', 0, 0};
+const char INDEX_MAGIC[8] = {'R', 'V', 'I', 'D', 'X', '1', 0, 0};
+const char INDEX_TRAILER[8] = {'R', 'V', 'I', 'D', 'X', 'E', 'N', 'D'};
+const size_t WRITE_BLOCK = 1 << 20;
+const uint8_t TAG_END = 0x00;
+const uint8_t TAG_SYNC = 0x01;
+const uint8_t TAG_STAGE = 0x10;
+const uint8_t TAG_COMMIT = 0x20;
+
+uint64_t getFixed(const uint8_t* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    return value;
+}
+
+} // namespace
+
+// ---------------------- Writer ----------------------
+EventTraceWriter::EventTraceWriter() :
+    out(nullptr), written(0), lastCycle(0), lastRow(0), lastPc(0), lastAddress(0),
+    textBase(0), nextSyncCycle(0), ordered(true) {
+}
+
+EventTraceWriter::~EventTraceWriter() {
+    close();
+}
+
+bool EventTraceWriter::open(const std::string& filename, const std::vector<std::string_view>& instructionStrings,
+                            int32_t textBase, int cycles) {
+    out = std::fopen(filename.c_str(), "wb");
+    if (!out) {
+        std::cerr << "Error: Unable to open event trace " << filename << " for writing" << std::endl;
+        return false;
+    }
+    written = 0;
+    buffer.reserve(WRITE_BLOCK + 64);
+    buffer.insert(buffer.end(), EVENT_MAGIC, EVENT_MAGIC + sizeof(EVENT_MAGIC));
+    putVarint(static_cast<uint64_t>(cycles));
+    putVarint(static_cast<uint32_t>(textBase));
+    putVarint(instructionStrings.size());
+    for (std::string_view text : instructionStrings) {
+        putVarint(text.size());
+        buffer.insert(buffer.end(), text.begin(), text.end());
+        flushIfFull();
+    }
+    lastCycle = lastRow = 0;
+    lastPc = 0;
+    lastAddress = 0;
+    this->textBase = textBase;
+    nextSyncCycle = 0;
+    ordered = true;
+    blocks.clear();
+    rowBlocks.assign(instructionStrings.size(), std::vector<uint32_t>());
+    return true;
+}
+
+void EventTraceWriter::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void EventTraceWriter::putFixed(uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+// Starts a new block when 'cycle' crosses a sync boundary and notes the row in
+// the per-row index
+void EventTraceWriter::beginEvent(int cycle, int row) {
+    if (cycle < lastCycle)
+        ordered = false;
+    if (!ordered)
+        return;
+    if (cycle >= nextSyncCycle) {
+        int start = cycle - cycle % EVENT_SYNC_INTERVAL;
+        blocks.push_back({static_cast<uint64_t>(start), written + buffer.size()});
+        buffer.push_back(TAG_SYNC);
+        putVarint(static_cast<uint64_t>(start));
+        lastCycle = start;
+        lastRow = 0;
+        lastPc = 0;
+        lastAddress = 0;
+        nextSyncCycle = start + EVENT_SYNC_INTERVAL;
+    }
+    if (row >= 0 && static_cast<size_t>(row) < rowBlocks.size()) {
+        std::vector<uint32_t>& list = rowBlocks[row];
+        uint32_t block = static_cast<uint32_t>(blocks.size() - 1);
+        if (list.empty() || list.back() != block)
+            list.push_back(block);
+    }
+}
+
+void EventTraceWriter::flushIfFull() {
+    if (buffer.size() < WRITE_BLOCK)
+        return;
+    std::fwrite(buffer.data(), 1, buffer.size(), out);
+    written += buffer.size();
+    buffer.clear();
+}
+
+void EventTraceWriter::stage(int row, int cycle, PipelineStage stage) {
+    beginEvent(cycle, row);
+    buffer.push_back(static_cast<uint8_t>(TAG_STAGE | stage));
+    putSigned(cycle - lastCycle);
+    putSigned(row - lastRow);
+    lastCycle = cycle;
+    lastRow = row;
+    flushIfFull();
+}
+
+void EventTraceWriter::commit(const CommitRecord& commit) {
+    int64_t offset = static_cast<int64_t>(commit.pc) - textBase;
+    beginEvent(commit.cycle, (offset >= 0 && offset % 4 == 0) ? static_cast<int>(offset / 4) : -1);
+    buffer.push_back(static_cast<uint8_t>(TAG_COMMIT | commit.flags));
+    putSigned(commit.cycle - lastCycle);
+    putSigned(static_cast<int64_t>(commit.pc) - lastPc);
+    lastCycle = commit.cycle;
+    lastPc = commit.pc;
+    if (commit.flags & COMMIT_HAS_RD) {
+        buffer.push_back(static_cast<uint8_t>(commit.rd));
+        putSigned(commit.rdValue);
+    }
+    if (commit.flags & (COMMIT_LOAD | COMMIT_STORE)) {
+        putSigned(static_cast<int64_t>(commit.memAddress) - lastAddress);
+        putSigned(commit.memData);
+        lastAddress = commit.memAddress;
+    }
+    flushIfFull();
+}
+
+bool EventTraceWriter::close() {
+    if (!out)
+        return true;
+    buffer.push_back(TAG_END);
+    if (ordered)
+        writeIndex();
+    bool ok = std::fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+    written += buffer.size();
+    buffer.clear();
+    ok = (std::fclose(out) == 0) && ok;
+    out = nullptr;
+    return ok;
+}
+
+void EventTraceWriter::writeIndex() {
+    uint64_t indexOffset = written + buffer.size();
+    buffer.insert(buffer.end(), INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+    putFixed(EVENT_SYNC_INTERVAL, 8);
+    putFixed(blocks.size(), 8);
+    putFixed(rowBlocks.size(), 8);
+    for (const Block& block : blocks) {
+        putFixed(block.cycle, 8);
+        putFixed(block.offset, 8);
+        flushIfFull();
+    }
+    uint64_t first = 0;
+    for (const std::vector<uint32_t>& list : rowBlocks) {
+        putFixed(first, 8);
+        putFixed(list.size(), 8);
+        first += list.size();
+        flushIfFull();
+    }
+    for (const std::vector<uint32_t>& list : rowBlocks) {
+        for (uint32_t block : list) {
+            putFixed(block, 4);
+            flushIfFull();
+        }
+    }
+    putFixed(indexOffset, 8);
+    buffer.insert(buffer.end(), INDEX_TRAILER, INDEX_TRAILER + sizeof(INDEX_TRAILER));
+}
+
+// ---------------------- Reader ----------------------
+EventTraceReader::EventTraceReader() :
+    cycles(0), textBase(0), events(nullptr), cursor(nullptr), end(nullptr), damaged(false),
+    lastCycle(0), lastRow(0), lastPc(0), lastAddress(0),
+    blockTable(nullptr), rowTable(nullptr), rowEntries(nullptr), blocks(0), rows(0) {
+}
+
+bool EventTraceReader::getVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (cursor >= end)
+            return false;
+        uint8_t byte = *cursor++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool EventTraceReader::getSigned(int64_t& value) {
+    uint64_t raw = 0;
+    if (!getVarint(raw))
+        return false;
+    value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+    return true;
+}
+
+bool EventTraceReader::open(const std::string& filename) {
+    if (!file.open(filename))
+        return false;
+    cursor = file.data();
+    end = cursor + file.size();
+    damaged = false;
+    lastCycle = lastRow = 0;
+    lastPc = 0;
+    lastAddress = 0;
+
+    uint64_t value = 0, base = 0, rows = 0;
+    if (file.size() < sizeof(EVENT_MAGIC) || memcmp(cursor, EVENT_MAGIC, sizeof(EVENT_MAGIC)) != 0) {
+        std::cerr << "Error: " << filename << " is not a pipeline event trace" << std::endl;
+        return false;
+    }
+    cursor += sizeof(EVENT_MAGIC);
+    if (!getVarint(value) || !getVarint(base) || !getVarint(rows)) {
+        std::cerr << "Error: " << filename << ": truncated header" << std::endl;
+        return false;
+    }
+    cycles = static_cast<int>(value);
+    textBase = static_cast<int32_t>(base);
+    instructionStrings.clear();
+    instructionStrings.reserve(rows);
+    for (uint64_t i = 0; i < rows; i++) {
+        uint64_t length = 0;
+        if (!getVarint(length) || length > static_cast<uint64_t>(end - cursor)) {
+            std::cerr << "Error: " << filename << ": truncated header" << std::endl;
+            return false;
+        }
+        instructionStrings.emplace_back(reinterpret_cast<const char*>(cursor), length);
+        cursor += length;
+    }
+    events = cursor;
+    loadIndex();
+    return true;
+}
+
+// Finds the index through the trailer; a trace without a valid one is read sequentially
+void EventTraceReader::loadIndex() {
+    blockTable = rowTable = rowEntries = nullptr;
+    blocks = rows = 0;
+    const uint8_t* base = file.data();
+    size_t size = file.size();
+    if (size < 16 || memcmp(base + size - 8, INDEX_TRAILER, sizeof(INDEX_TRAILER)) != 0)
+        return;
+    size_t trailer = size - 16;
+    uint64_t indexOffset = getFixed(base + trailer, 8);
+    if (indexOffset < static_cast<uint64_t>(events - base) || indexOffset + 32 > trailer ||
+        memcmp(base + indexOffset, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+        return;
+    const uint8_t* index = base + indexOffset;
+    uint64_t blockCount = getFixed(index + 16, 8);
+    uint64_t rowCount = getFixed(index + 24, 8);
+    uint64_t available = trailer - indexOffset - 32;
+    if (blockCount == 0 || rowCount != instructionStrings.size() || blockCount > available / 16 ||
+        rowCount > (available - blockCount * 16) / 16)
+        return;
+    uint64_t entryCount = (available - blockCount * 16 - rowCount * 16) / 4;
+    const uint8_t* rowList = index + 32 + blockCount * 16;
+    for (uint64_t row = 0; row < rowCount; row++) {
+        uint64_t first = getFixed(rowList + 16 * row, 8);
+        uint64_t count = getFixed(rowList + 16 * row + 8, 8);
+        if (first > entryCount || count > entryCount - first)
+            return;
+    }
+    blockTable = index + 32;
+    rowTable = rowList;
+    rowEntries = rowList + rowCount * 16;
+    blocks = static_cast<size_t>(blockCount);
+    rows = static_cast<size_t>(rowCount);
+}
+
+uint64_t EventTraceReader::blockCycle(size_t block) const {
+    return hasIndex() ? getFixed(blockTable + 16 * block, 8) : 0;
+}
+
+size_t EventTraceReader::blockForCycle(int cycle) const {
+    if (!hasIndex() || cycle < 0)
+        return 0;
+    // Binary search for the last block starting at or before 'cycle'
+    size_t low = 0, high = blocks;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (blockCycle(middle) <= static_cast<uint64_t>(cycle))
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+bool EventTraceReader::blockHasRow(size_t block, int row) const {
+    if (!hasIndex())
+        return true;
+    if (row < 0 || static_cast<size_t>(row) >= rows)
+        return false;
+    const uint8_t* list = rowEntries + 4 * getFixed(rowTable + 16 * row, 8);
+    size_t low = 0, high = static_cast<size_t>(getFixed(rowTable + 16 * row + 8, 8));
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        uint64_t value = getFixed(list + 4 * middle, 4);
+        if (value == block)
+            return true;
+        if (value < block)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return false;
+}
+
+void EventTraceReader::seekBlock(size_t block) {
+    cursor = events;
+    if (hasIndex() && block < blocks) {
+        uint64_t offset = getFixed(blockTable + 16 * block + 8, 8);
+        cursor = (offset < file.size()) ? file.data() + offset : end;
+    }
+    damaged = false;
+    lastCycle = lastRow = 0;
+    lastPc = 0;
+    lastAddress = 0;
+}
+
+bool EventTraceReader::next(TraceEvent& event) {
+    if (cursor >= end) {
+        damaged = true;  // No end marker: the run was interrupted
+        return false;
+    }
+    uint8_t tag = *cursor++;
+    while (tag == TAG_SYNC) {
+        uint64_t start = 0;
+        if (!getVarint(start) || cursor >= end) {
+            damaged = true;
+            cursor = end;
+            return false;
+        }
+        lastCycle = static_cast<int>(start);
+        lastRow = 0;
+        lastPc = 0;
+        lastAddress = 0;
+        tag = *cursor++;
+    }
+    if (tag == TAG_END)
+        return false;
+
+    int64_t cycleDelta = 0;
+    bool ok = getSigned(cycleDelta);
+    if ((tag & 0xF0) == TAG_STAGE) {
+        int64_t rowDelta = 0;
+        ok = ok && getSigned(rowDelta);
+        lastCycle += static_cast<int>(cycleDelta);
+        lastRow += static_cast<int>(rowDelta);
+        event.kind = TraceEvent::STAGE;
+        event.cycle = lastCycle;
+        event.row = lastRow;
+        event.stage = static_cast<PipelineStage>(tag & 0x0F);
+    } else if ((tag & 0xF0) == TAG_COMMIT) {
+        CommitRecord& commit = event.commit;
+        int64_t pcDelta = 0;
+        ok = ok && getSigned(pcDelta);
+        lastCycle += static_cast<int>(cycleDelta);
+        lastPc += static_cast<int32_t>(pcDelta);
+        commit.cycle = lastCycle;
+        commit.pc = lastPc;
+        commit.flags = tag & 0x0F;
+        commit.rd = 0;
+        commit.rdValue = 0;
+        commit.memAddress = 0;
+        commit.memData = 0;
+        if (commit.flags & COMMIT_HAS_RD) {
+            int64_t value = 0;
+            ok = ok && cursor < end;
+            if (ok)
+                commit.rd = *cursor++;
+            ok = ok && getSigned(value);
+            commit.rdValue = static_cast<int32_t>(value);
+        }
+        if (commit.flags & (COMMIT_LOAD | COMMIT_STORE)) {
+            int64_t addressDelta = 0, data = 0;
+            ok = ok && getSigned(addressDelta) && getSigned(data);
+            lastAddress += static_cast<uint32_t>(addressDelta);
+            commit.memAddress = lastAddress;
+            commit.memData = static_cast<int32_t>(data);
+        }
+        event.kind = TraceEvent::COMMIT;
+        event.cycle = lastCycle;
+    } else {
+        ok = false;
+    }
+    if (!ok) {
+        damaged = true;
+        cursor = end;
+        return false;
+    }
+    return true;
+}
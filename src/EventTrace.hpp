@@ -0,0 +1,144 @@
+#pragma once
+#include "MappedFile.hpp"
+#include "PipelineStages.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary pipeline event trace: a compact replacement for the rows x cycles
+// diagram. The file holds a header with the program listing, then a stream of
+// stage events (one per recordStage call) and commit records (one per
+// instruction leaving WB), delta and varint encoded:
+//
+//   header   "RVEVT1\0\0", varint cycles, varint textBase, varint rows,
+//            rows x (varint length, instruction text)
+//   stage    1 byte  0x10 | stage,  zigzag varint cycle delta, zigzag varint row delta
+//   commit   1 byte  0x20 | flags,  zigzag varint cycle delta, zigzag varint pc delta,
+//            [rd byte, zigzag varint value]            (flags & COMMIT_HAS_RD)
+//            [zigzag varint address delta, zigzag varint data]  (flags & COMMIT_LOAD/COMMIT_STORE)
+//   sync     1 byte  0x01,  varint cycle   (resets every delta to zero, cycle to 'cycle')
+//   end      1 byte  0x00
+//
+// Cycle deltas are relative to the previous event of either kind, row, pc and
+// address deltas to the previous event of the same kind.
+//
+// A sync record starts every block of EVENT_SYNC_INTERVAL cycles, so decoding
+// can start at any block. When the trace is closed an index follows the end
+// marker (all fields little endian):
+//
+//   "RVIDX1\0\0", u64 sync interval, u64 blocks, u64 rows
+//   blocks x (u64 first cycle, u64 file offset of the sync record)
+//   rows   x (u64 first entry, u64 entry count)   blocks holding events of the row
+//   entries x u32 block number, ascending per row
+//   u64 index offset, "RVIDXEND"
+//
+// Events are written in cycle order (the extrapolator replays skipped
+// iterations in order too); a trace that is not is written without an index.
+
+const int EVENT_SYNC_INTERVAL = 1024;
+
+enum CommitFlags {
+    COMMIT_HAS_RD = 1,
+    COMMIT_LOAD = 2,
+    COMMIT_STORE = 4
+};
+
+struct CommitRecord {
+    int cycle;
+    int32_t pc;
+    uint32_t flags;
+    uint32_t rd;
+    int32_t rdValue;
+    uint32_t memAddress;
+    int32_t memData;
+};
+
+class EventTraceWriter {
+public:
+    EventTraceWriter();
+    ~EventTraceWriter();
+    bool open(const std::string& filename, const std::vector<std::string_view>& instructionStrings,
+              int32_t textBase, int cycles);
+    void stage(int row, int cycle, PipelineStage stage);
+    void commit(const CommitRecord& commit);
+    bool close();  // Writes the end marker and flushes
+    uint64_t bytesWritten() const { return written + buffer.size(); }
+
+private:
+    struct Block {
+        uint64_t cycle;
+        uint64_t offset;
+    };
+
+    std::FILE* out;
+    std::vector<uint8_t> buffer;  // Flushed in large blocks
+    uint64_t written;
+    int lastCycle;
+    int lastRow;
+    int32_t lastPc;
+    uint32_t lastAddress;
+    int32_t textBase;
+    int nextSyncCycle;
+    bool ordered;                 // false once an event goes back in time, no index then
+    std::vector<Block> blocks;
+    std::vector<std::vector<uint32_t>> rowBlocks;
+
+    void putVarint(uint64_t value);
+    void putSigned(int64_t value) { putVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63)); }
+    void putFixed(uint64_t value, int bytes);
+    void beginEvent(int cycle, int row);
+    void writeIndex();
+    void flushIfFull();
+};
+
+// One decoded event
+struct TraceEvent {
+    enum Kind { STAGE, COMMIT } kind;
+    int cycle;
+    int row;                 // STAGE
+    PipelineStage stage;     // STAGE
+    CommitRecord commit;     // COMMIT
+};
+
+class EventTraceReader {
+public:
+    EventTraceReader();
+    bool open(const std::string& filename);
+    bool next(TraceEvent& event);  // false at the end marker or end of file
+    bool truncated() const { return damaged; }
+
+    // Random access through the index; without one there is a single block
+    // starting at cycle 0
+    bool hasIndex() const { return blockTable != nullptr; }
+    size_t blockCount() const { return hasIndex() ? blocks : 1; }
+    uint64_t blockCycle(size_t block) const;
+    size_t blockForCycle(int cycle) const;        // Last block starting at or before 'cycle'
+    bool blockHasRow(size_t block, int row) const;
+    void seekBlock(size_t block);
+
+    int cycles;
+    int32_t textBase;
+    std::vector<std::string> instructionStrings;
+
+private:
+    MappedFile file;
+    const uint8_t* events;        // First event after the header
+    const uint8_t* cursor;
+    const uint8_t* end;
+    bool damaged;
+    int lastCycle;
+    int lastRow;
+    int32_t lastPc;
+    uint32_t lastAddress;
+    const uint8_t* blockTable;
+    const uint8_t* rowTable;
+    const uint8_t* rowEntries;
+    size_t blocks;
+    size_t rows;
+
+    bool getVarint(uint64_t& value);
+    bool getSigned(int64_t& value);
+    void loadIndex();
+};
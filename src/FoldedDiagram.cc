@@ -0,0 +1,483 @@
+#include "FoldedDiagram.hpp"
+#include "DiagramRenderer.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const size_t NONE = SIZE_MAX;
+const size_t MAX_PERIOD = 1 << 16;  // Longest block (in tokens) a fold pass looks for
+const int MAX_FOLD_PASSES = 16;     // One per loop nesting level
+const size_t FLUSH_BYTES = 1 << 22;
+
+// Cell names that stay unambiguous in a folded file, indexed by PipelineStage
+const char* const FOLDED_STAGE_NAMES[] = {"  ", "STALL", "SLASH", "IF", "ID", "EX", "MEM", "WB"};
+
+uint32_t entryRow(uint32_t entry) { return entry >> 4; }
+PipelineStage entryStage(uint32_t entry) { return static_cast<PipelineStage>(entry & 0xF); }
+
+// Writes one cell of a folded block. Plain cells use the diagram rules, cells
+// holding STALL or SLASH spell every stage out.
+void appendFoldedCell(std::string& out, const PipelineStage* stages, size_t count, PipelineStage& prevStage) {
+    bool special = false;
+    for (size_t k = 0; k < count; k++)
+        special = special || stages[k] == STALL || stages[k] == SLASH;
+    if (!special) {
+        appendDiagramCell(out, stages, count, prevStage);
+        return;
+    }
+    out += ';';
+    for (size_t k = count; k-- > 0;) {
+        out += FOLDED_STAGE_NAMES[stages[k]];
+        if (k > 0)
+            out += '/';
+    }
+    prevStage = (count == 1) ? stages[0] : SPACE;
+}
+
+bool parseStageName(std::string_view name, PipelineStage& stage) {
+    for (int s = STALL; s <= WB; s++) {
+        if (name == FOLDED_STAGE_NAMES[s]) {
+            stage = static_cast<PipelineStage>(s);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Inverse of appendFoldedCell: the stages of a cell in recordStage order
+bool parseFoldedCell(std::string_view text, std::vector<PipelineStage>& stages, PipelineStage& prevStage) {
+    stages.clear();
+    if (text == "  ") {
+        prevStage = SPACE;
+        return true;
+    }
+    if (text == "-") {
+        if (prevStage == SPACE)
+            return false;
+        stages.push_back(prevStage);
+        return true;
+    }
+    // Newest first in the text
+    size_t start = 0;
+    while (true) {
+        size_t slash = text.find('/', start);
+        PipelineStage stage = SPACE;
+        if (!parseStageName(text.substr(start, slash == std::string_view::npos ? slash : slash - start), stage))
+            return false;
+        stages.push_back(stage);
+        if (slash == std::string_view::npos)
+            break;
+        start = slash + 1;
+    }
+    std::reverse(stages.begin(), stages.end());
+    prevStage = (stages.size() == 1) ? stages[0] : SPACE;
+    return true;
+}
+
+std::string cleanInstruction(std::string_view text) {
+    std::string clean;
+    for (char c : text) {
+        if (c != '\n' && c != '\r')
+            clean += c;
+    }
+    return clean;
+}
+
+void flushTo(std::FILE* file, std::string& out, bool& ok) {
+    ok = (std::fwrite(out.data(), 1, out.size(), file) == out.size()) && ok;
+    out.clear();
+}
+
+} // namespace
+
+size_t DiagramFolder::ColumnHash::operator()(const Column& column) const {
+    uint64_t hash = 1469598103934665603ull;
+    for (uint32_t entry : column)
+        hash = (hash ^ entry) * 1099511628211ull;
+    return static_cast<size_t>(hash);
+}
+
+DiagramFolder::DiagramFolder() : rows(0), cycles(0), openCycle(-1) {
+}
+
+void DiagramFolder::reset(int rows, int cycles) {
+    this->rows = rows;
+    this->cycles = cycles;
+    columns.assign(1, Column());
+    columnIds.clear();
+    columnIds.emplace(Column(), 0);
+    repeats.clear();
+    repeatIds.clear();
+    sequence.clear();
+    openColumn.clear();
+    openCycle = -1;
+}
+
+uint32_t DiagramFolder::internColumn(Column& column) {
+    std::stable_sort(column.begin(), column.end(),
+                     [](uint32_t a, uint32_t b) { return entryRow(a) < entryRow(b); });
+    auto found = columnIds.find(column);
+    if (found != columnIds.end())
+        return found->second;
+    uint32_t id = static_cast<uint32_t>(columns.size());
+    columns.push_back(column);
+    columnIds.emplace(column, id);
+    return id;
+}
+
+uint32_t DiagramFolder::internRepeat(const uint32_t* body, size_t length, uint32_t count) {
+    Column key(body, body + length);
+    key.push_back(count);
+    auto found = repeatIds.find(key);
+    if (found != repeatIds.end())
+        return found->second;
+    Repeat repeat;
+    repeat.body.assign(body, body + length);
+    repeat.count = count;
+    uint64_t iteration = 0;
+    for (uint32_t token : repeat.body)
+        iteration += tokenCycles(token);
+    repeat.cycles = iteration * count;
+    uint32_t index = static_cast<uint32_t>(repeats.size());
+    repeats.push_back(std::move(repeat));
+    repeatIds.emplace(std::move(key), index);
+    return index;
+}
+
+uint64_t DiagramFolder::tokenCycles(uint32_t token) const {
+    return (token & REPEAT_TOKEN) ? repeats[token & ~REPEAT_TOKEN].cycles : 1;
+}
+
+void DiagramFolder::record(int row, int cycle, PipelineStage stage) {
+    if (row < 0 || row >= rows || cycle < 0 || cycle >= cycles)
+        return;
+    uint32_t entry = (static_cast<uint32_t>(row) << 4) | static_cast<uint32_t>(stage);
+    if (cycle == openCycle) {
+        openColumn.push_back(entry);
+    } else if (cycle > openCycle) {
+        closeOpenColumn();
+        openCycle = cycle;
+        openColumn.push_back(entry);
+    } else {
+        // A cycle already closed (replayed stages arrive in order, but nothing relies on it)
+        if (static_cast<size_t>(cycle) >= sequence.size())
+            sequence.resize(static_cast<size_t>(cycle) + 1, 0);
+        Column column = columns[sequence[cycle]];
+        column.push_back(entry);
+        sequence[cycle] = internColumn(column);
+    }
+}
+
+void DiagramFolder::closeOpenColumn() {
+    if (openCycle < 0)
+        return;
+    if (sequence.size() < static_cast<size_t>(openCycle))
+        sequence.resize(static_cast<size_t>(openCycle), 0);
+    sequence.push_back(internColumn(openColumn));
+    openColumn.clear();
+    openCycle = -1;
+}
+
+void DiagramFolder::fold() {
+    closeOpenColumn();
+    sequence.resize(static_cast<size_t>(std::max(cycles, 0)), 0);
+    for (int pass = 0; pass < MAX_FOLD_PASSES && foldPass(); pass++) {
+    }
+}
+
+// Replaces every block of tokens that directly repeats itself with one repeat
+// token. The period tried at each position is the distance to the previous
+// occurrence of the same token, so one pass folds the innermost loops and the
+// next pass the loops around them.
+bool DiagramFolder::foldPass() {
+    std::vector<size_t> lastColumn(columns.size(), NONE);
+    std::vector<size_t> lastRepeat(repeats.size(), NONE);
+    std::vector<uint32_t> out;
+    out.reserve(sequence.size());
+    const uint32_t* tokens = sequence.data();
+    size_t length = sequence.size();
+    size_t literalStart = 0;  // out mirrors tokens one to one from here on
+    size_t i = 0;
+    while (i < length) {
+        uint32_t token = tokens[i];
+        size_t& last = (token & REPEAT_TOKEN) ? lastRepeat[token & ~REPEAT_TOKEN] : lastColumn[token];
+        if (last != NONE && last >= literalStart) {
+            size_t start = last;
+            size_t period = i - start;
+            if (period <= MAX_PERIOD && i + period <= length && std::equal(tokens + start, tokens + i, tokens + i)) {
+                size_t count = 2;
+                while (start + (count + 1) * period <= length &&
+                       std::equal(tokens + start, tokens + i, tokens + start + count * period))
+                    count++;
+                out.resize(out.size() - period);
+                out.push_back(REPEAT_TOKEN | internRepeat(tokens + start, period, static_cast<uint32_t>(count)));
+                i = start + count * period;
+                literalStart = i;
+                continue;
+            }
+        }
+        last = i;
+        out.push_back(token);
+        i++;
+    }
+    bool shorter = out.size() < length;
+    sequence.swap(out);
+    return shorter;
+}
+
+// ---------------------- Folded Output ----------------------
+bool DiagramFolder::writeFolded(std::FILE* file, const std::vector<std::string_view>& instructionStrings) const {
+    std::vector<std::string> labels;
+    size_t labelWidth = 20;
+    std::string out = "Folded pipeline diagram: " + std::to_string(cycles) + " cycles, " + std::to_string(rows) +
+                      " instructions\n";
+    for (int row = 0; row < rows; row++) {
+        labels.push_back(std::to_string(row) + ":" + cleanInstruction(instructionStrings[row]));
+        labelWidth = std::max(labelWidth, labels.back().size());
+        out += labels.back();
+        out += '\n';
+    }
+    bool ok = true;
+    uint64_t cycle = 0;
+    writeTokens(out, file, ok, sequence, cycle, 0, labels, labelWidth);
+    flushTo(file, out, ok);
+    return ok;
+}
+
+void DiagramFolder::writeTokens(std::string& out, std::FILE* file, bool& ok, const std::vector<uint32_t>& tokens,
+                                uint64_t& cycle, int depth, const std::vector<std::string>& labels,
+                                size_t labelWidth) const {
+    std::string indent(static_cast<size_t>(2 * depth), ' ');
+    size_t i = 0;
+    while (i < tokens.size()) {
+        if (!(tokens[i] & REPEAT_TOKEN)) {
+            size_t end = i;
+            while (end < tokens.size() && !(tokens[end] & REPEAT_TOKEN))
+                end++;
+            writeBlock(out, tokens.data() + i, end - i, cycle, depth, labels, labelWidth);
+            cycle += end - i;
+            i = end;
+        } else {
+            const Repeat& repeat = repeats[tokens[i] & ~REPEAT_TOKEN];
+            uint64_t iteration = repeat.cycles / repeat.count;
+            out += indent + "Repeat " + std::to_string(repeat.count) + " x " + std::to_string(iteration) +
+                   " cycles (cycles " + std::to_string(cycle) + "-" + std::to_string(cycle + repeat.cycles - 1) + "):\n";
+            // The body is shown once, numbered as the first iteration
+            uint64_t bodyCycle = cycle;
+            writeTokens(out, file, ok, repeat.body, bodyCycle, depth + 1, labels, labelWidth);
+            out += indent + "End repeat\n";
+            cycle += repeat.cycles;
+            i++;
+        }
+        if (out.size() >= FLUSH_BYTES)
+            flushTo(file, out, ok);
+    }
+}
+
+void DiagramFolder::writeBlock(std::string& out, const uint32_t* tokens, size_t length, uint64_t firstCycle, int depth,
+                               const std::vector<std::string>& labels, size_t labelWidth) const {
+    std::string indent(static_cast<size_t>(2 * depth), ' ');
+    uint64_t lastCycle = firstCycle + length - 1;
+    out += indent + "Cycles " + std::to_string(firstCycle) + "-" + std::to_string(lastCycle) + ":\n";
+    out += indent;
+    appendDiagramHeader(out, labelWidth, static_cast<int>(firstCycle), static_cast<int>(lastCycle));
+
+    // Only rows with a stage somewhere in the block are listed
+    std::vector<uint32_t> activeRows;
+    for (size_t k = 0; k < length; k++) {
+        for (uint32_t entry : columns[tokens[k]])
+            activeRows.push_back(entryRow(entry));
+    }
+    std::sort(activeRows.begin(), activeRows.end());
+    activeRows.erase(std::unique(activeRows.begin(), activeRows.end()), activeRows.end());
+
+    std::vector<PipelineStage> stages;
+    for (uint32_t row : activeRows) {
+        out += indent;
+        appendInstructionColumn(out, labels[row], labelWidth);
+        PipelineStage prevStage = SPACE;
+        for (size_t k = 0; k < length; k++) {
+            const Column& column = columns[tokens[k]];
+            stages.clear();
+            auto entry = std::lower_bound(column.begin(), column.end(), row << 4);
+            for (; entry != column.end() && entryRow(*entry) == row; ++entry)
+                stages.push_back(entryStage(*entry));
+            appendFoldedCell(out, stages.data(), stages.size(), prevStage);
+        }
+        out += '\n';
+    }
+}
+
+// ---------------------- Reading and Expansion ----------------------
+bool DiagramFolder::readFolded(const std::string& filename, std::vector<std::string>& instructionStrings) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "Error: Unable to open " << filename << std::endl;
+        return false;
+    }
+    int lineNumber = 0;
+    std::string line;
+    auto fail = [&](const char* reason) {
+        std::cerr << "Error: " << filename << ":" << lineNumber << ": " << reason << std::endl;
+        return false;
+    };
+
+    int headerCycles = 0, headerRows = 0;
+    lineNumber++;
+    if (!std::getline(in, line) ||
+        std::sscanf(line.c_str(), "Folded pipeline diagram: %d cycles, %d instructions", &headerCycles, &headerRows) != 2 ||
+        headerCycles < 0 || headerRows < 0)
+        return fail("not a folded pipeline diagram");
+    reset(headerRows, headerCycles);
+
+    instructionStrings.clear();
+    size_t labelWidth = 20;
+    for (int row = 0; row < headerRows; row++) {
+        lineNumber++;
+        std::string prefix = std::to_string(row) + ":";
+        if (!std::getline(in, line) || line.compare(0, prefix.size(), prefix) != 0)
+            return fail("bad instruction list");
+        instructionStrings.push_back(line.substr(prefix.size()));
+        labelWidth = std::max(labelWidth, line.size());
+    }
+
+    struct Frame {
+        std::vector<uint32_t> tokens;
+        uint32_t count;
+    };
+    std::vector<Frame> frames(1);
+    std::vector<Column> block;
+    std::vector<PipelineStage> stages;
+    bool inBlock = false;
+    bool expectHeader = false;
+    auto closeBlock = [&]() {
+        for (Column& column : block)
+            frames.back().tokens.push_back(internColumn(column));
+        block.clear();
+        inBlock = false;
+    };
+
+    while (std::getline(in, line)) {
+        lineNumber++;
+        size_t indent = line.find_first_not_of(' ');
+        if (indent == std::string::npos)
+            continue;
+        std::string_view text(line);
+        text.remove_prefix(indent);
+        if (expectHeader) {
+            if (text.compare(0, 11, "Instruction") != 0)
+                return fail("missing block header");
+            expectHeader = false;
+            continue;
+        }
+        unsigned long long first = 0, last = 0, count = 0, iteration = 0;
+        if (text.compare(0, 7, "Cycles ") == 0) {
+            if (inBlock)
+                closeBlock();
+            if (std::sscanf(line.c_str() + indent, "Cycles %llu-%llu:", &first, &last) != 2 || last < first ||
+                last - first >= static_cast<unsigned long long>(INT_MAX))
+                return fail("bad block line");
+            block.assign(static_cast<size_t>(last - first + 1), Column());
+            inBlock = true;
+            expectHeader = true;
+        } else if (text.compare(0, 7, "Repeat ") == 0) {
+            if (inBlock)
+                closeBlock();
+            if (std::sscanf(line.c_str() + indent, "Repeat %llu x %llu cycles", &count, &iteration) != 2 || count < 2 ||
+                count > UINT32_MAX)
+                return fail("bad repeat line");
+            frames.push_back(Frame{std::vector<uint32_t>(), static_cast<uint32_t>(count)});
+        } else if (text == "End repeat") {
+            if (inBlock)
+                closeBlock();
+            if (frames.size() < 2 || frames.back().tokens.empty())
+                return fail("unmatched End repeat");
+            Frame frame = std::move(frames.back());
+            frames.pop_back();
+            frames.back().tokens.push_back(REPEAT_TOKEN |
+                                           internRepeat(frame.tokens.data(), frame.tokens.size(), frame.count));
+        } else if (inBlock) {
+            // <row>:<instruction><padding>;cell;cell...
+            size_t colon = text.find(':');
+            int row = (colon == std::string_view::npos) ? -1 : std::atoi(std::string(text.substr(0, colon)).c_str());
+            if (row < 0 || row >= headerRows || text.size() < labelWidth)
+                return fail("bad row line");
+            std::string_view cells = text.substr(labelWidth);
+            PipelineStage prevStage = SPACE;
+            size_t k = 0;
+            while (!cells.empty()) {
+                if (cells[0] != ';' || k >= block.size())
+                    return fail("bad cell list");
+                size_t next = cells.find(';', 1);
+                std::string_view cell = cells.substr(1, next == std::string_view::npos ? std::string_view::npos : next - 1);
+                if (!parseFoldedCell(cell, stages, prevStage))
+                    return fail("bad cell");
+                for (PipelineStage stage : stages)
+                    block[k].push_back((static_cast<uint32_t>(row) << 4) | static_cast<uint32_t>(stage));
+                cells = (next == std::string_view::npos) ? std::string_view() : cells.substr(next);
+                k++;
+            }
+            if (k != block.size())
+                return fail("wrong number of cells");
+        } else {
+            return fail("unexpected line");
+        }
+    }
+    if (inBlock)
+        closeBlock();
+    if (frames.size() != 1)
+        return fail("missing End repeat");
+    sequence = std::move(frames[0].tokens);
+    uint64_t total = 0;
+    for (uint32_t token : sequence)
+        total += tokenCycles(token);
+    if (total != static_cast<uint64_t>(headerCycles))
+        return fail("blocks do not add up to the cycle count");
+    return true;
+}
+
+void DiagramFolder::expandTokens(const std::vector<uint32_t>& tokens, std::vector<uint32_t>& out) const {
+    for (uint32_t token : tokens) {
+        if (!(token & REPEAT_TOKEN)) {
+            out.push_back(token);
+            continue;
+        }
+        const Repeat& repeat = repeats[token & ~REPEAT_TOKEN];
+        for (uint32_t i = 0; i < repeat.count; i++)
+            expandTokens(repeat.body, out);
+    }
+}
+
+bool DiagramFolder::writeExpanded(std::FILE* file, const std::vector<std::string_view>& instructionStrings) const {
+    std::vector<uint32_t> perCycle;
+    perCycle.reserve(static_cast<size_t>(std::max(cycles, 0)));
+    expandTokens(sequence, perCycle);
+
+    size_t columnWidth = diagramColumnWidth(instructionStrings);
+    std::string out;
+    appendDiagramHeader(out, columnWidth, 0, cycles - 1);
+    bool ok = true;
+    std::vector<PipelineStage> stages;
+    for (int row = 0; row < rows; row++) {
+        appendInstructionColumn(out, instructionStrings[row], columnWidth);
+        PipelineStage prevStage = SPACE;
+        uint32_t key = static_cast<uint32_t>(row) << 4;
+        for (uint32_t id : perCycle) {
+            const Column& column = columns[id];
+            stages.clear();
+            auto entry = std::lower_bound(column.begin(), column.end(), key);
+            for (; entry != column.end() && entryRow(*entry) == static_cast<uint32_t>(row); ++entry)
+                stages.push_back(entryStage(*entry));
+            appendDiagramCell(out, stages.data(), stages.size(), prevStage);
+        }
+        out += '\n';
+        if (out.size() >= FLUSH_BYTES)
+            flushTo(file, out, ok);
+    }
+    flushTo(file, out, ok);
+    return ok;
+}
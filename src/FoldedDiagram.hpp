@@ -0,0 +1,82 @@
+#pragma once
+#include "PipelineStages.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Folded pipeline diagram: the cycles of a run are grouped into blocks of
+// literal cycles and repeat blocks ("the next 12 cycles happen 200 times"),
+// nested for nested loops, so the output grows with the number of distinct
+// behaviours instead of with cycles. Text layout:
+//
+//   Folded pipeline diagram: <cycles> cycles, <rows> instructions
+//   Cycles 0-11:                            literal cycles
+//   Instruction         ;0;1;...;11
+//   3:addi x6 x0 1      ;IF;ID;-;EX;...     <row>:<instruction>, only rows active in the block
+//   Repeat 200 x 12 cycles (cycles 12-2411):
+//     Cycles 12-23:                         one steady-state iteration, cycle numbers of the first
+//     ...
+//   End repeat
+//
+// Cells follow printPipelineDiagram ("-" repeats the previous cell of the row
+// within the block, several stages print newest first, "WB/MEM"); STALL and
+// SLASH entries, which the simulators never record, are spelled out so the
+// file is lossless. unfold regenerates the full diagram from it.
+class DiagramFolder {
+public:
+    DiagramFolder();
+    void reset(int rows, int cycles);
+    // Same arguments as recordStage; stages of one cell keep their order, cycles may come in any order
+    void record(int row, int cycle, PipelineStage stage);
+    // Closes the last cycle and folds repeated blocks
+    void fold();
+
+    bool writeFolded(std::FILE* out, const std::vector<std::string_view>& instructionStrings) const;
+    // Parses a folded file back into the folded form
+    bool readFolded(const std::string& filename, std::vector<std::string>& instructionStrings);
+    // Writes the full printPipelineDiagram layout
+    bool writeExpanded(std::FILE* out, const std::vector<std::string_view>& instructionStrings) const;
+
+    size_t distinctCycles() const { return columns.size(); }
+    size_t blockCount() const { return repeats.size(); }
+
+private:
+    // The cell entries of one cycle, (row << 4) | stage, sorted by row and in
+    // recordStage order within a row. Column 0 is the empty cycle.
+    using Column = std::vector<uint32_t>;
+    struct ColumnHash {
+        size_t operator()(const Column& column) const;
+    };
+    // A folded block: 'body' tokens 'count' times
+    struct Repeat {
+        std::vector<uint32_t> body;
+        uint32_t count;
+        uint64_t cycles;
+    };
+    // Tokens are column ids, or REPEAT_TOKEN | index into repeats
+    static const uint32_t REPEAT_TOKEN = 0x80000000u;
+
+    int rows;
+    int cycles;
+    std::vector<Column> columns;
+    std::unordered_map<Column, uint32_t, ColumnHash> columnIds;
+    std::vector<Repeat> repeats;
+    std::unordered_map<Column, uint32_t, ColumnHash> repeatIds;  // body + count -> index
+    std::vector<uint32_t> sequence;  // One column id per cycle until fold(), then the folded tokens
+    Column openColumn;
+    int openCycle;
+
+    uint32_t internColumn(Column& column);
+    uint32_t internRepeat(const uint32_t* body, size_t length, uint32_t count);
+    void closeOpenColumn();
+    bool foldPass();
+    uint64_t tokenCycles(uint32_t token) const;
+    void expandTokens(const std::vector<uint32_t>& tokens, std::vector<uint32_t>& out) const;
+    void writeTokens(std::string& out, std::FILE* file, bool& ok, const std::vector<uint32_t>& tokens, uint64_t& cycle,
+                     int depth, const std::vector<std::string>& labels, size_t labelWidth) const;
+    void writeBlock(std::string& out, const uint32_t* tokens, size_t length, uint64_t firstCycle, int depth,
+                    const std::vector<std::string>& labels, size_t labelWidth) const;
+};
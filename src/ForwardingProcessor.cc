@@ -14,35 +14,18 @@ ForwardingProcessor::ForwardingProcessor() :
 ForwardingProcessor::~ForwardingProcessor() {
 }
 
-// Override run method to implement forwarding
-void ForwardingProcessor::run(int cycles) {
-    // Reset pipeline state.
-    pc = 0;
-    stall = false;
-    ifid.isEmpty = true;
-    idex.isEmpty = true;
-    exmem.isEmpty = true;
-    memwb.isEmpty = true;
-    Imm_valid = true;
-    bool clear = false;
-    // Allocate the pipeline matrix.
-    matrixRows = static_cast<int>(instructionStrings.size());
-    matrixCols = cycles;
+void ForwardingProcessor::beginRun(int cycles) {
+    NoForwardingProcessor::beginRun(cycles);
+    clear = false;
+}
 
-    // Resize the outer vector to have matrixRows elements
-    pipelineMatrix3D.resize(matrixRows);
+// Override runCycles to implement forwarding
+void ForwardingProcessor::runCycles(int firstCycle, int lastCycle) {
+    if (halted)
+        return;
 
-    // Resize each inner vector to have matrixCols elements
-    for (int i = 0; i < matrixRows; i++) {
-        pipelineMatrix3D[i].resize(matrixCols);
-        // Initialize each cell with a vector containing a single SPACE value
-        for (int j = 0; j < matrixCols; j++) {
-            pipelineMatrix3D[i][j].push_back(SPACE);
-        }
-    }
-    
     // Simulation loop.
-    for (int cycle = 0; cycle < cycles; cycle++) {
+    for (int cycle = firstCycle; cycle < lastCycle; cycle++) {
         std::cout << "========== Starting Cycle " << cycle << " ==========" << std::endl;
         bool branchTaken = false;
         int32_t branchTarget = 0;  // Changed to signed 32-bit
@@ -53,64 +36,57 @@ void ForwardingProcessor::run(int cycles) {
             int idx = getInstructionIndex(memwb.pc);
             if (idx != -1)
                 recordStage(idx, cycle, WB);
+            if (eventTrace)
+                recordCommit(cycle);
+            if (criticalPath)
+                criticalPath->commit(cycle, memwb.pc, memwb.instruction);
+            if (intervalSampler)
+                intervalSampler->commit(cycle, memwb.pc, memwb.instruction);
             // Removed write in WB stage to allow for forwarding as writing is done now earlier in MEM and EX stages
+            if (isEcall(memwb.instruction) && !commitSyscall(cycle))
+                return;
         }
         else {
             std::cout << "Cycle " << cycle << " - WB: No instruction" << std::endl;
         }
         
         // -------------------- MEM Stage --------------------
-        if (!exmem.isEmpty) {
+        // A vector load or store keeps MEM until all of its elements have moved, and
+        // with --dram or --prefetch every access until memory returns its data
+        bool memHeld = occupyMemoryStage(vector, cycle);
+        if (memHeld) {
+            std::cout << "Cycle " << cycle << " - MEM: Processing " << exmem.instructionString << " at PC: " << exmem.pc
+                      << " (" << memCyclesLeft << " more cycle(s))" << std::endl;
+            recordStage(getInstructionIndex(exmem.pc), cycle, MEM);
+            memwb.isEmpty = true;
+        }
+        else if (!exmem.isEmpty) {
             std::cout << "Cycle " << cycle << " - MEM: Processing " << exmem.instructionString << " at PC: " << exmem.pc << std::endl;
             int idx = getInstructionIndex(exmem.pc);
             if (idx != -1)
                 recordStage(idx, cycle, MEM);
-            if (exmem.controls.memRead) {
-                // Determine the type of load based on the funct3 field
-                uint32_t funct3 = (exmem.instruction >> 12) & 0x7;
-                switch (funct3) {
-                    case 0x0: // LB - Load Byte (sign-extended)
-                        memwb.readData = static_cast<int8_t>(dataMemory.readByte(exmem.aluResult));
-                        break;
-                    case 0x1: // LH - Load Half-word (sign-extended)
-                        memwb.readData = dataMemory.readHalfWord(exmem.aluResult);
-                        break;
-                    case 0x2: // LW - Load Word
-                        memwb.readData = dataMemory.readWord(exmem.aluResult);
-                        break;
-                    case 0x4: // LBU - Load Byte (zero-extended)
-                        memwb.readData = dataMemory.readByte(exmem.aluResult);
-                        break;
-                    case 0x5: // LHU - Load Half-word (zero-extended)
-                        memwb.readData = static_cast<uint16_t>(dataMemory.readHalfWord(exmem.aluResult) & 0xFFFF);
-                        break;
-                    default: // Default to word for unknown types
-                        memwb.readData = dataMemory.readWord(exmem.aluResult);
-                        break;
+            // Width and extension come from funct3 (see Memory::load/store)
+            uint32_t funct3 = (exmem.instruction >> 12) & 0x7;
+            if ((exmem.instruction & 0x7F) == 0x2F) {
+                memwb.readData = atomicAccess(exmem.instruction, exmem.aluResult, exmem.readData2);
+                std::cout << "         Atomic access at address " << exmem.aluResult << " operand: " << exmem.readData2
+                          << " result: " << memwb.readData << std::endl;
+            } else if (isVectorMemoryAccess(exmem.instruction)) {
+                vectorAccess(exmem.instruction, exmem.aluResult, exmem.readData2);
+                std::cout << "         Vector access of " << vector.vl << " element(s) at address " << exmem.aluResult << std::endl;
+            } else {
+                if (exmem.controls.memRead) {
+                    memwb.readData = loadData(funct3, exmem.aluResult);
+                    std::cout << "         Read from memory at address " << exmem.aluResult << " data: " << memwb.readData << std::endl;
                 }
-                std::cout << "         Read from memory at address " << exmem.aluResult << " data: " << memwb.readData << std::endl;
-            }
-            if (exmem.controls.memWrite) {
-                // Determine the type of store based on the funct3 field
-                uint32_t funct3 = (exmem.instruction >> 12) & 0x7;
-                switch (funct3) {
-                    case 0x0: // SB - Store Byte
-                        dataMemory.writeByte(exmem.aluResult, exmem.readData2 & 0xFF);
-                        break;
-                    case 0x1: // SH - Store Half-word
-                        dataMemory.writeHalfWord(exmem.aluResult, exmem.readData2 & 0xFFFF);
-                        break;
-                    case 0x2: // SW - Store Word
-                        dataMemory.writeWord(exmem.aluResult, exmem.readData2);
-                        break;
-                    default: // Default to word for unknown types
-                        dataMemory.writeWord(exmem.aluResult, exmem.readData2);
-                        break;
+                if (exmem.controls.memWrite) {
+                    storeData(funct3, exmem.aluResult, exmem.readData2);
+                    std::cout << "         Wrote " << exmem.readData2 << " to memory at address " << exmem.aluResult << "---> Funt3: "<< funct3 << std::endl;
                 }
-                std::cout << "         Wrote " << exmem.readData2 << " to memory at address " << exmem.aluResult << "---> Funt3: "<< funct3 << std::endl;
             }
             memwb.pc = exmem.pc;
             memwb.aluResult = exmem.aluResult;
+            memwb.storeData = exmem.readData2;
             memwb.rd = exmem.rd;
             memwb.controls = exmem.controls;
             memwb.instruction = exmem.instruction;
@@ -133,7 +109,21 @@ void ForwardingProcessor::run(int cycles) {
         }
         
         // -------------------- EX Stage --------------------
-        if (!idex.isEmpty) {
+        // EX waits while MEM is held, and a vector instruction stays as many cycles as its elements take
+        if (memHeld) {
+            if (!idex.isEmpty) {
+                std::cout << "Cycle " << cycle << " - EX: " << idex.instructionString << " at PC: " << idex.pc
+                          << " waits for MEM" << std::endl;
+                recordStage(getInstructionIndex(idex.pc), cycle, EX);
+            }
+        }
+        else if (!idex.isEmpty && occupyStage(exCyclesLeft, vector.executeCycles(idex.instruction))) {
+            std::cout << "Cycle " << cycle << " - EX: Processing " << idex.instructionString << " at PC: " << idex.pc
+                      << " (" << exCyclesLeft << " more cycle(s))" << std::endl;
+            recordStage(getInstructionIndex(idex.pc), cycle, EX);
+            exmem.isEmpty = true;
+        }
+        else if (!idex.isEmpty) {
             std::cout << "Cycle " << cycle << " - EX: Processing " << idex.instructionString << " at PC: " << idex.pc << std::endl;
             int idx = getInstructionIndex(idex.pc);
             if (idx != -1)
@@ -159,6 +149,10 @@ void ForwardingProcessor::run(int cycles) {
                 exmem.aluResult = idex.aluResult;
                 std::cout << "         Setting return address (PC+4): " << exmem.aluResult << std::endl;
             }
+            else if (isVectorInstruction(idex.instruction)) {
+                exmem.aluResult = vector.execute(idex.instruction, aluOp1, idex.readData2);
+                std::cout << "         Vector instruction, vl = " << vector.vl << std::endl;
+            }
             // Only handle ALU operations here, branch/jump is already handled in ID stage
             else {
                 exmem.aluResult = executeALU(aluOp1, aluOp2, idex.controls.aluOp);
@@ -195,6 +189,8 @@ void ForwardingProcessor::run(int cycles) {
             std::cout << "Cycle " << cycle << " - EX: No instruction" << std::endl;
         }
         
+        exHeld = !idex.isEmpty && (memHeld || exCyclesLeft > 0);
+
         // -------------------- ID Stage --------------------
         if (!ifid.isEmpty) {
             std::cout << "Cycle " << cycle << " - ID: Processing " << ifid.instructionString << " at PC: " << ifid.pc << std::endl;
@@ -235,6 +231,8 @@ void ForwardingProcessor::run(int cycles) {
             // More precise hazard detection based on instruction type
             bool hazard = false;
             hazard = detect_hazard(hazard, opcode, rs1, rs2);
+            hazard = hazard || exHeld;  // EX still has its instruction
+            hazard = hazard || syscallPending;  // An ECALL has to commit first
 
             if (!hazard) {
                 // Calculate branch or jump target in ID stage if applicable
@@ -245,6 +243,7 @@ void ForwardingProcessor::run(int cycles) {
                         std::cout<<"Invalid Immediate value"<<std::endl;
                         std::cout<<"Instruction: "<<ifid.instructionString<<std::endl;
                         std::cout<<"----------------------> Breaking the simulation"<<std::endl;
+                        halted = true;
                         return;
                     }
                 }
@@ -264,6 +263,10 @@ void ForwardingProcessor::run(int cycles) {
                 idex.rs2 = rs2;
                 idex.rd = rd;
                 idex.controls = decodeControlSignals(instruction);
+                if (!idex.controls.illegal_instruction && !vector.accepts(instruction)) {
+                    std::cerr << "Vector instruction not allowed with vtype 0x" << std::hex << vector.vtype << std::dec << std::endl;
+                    idex.controls.illegal_instruction = true;
+                }
                 idex.instruction = ifid.instruction;
                 idex.instructionString = ifid.instructionString;
                 idex.isEmpty = false;
@@ -272,6 +275,7 @@ void ForwardingProcessor::run(int cycles) {
                     std::cout<<"Illegal instruction detected at PC: "<< ifid.pc <<std::endl;
                     std::cout<<"Instruction: "<<ifid.instructionString<<std::endl;
                     std::cout<<"----------------------> Breaking the simulation"<<std::endl;
+                    halted = true;
                     return;
                 }
                 if (idex.controls.regWrite && rd != 0 ) {                          
@@ -285,10 +289,12 @@ void ForwardingProcessor::run(int cycles) {
                     clearRegisterUsage(rd);
                     std::cout<<"----------------------> x"<< rd << " is not a branch or jump instruction"<<std::endl;
                 }
+                syscallPending = isEcall(instruction);
             }
             else {
                 stall = true;
-                idex.isEmpty = true;
+                if (!exHeld)
+                    idex.isEmpty = true;
                 std::cout << "         Hazard detected: Stalling pipeline." << std::endl;
                 if (rs1 != 0 && isRegisterUsedBy(rs1))
                     std::cout << "         Register x" << rs1 << " is in use"<< " size: "<< regUsageTracker[rd].size() << std::endl;
@@ -298,7 +304,8 @@ void ForwardingProcessor::run(int cycles) {
             }
         }
         else {
-            idex.isEmpty = true;
+            if (!exHeld)
+                idex.isEmpty = true;
             std::cout << "Cycle " << cycle << " - ID: No instruction" << std::endl;
         }
         
@@ -313,14 +320,22 @@ void ForwardingProcessor::run(int cycles) {
         }
         // -------------------- IF Stage --------------------
         std::cout << "Stall: " << stall << "; pc: " << pc << "; instructionMemory.size(): " << instructionMemory.size() << std::endl;
-        if (!stall && (pc / 4 < static_cast<int32_t>(instructionMemory.size()))) {  // Adjusted for signed pc
-            ifid.instruction = instructionMemory[pc / 4];
+        int fetchIdx = getInstructionIndex(pc);
+        // With --sv32 a fetch that misses the I-TLB waits in IF for the page walk
+        bool fetchHeld = fetchIdx != -1 && occupyFetchStage(cycle);
+        if (fetchHeld) {
+            if (!stall)
+                ifid.isEmpty = true;
+            recordStage(fetchIdx, cycle, IF);
+            std::cout << "Cycle " << cycle << " - IF: Page walk for PC: " << pc << " (" << fetchCyclesLeft
+                      << " more cycle(s))" << std::endl;
+        }
+        else if (!stall && fetchIdx != -1) {  // pc is relative to textBase
+            ifid.instruction = instructionMemory[fetchIdx];
             ifid.pc = pc;
-            ifid.instructionString = instructionStrings[pc / 4];
+            ifid.instructionString = instructionStrings[fetchIdx];
             ifid.isEmpty = false;
-            int idx = getInstructionIndex(ifid.pc);
-            if (idx != -1)
-                recordStage(idx, cycle, IF);
+            recordStage(fetchIdx, cycle, IF);
             std::cout << "Cycle " << cycle << " - IF: Fetched " << ifid.instructionString << " at PC: " << pc << std::endl;
             pc += 4;
         }
@@ -342,6 +357,7 @@ void ForwardingProcessor::run(int cycles) {
             pc = branchTarget;
             // If we have a branch/jump in ID, we only need to flush IF stage
             ifid.isEmpty = true;
+            fetchCyclesLeft = 0;  // A page walk for the wrong path is dropped
             std::cout << "         Flushing pipeline due to branch/jump" << std::endl;
         }
         if (stall) {
@@ -349,5 +365,172 @@ void ForwardingProcessor::run(int cycles) {
         }
         
         std::cout << "========== Ending Cycle " << cycle << " ==========" << std::endl << std::endl;
+        // A page walk found the page table region full
+        if (mmu && mmu->exhausted) {
+            std::cout << "----------------------> Breaking the simulation" << std::endl;
+            halted = true;
+            return;
+        }
+
+        // A taken backward branch ends a loop iteration; steady-state iterations are skipped
+        if (extrapolateLoops)
+            cycle += loopExtrapolator.endOfCycle(cycle, lastCycle, branchTaken && branchTarget <= idex.pc);
     }
-}
\ No newline at end of file
+}
+
+// Trace-driven timing: the same stage and scoreboard bookkeeping as run(), with
+// values and branch outcomes taken from the trace instead of being computed
+void ForwardingProcessor::runTrace(int cycles, TraceSource& trace) {
+    resetPipeline(cycles);
+    bool clear = false;
+
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        std::cout << "========== Starting Cycle " << cycle << " ==========" << std::endl;
+        bool branchTaken = false;
+        int32_t branchTarget = 0;
+
+        // -------------------- WB Stage --------------------
+        if (!memwb.isEmpty) {
+            std::cout << "Cycle " << cycle << " - WB: Processing " << memwb.instructionString << " at PC: " << memwb.pc << std::endl;
+            recordStage(getInstructionIndex(memwb.pc), cycle, WB);
+            if (criticalPath)
+                criticalPath->commit(cycle, memwb.pc, memwb.instruction);
+            if (intervalSampler)
+                intervalSampler->commit(cycle, memwb.pc, memwb.instruction);
+            if (isEcall(memwb.instruction))
+                syscallPending = false;  // The producer already made the system call
+        }
+
+        // -------------------- MEM Stage --------------------
+        bool memHeld = occupyMemoryStage(traceVector, cycle);
+        if (memHeld) {
+            recordStage(getInstructionIndex(exmem.pc), cycle, MEM);
+            memwb.isEmpty = true;
+        }
+        else if (!exmem.isEmpty) {
+            std::cout << "Cycle " << cycle << " - MEM: Processing " << exmem.instructionString << " at PC: " << exmem.pc << std::endl;
+            recordStage(getInstructionIndex(exmem.pc), cycle, MEM);
+            // Only the timing of a buffered store is known, memory is the functional model's
+            if (storeBuffer && (exmem.instruction & 0x7F) == 0x23)
+                storeBuffer->push(exmem.pc, (exmem.instruction >> 12) & 0x7, exmem.aluResult, exmem.readData2, false);
+            memwb.pc = exmem.pc;
+            memwb.aluResult = exmem.aluResult;
+            memwb.storeData = exmem.readData2;
+            memwb.rd = exmem.rd;
+            memwb.controls = exmem.controls;
+            memwb.instruction = exmem.instruction;
+            memwb.instructionString = exmem.instructionString;
+            memwb.isEmpty = false;
+        }
+        else {
+            memwb.isEmpty = true;
+        }
+
+        // -------------------- EX Stage --------------------
+        if (memHeld) {
+            if (!idex.isEmpty)
+                recordStage(getInstructionIndex(idex.pc), cycle, EX);
+        }
+        else if (!idex.isEmpty && occupyStage(exCyclesLeft, traceVector.executeCycles(idex.instruction))) {
+            recordStage(getInstructionIndex(idex.pc), cycle, EX);
+            exmem.isEmpty = true;
+        }
+        else if (!idex.isEmpty) {
+            std::cout << "Cycle " << cycle << " - EX: Processing " << idex.instructionString << " at PC: " << idex.pc << std::endl;
+            recordStage(getInstructionIndex(idex.pc), cycle, EX);
+            // vl and vtype change in EX, as in run()
+            if (isVectorInstruction(idex.instruction))
+                traceVector.replayConfiguration(idex.instruction, idex.readData2, idex.aluResult);
+            exmem.pc = idex.pc;
+            exmem.aluResult = idex.aluResult;
+            exmem.readData2 = idex.readData2;
+            exmem.rd = idex.rd;
+            exmem.controls = idex.controls;
+            exmem.instruction = idex.instruction;
+            exmem.instructionString = idex.instructionString;
+            exmem.isEmpty = false;
+        }
+        else {
+            exmem.isEmpty = true;
+        }
+
+        exHeld = !idex.isEmpty && (memHeld || exCyclesLeft > 0);
+
+        // -------------------- ID Stage --------------------
+        if (!ifid.isEmpty) {
+            std::cout << "Cycle " << cycle << " - ID: Processing " << ifid.instructionString << " at PC: " << ifid.pc << std::endl;
+            recordStage(getInstructionIndex(ifid.pc), cycle, ID);
+            uint32_t opcode = ifid.instruction & 0x7F;
+            uint32_t rd  = (ifid.instruction >> 7) & 0x1F;
+            uint32_t rs1 = (ifid.instruction >> 15) & 0x1F;
+            uint32_t rs2 = (ifid.instruction >> 20) & 0x1F;
+
+            // Same forwarding bookkeeping as run()
+            bool rs1UsedEX = (!exmem.isEmpty && rs1 == exmem.rd && exmem.controls.regWrite && exmem.rd != 0 && !exmem.controls.memToReg);
+            bool rs1UsedMEM = (!memwb.isEmpty && rs1 == memwb.rd && exmem.controls.memToReg && rs1!=0);
+            bool rs2UsedEX = (!exmem.isEmpty && rs2 == exmem.rd && exmem.controls.regWrite && exmem.rd != 0 && !exmem.controls.memToReg);
+            bool rs2UsedMEM = (!memwb.isEmpty && rs2 == memwb.rd && exmem.controls.memToReg && rs2!=0);
+            clear = ((opcode == 0x67 &&( rs1UsedEX || rs1UsedMEM)) || (opcode == 0x63 && (rs1UsedEX || rs1UsedMEM || rs2UsedEX || rs2UsedMEM)));
+            if (!clear) {
+                if(!exmem.isEmpty && exmem.controls.regWrite && exmem.rd != 0 && !exmem.controls.memToReg)
+                    clearRegisterUsage(exmem.rd);
+                if(!memwb.isEmpty && memwb.controls.memToReg && memwb.rd != 0 && memwb.controls.regWrite)
+                    clearRegisterUsage(memwb.rd);
+            }
+
+            if (!exHeld && !syscallPending && !detect_hazard(false, opcode, rs1, rs2)) {
+                if (!issueFromTrace(trace, branchTaken, branchTarget))
+                    return;
+                if (idex.controls.regWrite && rd != 0)
+                    addRegisterUsage(rd);
+                if (opcode == 0x6F && rd != 0)
+                    clearRegisterUsage(rd);
+                syscallPending = isEcall(ifid.instruction);
+            }
+            else {
+                stall = true;
+                if (!exHeld)
+                    idex.isEmpty = true;
+                std::cout << "         Hazard detected: Stalling pipeline." << std::endl;
+            }
+        }
+        else {
+            if (!exHeld)
+                idex.isEmpty = true;
+        }
+
+        if (clear) {
+            if(!exmem.isEmpty && exmem.controls.regWrite && exmem.rd != 0 && !exmem.controls.memToReg)
+                clearRegisterUsage(exmem.rd);
+            if(!memwb.isEmpty && memwb.controls.memToReg && memwb.rd != 0 && memwb.controls.regWrite)
+                clearRegisterUsage(memwb.rd);
+        }
+
+        // -------------------- IF Stage --------------------
+        int fetchIdx = getInstructionIndex(pc);
+        if (!stall && fetchIdx != -1) {
+            ifid.instruction = instructionMemory[fetchIdx];
+            ifid.pc = pc;
+            ifid.instructionString = instructionStrings[fetchIdx];
+            ifid.isEmpty = false;
+            recordStage(fetchIdx, cycle, IF);
+            std::cout << "Cycle " << cycle << " - IF: Fetched " << ifid.instructionString << " at PC: " << pc << std::endl;
+            pc += 4;
+        }
+        else if (stall) {
+            recordStage(fetchIdx, cycle, IF);
+        }
+        else {
+            ifid.isEmpty = true;
+        }
+
+        // -------------------- End-of-Cycle Processing --------------------
+        if (branchTaken) {
+            pc = branchTarget;
+            ifid.isEmpty = true;
+        }
+        stall = false;
+
+        std::cout << "========== Ending Cycle " << cycle << " ==========" << std::endl << std::endl;
+    }
+}
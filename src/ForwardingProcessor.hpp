@@ -11,9 +11,15 @@ public:
     ForwardingProcessor();
     ~ForwardingProcessor();
     
-    // Override the run method to implement forwarding
-    // Make sure this exactly matches the base class signature
-    virtual void run(int cycles) override;
+    // Override the cycle loop to implement forwarding
+    // Make sure these exactly match the base class signatures
+    virtual void beginRun(int cycles) override;
+    virtual void runCycles(int firstCycle, int lastCycle) override;
+    // Trace-driven timing with the forwarding hazard rules
+    virtual void runTrace(int cycles, TraceSource& trace) override;
+
+private:
+    bool clear;  // A branch/JALR in ID read a forwarded register, carried into the next cycle
 };
 
 #endif // FORWARDING_PROCESSOR_HPP
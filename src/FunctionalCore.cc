@@ -0,0 +1,163 @@
+#include "FunctionalCore.hpp"
+#include "Processor.hpp"
+
+FunctionalCore::FunctionalCore(NoForwardingProcessor& cpu) : executed(0), keepUndo(false), cpu(cpu), vectorSaved(false) {
+}
+
+StepStatus FunctionalCore::step(int32_t& pc, RetiredInstruction& retired) {
+    if (cpu.syscalls.exited)
+        return STEP_EXIT;
+    int idx = cpu.getInstructionIndex(pc);
+    if (idx == -1)
+        return STEP_OUT_OF_TEXT;
+
+    uint32_t instruction = cpu.instructionMemory[idx];
+    uint32_t opcode = instruction & 0x7F;
+    switch (opcode) {
+        case 0x33: case 0x13: case 0x03: case 0x23: case 0x63:
+        case 0x6F: case 0x67: case 0x37: case 0x17:
+            break;
+        case 0x2F:
+            if (isAtomicInstruction(instruction))
+                break;
+            return STEP_ILLEGAL;
+        case 0x57: case 0x07: case 0x27:
+            if (isVectorInstruction(instruction) && cpu.vector.accepts(instruction))
+                break;
+            return STEP_ILLEGAL;
+        case 0x73:
+            if (isEcall(instruction))
+                break;
+            return STEP_ILLEGAL;
+        default:
+            return STEP_ILLEGAL;
+    }
+
+    uint32_t rd  = (instruction >> 7) & 0x1F;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+    uint32_t rs1 = (instruction >> 15) & 0x1F;
+    uint32_t rs2 = (instruction >> 20) & 0x1F;
+    int32_t imm = cpu.extractImmediate(instruction, opcode);
+    bool isControl = (opcode == 0x63 || opcode == 0x6F || opcode == 0x67);
+    bool isVector = isVectorInstruction(instruction);
+    if (isControl && imm % 4 != 0)
+        return STEP_BAD_OFFSET;
+
+    ControlSignals controls = cpu.decodeControlSignals(instruction);
+    retired.pc = pc;
+    retired.instruction = instruction;
+    retired.rs1Value = cpu.registers.read(rs1);
+    retired.rs2Value = cpu.registers.read(rs2);
+    retired.loadData = 0;
+    retired.nextPc = pc + 4;
+    retired.taken = false;
+
+    // ID: branches and jumps resolve here
+    if (opcode == 0x63) {
+        bool taken = false;
+        switch (funct3) {
+            case 0x0: taken = retired.rs1Value == retired.rs2Value; break;
+            case 0x1: taken = retired.rs1Value != retired.rs2Value; break;
+            case 0x4: taken = retired.rs1Value < retired.rs2Value; break;
+            case 0x5: taken = retired.rs1Value >= retired.rs2Value; break;
+            case 0x6: taken = static_cast<uint32_t>(retired.rs1Value) < static_cast<uint32_t>(retired.rs2Value); break;
+            case 0x7: taken = static_cast<uint32_t>(retired.rs1Value) >= static_cast<uint32_t>(retired.rs2Value); break;
+            default: break;
+        }
+        if (taken)
+            retired.nextPc = pc + imm;
+        retired.taken = taken;
+    } else if (opcode == 0x6F) {
+        retired.nextPc = pc + imm;
+        retired.taken = true;
+    } else if (opcode == 0x67) {
+        retired.nextPc = retired.rs1Value + imm;
+        retired.taken = true;
+    }
+
+    // EX
+    if (opcode == 0x17)
+        retired.result = pc + imm;
+    else if (opcode == 0x37)
+        retired.result = imm;
+    else if (opcode == 0x67 || opcode == 0x6F)
+        retired.result = pc + 4;
+    else if (isVector) {
+        if (keepUndo && !vectorSaved) {
+            savedVector = cpu.vector;
+            vectorSaved = true;
+        }
+        retired.result = cpu.vector.execute(instruction, retired.rs1Value, retired.rs2Value);
+    } else
+        retired.result = cpu.executeALU(retired.rs1Value, controls.aluSrc ? imm : retired.rs2Value, controls.aluOp);
+
+    // MEM
+    uint32_t address = static_cast<uint32_t>(retired.result);
+    if (isVector) {
+        if (isVectorMemoryAccess(instruction)) {
+            if (keepUndo && opcode == 0x27) {
+                uint32_t bytes = VectorUnit::memoryElementBytes(instruction);
+                for (uint32_t i = 0; i < cpu.vector.memoryElements(); i++)
+                    saveMemory(VectorUnit::elementAddress(instruction, address, retired.rs2Value, i), bytes / 2);
+            }
+            cpu.vector.transfer(instruction, address, retired.rs2Value, cpu.dataMemory);
+        }
+    } else if (opcode == 0x2F) {
+        if (keepUndo && (instruction >> 27) != AMO_LR)
+            saveMemory(address, 0x2);
+        bool stored = false;
+        retired.loadData = executeAtomic(cpu.dataMemory, cpu.reservation, instruction, address, retired.rs2Value, stored);
+    } else {
+        if (controls.memRead)
+            retired.loadData = cpu.dataMemory.load(funct3, address);
+        if (controls.memWrite) {
+            if (keepUndo)
+                saveMemory(address, funct3);
+            cpu.dataMemory.store(funct3, address, retired.rs2Value);
+        }
+    }
+
+    // WB
+    if (controls.regWrite && rd != 0)
+        cpu.registers.write(rd, controls.memToReg ? retired.loadData : retired.result);
+    if (isEcall(instruction))
+        cpu.syscalls.handle(cpu, executed);
+
+    pc = retired.nextPc;
+    executed++;
+    return STEP_OK;
+}
+
+void FunctionalCore::saveMemory(uint32_t address, uint32_t funct3) {
+    MemoryUndo undo;
+    undo.address = address;
+    undo.funct3 = funct3;
+    undo.oldValue = (funct3 == 0x0) ? cpu.dataMemory.readByte(address)
+                  : (funct3 == 0x1) ? cpu.dataMemory.readHalfWord(address)
+                                    : cpu.dataMemory.readWord(address);
+    memoryUndo.push_back(undo);
+}
+
+void FunctionalCore::checkpoint() {
+    savedRegisters = cpu.registers;
+    savedReservation = cpu.reservation;
+    memoryUndo.clear();
+    vectorSaved = false;
+}
+
+void FunctionalCore::rollback() {
+    for (size_t i = memoryUndo.size(); i-- > 0;) {
+        const MemoryUndo& undo = memoryUndo[i];
+        switch (undo.funct3) {
+            case 0x0: cpu.dataMemory.writeByte(undo.address, undo.oldValue & 0xFF); break;
+            case 0x1: cpu.dataMemory.writeHalfWord(undo.address, undo.oldValue & 0xFFFF); break;
+            default:  cpu.dataMemory.writeWord(undo.address, undo.oldValue); break;
+        }
+    }
+    memoryUndo.clear();
+    cpu.registers = savedRegisters;
+    cpu.reservation = savedReservation;
+    if (vectorSaved)
+        cpu.vector = savedVector;
+    vectorSaved = false;
+}
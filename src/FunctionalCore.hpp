@@ -0,0 +1,65 @@
+#pragma once
+#include "Register.hpp"
+#include "Interconnect.hpp"
+#include "VectorUnit.hpp"
+#include <cstdint>
+#include <vector>
+
+class NoForwardingProcessor;
+
+// One executed instruction, with the values the pipeline latches would carry for it
+struct RetiredInstruction {
+    int32_t pc;
+    uint32_t instruction;
+    int32_t rs1Value;   // Register values read in ID
+    int32_t rs2Value;
+    int32_t result;     // EX result: ALU value, effective address, link address, LUI/AUIPC value
+    int32_t loadData;   // Value read in MEM by loads
+    int32_t nextPc;
+    bool taken;         // Branch or jump redirected fetch (always set for JAL/JALR)
+};
+
+enum StepStatus {
+    STEP_OK = 0,
+    STEP_OUT_OF_TEXT,     // pc is outside instructionMemory
+    STEP_ILLEGAL,         // Unknown opcode or vector instruction vtype does not allow, the pipeline stops the simulation here
+    STEP_BAD_OFFSET,      // Branch/jump immediate not a multiple of 4, also fatal in the pipeline
+    STEP_EXIT             // The program made the exit system call, execution ends normally
+};
+
+// Instruction-at-a-time interpreter over the processor's architectural state
+// (registers, dataMemory, instructionMemory). It shares extractImmediate,
+// decodeControlSignals and executeALU with the pipeline, so results match the
+// pipelined execution exactly; only the timing is missing.
+class FunctionalCore {
+public:
+    explicit FunctionalCore(NoForwardingProcessor& cpu);
+
+    // Executes the instruction at 'pc' and advances it. On failure nothing is changed.
+    // ECALL makes its system call (see Syscalls.hpp) right away.
+    StepStatus step(int32_t& pc, RetiredInstruction& retired);
+
+    uint64_t executed;  // Instructions stepped, the clock of the system calls
+
+    // Undo support: while enabled, every register file and memory change since the
+    // last checkpoint() can be reverted with rollback()
+    void checkpoint();
+    void rollback();
+    bool keepUndo;
+
+private:
+    struct MemoryUndo {
+        uint32_t address;
+        uint32_t funct3;   // Store width as encoded in the store
+        int32_t oldValue;
+    };
+
+    NoForwardingProcessor& cpu;
+    RegisterFile savedRegisters;
+    Reservation savedReservation;
+    std::vector<MemoryUndo> memoryUndo;
+    VectorUnit savedVector;  // Copied at the first vector instruction after checkpoint()
+    bool vectorSaved;
+
+    void saveMemory(uint32_t address, uint32_t funct3);  // Undo record for a store of width funct3
+};
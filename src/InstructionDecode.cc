@@ -0,0 +1,35 @@
+#include "InstructionDecode.hpp"
+#include "VectorUnit.hpp"
+
+int sourceRegisters(uint32_t instruction, uint32_t sources[2]) {
+    if (isVectorInstruction(instruction))
+        return vectorScalarSources(instruction, sources);
+    uint32_t rs1 = (instruction >> 15) & 0x1F;
+    uint32_t rs2 = (instruction >> 20) & 0x1F;
+    int count = 0;
+    switch (instruction & 0x7F) {
+        case 0x33:  // R-type
+        case 0x23:  // STORE
+        case 0x63:  // BRANCH
+        case 0x2F:  // AMO
+            sources[count++] = rs1;
+            sources[count++] = rs2;
+            break;
+        case 0x13:  // I-type ALU
+        case 0x03:  // LOAD
+        case 0x67:  // JALR
+            sources[count++] = rs1;
+            break;
+        default:
+            break;
+    }
+    return count;
+}
+
+bool writesRegister(uint32_t instruction) {
+    uint32_t opcode = instruction & 0x7F;
+    uint32_t rd = (instruction >> 7) & 0x1F;
+    return rd != 0 && (opcode == 0x33 || opcode == 0x13 || opcode == 0x03 || opcode == 0x67 ||
+                       opcode == 0x6F || opcode == 0x37 || opcode == 0x17 || opcode == 0x2F ||
+                       vectorWritesScalar(instruction));
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+
+// Register and control-flow fields of an instruction, shared by the analyses
+// and the SMT pipeline.
+
+// Branch, JAL or JALR
+inline bool isControlTransfer(uint32_t opcode) {
+    return opcode == 0x63 || opcode == 0x67 || opcode == 0x6F;
+}
+
+// Scalar registers the instruction reads, as detect_hazard() checks them;
+// returns how many were written to 'sources'
+int sourceRegisters(uint32_t instruction, uint32_t sources[2]);
+
+// Whether the instruction writes a scalar register other than x0
+bool writesRegister(uint32_t instruction);
@@ -0,0 +1,194 @@
+#include "InstructionTrace.hpp"
+#include "Processor.hpp"
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char TRACE_MAGIC[8] = {'R', 'V', 'T', 'R', 'A', 'C', 'E', '1'};
+const size_t TRACE_HEADER_SIZE = 16;
+const size_t TRACE_RECORD_SIZE = 32;
+const size_t RING_CAPACITY = 1 << 14;
+
+void putWord(char* out, uint32_t value) {
+    out[0] = static_cast<char>(value & 0xFF);
+    out[1] = static_cast<char>((value >> 8) & 0xFF);
+    out[2] = static_cast<char>((value >> 16) & 0xFF);
+    out[3] = static_cast<char>((value >> 24) & 0xFF);
+}
+
+uint32_t getWord(const uint8_t* in) {
+    return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+           (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+} // namespace
+
+// ---------------------- Trace Files ----------------------
+TraceFileWriter::TraceFileWriter() {
+}
+
+TraceFileWriter::~TraceFileWriter() {
+    close();
+}
+
+bool TraceFileWriter::open(const std::string& filename) {
+    out.open(filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: Unable to open trace file " << filename << " for writing" << std::endl;
+        return false;
+    }
+    char header[TRACE_HEADER_SIZE] = {};
+    memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    putWord(header + 8, TRACE_RECORD_SIZE);
+    out.write(header, sizeof(header));
+    buffer.reserve(TRACE_RECORD_SIZE * 4096);
+    return true;
+}
+
+void TraceFileWriter::appendRecord(const RetiredInstruction& retired, uint32_t status) {
+    char record[TRACE_RECORD_SIZE];
+    putWord(record, static_cast<uint32_t>(retired.pc));
+    putWord(record + 4, retired.instruction);
+    putWord(record + 8, static_cast<uint32_t>(retired.rs1Value));
+    putWord(record + 12, static_cast<uint32_t>(retired.rs2Value));
+    putWord(record + 16, static_cast<uint32_t>(retired.result));
+    putWord(record + 20, static_cast<uint32_t>(retired.loadData));
+    putWord(record + 24, static_cast<uint32_t>(retired.nextPc));
+    putWord(record + 28, (retired.taken ? 1u : 0u) | (status << 8));
+    buffer.insert(buffer.end(), record, record + sizeof(record));
+    if (buffer.size() >= TRACE_RECORD_SIZE * 4096) {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+void TraceFileWriter::write(const RetiredInstruction& retired) {
+    appendRecord(retired, STEP_OK);
+}
+
+void TraceFileWriter::writeEnd(StepStatus status, int32_t pc) {
+    RetiredInstruction end = {};
+    end.pc = pc;
+    appendRecord(end, status);
+}
+
+bool TraceFileWriter::close() {
+    if (!out.is_open())
+        return true;
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+    bool ok = static_cast<bool>(out);
+    out.close();
+    return ok;
+}
+
+bool TraceFileReader::open(const std::string& filename) {
+    if (!file.open(filename))
+        return false;
+    if (file.size() < TRACE_HEADER_SIZE || memcmp(file.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        getWord(file.data() + 8) != TRACE_RECORD_SIZE) {
+        std::cerr << "Error: " << filename << " is not an instruction trace" << std::endl;
+        return false;
+    }
+    offset = TRACE_HEADER_SIZE;
+    return true;
+}
+
+size_t TraceFileReader::recordCount() const {
+    return (file.size() - TRACE_HEADER_SIZE) / TRACE_RECORD_SIZE;
+}
+
+bool TraceFileReader::next(RetiredInstruction& retired) {
+    if (endStatus != STEP_OK || offset + TRACE_RECORD_SIZE > file.size())
+        return false;
+    const uint8_t* record = file.data() + offset;
+    offset += TRACE_RECORD_SIZE;
+    uint32_t flags = getWord(record + 28);
+    StepStatus status = static_cast<StepStatus>((flags >> 8) & 0xFF);
+    if (status != STEP_OK) {
+        endStatus = status;
+        return false;
+    }
+    retired.pc = static_cast<int32_t>(getWord(record));
+    retired.instruction = getWord(record + 4);
+    retired.rs1Value = static_cast<int32_t>(getWord(record + 8));
+    retired.rs2Value = static_cast<int32_t>(getWord(record + 12));
+    retired.result = static_cast<int32_t>(getWord(record + 16));
+    retired.loadData = static_cast<int32_t>(getWord(record + 20));
+    retired.nextPc = static_cast<int32_t>(getWord(record + 24));
+    retired.taken = (flags & 1) != 0;
+    return true;
+}
+
+// ---------------------- Functional Producer ----------------------
+FunctionalTraceSource::FunctionalTraceSource(NoForwardingProcessor& cpu, uint64_t limit, TraceFileWriter* writer) :
+    cpu(cpu),
+    limit(limit),
+    writer(writer),
+    ring(RING_CAPACITY),
+    stopRequested(false),
+    producerDone(false),
+    producedCount(0)
+{
+    producer = std::thread(&FunctionalTraceSource::produce, this);
+}
+
+FunctionalTraceSource::~FunctionalTraceSource() {
+    finish();
+}
+
+void FunctionalTraceSource::produce() {
+    FunctionalCore core(cpu);
+    int32_t pc = cpu.entryPC;
+    Entry entry;
+    for (uint64_t n = 0; n < limit; n++) {
+        // Once the timing pipeline is done only a trace file still needs records
+        bool stopped = stopRequested.load(std::memory_order_relaxed);
+        if (stopped && !writer)
+            break;
+        entry.status = core.step(pc, entry.retired);
+        if (entry.status != STEP_OK) {
+            entry.retired.pc = pc;
+            if (writer)
+                writer->writeEnd(entry.status, pc);
+        } else if (writer) {
+            writer->write(entry.retired);
+        }
+        while (!stopped && !ring.push(entry)) {
+            std::this_thread::yield();
+            stopped = stopRequested.load(std::memory_order_relaxed);
+        }
+        if (entry.status != STEP_OK)
+            break;
+        producedCount.store(n + 1, std::memory_order_release);
+    }
+    producerDone.store(true, std::memory_order_release);
+}
+
+bool FunctionalTraceSource::next(RetiredInstruction& retired) {
+    if (endStatus != STEP_OK)
+        return false;
+    Entry entry;
+    while (!ring.pop(entry)) {
+        if (producerDone.load(std::memory_order_acquire)) {
+            // The producer may have pushed its last entry just before finishing
+            if (ring.pop(entry))
+                break;
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    if (entry.status != STEP_OK) {
+        endStatus = entry.status;
+        return false;
+    }
+    retired = entry.retired;
+    return true;
+}
+
+void FunctionalTraceSource::finish() {
+    stopRequested.store(true, std::memory_order_relaxed);
+    if (producer.joinable())
+        producer.join();
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "FunctionalCore.hpp"
+#include "MappedFile.hpp"
+#include "SpscRing.hpp"
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class NoForwardingProcessor;
+
+// Retired-instruction stream consumed by the trace-driven timing pipeline
+// (NoForwardingProcessor::runTrace). Records come in program order, one per
+// issued instruction.
+class TraceSource {
+public:
+    TraceSource() : endStatus(STEP_OK) {}
+    virtual ~TraceSource() {}
+
+    // Next retired instruction; false at the end of the trace. endStatus then
+    // says why: STEP_ILLEGAL/STEP_BAD_OFFSET stop the pipeline the same way the
+    // detailed run does, STEP_OUT_OF_TEXT ends execution normally and STEP_OK
+    // means the trace was cut short (instruction limit or end of the file).
+    virtual bool next(RetiredInstruction& retired) = 0;
+    StepStatus endStatus;
+};
+
+// Saved traces: a 16 byte header ("RVTRACE1", record size, reserved) followed
+// by fixed 32 byte little-endian records. The last record of a trace that ended
+// in an error has a non-zero status and no instruction.
+class TraceFileWriter {
+public:
+    TraceFileWriter();
+    ~TraceFileWriter();
+    bool open(const std::string& filename);
+    void write(const RetiredInstruction& retired);
+    void writeEnd(StepStatus status, int32_t pc);
+    bool close();
+    bool isOpen() const { return out.is_open(); }
+
+private:
+    std::ofstream out;
+    std::vector<char> buffer;
+    void appendRecord(const RetiredInstruction& retired, uint32_t status);
+};
+
+class TraceFileReader : public TraceSource {
+public:
+    bool open(const std::string& filename);
+    bool next(RetiredInstruction& retired) override;
+    size_t recordCount() const;
+
+private:
+    MappedFile file;
+    size_t offset;
+};
+
+// Functional-first execution: a producer thread runs the FunctionalCore ahead
+// of the timing pipeline and streams records through a lock-free SPSC ring.
+// The producer owns the processor's registers and dataMemory until the source
+// is destroyed, so the timing pipeline must not touch them.
+class FunctionalTraceSource : public TraceSource {
+public:
+    // Executes at most 'limit' instructions; with a writer every executed
+    // record is also saved, even the ones the timing pipeline never reaches
+    FunctionalTraceSource(NoForwardingProcessor& cpu, uint64_t limit, TraceFileWriter* writer);
+    ~FunctionalTraceSource();
+    bool next(RetiredInstruction& retired) override;
+
+    // Waits for the producer; with a writer the whole trace is finished first
+    void finish();
+    uint64_t produced() const { return producedCount.load(std::memory_order_acquire); }
+
+private:
+    struct Entry {
+        RetiredInstruction retired;
+        StepStatus status;  // STEP_OK for an instruction, anything else ends the stream
+    };
+
+    NoForwardingProcessor& cpu;
+    uint64_t limit;
+    TraceFileWriter* writer;
+    SpscRing<Entry> ring;
+    std::atomic<bool> stopRequested;
+    std::atomic<bool> producerDone;
+    std::atomic<uint64_t> producedCount;
+    std::thread producer;
+
+    void produce();
+};
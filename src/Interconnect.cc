@@ -0,0 +1,110 @@
+#include "Interconnect.hpp"
+#include "VectorUnit.hpp"
+#include <algorithm>
+
+int32_t executeAtomic(Memory& memory, Reservation& reservation, uint32_t instruction, uint32_t address,
+                      int32_t operand, bool& stored) {
+    uint32_t op = instruction >> 27;
+    stored = false;
+    if (op == AMO_LR) {
+        reservation.valid = true;
+        reservation.address = address;
+        return memory.readWord(address);
+    }
+    if (op == AMO_SC) {
+        bool success = reservation.valid && reservation.address == address;
+        reservation.valid = false;
+        if (!success)
+            return 1;
+        memory.writeWord(address, operand);
+        stored = true;
+        return 0;
+    }
+
+    int32_t old = memory.readWord(address);
+    int32_t value = operand;
+    switch (op) {
+        case AMO_ADD:  value = static_cast<int32_t>(static_cast<uint32_t>(old) + static_cast<uint32_t>(operand)); break;
+        case AMO_XOR:  value = old ^ operand; break;
+        case AMO_OR:   value = old | operand; break;
+        case AMO_AND:  value = old & operand; break;
+        case AMO_MIN:  value = std::min(old, operand); break;
+        case AMO_MAX:  value = std::max(old, operand); break;
+        case AMO_MINU: value = static_cast<int32_t>(std::min(static_cast<uint32_t>(old), static_cast<uint32_t>(operand))); break;
+        case AMO_MAXU: value = static_cast<int32_t>(std::max(static_cast<uint32_t>(old), static_cast<uint32_t>(operand))); break;
+        default:       break;  // AMOSWAP
+    }
+    memory.writeWord(address, value);
+    stored = true;
+    return old;
+}
+
+Interconnect::Interconnect(Memory& memory, int harts)
+    : stats(static_cast<size_t>(harts)), memory(memory), reservations(static_cast<size_t>(harts)) {
+}
+
+void Interconnect::read(int hart, uint32_t address) {
+    std::unordered_map<uint32_t, uint64_t>::iterator line = sharers.find(address >> LINE_BITS);
+    uint64_t mask = 1ull << hart;
+    if (line != sharers.end() && !(line->second & mask)) {
+        stats[hart].transfers++;
+        line->second |= mask;
+    }
+}
+
+void Interconnect::write(int hart, uint32_t address) {
+    uint64_t mask = 1ull << hart;
+    uint64_t& holders = sharers[address >> LINE_BITS];
+    if (holders & ~mask)
+        stats[hart].transfers++;
+    holders = mask;
+    // A write to the word breaks every other hart's reservation on it
+    uint32_t word = address & ~3u;
+    for (size_t other = 0; other < reservations.size(); other++) {
+        if (static_cast<int>(other) != hart && reservations[other].valid && (reservations[other].address & ~3u) == word)
+            reservations[other].valid = false;
+    }
+}
+
+int32_t Interconnect::load(int hart, uint32_t funct3, uint32_t address) {
+    std::lock_guard<std::mutex> guard(lock);
+    stats[hart].loads++;
+    read(hart, address);
+    return memory.load(funct3, address);
+}
+
+void Interconnect::store(int hart, uint32_t funct3, uint32_t address, int32_t value) {
+    std::lock_guard<std::mutex> guard(lock);
+    stats[hart].stores++;
+    write(hart, address);
+    memory.store(funct3, address, value);
+}
+
+int32_t Interconnect::atomic(int hart, uint32_t instruction, uint32_t address, int32_t operand) {
+    std::lock_guard<std::mutex> guard(lock);
+    stats[hart].atomics++;
+    read(hart, address);
+    bool stored = false;
+    int32_t result = executeAtomic(memory, reservations[static_cast<size_t>(hart)], instruction, address, operand, stored);
+    if (stored)
+        write(hart, address);
+    else if ((instruction >> 27) == AMO_SC)
+        stats[hart].failedStoreConditionals++;
+    return result;
+}
+
+void Interconnect::vectorTransfer(int hart, VectorUnit& unit, uint32_t instruction, uint32_t address, int32_t stride) {
+    std::lock_guard<std::mutex> guard(lock);
+    bool store = (instruction & 0x7F) == 0x27;
+    for (uint32_t i = 0; i < unit.memoryElements(); i++) {
+        uint32_t elementAddress = VectorUnit::elementAddress(instruction, address, stride, i);
+        if (store) {
+            stats[hart].stores++;
+            write(hart, elementAddress);
+        } else {
+            stats[hart].loads++;
+            read(hart, elementAddress);
+        }
+    }
+    unit.transfer(instruction, address, stride, memory);
+}
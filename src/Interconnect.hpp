@@ -0,0 +1,84 @@
+#pragma once
+#include "Memory.hpp"
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class VectorUnit;
+
+// RV32A word instructions (opcode 0x2F, funct3 010). aq/rl are accepted and
+// ignored: every hart is in order and memory is sequentially consistent.
+enum AtomicOp {
+    AMO_ADD = 0x00, AMO_SWAP = 0x01, AMO_LR = 0x02, AMO_SC = 0x03, AMO_XOR = 0x04, AMO_OR = 0x08,
+    AMO_AND = 0x0C, AMO_MIN = 0x10, AMO_MAX = 0x14, AMO_MINU = 0x18, AMO_MAXU = 0x1C
+};
+
+inline bool isAtomicInstruction(uint32_t instruction) {
+    if ((instruction & 0x7F) != 0x2F || ((instruction >> 12) & 0x7) != 0x2)
+        return false;
+    switch (instruction >> 27) {
+        case AMO_ADD: case AMO_SWAP: case AMO_LR: case AMO_SC: case AMO_XOR: case AMO_OR:
+        case AMO_AND: case AMO_MIN: case AMO_MAX: case AMO_MINU: case AMO_MAXU:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Reservation set of one hart, a single word
+struct Reservation {
+    bool valid;
+    uint32_t address;
+
+    Reservation() : valid(false), address(0) {}
+};
+
+// Executes an atomic instruction on 'memory' and returns the value for rd: the
+// old word, or 0/1 for a successful/failed SC. 'operand' is rs2. 'stored' tells
+// whether memory was written.
+int32_t executeAtomic(Memory& memory, Reservation& reservation, uint32_t instruction, uint32_t address,
+                      int32_t operand, bool& stored);
+
+// The bus between the harts of a multi-hart system and their shared memory.
+//
+// Every access is serialized by one lock, so loads, stores and atomics are
+// each indivisible and the harts see one global order of memory operations.
+// A store or successful SC/AMO breaks the LR reservations other harts hold on
+// the word. Traffic is counted per hart, with a line-granular coherence model:
+// reading a 64-byte line another hart has written since this hart last saw it,
+// or writing a line other harts hold, is one transfer.
+class Interconnect {
+public:
+    static const int MAX_HARTS = 64;  // Sharers are kept in a 64-bit mask
+
+    Interconnect(Memory& memory, int harts);
+
+    int32_t load(int hart, uint32_t funct3, uint32_t address);
+    void store(int hart, uint32_t funct3, uint32_t address, int32_t value);
+    int32_t atomic(int hart, uint32_t instruction, uint32_t address, int32_t operand);
+    // A vector load or store of the hart's 'unit' (see VectorUnit::transfer), one access per element
+    void vectorTransfer(int hart, VectorUnit& unit, uint32_t instruction, uint32_t address, int32_t stride);
+
+    struct HartStats {
+        uint64_t loads;
+        uint64_t stores;
+        uint64_t atomics;
+        uint64_t failedStoreConditionals;
+        uint64_t transfers;
+
+        HartStats() : loads(0), stores(0), atomics(0), failedStoreConditionals(0), transfers(0) {}
+    };
+    std::vector<HartStats> stats;  // Read once the harts have stopped
+
+private:
+    static const uint32_t LINE_BITS = 6;
+
+    Memory& memory;
+    std::mutex lock;
+    std::vector<Reservation> reservations;
+    std::unordered_map<uint32_t, uint64_t> sharers;  // Line -> harts holding it, for lines written at least once
+
+    void read(int hart, uint32_t address);
+    void write(int hart, uint32_t address);
+};
@@ -0,0 +1,195 @@
+#include "IntervalSampler.hpp"
+#include "InstructionDecode.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+const int64_t NO_WRITER = INT64_MIN / 2;
+
+} // namespace
+
+IntervalSampler::IntervalSampler()
+    : keepHistory(false), intervals(0), instructions(0), statsOut(nullptr), bbvOut(nullptr), intervalLength(0), ok(true),
+      started(false), lastIssue(0), lastPc(0), lastOpcode(0), replaying(false), intervalStart(0),
+      intervalStartCycle(0), intervalInstructions(0), loadStalls(0), dataStalls(0), otherStalls(0), flushes(0),
+      extrapolated(0), currentBlock(0) {
+    for (int reg = 0; reg < 32; reg++) {
+        regWriterIssue[reg] = NO_WRITER;
+        regWriterLoad[reg] = false;
+    }
+}
+
+IntervalSampler::~IntervalSampler() {
+    if (statsOut && statsOut != stdout)
+        std::fclose(statsOut);
+    if (bbvOut)
+        std::fclose(bbvOut);
+}
+
+bool IntervalSampler::open(const std::string& statsFile, const std::string& bbvFile, uint64_t length) {
+    intervalLength = length;
+    if (!statsFile.empty()) {
+        statsOut = (statsFile == "-") ? stdout : std::fopen(statsFile.c_str(), "w");
+        if (!statsOut) {
+            std::cerr << "Error: Unable to open " << statsFile << " for writing" << std::endl;
+            return false;
+        }
+        std::fprintf(statsOut, "interval,first_instruction,instructions,first_cycle,cycles,cpi,load_use_stalls,"
+                               "data_stalls,other_stalls,branch_flushes,extrapolated_instructions\n");
+    }
+    if (!bbvFile.empty()) {
+        bbvOut = std::fopen(bbvFile.c_str(), "w");
+        if (!bbvOut) {
+            std::cerr << "Error: Unable to open " << bbvFile << " for writing" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void IntervalSampler::commit(int cycle, int32_t pc, uint32_t instruction) {
+    count(cycle, pc, instruction);
+}
+
+void IntervalSampler::count(int64_t cycle, int32_t pc, uint32_t instruction) {
+    int64_t issue = cycle - DRAIN_CYCLES;
+    bool newBlock = !started || isControlTransfer(lastOpcode) || pc != lastPc + 4;
+    if (started) {
+        int flush = (isControlTransfer(lastOpcode) && (lastOpcode != 0x63 || pc != lastPc + 4)) ? 1 : 0;
+        flushes += static_cast<uint64_t>(flush);
+        int64_t stall = std::max<int64_t>(issue - lastIssue - flush - 1, 0);
+        if (stall > 0) {
+            // Charged to the youngest source producer still in flight
+            uint32_t sources[2];
+            int sourceCount = sourceRegisters(instruction, sources);
+            int64_t producerIssue = NO_WRITER;
+            bool producerLoad = false;
+            for (int i = 0; i < sourceCount; i++) {
+                uint32_t reg = sources[i];
+                if (reg == 0 || issue - regWriterIssue[reg] > MAX_PRODUCER_LATENCY)
+                    continue;
+                if (regWriterIssue[reg] > producerIssue) {
+                    producerIssue = regWriterIssue[reg];
+                    producerLoad = regWriterLoad[reg];
+                }
+            }
+            if (producerIssue == NO_WRITER)
+                otherStalls += static_cast<uint64_t>(stall);
+            else
+                (producerLoad ? loadStalls : dataStalls) += static_cast<uint64_t>(stall);
+        }
+    }
+    started = true;
+    lastIssue = issue;
+    lastPc = pc;
+    lastOpcode = instruction & 0x7F;
+    if (writesRegister(instruction)) {
+        uint32_t rd = (instruction >> 7) & 0x1F;
+        regWriterIssue[rd] = issue;
+        regWriterLoad[rd] = (lastOpcode == 0x03 || lastOpcode == 0x2F);
+    }
+
+    if (bbvOut) {
+        if (newBlock) {
+            std::pair<std::unordered_map<int32_t, uint32_t>::iterator, bool> inserted =
+                blockIds.emplace(pc, static_cast<uint32_t>(blockIds.size()));
+            currentBlock = inserted.first->second;
+            if (inserted.second)
+                blockCounts.push_back(0);
+        }
+        if (blockCounts[currentBlock]++ == 0)
+            touchedBlocks.push_back(currentBlock);
+    }
+
+    if (keepHistory) {
+        history.push_back(Commit{cycle, pc, instruction});
+        if (history.size() > MAX_HISTORY)
+            history.pop_front();
+    }
+
+    instructions++;
+    intervalInstructions++;
+    if (replaying)
+        extrapolated++;
+    if (intervalInstructions == intervalLength)
+        writeInterval(cycle);
+}
+
+void IntervalSampler::repeat(int cycle, int iterationCycles, int iterations) {
+    int64_t windowStart = static_cast<int64_t>(cycle) - iterationCycles;
+    std::deque<Commit>::iterator first = history.end();
+    while (first != history.begin() && (first - 1)->cycle > windowStart)
+        --first;
+    std::vector<Commit> window(first, history.end());
+
+    // The skipped cycles commit the same instructions with the same timing
+    replaying = true;
+    for (int i = 1; i <= iterations; i++) {
+        int64_t offset = static_cast<int64_t>(i) * iterationCycles;
+        for (const Commit& repeated : window)
+            count(repeated.cycle + offset, repeated.pc, repeated.instruction);
+    }
+    replaying = false;
+    if (window.empty()) {
+        // Nothing committed in an iteration: only time passes
+        int64_t skipped = static_cast<int64_t>(iterations) * iterationCycles;
+        lastIssue += skipped;
+        for (int64_t& writer : regWriterIssue)
+            writer += skipped;
+    }
+}
+
+void IntervalSampler::writeInterval(int64_t endCycle) {
+    int64_t cycles = endCycle - intervalStartCycle + 1;
+    if (statsOut) {
+        int written = std::fprintf(statsOut, "%llu,%llu,%llu,%lld,%lld,%.3f,%llu,%llu,%llu,%llu,%llu\n",
+                                   static_cast<unsigned long long>(intervals),
+                                   static_cast<unsigned long long>(intervalStart),
+                                   static_cast<unsigned long long>(intervalInstructions),
+                                   static_cast<long long>(intervalStartCycle), static_cast<long long>(cycles),
+                                   static_cast<double>(cycles) / static_cast<double>(intervalInstructions),
+                                   static_cast<unsigned long long>(loadStalls),
+                                   static_cast<unsigned long long>(dataStalls),
+                                   static_cast<unsigned long long>(otherStalls),
+                                   static_cast<unsigned long long>(flushes),
+                                   static_cast<unsigned long long>(extrapolated));
+        ok = ok && written > 0;
+    }
+    if (bbvOut) {
+        std::sort(touchedBlocks.begin(), touchedBlocks.end());
+        std::string line = "T";
+        for (uint32_t block : touchedBlocks) {
+            line += ':';
+            line += std::to_string(block + 1);
+            line += ':';
+            line += std::to_string(blockCounts[block]);
+            line += ' ';
+            blockCounts[block] = 0;
+        }
+        line += '\n';
+        touchedBlocks.clear();
+        ok = ok && std::fwrite(line.data(), 1, line.size(), bbvOut) == line.size();
+    }
+    intervals++;
+    intervalStart = instructions;
+    intervalStartCycle = endCycle + 1;
+    intervalInstructions = 0;
+    loadStalls = dataStalls = otherStalls = flushes = extrapolated = 0;
+}
+
+bool IntervalSampler::close(int cycles) {
+    if (intervalInstructions > 0)
+        writeInterval(std::max<int64_t>(cycles - 1, intervalStartCycle));
+    if (statsOut) {
+        ok = (std::fflush(statsOut) == 0) && ok;
+        if (statsOut != stdout)
+            ok = (std::fclose(statsOut) == 0) && ok;
+        statsOut = nullptr;
+    }
+    if (bbvOut) {
+        ok = (std::fclose(bbvOut) == 0) && ok;
+        bbvOut = nullptr;
+    }
+    return ok;
+}
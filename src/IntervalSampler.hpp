@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Interval statistics and basic-block vectors (--interval-stats, --bbv), fed
+// with the commit stream at WB.
+//
+// Every 'intervalLength' committed instructions one CSV row is written with
+// the interval's cycles, CPI, ID stall cycles split by cause and taken
+// branches/jumps (one flush bubble each). Stalls are derived as in
+// CriticalPath.hpp: an instruction committing in cycle W left ID in W - 3, and
+// anything beyond one cycle after its predecessor (plus the flush bubble) was
+// spent stalled, on a load result, on another in-flight result or on neither.
+// Like the critical path, this needs the flat memory and a scalar program.
+//
+// The basic-block vector of the interval goes to the BBV file in the SimPoint
+// format, one line per interval: "T:id:count :id:count ...", where count is the
+// number of instructions the interval executed in block 'id'. Blocks are
+// dynamic, as in valgrind's exp-bbv: one starts at the first instruction, after
+// every branch or jump and wherever the pc is not the previous one + 4. Ids
+// count from 1 in order of first execution.
+class IntervalSampler {
+public:
+    IntervalSampler();
+    ~IntervalSampler();
+
+    // Either filename may be empty; "-" writes the statistics to stdout
+    bool open(const std::string& statsFile, const std::string& bbvFile, uint64_t intervalLength);
+    // Instruction leaving WB in 'cycle'
+    void commit(int cycle, int32_t pc, uint32_t instruction);
+    // The loop extrapolator found the commits of cycles (cycle - iterationCycles, cycle]
+    // to repeat and skipped 'iterations' more of them
+    void repeat(int cycle, int iterationCycles, int iterations);
+    // Writes the last, partial interval of a 'cycles' cycle run and closes the files
+    bool close(int cycles);
+
+    bool keepHistory;         // Keep the recent commits for repeat() (set with --extrapolate)
+    uint64_t intervals;       // Rows written so far
+    uint64_t instructions;    // Committed, extrapolated ones included
+    size_t basicBlocks() const { return blockIds.size(); }
+
+private:
+    struct Commit {
+        int64_t cycle;
+        int32_t pc;
+        uint32_t instruction;
+    };
+
+    static const size_t MAX_HISTORY = 1 << 17;    // Commits kept for repeat(), more than any captured iteration
+    static const int MAX_PRODUCER_LATENCY = 3;    // Issue to WB, the longest a producer holds back ID
+    static const int DRAIN_CYCLES = 3;            // EX, MEM and WB
+
+    std::FILE* statsOut;
+    std::FILE* bbvOut;
+    uint64_t intervalLength;
+    bool ok;
+
+    // Issue state
+    bool started;
+    int64_t lastIssue;
+    int32_t lastPc;
+    uint32_t lastOpcode;
+    int64_t regWriterIssue[32];  // Issue cycle of the last writer of each register
+    bool regWriterLoad[32];
+    std::deque<Commit> history;  // Last commits, for repeat()
+    bool replaying;
+
+    // Current interval
+    uint64_t intervalStart;      // Index of its first instruction
+    int64_t intervalStartCycle;
+    uint64_t intervalInstructions;
+    uint64_t loadStalls;
+    uint64_t dataStalls;
+    uint64_t otherStalls;
+    uint64_t flushes;
+    uint64_t extrapolated;
+
+    // Basic-block vector of the current interval
+    std::unordered_map<int32_t, uint32_t> blockIds;  // Leader pc -> id - 1
+    std::vector<uint64_t> blockCounts;               // By id - 1
+    std::vector<uint32_t> touchedBlocks;
+    uint32_t currentBlock;
+
+    void count(int64_t cycle, int32_t pc, uint32_t instruction);
+    void writeInterval(int64_t endCycle);
+};
@@ -0,0 +1,248 @@
+#include "JitCompiler.hpp"
+#include "Memory.hpp"
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+namespace {
+
+// [rbx + disp32] addressing with the register in bits 3-5
+const uint8_t EAX = 0x83;
+const uint8_t ECX = 0x8B;
+const uint8_t EDX = 0x93;
+const uint8_t ESI = 0xB3;
+const uint8_t EDI = 0xBB;
+
+// Called from generated code: Memory accesses and division, as executeALU and FunctionalCore::step() do them
+int32_t loadByte(Memory* memory, uint32_t address) { return static_cast<int8_t>(memory->readByte(address)); }
+int32_t loadHalf(Memory* memory, uint32_t address) { return memory->readHalfWord(address); }
+int32_t loadWord(Memory* memory, uint32_t address) { return memory->readWord(address); }
+int32_t loadByteUnsigned(Memory* memory, uint32_t address) { return memory->readByte(address); }
+int32_t loadHalfUnsigned(Memory* memory, uint32_t address) { return static_cast<uint16_t>(memory->readHalfWord(address) & 0xFFFF); }
+void storeByte(Memory* memory, uint32_t address, int32_t value) { memory->writeByte(address, value & 0xFF); }
+void storeHalf(Memory* memory, uint32_t address, int32_t value) { memory->writeHalfWord(address, value & 0xFFFF); }
+void storeWord(Memory* memory, uint32_t address, int32_t value) { memory->writeWord(address, value); }
+int32_t divide(int32_t a, int32_t b) { return (b == 0) ? -1 : (a / b); }
+int32_t divideUnsigned(int32_t a, int32_t b) { return (b == 0) ? -1 : (static_cast<uint32_t>(a) / static_cast<uint32_t>(b)); }
+int32_t remainderSigned(int32_t a, int32_t b) { return (b == 0) ? a : (a % b); }
+int32_t remainderUnsigned(int32_t a, int32_t b) { return (b == 0) ? a : (static_cast<uint32_t>(a) % static_cast<uint32_t>(b)); }
+
+} // namespace
+
+JitCompiler::JitCompiler() : compiledBlocks(0), codeBytes(0) {
+}
+
+JitCompiler::~JitCompiler() {
+#if JIT_SUPPORTED
+    for (Buffer& buffer : buffers)
+        munmap(buffer.base, buffer.size);
+#endif
+}
+
+bool JitCompiler::available() {
+    return JIT_SUPPORTED != 0;
+}
+
+void JitCompiler::emit(std::initializer_list<uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+void JitCompiler::emit32(uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void JitCompiler::emit64(uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void JitCompiler::loadRegister(uint8_t modrm, uint8_t index) {
+    emit({0x8B, modrm});  // mov r32, [rbx + disp32]
+    emit32(4u * index);
+}
+
+void JitCompiler::storeResult(uint8_t index) {
+    emit({0x89, EAX});  // mov [rbx + disp32], eax
+    emit32(4u * index);
+}
+
+void JitCompiler::call(const void* function) {
+    emit({0x48, 0xB8});  // mov rax, imm64
+    emit64(reinterpret_cast<uint64_t>(function));
+    emit({0xFF, 0xD0});  // call rax
+}
+
+bool JitCompiler::emitOp(const TranslationCache::Op& op) {
+    uint32_t opcode = op.instruction & 0x7F;
+    uint32_t funct3 = (op.instruction >> 12) & 0x7;
+    switch (opcode) {
+        case 0x37:
+        case 0x17:
+            emit({0xC7, EAX});  // mov dword [rbx + disp32], imm32
+            emit32(4u * op.rd);
+            emit32(static_cast<uint32_t>(op.imm));
+            return true;
+
+        case 0x03: {
+            emit({0x4C, 0x89, 0xE7});  // mov rdi, r12
+            loadRegister(ESI, op.rs1);
+            emit({0x81, 0xC6});        // add esi, imm32
+            emit32(static_cast<uint32_t>(op.imm));
+            const void* function = (funct3 == 0x0) ? reinterpret_cast<const void*>(loadByte)
+                                 : (funct3 == 0x1) ? reinterpret_cast<const void*>(loadHalf)
+                                 : (funct3 == 0x4) ? reinterpret_cast<const void*>(loadByteUnsigned)
+                                 : (funct3 == 0x5) ? reinterpret_cast<const void*>(loadHalfUnsigned)
+                                                   : reinterpret_cast<const void*>(loadWord);
+            call(function);
+            storeResult(op.rd);
+            return true;
+        }
+
+        case 0x23: {
+            emit({0x4C, 0x89, 0xE7});  // mov rdi, r12
+            loadRegister(ESI, op.rs1);
+            emit({0x81, 0xC6});        // add esi, imm32
+            emit32(static_cast<uint32_t>(op.imm));
+            loadRegister(EDX, op.rs2);
+            const void* function = (funct3 == 0x0) ? reinterpret_cast<const void*>(storeByte)
+                                 : (funct3 == 0x1) ? reinterpret_cast<const void*>(storeHalf)
+                                                   : reinterpret_cast<const void*>(storeWord);
+            call(function);
+            return true;
+        }
+
+        case 0x33:
+        case 0x13:
+            break;
+
+        default:  // Atomics stay interpreted
+            return false;
+    }
+
+    // a in eax (edi for calls), b in ecx (esi for calls)
+    bool immediate = (opcode == 0x13);
+    if (op.aluOp >= 14 && op.aluOp <= 17) {
+        loadRegister(EDI, op.rs1);
+        if (immediate) {
+            emit({0xBE});  // mov esi, imm32
+            emit32(static_cast<uint32_t>(op.imm));
+        } else {
+            loadRegister(ESI, op.rs2);
+        }
+        static const void* const DIVISION[4] = {
+            reinterpret_cast<const void*>(divide), reinterpret_cast<const void*>(divideUnsigned),
+            reinterpret_cast<const void*>(remainderSigned), reinterpret_cast<const void*>(remainderUnsigned)};
+        call(DIVISION[op.aluOp - 14]);
+        storeResult(op.rd);
+        return true;
+    }
+
+    loadRegister(EAX, op.rs1);
+    if (immediate) {
+        emit({0xB9});  // mov ecx, imm32
+        emit32(static_cast<uint32_t>(op.imm));
+    } else {
+        loadRegister(ECX, op.rs2);
+    }
+    switch (op.aluOp) {
+        case 0:  emit({0x01, 0xC8}); break;                     // add eax, ecx
+        case 1:  emit({0x29, 0xC8}); break;                     // sub eax, ecx
+        case 2:  emit({0xD3, 0xE0}); break;                     // shl eax, cl (cl & 31 like b & 0x1F)
+        case 3:  emit({0x39, 0xC8, 0x0F, 0x9C, 0xC0, 0x0F, 0xB6, 0xC0}); break;  // cmp; setl al; movzx eax, al
+        case 4:  emit({0x39, 0xC8, 0x0F, 0x92, 0xC0, 0x0F, 0xB6, 0xC0}); break;  // cmp; setb al; movzx eax, al
+        case 5:  emit({0x31, 0xC8}); break;                     // xor eax, ecx
+        case 6:  emit({0xD3, 0xE8}); break;                     // shr eax, cl
+        case 7:  emit({0xD3, 0xF8}); break;                     // sar eax, cl
+        case 8:  emit({0x09, 0xC8}); break;                     // or eax, ecx
+        case 9:  emit({0x21, 0xC8}); break;                     // and eax, ecx
+        case 10: emit({0x0F, 0xAF, 0xC1}); break;               // imul eax, ecx
+        case 11:
+        case 12:
+            // MULHSU as executeALU computes it: b converted to uint64_t keeps its sign
+            // extension, so the upper word is the same as MULH's
+            emit({0x48, 0x63, 0xC0, 0x48, 0x63, 0xC9});         // movsxd rax, eax; movsxd rcx, ecx
+            emit({0x48, 0x0F, 0xAF, 0xC1, 0x48, 0xC1, 0xF8, 0x20});  // imul rax, rcx; sar rax, 32
+            break;
+        case 13:
+            // The 32-bit loads zero the upper halves
+            emit({0x48, 0x0F, 0xAF, 0xC1, 0x48, 0xC1, 0xE8, 0x20});  // imul rax, rcx; shr rax, 32
+            break;
+        default:
+            emit({0x31, 0xC0});                                 // xor eax, eax: executeALU gives 0
+            break;
+    }
+    storeResult(op.rd);
+    return true;
+}
+
+void JitCompiler::emitBranch(const TranslationCache::Op& branch) {
+    uint8_t condition = 0;
+    switch ((branch.instruction >> 12) & 0x7) {
+        case 0x0: condition = 0x94; break;  // sete
+        case 0x1: condition = 0x95; break;  // setne
+        case 0x4: condition = 0x9C; break;  // setl
+        case 0x5: condition = 0x9D; break;  // setge
+        case 0x6: condition = 0x92; break;  // setb
+        case 0x7: condition = 0x93; break;  // setae
+        default: break;
+    }
+    if (condition == 0) {
+        emit({0x31, 0xC0});  // xor eax, eax: never taken
+        return;
+    }
+    loadRegister(EAX, branch.rs1);
+    loadRegister(ECX, branch.rs2);
+    emit({0x39, 0xC8, 0x0F, condition, 0xC0, 0x0F, 0xB6, 0xC0});  // cmp eax, ecx; setcc al; movzx eax, al
+}
+
+TranslationCache::NativeBlock JitCompiler::compile(const TranslationCache::Op* ops, size_t count,
+                                                   const TranslationCache::Op* branch) {
+    if (!available())
+        return nullptr;
+    code.clear();
+    // push rbx; push r12; sub rsp, 8 (calls need rsp 16-byte aligned); mov rbx, rdi; mov r12, rsi
+    emit({0x53, 0x41, 0x54, 0x48, 0x83, 0xEC, 0x08, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4});
+    for (size_t i = 0; i < count; i++) {
+        if (!emitOp(ops[i]))
+            return nullptr;
+    }
+    if (branch)
+        emitBranch(*branch);
+    else
+        emit({0x31, 0xC0});  // xor eax, eax
+    // add rsp, 8; pop r12; pop rbx; ret
+    emit({0x48, 0x83, 0xC4, 0x08, 0x41, 0x5C, 0x5B, 0xC3});
+    return install();
+}
+
+TranslationCache::NativeBlock JitCompiler::install() {
+#if JIT_SUPPORTED
+    if (buffers.empty() || buffers.back().size - buffers.back().used < code.size()) {
+        size_t size = std::max(BUFFER_SIZE, (code.size() + 4095) & ~static_cast<size_t>(4095));
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+            return nullptr;
+        buffers.push_back(Buffer{static_cast<uint8_t*>(base), size, 0});
+    }
+    // Writable while the block is copied in, executable otherwise
+    Buffer& buffer = buffers.back();
+    if (mprotect(buffer.base, buffer.size, PROT_READ | PROT_WRITE) != 0)
+        return nullptr;
+    uint8_t* entry = buffer.base + buffer.used;
+    std::memcpy(entry, code.data(), code.size());
+    buffer.used = std::min(buffer.size, buffer.used + ((code.size() + 15) & ~static_cast<size_t>(15)));
+    if (mprotect(buffer.base, buffer.size, PROT_READ | PROT_EXEC) != 0)
+        return nullptr;
+    compiledBlocks++;
+    codeBytes += code.size();
+    return reinterpret_cast<TranslationCache::NativeBlock>(entry);
+#else
+    return nullptr;
+#endif
+}
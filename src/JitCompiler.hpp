@@ -0,0 +1,54 @@
+#pragma once
+#include "TranslationCache.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// x86-64 code generation for hot translated blocks (--jit).
+//
+// A block body becomes one native function over the TranslationCache register
+// array: guest registers stay in that array (rbx points to it), ALU and
+// M-extension operations are done inline except division, which calls the
+// same C++ expressions as the interpreter, and loads and stores call out to
+// Memory. A conditional branch ending the block is evaluated too and is the
+// return value (1 = taken); jumps are left to the caller.
+//
+// Code is written to mmap'd buffers that are made executable once written.
+// On other hosts, or for a block holding an atomic, compile() gives nullptr and
+// the block stays interpreted.
+class JitCompiler {
+public:
+    JitCompiler();
+    ~JitCompiler();
+
+    static bool available();  // Built for an x86-64 host that can map executable memory
+
+    // 'branch' is the block's conditional branch, or nullptr
+    TranslationCache::NativeBlock compile(const TranslationCache::Op* ops, size_t count, const TranslationCache::Op* branch);
+
+    uint64_t compiledBlocks;
+    uint64_t codeBytes;
+
+private:
+    struct Buffer {
+        uint8_t* base;
+        size_t size;
+        size_t used;
+    };
+
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    std::vector<Buffer> buffers;
+    std::vector<uint8_t> code;  // Block being generated
+
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    // mov <reg>, [rbx + 4 * index] and mov [rbx + 4 * index], eax; 'modrm' selects the register
+    void loadRegister(uint8_t modrm, uint8_t index);
+    void storeResult(uint8_t index);
+    void call(const void* function);
+    bool emitOp(const TranslationCache::Op& op);
+    void emitBranch(const TranslationCache::Op& branch);
+    TranslationCache::NativeBlock install();
+};
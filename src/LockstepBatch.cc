@@ -0,0 +1,517 @@
+#include "LockstepBatch.hpp"
+#include "Processor.hpp"
+#include "SimdKernel.hpp"
+#include <algorithm>
+
+namespace {
+
+typedef LockstepBatch::LaneVector LaneVector;
+typedef uint32_t UnsignedVector __attribute__((vector_size(sizeof(LaneVector)), aligned(16), may_alias));
+
+const uint32_t SINK_REGISTER = 32;
+const uint32_t REGISTER_ROWS = 33;
+
+inline LaneVector splat(int32_t value) {
+    return LaneVector{} + value;
+}
+
+inline LaneVector select(const LaneVector& mask, const LaneVector& a, const LaneVector& b) {
+    return (a & mask) | (b & ~mask);
+}
+
+inline LaneVector minimum(const LaneVector& a, const LaneVector& b) {
+    return select(a < b, a, b);
+}
+
+inline LaneVector minimumUnsigned(const LaneVector& a, const LaneVector& b) {
+    return select(reinterpret_cast<const UnsignedVector&>(a) < reinterpret_cast<const UnsignedVector&>(b), a, b);
+}
+
+// Smallest element, signed or unsigned
+inline int32_t lowest(const LaneVector& v) {
+    int32_t result = v[0];
+    for (size_t i = 1; i < LockstepBatch::VECTOR_LANES; i++)
+        result = std::min(result, v[i]);
+    return result;
+}
+
+inline uint32_t lowestUnsigned(const LaneVector& v) {
+    uint32_t result = static_cast<uint32_t>(v[0]);
+    for (size_t i = 1; i < LockstepBatch::VECTOR_LANES; i++)
+        result = std::min(result, static_cast<uint32_t>(v[i]));
+    return result;
+}
+
+inline bool any(const LaneVector& mask) {
+    for (size_t i = 0; i < LockstepBatch::VECTOR_LANES; i++) {
+        if (mask[i])
+            return true;
+    }
+    return false;
+}
+
+// executeALU's M-extension operations on one lane
+template <uint32_t OP>
+inline int32_t wideAlu(int32_t a, int32_t b) {
+    switch (OP) {
+        case 11: return static_cast<int64_t>(a) * static_cast<int64_t>(b) >> 32;
+        case 12: return static_cast<int64_t>(a) * static_cast<uint64_t>(b) >> 32;
+        case 13: return static_cast<uint64_t>(static_cast<uint32_t>(a)) * static_cast<uint64_t>(static_cast<uint32_t>(b)) >> 32;
+        case 14: return (b == 0) ? -1 : (a / b);
+        case 15: return (b == 0) ? -1 : (static_cast<uint32_t>(a) / static_cast<uint32_t>(b));
+        case 16: return (b == 0) ? a : (a % b);
+        default: return (b == 0) ? a : (static_cast<uint32_t>(a) % static_cast<uint32_t>(b));
+    }
+}
+
+// executeALU for VECTOR_LANES operands; wrapping arithmetic is done unsigned
+template <uint32_t OP>
+inline LaneVector alu(const LaneVector& a, const LaneVector& b) {
+    UnsignedVector ua = reinterpret_cast<const UnsignedVector&>(a);
+    UnsignedVector ub = reinterpret_cast<const UnsignedVector&>(b);
+    UnsignedVector shift = ub & 0x1F;
+    UnsignedVector result;
+    switch (OP) {
+        case 0:  result = ua + ub; break;
+        case 1:  result = ua - ub; break;
+        case 2:  result = ua << shift; break;
+        case 3:  return (a < b) & 1;
+        case 4:  return (ua < ub) & 1;
+        case 5:  return a ^ b;
+        case 6:  result = ua >> shift; break;
+        case 7:  return a >> (b & 0x1F);
+        case 8:  return a | b;
+        case 9:  return a & b;
+        case 10: result = ua * ub; break;
+        case 11:
+        case 12:
+        case 13: {
+            LaneVector high;
+            for (size_t i = 0; i < LockstepBatch::VECTOR_LANES; i++)
+                high[i] = wideAlu<OP>(a[i], b[i]);
+            return high;
+        }
+        default: return LaneVector{};
+    }
+    return reinterpret_cast<LaneVector&>(result);
+}
+
+// d = a OP b in the masked lanes; an immediate b is a single vector with 'bStride' 0
+template <uint32_t OP>
+inline void aluRows(LaneVector* d, const LaneVector* a, const LaneVector* b, size_t bStride, const LaneVector* mask,
+                    size_t chunks) {
+    for (size_t c = 0; c < chunks; c++)
+        d[c] = select(mask[c], alu<OP>(a[c], b[c * bStride]), d[c]);
+}
+
+// Division, only in the masked lanes: the others could trap on values they never divide
+template <uint32_t OP>
+inline void divideRows(LaneVector* d, const LaneVector* a, const LaneVector* b, size_t bStride, const LaneVector* mask,
+                       size_t chunks) {
+    for (size_t c = 0; c < chunks; c++) {
+        for (size_t i = 0; i < LockstepBatch::VECTOR_LANES; i++) {
+            if (mask[c][i])
+                d[c][i] = wideAlu<OP>(a[c][i], b[c * bStride][i]);
+        }
+    }
+}
+
+SIMD_KERNEL
+void executeAluRows(uint32_t aluOp, LaneVector* d, const LaneVector* a, const LaneVector* b, size_t bStride,
+                    const LaneVector* mask, size_t chunks) {
+    switch (aluOp) {
+        case 0:  aluRows<0>(d, a, b, bStride, mask, chunks); break;
+        case 1:  aluRows<1>(d, a, b, bStride, mask, chunks); break;
+        case 2:  aluRows<2>(d, a, b, bStride, mask, chunks); break;
+        case 3:  aluRows<3>(d, a, b, bStride, mask, chunks); break;
+        case 4:  aluRows<4>(d, a, b, bStride, mask, chunks); break;
+        case 5:  aluRows<5>(d, a, b, bStride, mask, chunks); break;
+        case 6:  aluRows<6>(d, a, b, bStride, mask, chunks); break;
+        case 7:  aluRows<7>(d, a, b, bStride, mask, chunks); break;
+        case 8:  aluRows<8>(d, a, b, bStride, mask, chunks); break;
+        case 9:  aluRows<9>(d, a, b, bStride, mask, chunks); break;
+        case 10: aluRows<10>(d, a, b, bStride, mask, chunks); break;
+        case 11: aluRows<11>(d, a, b, bStride, mask, chunks); break;
+        case 12: aluRows<12>(d, a, b, bStride, mask, chunks); break;
+        case 13: aluRows<13>(d, a, b, bStride, mask, chunks); break;
+        case 14: divideRows<14>(d, a, b, bStride, mask, chunks); break;
+        case 15: divideRows<15>(d, a, b, bStride, mask, chunks); break;
+        case 16: divideRows<16>(d, a, b, bStride, mask, chunks); break;
+        case 17: divideRows<17>(d, a, b, bStride, mask, chunks); break;
+        default: aluRows<18>(d, a, b, bStride, mask, chunks); break;
+    }
+}
+
+// Branch condition of every lane as a mask
+SIMD_KERNEL
+void compareRows(uint32_t funct3, LaneVector* taken, const LaneVector* a, const LaneVector* b, const LaneVector* mask,
+                 size_t chunks) {
+    for (size_t c = 0; c < chunks; c++) {
+        UnsignedVector ua = reinterpret_cast<const UnsignedVector&>(a[c]);
+        UnsignedVector ub = reinterpret_cast<const UnsignedVector&>(b[c]);
+        LaneVector condition;
+        switch (funct3) {
+            case 0x0: condition = a[c] == b[c]; break;
+            case 0x1: condition = a[c] != b[c]; break;
+            case 0x4: condition = a[c] < b[c]; break;
+            case 0x5: condition = a[c] >= b[c]; break;
+            case 0x6: condition = ua < ub; break;
+            case 0x7: condition = ua >= ub; break;
+            default:  condition = LaneVector{}; break;
+        }
+        taken[c] = condition & mask[c];
+    }
+}
+
+} // namespace
+
+LockstepBatch::LockstepBatch(NoForwardingProcessor& cpu, size_t lanes)
+    : issued(0), laneInstructions(0), divergences(0), regroups(0), cpu(cpu), laneCount(lanes),
+      chunks((lanes + VECTOR_LANES - 1) / VECTOR_LANES), regs(REGISTER_ROWS * chunks * VECTOR_LANES),
+      pcs(chunks * VECTOR_LANES, cpu.entryPC), counts(chunks * VECTOR_LANES), running(chunks * VECTOR_LANES),
+      group(chunks * VECTOR_LANES), epochs(chunks * VECTOR_LANES), scratch(chunks * VECTOR_LANES), memories(lanes), reservations(lanes, cpu.reservation),
+      statuses(lanes, STEP_OK), groupPc(cpu.entryPC), groupSize(0), groupEpoch(0), groupSteps(0), groupBackward(0),
+      groupBudget(0), nextWaitingPc(UINT32_MAX), lowestWaitingPc(UINT32_MAX), lowestWaitingEpoch(INT32_MAX) {
+    for (uint32_t reg = 0; reg < 32; reg++)
+        std::fill_n(row(reg), chunks, splat(cpu.registers.read(reg)));
+    for (size_t lane = 0; lane < lanes; lane++) {
+        running[lane] = -1;
+        cpu.dataMemory.copyTo(memories[lane]);
+    }
+    Decoded undecoded = {};
+    undecoded.kind = UNDECODED;
+    decoded.assign(std::min(cpu.instructionStrings.size(), cpu.instructionMemory.size()), undecoded);
+}
+
+int32_t LockstepBatch::readRegister(size_t lane, uint32_t reg) const {
+    return regs[reg * chunks * VECTOR_LANES + lane];
+}
+
+void LockstepBatch::writeRegister(size_t lane, uint32_t reg, int32_t value) {
+    if (reg != 0)
+        regs[reg * chunks * VECTOR_LANES + lane] = value;
+}
+
+int32_t LockstepBatch::pc(size_t lane) const {
+    return pcs[lane];
+}
+
+uint64_t LockstepBatch::executed(size_t lane) const {
+    return static_cast<uint32_t>(counts[lane]);
+}
+
+const LockstepBatch::Decoded& LockstepBatch::decode(size_t index) {
+    Decoded& op = decoded[index];
+    if (op.kind != UNDECODED)
+        return op;
+
+    uint32_t instruction = cpu.instructionMemory[index];
+    uint32_t opcode = instruction & 0x7F;
+    uint32_t rd = (instruction >> 7) & 0x1F;
+    op.rd = static_cast<uint8_t>(rd == 0 ? SINK_REGISTER : rd);
+    op.rs1 = static_cast<uint8_t>((instruction >> 15) & 0x1F);
+    op.rs2 = static_cast<uint8_t>((instruction >> 20) & 0x1F);
+    op.funct3 = static_cast<uint8_t>((instruction >> 12) & 0x7);
+    op.aluOp = 0;
+    op.immediate = false;
+    op.status = STEP_OK;
+    op.instruction = instruction;
+    op.imm = 0;
+    switch (opcode) {
+        case 0x33: case 0x13: case 0x03: case 0x23: case 0x63:
+        case 0x6F: case 0x67: case 0x37: case 0x17:
+            break;
+        case 0x2F:
+            if (isAtomicInstruction(instruction))
+                break;
+            op.kind = FAULT;
+            op.status = STEP_ILLEGAL;
+            return op;
+        default:  // Vector instructions as well: lanes have no vector state
+            op.kind = FAULT;
+            op.status = STEP_ILLEGAL;
+            return op;
+    }
+
+    op.imm = cpu.extractImmediate(instruction, opcode);
+    if ((opcode == 0x63 || opcode == 0x6F || opcode == 0x67) && op.imm % 4 != 0) {
+        op.kind = FAULT;
+        op.status = STEP_BAD_OFFSET;
+        return op;
+    }
+    switch (opcode) {
+        case 0x33:
+        case 0x13: {
+            uint32_t aluOp = cpu.decodeControlSignals(instruction).aluOp;
+            op.immediate = (opcode == 0x13);
+            if (aluOp < 18) {
+                op.kind = ALU;
+                op.aluOp = static_cast<uint8_t>(aluOp);
+            } else {
+                op.kind = CONSTANT;  // executeALU gives 0
+                op.imm = 0;
+            }
+            break;
+        }
+        case 0x03: op.kind = LOAD; break;
+        case 0x23: op.kind = STORE; break;
+        case 0x2F: op.kind = ATOMIC; break;
+        case 0x63: op.kind = BRANCH; break;
+        case 0x6F: op.kind = JAL; break;
+        case 0x67: op.kind = JALR; break;
+        case 0x37: op.kind = CONSTANT; break;
+        default:   op.kind = AUIPC; break;
+    }
+    return op;
+}
+
+void LockstepBatch::retireGroup(bool atGroupPc) {
+    LaneVector steps = splat(static_cast<int32_t>(groupSteps));
+    LaneVector backward = splat(static_cast<int32_t>(groupBackward));
+    LaneVector at = splat(groupPc);
+    LaneVector* laneCounts = vectors(counts);
+    LaneVector* laneEpochs = vectors(epochs);
+    LaneVector* lanePcs = vectors(pcs);
+    const LaneVector* mask = vectors(group);
+    for (size_t c = 0; c < chunks; c++) {
+        laneCounts[c] += steps & mask[c];
+        laneEpochs[c] += backward & mask[c];
+        if (atGroupPc)
+            lanePcs[c] = select(mask[c], at, lanePcs[c]);
+    }
+    groupSteps = 0;
+    groupBackward = 0;
+}
+
+void LockstepBatch::stopGroup(StepStatus status) {
+    retireGroup(true);
+    for (size_t lane = 0; lane < laneCount; lane++) {
+        if (group[lane]) {
+            statuses[lane] = status;
+            running[lane] = 0;
+        }
+    }
+}
+
+bool LockstepBatch::regroup(uint64_t limit) {
+    regroups++;
+    LaneVector* laneRunning = vectors(running);
+    LaneVector* laneGroup = vectors(group);
+    const LaneVector* laneCounts = vectors(counts);
+    const LaneVector* laneEpochs = vectors(epochs);
+    const LaneVector* lanePcs = vectors(pcs);
+    const LaneVector none = splat(INT32_MAX);
+    const LaneVector noPc = splat(-1);  // UINT32_MAX
+
+    // Lanes at the limit stop, the rest pick the lowest epoch, then the lowest pc in it
+    LaneVector cap = splat(static_cast<int32_t>(limit));
+    LaneVector epoch = none;
+    for (size_t c = 0; c < chunks; c++) {
+        LaneVector done = laneRunning[c] & (laneCounts[c] >= cap);
+        if (any(done)) {
+            for (size_t i = 0; i < VECTOR_LANES; i++) {
+                if (done[i])
+                    statuses[c * VECTOR_LANES + i] = STEP_OK;
+            }
+            laneRunning[c] &= ~done;
+        }
+        epoch = minimum(epoch, select(laneRunning[c], laneEpochs[c], none));
+    }
+    groupEpoch = lowest(epoch);
+    if (groupEpoch == INT32_MAX)
+        return false;
+    LaneVector earliest = splat(groupEpoch);
+    LaneVector at = noPc;
+    for (size_t c = 0; c < chunks; c++)
+        at = minimumUnsigned(at, select(laneRunning[c] & (laneEpochs[c] == earliest), lanePcs[c], noPc));
+    groupPc = static_cast<int32_t>(lowestUnsigned(at));
+
+    // The group is every running lane at that pc, whatever its epoch
+    at = splat(groupPc);
+    LaneVector size{}, mostExecuted{}, nextWaiting = noPc, lowestWaiting = noPc, waitingEpoch = none;
+    for (size_t c = 0; c < chunks; c++) {
+        LaneVector member = laneRunning[c] & (lanePcs[c] == at);
+        LaneVector waiting = laneRunning[c] & ~member;
+        LaneVector ahead = waiting & (reinterpret_cast<const UnsignedVector&>(lanePcs[c]) >
+                                      reinterpret_cast<const UnsignedVector&>(at));
+        laneGroup[c] = member;
+        size -= member;
+        mostExecuted = select(member & (laneCounts[c] > mostExecuted), laneCounts[c], mostExecuted);
+        nextWaiting = minimumUnsigned(nextWaiting, select(ahead, lanePcs[c], noPc));
+        lowestWaiting = minimumUnsigned(lowestWaiting, select(waiting, lanePcs[c], noPc));
+        waitingEpoch = minimum(waitingEpoch, select(waiting, laneEpochs[c], none));
+    }
+    groupSize = 0;
+    int32_t most = 0;
+    for (size_t i = 0; i < VECTOR_LANES; i++) {
+        groupSize += static_cast<uint32_t>(size[i]);
+        most = std::max(most, mostExecuted[i]);
+    }
+    nextWaitingPc = lowestUnsigned(nextWaiting);
+    lowestWaitingPc = lowestUnsigned(lowestWaiting);
+    lowestWaitingEpoch = lowest(waitingEpoch);
+    groupSteps = 0;
+    groupBackward = 0;
+    groupBudget = limit - static_cast<uint64_t>(most);
+    return true;
+}
+
+void LockstepBatch::run(uint64_t limit) {
+    // The counts are 32-bit lanes
+    limit = std::min<uint64_t>(limit, INT32_MAX);
+    if (!regroup(limit))
+        return;
+    while (true) {
+        int index = cpu.getInstructionIndex(groupPc);
+        if (index == -1 || static_cast<size_t>(index) >= decoded.size()) {
+            stopGroup(STEP_OUT_OF_TEXT);
+        } else if (decode(index).kind == FAULT) {
+            stopGroup(decoded[index].status);
+        } else {
+            issued++;
+            laneInstructions += groupSize;
+            groupSteps++;
+            Outcome outcome = execute(decoded[index]);
+            if (outcome == SPLIT)
+                retireGroup(false);
+            else if (outcome == REGROUP || groupSteps == groupBudget || static_cast<uint32_t>(groupPc) >= nextWaitingPc)
+                retireGroup(true);
+            else
+                continue;
+        }
+        if (!regroup(limit))
+            return;
+    }
+}
+
+LockstepBatch::Outcome LockstepBatch::transfer(int32_t target) {
+    uint32_t from = static_cast<uint32_t>(groupPc);
+    groupPc = target;
+    if (static_cast<uint32_t>(target) > from)
+        return CONTINUE;
+    // Lanes waiting at or before the jump, which may be where it goes, or lanes
+    // that have gone round fewer times come first
+    groupBackward++;
+    if (lowestWaitingPc <= from || static_cast<int64_t>(lowestWaitingEpoch) < static_cast<int64_t>(groupEpoch) + static_cast<int64_t>(groupBackward))
+        return REGROUP;
+    return CONTINUE;
+}
+
+LockstepBatch::Outcome LockstepBatch::execute(const Decoded& op) {
+    LaneVector* d = row(op.rd);
+    const LaneVector* mask = vectors(group);
+    switch (op.kind) {
+        case ALU: {
+            LaneVector imm = splat(op.imm);
+            executeAluRows(op.aluOp, d, row(op.rs1), op.immediate ? &imm : row(op.rs2), op.immediate ? 0 : 1, mask, chunks);
+            break;
+        }
+        case CONSTANT:
+        case AUIPC:
+        case JAL: {
+            int32_t value = (op.kind == CONSTANT) ? op.imm : (op.kind == AUIPC) ? groupPc + op.imm : groupPc + 4;
+            LaneVector result = splat(value);
+            for (size_t c = 0; c < chunks; c++)
+                d[c] = select(mask[c], result, d[c]);
+            if (op.kind == JAL)
+                return transfer(groupPc + op.imm);
+            break;
+        }
+        case LOAD:
+        case STORE:
+        case ATOMIC:
+            executeMemory(op);
+            break;
+        case BRANCH:
+            return executeBranch(op);
+        case JALR:
+            return executeJalr(op);
+        default:
+            break;
+    }
+    groupPc += 4;
+    return CONTINUE;
+}
+
+void LockstepBatch::executeMemory(const Decoded& op) {
+    int32_t* result = &regs[op.rd * chunks * VECTOR_LANES];
+    const int32_t* a = &regs[op.rs1 * chunks * VECTOR_LANES];
+    const int32_t* b = &regs[op.rs2 * chunks * VECTOR_LANES];
+    for (size_t lane = 0; lane < laneCount; lane++) {
+        if (!group[lane])
+            continue;
+        uint32_t address = static_cast<uint32_t>(a[lane]) + static_cast<uint32_t>(op.imm);
+        if (op.kind == LOAD) {
+            result[lane] = memories[lane].load(op.funct3, address);
+        } else if (op.kind == STORE) {
+            memories[lane].store(op.funct3, address, b[lane]);
+        } else {
+            bool stored = false;
+            result[lane] = executeAtomic(memories[lane], reservations[lane], op.instruction, static_cast<uint32_t>(a[lane]),
+                                         b[lane], stored);
+        }
+    }
+}
+
+LockstepBatch::Outcome LockstepBatch::executeBranch(const Decoded& op) {
+    LaneVector* taken = vectors(scratch);
+    const LaneVector* mask = vectors(group);
+    compareRows(op.funct3, taken, row(op.rs1), row(op.rs2), mask, chunks);
+    LaneVector anyTaken{}, anyNotTaken{};
+    for (size_t c = 0; c < chunks; c++) {
+        anyTaken |= taken[c];
+        anyNotTaken |= mask[c] & ~taken[c];
+    }
+    if (!any(anyNotTaken))
+        return transfer(groupPc + op.imm);
+    if (!any(anyTaken)) {
+        groupPc += 4;
+        return CONTINUE;
+    }
+    divergences++;
+    LaneVector target = splat(groupPc + op.imm);
+    LaneVector fallThrough = splat(groupPc + 4);
+    LaneVector backward = splat(op.imm <= 0 ? 1 : 0);
+    LaneVector* lanePcs = vectors(pcs);
+    LaneVector* laneEpochs = vectors(epochs);
+    for (size_t c = 0; c < chunks; c++) {
+        lanePcs[c] = select(mask[c], select(taken[c], target, fallThrough), lanePcs[c]);
+        laneEpochs[c] += taken[c] & backward;
+    }
+    return SPLIT;
+}
+
+LockstepBatch::Outcome LockstepBatch::executeJalr(const Decoded& op) {
+    // Targets before the link is written, rd may be rs1
+    LaneVector* targets = vectors(scratch);
+    const LaneVector* mask = vectors(group);
+    const LaneVector* a = row(op.rs1);
+    LaneVector imm = splat(op.imm);
+    for (size_t c = 0; c < chunks; c++)
+        targets[c] = alu<0>(a[c], imm);
+    LaneVector* d = row(op.rd);
+    LaneVector link = splat(groupPc + 4);
+    for (size_t c = 0; c < chunks; c++)
+        d[c] = select(mask[c], link, d[c]);
+
+    bool first = true, together = true;
+    int32_t target = 0;
+    for (size_t lane = 0; lane < laneCount && together; lane++) {
+        if (!group[lane])
+            continue;
+        together = first || scratch[lane] == target;
+        target = scratch[lane];
+        first = false;
+    }
+    if (together)
+        return transfer(target);
+    divergences++;
+    UnsignedVector from = reinterpret_cast<const UnsignedVector&>(link) - 4u;
+    LaneVector* lanePcs = vectors(pcs);
+    LaneVector* laneEpochs = vectors(epochs);
+    for (size_t c = 0; c < chunks; c++) {
+        lanePcs[c] = select(mask[c], targets[c], lanePcs[c]);
+        laneEpochs[c] += mask[c] & (reinterpret_cast<const UnsignedVector&>(targets[c]) <= from) & 1;
+    }
+    return SPLIT;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "FunctionalCore.hpp"
+#include "Interconnect.hpp"
+#include "Memory.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class NoForwardingProcessor;
+
+// Functional execution of one program over many data sets at once (--batch).
+//
+// Every data set is a lane with its own registers, pc, memory and reservation.
+// The registers are kept as structure of arrays: for each guest register the
+// values of all lanes are consecutive, in LaneVector chunks of VECTOR_LANES.
+// An instruction is decoded once and executed for a whole group of lanes with
+// one vector operation per chunk, lanes outside the group masked off. The ALU
+// kernels follow executeALU, down to its quirks; division and the high
+// multiplies are done lane by lane, and loads, stores and atomics go through
+// each lane's Memory as in FunctionalCore::step(), whose results and statuses
+// every lane reproduces.
+//
+// When a branch or JALR sends the lanes of the group different ways, the group
+// splits and lanes wait. Every lane counts the backward jumps it took (its
+// epoch): the next group is picked among the lanes with the lowest epoch, at
+// the lowest pc, and takes every lane at that pc. A group running into the pc
+// of waiting lanes takes them along, and one jumping back hands over to lanes
+// that are behind it. Lanes that took different sides of an if/else meet again
+// where the paths join, and those going round a loop with a data-dependent
+// branch in its body meet at the top of every iteration.
+class LockstepBatch {
+public:
+    static constexpr size_t VECTOR_LANES = 8;  // 256-bit chunks: one AVX2 register or two SSE ones
+
+    // Every lane starts with the processor's registers, entry pc and a copy of its dataMemory
+    LockstepBatch(NoForwardingProcessor& cpu, size_t lanes);
+
+    size_t lanes() const { return laneCount; }
+    int32_t readRegister(size_t lane, uint32_t reg) const;
+    void writeRegister(size_t lane, uint32_t reg, int32_t value);
+    Memory& memory(size_t lane) { return memories[lane]; }
+    const Memory& memory(size_t lane) const { return memories[lane]; }
+
+    // Runs every lane until it has executed 'limit' instructions or one fails
+    void run(uint64_t limit);
+
+    // Where and why a lane stopped: STEP_OK is the instruction limit
+    int32_t pc(size_t lane) const;
+    uint64_t executed(size_t lane) const;
+    StepStatus status(size_t lane) const { return statuses[lane]; }
+
+    uint64_t issued;              // Instructions executed for a group
+    uint64_t laneInstructions;    // Instructions executed by all lanes together
+    uint64_t divergences;         // Branches and JALRs whose group went more than one way
+    uint64_t regroups;            // Times the group was picked again
+
+    // A view of VECTOR_LANES consecutive lanes of the int32_t arrays below. Those
+    // are only 16-byte aligned, which the AVX2 kernels must not assume more than.
+    typedef int32_t LaneVector __attribute__((vector_size(VECTOR_LANES * sizeof(int32_t)), aligned(16), may_alias));
+
+private:
+    enum Kind : uint8_t { ALU, CONSTANT, AUIPC, LOAD, STORE, ATOMIC, BRANCH, JAL, JALR, FAULT, UNDECODED };
+
+    // One decoded instruction; a write to x0 goes to register slot 32
+    struct Decoded {
+        Kind kind;
+        uint8_t rd;
+        uint8_t rs1;
+        uint8_t rs2;
+        uint8_t aluOp;      // decodeControlSignals() ALU operation
+        bool immediate;     // ALU operand b is imm
+        uint8_t funct3;
+        int32_t imm;        // Immediate, or the LUI result
+        StepStatus status;  // For FAULT
+        uint32_t instruction;
+    };
+
+    NoForwardingProcessor& cpu;
+    size_t laneCount;
+    size_t chunks;                        // LaneVectors per register; the lanes past laneCount are padding
+    // One value per lane each, registers one after another
+    std::vector<int32_t> regs;            // 33 registers
+    std::vector<int32_t> pcs;             // Lanes outside the group; group lanes are at groupPc
+    std::vector<int32_t> counts;          // Executed instructions, as of the last regroup for group lanes
+    std::vector<int32_t> running;         // All ones for lanes that have not stopped
+    std::vector<int32_t> group;           // All ones for the lanes executing now
+    std::vector<int32_t> epochs;          // Backward jumps taken, as of the last regroup for group lanes
+    std::vector<int32_t> scratch;         // Branch outcomes or JALR targets
+    std::vector<Memory> memories;
+    std::vector<Reservation> reservations;
+    std::vector<StepStatus> statuses;
+    std::vector<Decoded> decoded;         // By instructionMemory index, filled on first use
+
+    int32_t groupPc;
+    uint32_t groupSize;
+    int32_t groupEpoch;                   // Lowest epoch in the group when it was picked
+    uint64_t groupSteps;                  // Instructions the group executed since it was picked
+    uint64_t groupBackward;               // And backward jumps it took
+    uint64_t groupBudget;                 // Instructions it may execute before a lane reaches the limit
+    // Of the running lanes outside the group, UINT32_MAX/INT32_MAX if none
+    uint32_t nextWaitingPc;               // Lowest pc past groupPc, the group joins them there
+    uint32_t lowestWaitingPc;
+    int32_t lowestWaitingEpoch;
+
+    enum Outcome {
+        CONTINUE,
+        REGROUP,  // Go on with the lanes picked again
+        SPLIT     // The lanes went different ways, their pcs are written
+    };
+
+    static LaneVector* vectors(std::vector<int32_t>& lanes) { return reinterpret_cast<LaneVector*>(lanes.data()); }
+    LaneVector* row(uint32_t reg) { return reinterpret_cast<LaneVector*>(&regs[reg * chunks * VECTOR_LANES]); }
+    const Decoded& decode(size_t index);
+    // Writes the executed counts, epochs and (unless the lanes have their own) groupPc back to the group lanes
+    void retireGroup(bool atGroupPc);
+    // Stops the lanes at the limit and picks the next group, false when no lane is left
+    bool regroup(uint64_t limit);
+    void stopGroup(StepStatus status);
+    // A jump or taken branch of the whole group
+    Outcome transfer(int32_t target);
+    Outcome execute(const Decoded& op);
+    void executeMemory(const Decoded& op);  // Lane by lane
+    Outcome executeBranch(const Decoded& op);
+    Outcome executeJalr(const Decoded& op);
+};
@@ -0,0 +1,265 @@
+#include "LoopExtrapolator.hpp"
+#include "Processor.hpp"
+#include <iostream>
+
+namespace {
+// Iterations longer than this are not captured (straight-line code between
+// two backward branches gains nothing from extrapolation)
+const size_t MAX_ITERATION_LENGTH = 1 << 16;
+}
+
+LoopExtrapolator::LoopExtrapolator() :
+    capturing(false),
+    skippedCycles(0),
+    skippedIterations(0),
+    cpu(nullptr),
+    anchorCycle(-1),
+    windowOverflow(false)
+{
+}
+
+void LoopExtrapolator::reset(NoForwardingProcessor* processor) {
+    cpu = processor;
+    core.reset(new FunctionalCore(*processor));
+    anchorSignature.clear();
+    anchorCycle = -1;
+    path.clear();
+    window.clear();
+    windowOverflow = false;
+    capturing = false;
+    skippedCycles = 0;
+    skippedIterations = 0;
+}
+
+void LoopExtrapolator::captureStage(int instrIndex, int cycle, PipelineStage stage) {
+    if (window.size() >= MAX_ITERATION_LENGTH * 8) {
+        windowOverflow = true;
+        capturing = false;
+        return;
+    }
+    window.push_back({instrIndex, cycle, stage});
+}
+
+// Everything the next cycles' timing depends on: fetch pc, latch occupancy and
+// the instruction held in each latch, and the per-register scoreboard depth.
+// Data values are deliberately left out, the issued path covers them.
+void LoopExtrapolator::computeSignature(std::vector<uint32_t>& signature) const {
+    signature.clear();
+    signature.push_back(static_cast<uint32_t>(cpu->pc));
+    signature.push_back(cpu->stall);
+    signature.push_back(cpu->Imm_valid);
+    signature.push_back(cpu->ifid.isEmpty ? 0 : 1);
+    signature.push_back(cpu->ifid.isEmpty ? 0 : static_cast<uint32_t>(cpu->ifid.pc));
+    signature.push_back(cpu->idex.isEmpty ? 0 : 1);
+    signature.push_back(cpu->idex.isEmpty ? 0 : static_cast<uint32_t>(cpu->idex.pc));
+    signature.push_back(cpu->exmem.isEmpty ? 0 : 1);
+    signature.push_back(cpu->exmem.isEmpty ? 0 : static_cast<uint32_t>(cpu->exmem.pc));
+    signature.push_back(cpu->memwb.isEmpty ? 0 : 1);
+    signature.push_back(cpu->memwb.isEmpty ? 0 : static_cast<uint32_t>(cpu->memwb.pc));
+    signature.push_back(cpu->exCyclesLeft);
+    signature.push_back(cpu->memCyclesLeft);
+    for (const std::vector<bool>& users : cpu->regUsageTracker)
+        signature.push_back(static_cast<uint32_t>(users.size()));
+}
+
+void LoopExtrapolator::restartIteration(int cycle, std::vector<uint32_t>& signature) {
+    anchorSignature.swap(signature);
+    anchorCycle = cycle;
+    path.clear();
+    window.clear();
+    windowOverflow = false;
+    capturing = cpu->recordsStages();
+}
+
+int LoopExtrapolator::endOfCycle(int cycle, int totalCycles, bool backwardBranchTaken) {
+    // idex is refilled or emptied every cycle unless EX held on to it, so a full idex was issued this cycle
+    if (!cpu->idex.isEmpty && !cpu->exHeld) {
+        if (path.size() < MAX_ITERATION_LENGTH)
+            path.push_back(cpu->idex.pc);
+        else
+            windowOverflow = true;
+    }
+    if (!backwardBranchTaken)
+        return 0;
+
+    std::vector<uint32_t> signature;
+    computeSignature(signature);
+    int skipped = 0;
+    if (anchorCycle >= 0 && !windowOverflow && signature == anchorSignature)
+        skipped = extrapolate(cycle, totalCycles);
+    restartIteration(cycle + skipped, signature);
+    return skipped;
+}
+
+// Completes the architectural effects of the instructions still in flight, in
+// program order, so the FunctionalCore starts from a precise state. Redoing a
+// write the pipeline has already done (the forwarding processor writes in EX
+// and MEM) stores the same value again, so this is the same for both processors.
+void LoopExtrapolator::applyPendingWrites() {
+    MEMWBRegister& memwb = cpu->memwb;
+    EXMEMRegister& exmem = cpu->exmem;
+    IDEXRegister& idex = cpu->idex;
+    if (!memwb.isEmpty && memwb.controls.regWrite && memwb.rd != 0)
+        cpu->registers.write(memwb.rd, memwb.controls.memToReg ? memwb.readData : memwb.aluResult);
+    if (!exmem.isEmpty) {
+        uint32_t funct3 = (exmem.instruction >> 12) & 0x7;
+        uint32_t address = static_cast<uint32_t>(exmem.aluResult);
+        int32_t loadData = 0;
+        if (exmem.controls.memRead)
+            loadData = cpu->dataMemory.load(funct3, address);
+        if (exmem.controls.memWrite)
+            cpu->dataMemory.store(funct3, address, exmem.readData2);
+        if (exmem.controls.regWrite && exmem.rd != 0)
+            cpu->registers.write(exmem.rd, exmem.controls.memToReg ? loadData : exmem.aluResult);
+    }
+    // The backward branch itself, only a JAL/JALR link writes anything
+    if (!idex.isEmpty && idex.controls.regWrite && idex.rd != 0)
+        cpu->registers.write(idex.rd, idex.pc + 4);
+}
+
+// Refills the in-flight latches with the last instructions the FunctionalCore
+// executed; tail[0..2] are the three most recent, oldest first. The occupancy
+// pattern is unchanged, it is part of the signature.
+void LoopExtrapolator::reanchor(const RetiredInstruction* tail) {
+    int slot = 2;
+    IDEXRegister& idex = cpu->idex;
+    const RetiredInstruction& branch = tail[slot--];
+    uint32_t instruction = branch.instruction;
+    idex.pc = branch.pc;
+    idex.instruction = instruction;
+    idex.readData1 = branch.rs1Value;
+    idex.readData2 = branch.rs2Value;
+    idex.imm = cpu->extractImmediate(instruction, instruction & 0x7F);
+    idex.controls = cpu->decodeControlSignals(instruction);
+    if (idex.controls.jump && idex.rd != 0)
+        idex.aluResult = branch.pc + 4;
+
+    EXMEMRegister& exmem = cpu->exmem;
+    if (!exmem.isEmpty) {
+        const RetiredInstruction& retired = tail[slot--];
+        exmem.pc = retired.pc;
+        exmem.instruction = retired.instruction;
+        exmem.aluResult = retired.result;
+        exmem.readData2 = retired.rs2Value;
+        exmem.controls = cpu->decodeControlSignals(retired.instruction);
+    }
+
+    MEMWBRegister& memwb = cpu->memwb;
+    if (!memwb.isEmpty) {
+        const RetiredInstruction& retired = tail[slot--];
+        memwb.pc = retired.pc;
+        memwb.instruction = retired.instruction;
+        memwb.aluResult = retired.result;
+        memwb.storeData = retired.rs2Value;
+        memwb.controls = cpu->decodeControlSignals(retired.instruction);
+        if (memwb.controls.memRead)
+            memwb.readData = retired.loadData;
+    }
+}
+
+int LoopExtrapolator::extrapolate(int cycle, int totalCycles) {
+    int iterationCycles = cycle - anchorCycle;
+    size_t length = path.size();
+    if (iterationCycles <= 0 || length == 0 || path.front() != cpu->pc || path.back() != cpu->idex.pc)
+        return 0;
+
+    // The in-flight instructions have to be the tail of the repeating path,
+    // otherwise the latches cannot be rebuilt from the functional execution
+    int32_t inFlight[3];
+    int inFlightCount = 0;
+    if (!cpu->memwb.isEmpty)
+        inFlight[inFlightCount++] = cpu->memwb.pc;
+    if (!cpu->exmem.isEmpty)
+        inFlight[inFlightCount++] = cpu->exmem.pc;
+    inFlight[inFlightCount++] = cpu->idex.pc;
+    for (int i = 0; i < inFlightCount; i++) {
+        size_t back = static_cast<size_t>(inFlightCount - i);
+        if (inFlight[i] != path[(length - back % length) % length])
+            return 0;
+    }
+
+    // Redoing an atomic is not harmless like redoing a store: loops with one are simulated cycle by cycle,
+    // and so are loops with a system call, which cannot be rolled back at all.
+    // So are vector loops, whose timing depends on vl rather than on the issued path alone.
+    for (int32_t pc : path) {
+        uint32_t instruction = cpu->instructionMemory[cpu->getInstructionIndex(pc)];
+        if ((instruction & 0x7F) == 0x2F || isEcall(instruction) || isVectorInstruction(instruction))
+            return 0;
+    }
+
+    // Iterations are executed in groups large enough to hold every in-flight
+    // instruction, so a group that diverges can be rolled back on its own
+    int groupIterations = static_cast<int>((static_cast<size_t>(inFlightCount) + length - 1) / length);
+    int maxIterations = (totalCycles - 1 - cycle) / iterationCycles;
+    maxIterations -= maxIterations % groupIterations;
+    if (maxIterations <= 0)
+        return 0;
+
+    applyPendingWrites();
+
+    // Ring of the last three executed instructions, and its copy at the last committed group
+    RetiredInstruction recent[3];
+    RetiredInstruction committed[3];
+    int recentPos = 0;
+    int32_t loopPc = cpu->pc;
+    int iterations = 0;
+    core->keepUndo = true;
+    while (iterations < maxIterations) {
+        core->checkpoint();
+        bool diverged = false;
+        for (int g = 0; g < groupIterations && !diverged; g++) {
+            for (size_t i = 0; i < length; i++) {
+                RetiredInstruction& retired = recent[recentPos];
+                if (loopPc != path[i] || core->step(loopPc, retired) != STEP_OK) {
+                    diverged = true;
+                    break;
+                }
+                recentPos = (recentPos + 1) % 3;
+            }
+            if (!diverged && loopPc != path.front())
+                diverged = true;
+        }
+        if (diverged) {
+            core->rollback();
+            break;
+        }
+        for (int i = 0; i < 3; i++)
+            committed[i] = recent[(recentPos + i) % 3];
+        iterations += groupIterations;
+    }
+    core->keepUndo = false;
+    cpu->pc = path.front();
+    if (iterations == 0)
+        return 0;
+
+    reanchor(committed);
+
+    // Replicate the captured diagram columns (and trace events) for every skipped iteration
+    bool wasCapturing = capturing;
+    capturing = false;
+    if (cpu->recordsStages() && !window.empty()) {
+        for (int i = 1; i <= iterations; i++) {
+            int offset = i * iterationCycles;
+            if (window.front().cycle + offset >= cpu->matrixCols)
+                break;
+            for (const StageRecord& record : window) {
+                if (record.cycle + offset >= cpu->matrixCols)
+                    break;
+                cpu->recordStage(record.instrIndex, record.cycle + offset, record.stage);
+            }
+        }
+    }
+    capturing = wasCapturing;
+
+    int skipped = iterations * iterationCycles;
+    skippedCycles += static_cast<uint64_t>(skipped);
+    skippedIterations += static_cast<uint64_t>(iterations);
+    if (cpu->criticalPath)
+        cpu->criticalPath->skip(skipped);
+    if (cpu->intervalSampler)
+        cpu->intervalSampler->repeat(cycle, iterationCycles, iterations);
+    std::cout << "Cycles " << cycle + 1 << "-" << cycle + skipped << ": extrapolated " << iterations
+              << " iterations of the loop at PC " << path.front() << " (" << iterationCycles
+              << " cycles each)" << std::endl;
+    return skipped;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "FunctionalCore.hpp"
+#include "PipelineStages.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class NoForwardingProcessor;
+
+// Steady-state loop detection for run().
+//
+// At the end of every cycle in which a backward branch was taken in ID, the
+// pipeline state (latch occupancy and contents, scoreboard, fetch pc) is
+// reduced to a signature. Timing in this pipeline depends only on that state
+// and on the sequence of issued instructions, so when two successive backward
+// branches see the same signature, every later iteration that issues the same
+// instructions costs exactly the same number of cycles. Those iterations are
+// then executed with the FunctionalCore, the cycle counter is advanced by the
+// iteration cost and the recorded diagram columns are replicated. Detailed
+// simulation resumes as soon as an iteration takes a different path.
+class LoopExtrapolator {
+public:
+    LoopExtrapolator();
+
+    // Called by run() before the first cycle
+    void reset(NoForwardingProcessor* processor);
+
+    // End-of-cycle hook. Returns the number of cycles skipped (0 if none); the
+    // processor state then corresponds to the end of cycle 'cycle' + returned value.
+    int endOfCycle(int cycle, int totalCycles, bool backwardBranchTaken);
+
+    // recordStage() forwards stages here while an iteration is being captured
+    void captureStage(int instrIndex, int cycle, PipelineStage stage);
+    bool capturing;
+
+    // Statistics for the final report
+    uint64_t skippedCycles;
+    uint64_t skippedIterations;
+
+private:
+    struct StageRecord {
+        int instrIndex;
+        int cycle;
+        PipelineStage stage;
+    };
+
+    NoForwardingProcessor* cpu;
+    std::unique_ptr<FunctionalCore> core;
+    std::vector<uint32_t> anchorSignature;  // Signature at the previous backward branch
+    int anchorCycle;                        // Cycle of the previous backward branch, -1 if none
+    std::vector<int32_t> path;              // pcs issued since the previous backward branch
+    std::vector<StageRecord> window;        // Stages recorded since the previous backward branch
+    bool windowOverflow;
+
+    void computeSignature(std::vector<uint32_t>& signature) const;
+    void restartIteration(int cycle, std::vector<uint32_t>& signature);
+    int extrapolate(int cycle, int totalCycles);
+    void applyPendingWrites();
+    void reanchor(const RetiredInstruction* tail);
+};
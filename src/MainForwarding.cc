@@ -1,34 +1,60 @@
 #include "ForwardingProcessor.hpp"
+#include "MultiHart.hpp"
+#include "SmtProcessor.hpp"
+#include "SimOptions.hpp"
 #include <iostream>
 #include <string>
 
 int main(int argc, char* argv[]) {
     // Check arguments
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <instruction_file> <num_cycles>" << std::endl;
+    SimOptions options;
+    if (!parseSimOptions(argc, argv, options)) {
+        printUsage(argv[0]);
         return 1;
     }
     
     // Get filename and number of cycles
-    std::string filename = argv[1];
-    int cycles = std::stoi(argv[2]);
+    std::string filename = options.inputFile;
+    int cycles = options.cycles;
     
     std::cout << "Running with forwarding for " << cycles << " cycles" << std::endl;
     
+    if (options.harts > 1)
+        return runHarts(options, true, []() -> NoForwardingProcessor* { return new ForwardingProcessor; }) ? 0 : 1;
+    if (options.smt)
+        return runSmt(options, true) ? 0 : 1;
+    
     // Create forwarding processor
     ForwardingProcessor processor;
     
     // Load instructions
-    if (!processor.loadInstructions(filename)) {
+    if (!processor.loadProgram(filename)) {
         std::cerr << "Failed to load instructions from " << filename << std::endl;
         return 1;
     }
     
+    // Preload registers and data memory images
+    if (!applyPreloads(processor, options)) {
+        std::cerr << "Failed to apply register/memory preloads" << std::endl;
+        return 1;
+    }
+    
     // Run simulation
-    processor.run(cycles);
+    applyRunSettings(processor, options);
+    if (!runSimulation(processor, options))
+        return 1;
+    if (options.extrapolate)
+        std::cout << "Extrapolated " << processor.loopExtrapolator.skippedCycles << " of " << cycles << " cycles ("
+                  << processor.loopExtrapolator.skippedIterations << " loop iterations)" << std::endl;
     
     // Print pipeline diagram
-    processor.printPipelineDiagram(filename, true);
+    if (options.recordDiagram && options.foldDiagram)
+        processor.printFoldedDiagram(filename, true);
+    else if (options.recordDiagram)
+        processor.printPipelineDiagram(filename, true);
+    
+    if (!writeMemoryDumps(processor, options))
+        return 1;
     
     std::cout << "Forwarding simulation complete. Results written to CSV file." << std::endl;
     return 0;
@@ -1,27 +1,52 @@
 #include "Processor.hpp"
+#include "MultiHart.hpp"
+#include "SmtProcessor.hpp"
+#include "SimOptions.hpp"
 #include <iostream>
 #include <string>
 
 int main(int argc, char** argv) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <input_file> <cycle_count>" << std::endl;
+    SimOptions options;
+    if (!parseSimOptions(argc, argv, options)) {
+        printUsage(argv[0]);
         return 1;
     }
     
-    std::string inputFile = argv[1];
-    int cycleCount = std::stoi(argv[2]);
+    std::string inputFile = options.inputFile;
+    int cycleCount = options.cycles;
+    
+    if (options.harts > 1)
+        return runHarts(options, false, []() { return new NoForwardingProcessor; }) ? 0 : 1;
+    if (options.smt)
+        return runSmt(options, false) ? 0 : 1;
     
     NoForwardingProcessor processor;
     
-    if (!processor.loadInstructions(inputFile)) {
+    if (!processor.loadProgram(inputFile)) {
         std::cerr << "Failed to load instructions from file: " << inputFile << std::endl;
         return 1;
     }
     
-    processor.run(cycleCount);
+    if (!applyPreloads(processor, options)) {
+        std::cerr << "Failed to apply register/memory preloads" << std::endl;
+        return 1;
+    }
+    
+    applyRunSettings(processor, options);
+    if (!runSimulation(processor, options))
+        return 1;
+    if (options.extrapolate)
+        std::cout << "Extrapolated " << processor.loopExtrapolator.skippedCycles << " of " << cycleCount << " cycles ("
+                  << processor.loopExtrapolator.skippedIterations << " loop iterations)" << std::endl;
     
     // Print pipeline diagram to file only
-    processor.printPipelineDiagram(inputFile, false);
+    if (options.recordDiagram && options.foldDiagram)
+        processor.printFoldedDiagram(inputFile, false);
+    else if (options.recordDiagram)
+        processor.printPipelineDiagram(inputFile, false);
+    
+    if (!writeMemoryDumps(processor, options))
+        return 1;
     
     return 0;
 }
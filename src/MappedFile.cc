@@ -0,0 +1,112 @@
+#include "MappedFile.hpp"
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : bytes(nullptr), length(0), opened(false), writable(false), mapped(false) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : bytes(nullptr), length(0), opened(false), writable(false), mapped(false) {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        bytes = other.bytes;
+        length = other.length;
+        opened = other.opened;
+        writable = other.writable;
+        mapped = other.mapped;
+#ifdef _WIN32
+        buffer = std::move(other.buffer);
+#endif
+        other.bytes = nullptr;
+        other.length = 0;
+        other.opened = false;
+        other.writable = false;
+        other.mapped = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& filename, bool copyOnWrite) {
+    close();
+#ifdef _WIN32
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return false;
+    }
+    std::streamsize fileSize = file.tellg();
+    file.seekg(0, std::ios::beg);
+    buffer.resize(static_cast<size_t>(fileSize));
+    if (fileSize > 0 && !file.read(reinterpret_cast<char*>(buffer.data()), fileSize)) {
+        std::cerr << "Error: Cannot read file " << filename << std::endl;
+        buffer.clear();
+        return false;
+    }
+    bytes = buffer.empty() ? nullptr : buffer.data();
+    length = buffer.size();
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::cerr << "Error: Cannot stat file " << filename << std::endl;
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(st.st_size);
+    // mmap rejects zero-length mappings, an empty file is simply an empty view
+    if (length > 0) {
+        int protection = copyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void* addr = mmap(nullptr, length, protection, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Error: Cannot map file " << filename << std::endl;
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        // Programs are parsed front to back, let the kernel read ahead aggressively;
+        // copy-on-write images are data arrays accessed in any order
+        if (!copyOnWrite)
+            madvise(addr, length, MADV_SEQUENTIAL);
+        bytes = static_cast<uint8_t*>(addr);
+        mapped = true;
+    }
+    ::close(fd);  // The mapping stays valid after the descriptor is closed
+#endif
+    opened = true;
+    writable = copyOnWrite;
+    return true;
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (mapped)
+        munmap(bytes, length);
+#else
+    buffer.clear();
+#endif
+    bytes = nullptr;
+    length = 0;
+    opened = false;
+    writable = false;
+    mapped = false;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. On POSIX systems the file is mapped with mmap
+// so large programs are paged in on demand instead of being copied up front.
+// A copy-on-write mapping can be written through mutableData(); the changes
+// stay private to the process and never reach the file.
+class MappedFile {
+private:
+    uint8_t* bytes;
+    size_t length;
+    bool opened;
+    bool writable;
+    bool mapped;                 // true when bytes points into an mmap region
+#ifdef _WIN32
+    std::vector<uint8_t> buffer; // Fallback storage when mmap is not available
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::string& filename, bool copyOnWrite = false);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const uint8_t* data() const { return bytes; }
+    uint8_t* mutableData() { return writable ? bytes : nullptr; }
+    size_t size() const { return length; }
+};
@@ -1,21 +1,54 @@
 #include "Memory.hpp"
+#include <algorithm>
+#include <cstring>
 
-Memory::Memory() {}
+Memory::Memory() : lastPageNum(0xFFFFFFFF), lastPage(nullptr) {}
+
+uint8_t* Memory::findPage(uint32_t pageNum) const {
+    if (pageNum == lastPageNum)
+        return lastPage;
+    auto it = pages.find(pageNum);
+    if (it == pages.end())
+        return nullptr;  // Not cached, a later write may still allocate this page
+    lastPageNum = pageNum;
+    lastPage = it->second;
+    return lastPage;
+}
+
+uint8_t* Memory::touchPage(uint32_t pageNum) {
+    uint8_t* page = findPage(pageNum);
+    if (page)
+        return page;
+    ownedPages.emplace_back(new uint8_t[PAGE_SIZE]());
+    pages[pageNum] = ownedPages.back().get();
+    lastPageNum = pageNum;
+    lastPage = ownedPages.back().get();
+    return lastPage;
+}
 
 uint8_t Memory::readByte(uint32_t address) const {
-    auto it = memory.find(address);
-    if (it != memory.end()) {
-        return it->second;
+    const uint8_t* page = findPage(address >> PAGE_BITS);
+    if (page) {
+        return page[address & PAGE_MASK];
     }
     return 0;
 }
 
 int16_t Memory::readHalfWord(uint32_t address) const {
     uint16_t halfWord = 0;
-    // Little-endian
-    halfWord |= static_cast<uint16_t>(readByte(address));
-    halfWord |= static_cast<uint16_t>(readByte(address + 1)) << 8;
-    
+    const uint8_t* page = findPage(address >> PAGE_BITS);
+    uint32_t offset = address & PAGE_MASK;
+    if (offset <= PAGE_SIZE - 2) {
+        // Fast path: both bytes are in the same page
+        if (page) {
+            halfWord = static_cast<uint16_t>(page[offset] | (page[offset + 1] << 8));
+        }
+    } else {
+        // Little-endian
+        halfWord |= static_cast<uint16_t>(readByte(address));
+        halfWord |= static_cast<uint16_t>(readByte(address + 1)) << 8;
+    }
+
     // Sign extend if the MSB is set
     if (halfWord & 0x8000) {
         return static_cast<int16_t>(halfWord | 0xFFFF0000);
@@ -25,17 +58,29 @@ int16_t Memory::readHalfWord(uint32_t address) const {
 
 int32_t Memory::readWord(uint32_t address) const {
     uint32_t word = 0;
-    // Little-endian
-    word |= static_cast<uint32_t>(readByte(address));
-    word |= static_cast<uint32_t>(readByte(address + 1)) << 8;
-    word |= static_cast<uint32_t>(readByte(address + 2)) << 16;
-    word |= static_cast<uint32_t>(readByte(address + 3)) << 24;
-    
+    const uint8_t* page = findPage(address >> PAGE_BITS);
+    uint32_t offset = address & PAGE_MASK;
+    if (offset <= PAGE_SIZE - 4) {
+        // Fast path: the whole word is in one page
+        if (page) {
+            word = static_cast<uint32_t>(page[offset])
+                 | static_cast<uint32_t>(page[offset + 1]) << 8
+                 | static_cast<uint32_t>(page[offset + 2]) << 16
+                 | static_cast<uint32_t>(page[offset + 3]) << 24;
+        }
+    } else {
+        // Little-endian
+        word |= static_cast<uint32_t>(readByte(address));
+        word |= static_cast<uint32_t>(readByte(address + 1)) << 8;
+        word |= static_cast<uint32_t>(readByte(address + 2)) << 16;
+        word |= static_cast<uint32_t>(readByte(address + 3)) << 24;
+    }
+
     return static_cast<int32_t>(word);
 }
 
 void Memory::writeByte(uint32_t address, uint8_t value) {
-    memory[address] = value;
+    touchPage(address >> PAGE_BITS)[address & PAGE_MASK] = value;
 }
 
 void Memory::writeHalfWord(uint32_t address, int16_t value) {
@@ -45,9 +90,109 @@ void Memory::writeHalfWord(uint32_t address, int16_t value) {
 }
 
 void Memory::writeWord(uint32_t address, int32_t value) {
+    uint32_t offset = address & PAGE_MASK;
+    if (offset <= PAGE_SIZE - 4) {
+        uint8_t* page = touchPage(address >> PAGE_BITS);
+        page[offset]     = value & 0xFF;
+        page[offset + 1] = (value >> 8) & 0xFF;
+        page[offset + 2] = (value >> 16) & 0xFF;
+        page[offset + 3] = (value >> 24) & 0xFF;
+        return;
+    }
     // Little-endian
     writeByte(address, value & 0xFF);
     writeByte(address + 1, (value >> 8) & 0xFF);
     writeByte(address + 2, (value >> 16) & 0xFF);
     writeByte(address + 3, (value >> 24) & 0xFF);
 }
+
+int32_t Memory::load(uint32_t funct3, uint32_t address) const {
+    switch (funct3) {
+        case 0x0: return static_cast<int8_t>(readByte(address));                   // LB (sign-extended)
+        case 0x1: return readHalfWord(address);                                     // LH (sign-extended)
+        case 0x4: return readByte(address);                                         // LBU
+        case 0x5: return static_cast<uint16_t>(readHalfWord(address) & 0xFFFF);     // LHU
+        default:  return readWord(address);                                         // LW
+    }
+}
+
+void Memory::store(uint32_t funct3, uint32_t address, int32_t value) {
+    switch (funct3) {
+        case 0x0: writeByte(address, value & 0xFF); break;           // SB
+        case 0x1: writeHalfWord(address, value & 0xFFFF); break;     // SH
+        default:  writeWord(address, value); break;                  // SW
+    }
+}
+
+// ---------------------- Bulk Transfers ----------------------
+void Memory::writeBlock(uint32_t address, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        uint32_t offset = address & PAGE_MASK;
+        size_t chunk = std::min<size_t>(length, PAGE_SIZE - offset);
+        std::memcpy(touchPage(address >> PAGE_BITS) + offset, data, chunk);
+        address += static_cast<uint32_t>(chunk);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void Memory::readBlock(uint32_t address, uint8_t* out, size_t length) const {
+    while (length > 0) {
+        uint32_t offset = address & PAGE_MASK;
+        size_t chunk = std::min<size_t>(length, PAGE_SIZE - offset);
+        const uint8_t* page = findPage(address >> PAGE_BITS);
+        if (page)
+            std::memcpy(out, page + offset, chunk);
+        else
+            std::memset(out, 0, chunk);
+        address += static_cast<uint32_t>(chunk);
+        out += chunk;
+        length -= chunk;
+    }
+}
+
+void Memory::clearBlock(uint32_t address, size_t length) {
+    while (length > 0) {
+        uint32_t offset = address & PAGE_MASK;
+        size_t chunk = std::min<size_t>(length, PAGE_SIZE - offset);
+        // Unallocated pages already read as zero, no need to create them
+        uint8_t* page = findPage(address >> PAGE_BITS);
+        if (page)
+            std::memset(page + offset, 0, chunk);
+        address += static_cast<uint32_t>(chunk);
+        length -= chunk;
+    }
+}
+
+bool Memory::allocated(uint32_t address, size_t length) const {
+    while (length > 0) {
+        size_t chunk = std::min<size_t>(length, PAGE_SIZE - (address & PAGE_MASK));
+        if (findPage(address >> PAGE_BITS))
+            return true;
+        address += static_cast<uint32_t>(chunk);
+        length -= chunk;
+    }
+    return false;
+}
+
+void Memory::copyTo(Memory& other) const {
+    for (const auto& page : pages)
+        other.writeBlock(page.first << PAGE_BITS, page.second, PAGE_SIZE);
+}
+
+bool Memory::mapImage(uint32_t address, MappedFile&& image) {
+    if ((address & PAGE_MASK) != 0 || image.mutableData() == nullptr)
+        return false;
+    uint8_t* data = image.mutableData();
+    size_t wholePages = image.size() >> PAGE_BITS;
+    for (size_t i = 0; i < wholePages; i++)
+        pages[(address >> PAGE_BITS) + static_cast<uint32_t>(i)] = data + (i << PAGE_BITS);
+    lastPageNum = 0xFFFFFFFF;  // The cached page may have just been replaced
+    lastPage = nullptr;
+
+    size_t mappedBytes = wholePages << PAGE_BITS;
+    if (mappedBytes < image.size())
+        writeBlock(address + static_cast<uint32_t>(mappedBytes), data + mappedBytes, image.size() - mappedBytes);
+    mappings.push_back(std::move(image));
+    return true;
+}
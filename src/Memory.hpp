@@ -1,19 +1,57 @@
 #pragma once
+#include "MappedFile.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 class Memory {
+public:
+    static constexpr uint32_t PAGE_BITS = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_BITS;  // 4 KiB pages
+    static constexpr uint32_t PAGE_MASK = PAGE_SIZE - 1;
+
 private:
-    std::unordered_map<uint32_t, uint8_t> memory;
+    // Sparse page table: page number -> PAGE_SIZE bytes. Pages that were never
+    // written are not allocated and read back as zero. A page either lives in
+    // ownedPages or inside one of the copy-on-write file mappings.
+    std::unordered_map<uint32_t, uint8_t*> pages;
+    std::vector<std::unique_ptr<uint8_t[]>> ownedPages;
+    std::vector<MappedFile> mappings;
+
+    // One-entry translation cache, consecutive accesses usually hit the same page
+    mutable uint32_t lastPageNum;
+    mutable uint8_t* lastPage;
+
+    uint8_t* findPage(uint32_t pageNum) const;  // nullptr if the page was never written
+    uint8_t* touchPage(uint32_t pageNum);       // Allocates a zeroed page on first use
 
 public:
     Memory();
-    
+
     uint8_t readByte(uint32_t address) const;
     int16_t readHalfWord(uint32_t address) const;  // Returns 16-bit value (sign extended)
     int32_t readWord(uint32_t address) const;      // Returns 32-bit value (signed)
-    
+
     void writeByte(uint32_t address, uint8_t value);
     void writeHalfWord(uint32_t address, int16_t value);  // Stores 16-bit value
     void writeWord(uint32_t address, int32_t value);      // Stores 32-bit value (signed)
+
+    // Width and extension from the funct3 of a load (LB/LH/LW/LBU/LHU) or store
+    // (SB/SH/SW); unknown encodings access a word, as the pipelines always did
+    int32_t load(uint32_t funct3, uint32_t address) const;
+    void store(uint32_t funct3, uint32_t address, int32_t value);
+
+    // Bulk transfers used by the program loaders, copied a page at a time
+    void writeBlock(uint32_t address, const uint8_t* data, size_t length);
+    void readBlock(uint32_t address, uint8_t* out, size_t length) const;
+    void clearBlock(uint32_t address, size_t length);  // Zero fill (.bss), only touches allocated pages
+    bool allocated(uint32_t address, size_t length) const;  // Whether any page of the range was ever written
+    void copyTo(Memory& other) const;                   // Every allocated page, mapped ones included
+
+    // Backs the memory at a page aligned address directly with a copy-on-write
+    // mapping of the image, so large input arrays cost no copy at all. A partial
+    // last page is copied. Returns false if the address is not page aligned.
+    bool mapImage(uint32_t address, MappedFile&& image);
 };
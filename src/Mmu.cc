@@ -0,0 +1,121 @@
+#include "Mmu.hpp"
+#include "DramTiming.hpp"
+#include "Memory.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+
+namespace {
+
+// Sv32 PTE bits
+const uint32_t PTE_V = 1u << 0;
+const uint32_t PTE_R = 1u << 1;
+const uint32_t PTE_W = 1u << 2;
+const uint32_t PTE_X = 1u << 3;
+const uint32_t PTE_A = 1u << 6;
+const uint32_t PTE_D = 1u << 7;
+const uint32_t PTE_LEAF = PTE_V | PTE_R | PTE_W | PTE_X | PTE_A | PTE_D;
+
+void printTlb(std::ostream& out, const char* name, const Tlb& tlb) {
+    out << name << " " << tlb.config.entries << " entries " << tlb.config.ways << "-way: " << tlb.lookups
+        << " lookups, " << tlb.misses << " misses ("
+        << (tlb.lookups > 0 ? 100.0 * tlb.misses / tlb.lookups : 0.0) << "%)";
+}
+
+} // namespace
+
+Tlb::Tlb(const TlbConfig& config)
+    : config(config), lookups(0), misses(0), entries(config.entries, Entry{false, 0, 0}),
+      sets(config.entries / config.ways), useClock(0) {}
+
+bool Tlb::lookup(uint32_t vpn) {
+    lookups++;
+    Entry* set = &entries[(vpn % sets) * config.ways];
+    for (uint32_t way = 0; way < config.ways; way++) {
+        if (set[way].valid && set[way].vpn == vpn) {
+            set[way].lastUse = ++useClock;
+            return true;
+        }
+    }
+    misses++;
+    return false;
+}
+
+void Tlb::insert(uint32_t vpn) {
+    Entry* set = &entries[(vpn % sets) * config.ways];
+    Entry* victim = std::min_element(set, set + config.ways, [](const Entry& a, const Entry& b) {
+        return a.valid != b.valid ? !a.valid : a.lastUse < b.lastUse;
+    });
+    *victim = Entry{true, vpn, ++useClock};
+}
+
+Sv32Mmu::Sv32Mmu(const MmuConfig& config, Memory& memory, DramTiming* dram)
+    : config(config), itlb(config.itlb), dtlb(config.dtlb), walks(0), pteReads(0), walkCycles(0), pagesMapped(0),
+      exhausted(false), memory(memory), dram(dram), nextTable(config.pageTableBase + Memory::PAGE_SIZE) {
+    memory.clearBlock(config.pageTableBase, Memory::PAGE_SIZE);
+}
+
+uint32_t Sv32Mmu::readPte(uint32_t address, uint64_t cycle, uint32_t& cycles) {
+    pteReads++;
+    cycles += dram ? dram->access(address, false, cycle + cycles) : config.walkLatency;
+    return static_cast<uint32_t>(memory.readWord(address));
+}
+
+uint32_t Sv32Mmu::walk(uint32_t address, uint64_t cycle) {
+    walks++;
+    uint32_t cycles = 0;
+    uint32_t rootPte = config.pageTableBase + (address >> 22) * 4;
+    uint32_t pte = readPte(rootPte, cycle, cycles);
+    if (!(pte & PTE_V)) {
+        // First touch: map the megapage, or give it a second-level table
+        if (config.megapages) {
+            pte = ((address >> 22) << 20) | PTE_LEAF;
+            pagesMapped++;
+        } else if (nextTable - config.pageTableBase >= TABLE_REGION_SIZE) {
+            if (!exhausted)
+                std::cerr << "Error: the Sv32 page tables at 0x" << std::hex << config.pageTableBase << std::dec
+                          << " are full, no second-level table left for address 0x" << std::hex << address
+                          << std::dec << std::endl;
+            exhausted = true;
+            return cycles;
+        } else {
+            pte = ((nextTable >> 12) << 10) | PTE_V;
+            memory.clearBlock(nextTable, Memory::PAGE_SIZE);
+            nextTable += Memory::PAGE_SIZE;
+        }
+        memory.writeWord(rootPte, static_cast<int32_t>(pte));
+    }
+    if (pte & (PTE_R | PTE_X))
+        return cycles;
+
+    uint32_t leafPte = ((pte >> 10) << 12) + ((address >> 12) & 0x3FF) * 4;
+    pte = readPte(leafPte, cycle, cycles);
+    if (!(pte & PTE_V)) {
+        memory.writeWord(leafPte, static_cast<int32_t>(((address >> 12) << 10) | PTE_LEAF));
+        pagesMapped++;
+    }
+    return cycles;
+}
+
+uint32_t Sv32Mmu::translate(uint32_t address, bool fetch, uint64_t cycle) {
+    Tlb& tlb = fetch ? itlb : dtlb;
+    uint32_t vpn = address >> (config.megapages ? 22 : 12);
+    if (tlb.lookup(vpn))
+        return 0;
+    uint32_t cycles = walk(address, cycle);
+    tlb.insert(vpn);
+    walkCycles += cycles;
+    return cycles;
+}
+
+void Sv32Mmu::printSummary(std::ostream& out) const {
+    if (itlb.lookups + dtlb.lookups == 0)
+        return;
+    out << "Sv32 (" << (config.megapages ? "4 MiB" : "4 KiB") << " pages): " << std::fixed << std::setprecision(2);
+    printTlb(out, "I-TLB", itlb);
+    out << "; ";
+    printTlb(out, "D-TLB", dtlb);
+    out << "; " << walks << " page walks, " << pteReads << " PTE reads, " << walkCycles << " cycles walking, "
+        << pagesMapped << " pages mapped" << std::defaultfloat << std::endl;
+}
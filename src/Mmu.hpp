@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+class DramTiming;
+class Memory;
+
+struct TlbConfig {
+    uint32_t entries;
+    uint32_t ways;  // entries / ways sets
+
+    TlbConfig(uint32_t entries, uint32_t ways) : entries(entries), ways(ways) {}
+};
+
+struct MmuConfig {
+    bool megapages;           // 4 MiB leaves in the root table instead of 4 KiB pages
+    uint32_t pageTableBase;   // Physical address of the root table, the next-level tables follow it
+    uint32_t walkLatency;     // Cycles per PTE read when there is no DRAM model
+    TlbConfig itlb;
+    TlbConfig dtlb;
+
+    MmuConfig() : megapages(false), pageTableBase(0xFFC00000u), walkLatency(10), itlb(16, 4), dtlb(32, 4) {}
+};
+
+// Set-associative TLB with LRU replacement, keyed by virtual page number
+class Tlb {
+public:
+    explicit Tlb(const TlbConfig& config);
+    // True, and the entry made most recent, if the page is present
+    bool lookup(uint32_t vpn);
+    void insert(uint32_t vpn);
+
+    TlbConfig config;
+    uint64_t lookups;
+    uint64_t misses;
+
+private:
+    struct Entry {
+        bool valid;
+        uint32_t vpn;
+        uint64_t lastUse;
+    };
+    std::vector<Entry> entries;  // Set s holds entries [s * ways, (s + 1) * ways)
+    uint32_t sets;
+    uint64_t useClock;
+};
+
+// Sv32 address translation (--sv32 4k|4m) for the timing of fetches and
+// data accesses.
+//
+// There is no privileged mode or satp in this model, so the translation is
+// the identity: page tables are kept in the data memory at pageTableBase and
+// a page is mapped to itself the first time the walker finds no valid PTE
+// for it, as a kernel would map it on first touch. The tables have the Sv32
+// layout (two levels of 1024 four-byte PTEs, V/R/W/X/A/D bits, PPN from bit
+// 10), so they can be dumped and read back. With 4 MiB megapages the root
+// table holds the leaves and a walk reads one PTE, otherwise two. Each PTE
+// read takes walkLatency cycles, or goes to the DRAM model when one is given.
+//
+// Fetches look up the I-TLB and loads, stores and atomics the D-TLB; a miss
+// walks the tables and fills the TLB, and IF or MEM waits for the walk.
+//
+// The tables take TABLE_REGION_SIZE bytes from pageTableBase, room for the
+// root and 1023 second-level tables. A walk that needs one more leaves the
+// page unmapped and sets 'exhausted'.
+class Sv32Mmu {
+public:
+    // The root table and the second-level tables after it, which nothing else may use
+    static constexpr uint32_t TABLE_REGION_SIZE = 4u << 20;
+
+    Sv32Mmu(const MmuConfig& config, Memory& memory, DramTiming* dram);
+
+    // Cycles the access to 'address' made in 'cycle' waits for translation: 0 on a TLB hit
+    uint32_t translate(uint32_t address, bool fetch, uint64_t cycle);
+    void printSummary(std::ostream& out) const;
+
+    MmuConfig config;
+    Tlb itlb;
+    Tlb dtlb;
+    uint64_t walks;
+    uint64_t pteReads;
+    uint64_t walkCycles;
+    uint64_t pagesMapped;
+    bool exhausted;  // A walk needed a second-level table past the table region; the run stops
+
+private:
+    Memory& memory;
+    DramTiming* dram;
+    uint32_t nextTable;  // Where the next second-level table goes
+
+    // Reads the PTE at 'address' as the walker does, adding its latency to 'cycles'
+    uint32_t readPte(uint32_t address, uint64_t cycle, uint32_t& cycles);
+    uint32_t walk(uint32_t address, uint64_t cycle);
+};
@@ -0,0 +1,134 @@
+#include "MultiHart.hpp"
+#include "Interconnect.hpp"
+#include "Processor.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Quantum barrier of the host threads
+class Barrier {
+public:
+    explicit Barrier(int count) : count(count), waiting(0), generation(0) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        uint64_t current = generation;
+        if (++waiting == count) {
+            waiting = 0;
+            generation++;
+            released.notify_all();
+            return;
+        }
+        released.wait(guard, [&] { return generation != current; });
+    }
+
+private:
+    int count;
+    int waiting;
+    uint64_t generation;
+    std::mutex lock;
+    std::condition_variable released;
+};
+
+} // namespace
+
+bool runHarts(const SimOptions& options, bool isforwardcpu, NoForwardingProcessor* (*createHart)()) {
+    std::vector<std::unique_ptr<NoForwardingProcessor>> harts;
+    for (int h = 0; h < options.harts; h++)
+        harts.emplace_back(createHart());
+
+    // Hart 0 owns the program, its string arena and the shared memory
+    NoForwardingProcessor& boot = *harts[0];
+    std::string filename = options.inputFile;
+    if (!boot.loadProgram(filename)) {
+        std::cerr << "Failed to load instructions from " << filename << std::endl;
+        return false;
+    }
+    boot.syscalls.setHart(0, options.harts);
+    if (!applyPreloads(boot, options)) {
+        std::cerr << "Failed to apply register/memory preloads" << std::endl;
+        return false;
+    }
+    boot.materializeInstructionStrings();
+    // Every other hart starts with sp STACK_SIZE below the previous hart's, whatever
+    // the program; ELF programs and --arg also get their argv built there, in the
+    // shared memory, and --reg preloads still override a0 and a1
+    uint32_t bootStack = static_cast<uint32_t>(boot.registers.read(2));
+    for (int h = 1; h < options.harts; h++) {
+        NoForwardingProcessor& hart = *harts[h];
+        hart.registers = boot.registers;
+        if (boot.syscalls.imageEnd != 0)
+            hart.syscalls.setImageEnd(boot.syscalls.imageEnd);
+        hart.syscalls.setHart(h, options.harts);
+        setupProgramStack(hart, boot.dataMemory, options);
+        for (const RegisterPreload& preload : options.registerPreloads)
+            hart.registers.write(preload.reg, preload.value);
+        hart.registers.write(2, static_cast<int32_t>(bootStack - static_cast<uint32_t>(h) * SyscallEmulator::STACK_SIZE));
+    }
+
+    int threads = options.hostThreads;
+    if (threads <= 0)
+        threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::min(threads, options.harts);
+    std::cout << "Running " << options.harts << " harts on " << threads << " host thread(s), quantum "
+              << options.quantum << " cycles" << std::endl;
+
+    // The cycle log is off during the run, whatever --quiet says
+    std::ios_base::iostate coutState = std::cout.rdstate();
+    Interconnect interconnect(boot.dataMemory, options.harts);
+    for (int h = 0; h < options.harts; h++) {
+        NoForwardingProcessor& hart = *harts[h];
+        if (h > 0) {
+            hart.instructionMemory = boot.instructionMemory;
+            hart.instructionStrings = boot.instructionStrings;
+            hart.textBase = boot.textBase;
+            hart.entryPC = boot.entryPC;
+        }
+        hart.registers.write(4, h);
+        hart.interconnect = &interconnect;
+        hart.hartId = h;
+        hart.outputTag = "_hart" + std::to_string(h);
+        applyRunSettings(hart, options);
+        std::cout.setstate(std::ios_base::failbit);
+        hart.beginRun(options.cycles);
+    }
+
+    // Host thread t runs harts t, t + threads, ...
+    Barrier barrier(threads);
+    auto worker = [&](int thread) {
+        for (int first = 0; first < options.cycles; first += options.quantum) {
+            int last = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(first) + options.quantum, options.cycles));
+            for (int h = thread; h < options.harts; h += threads)
+                harts[h]->runCycles(first, last);
+            barrier.wait();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (std::thread& thread : pool)
+        thread.join();
+
+    std::cout.clear(coutState);
+    if (options.quiet)
+        std::cout.setstate(std::ios_base::failbit);
+    for (int h = 0; h < options.harts; h++) {
+        NoForwardingProcessor& hart = *harts[h];
+        if (options.recordDiagram && options.foldDiagram)
+            hart.printFoldedDiagram(filename, isforwardcpu);
+        else if (options.recordDiagram)
+            hart.printPipelineDiagram(filename, isforwardcpu);
+        const Interconnect::HartStats& stats = interconnect.stats[h];
+        std::cout << "Hart " << h << (hart.halted ? " (halted)" : "") << ": " << stats.loads << " loads, "
+                  << stats.stores << " stores, " << stats.atomics << " atomics (" << stats.failedStoreConditionals
+                  << " failed SC), " << stats.transfers << " line transfers" << std::endl;
+    }
+    return writeMemoryDumps(boot, options);
+}
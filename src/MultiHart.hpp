@@ -0,0 +1,23 @@
+#pragma once
+#include "SimOptions.hpp"
+
+class NoForwardingProcessor;
+
+// Multi-hart simulation (--harts n): n processors run the same program on one
+// shared data memory, each with its own registers and pipeline. Hart h starts
+// at the entry point with the preloaded registers and tp (x4) = h, the usual
+// way for RV32 code to tell the harts apart.
+//
+// Memory accesses go through an Interconnect, which serializes them and keeps
+// the LR/SC reservations. The harts advance in quanta of 'quantum' cycles and
+// wait for each other at the end of every quantum; within a quantum a hart may
+// run ahead of the others by up to 'quantum' cycles. The harts are spread over
+// 'hostThreads' host threads (default: one per hart, up to the host's cores).
+// With one host thread the harts take turns in hart order each quantum and a
+// run is deterministic; with several the interleaving of accesses inside a
+// quantum depends on the host.
+//
+// Each hart writes its own diagram, named with "_hart<n>" before _out.txt.
+// The cycle log is not written, concurrent harts would interleave it.
+// 'createHart' returns a new processor of the simulated kind.
+bool runHarts(const SimOptions& options, bool isforwardcpu, NoForwardingProcessor* (*createHart)());
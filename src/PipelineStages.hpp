@@ -1,6 +1,33 @@
 #pragma once
 #include <cstdint>
-#include <string>
+#include <string_view>
+
+// Enumeration for pipeline stages.
+// We use STALL to indicate either a stall or an empty cell.
+enum PipelineStage {
+    SPACE=0,  // Empty cell in the pipeline diagram
+    STALL,
+    SLASH, 
+    IF,
+    ID,
+    EX,
+    MEM,
+    WB
+};
+
+// Helper function to convert enum value to printable string.
+inline const char* stageToString(PipelineStage stage) {
+    switch (stage) {
+        case IF:   return "IF";
+        case ID:   return "ID";
+        case EX:   return "EX";
+        case MEM:  return "MEM";
+        case WB:   return "WB";
+        case SLASH: return "/";
+        case STALL: return "-";
+        default:   return "  ";
+    }
+}
 
 // Control signals
 struct ControlSignals {
@@ -19,7 +46,7 @@ struct ControlSignals {
 struct IFIDRegister {
     int32_t pc;                   // Changed from uint32_t to int32_t
     uint32_t instruction;         // Raw machine code.
-    std::string instructionString;
+    std::string_view instructionString;  // View into the processor's instruction arena
     bool isEmpty;
 
     IFIDRegister() : pc(0), instruction(0), isEmpty(true) {}
@@ -36,12 +63,13 @@ struct IDEXRegister {
     uint32_t rs2;
     uint32_t rd;
     ControlSignals controls;
-    std::string instructionString;
+    std::string_view instructionString;  // View into the processor's instruction arena
     bool isEmpty;
     int32_t aluResult;  // Added to support early calculation of return addresses
+    int thread;         // Hardware thread of the instruction in an SMT pipeline (see SmtProcessor.hpp), else 0
 
     IDEXRegister() : pc(0), instruction(0), readData1(0), readData2(0), imm(0), rs1(0), rs2(0), rd(0),
-                     isEmpty(true), aluResult(0) {}
+                     isEmpty(true), aluResult(0), thread(0) {}
 };
 
 // EX/MEM Pipeline Register
@@ -52,10 +80,11 @@ struct EXMEMRegister {
     int32_t readData2;
     uint32_t rd;
     ControlSignals controls;
-    std::string instructionString;
+    std::string_view instructionString;  // View into the processor's instruction arena
     bool isEmpty;
+    int thread;
 
-    EXMEMRegister() : pc(0), instruction(0), aluResult(0), readData2(0), rd(0), isEmpty(true) {}
+    EXMEMRegister() : pc(0), instruction(0), aluResult(0), readData2(0), rd(0), isEmpty(true), thread(0) {}
 };
 
 // MEM/WB Pipeline Register
@@ -64,10 +93,12 @@ struct MEMWBRegister {
     uint32_t instruction;         // Propagated raw machine code.
     int32_t aluResult;
     int32_t readData;
+    int32_t storeData;  // rs2 of a store, the value it wrote
     uint32_t rd;
     ControlSignals controls;
-    std::string instructionString;
+    std::string_view instructionString;  // View into the processor's instruction arena
     bool isEmpty;
+    int thread;
 
-    MEMWBRegister() : pc(0), instruction(0), aluResult(0), readData(0), rd(0), isEmpty(true) {}
+    MEMWBRegister() : pc(0), instruction(0), aluResult(0), readData(0), storeData(0), rd(0), isEmpty(true), thread(0) {}
 };
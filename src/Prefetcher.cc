@@ -0,0 +1,127 @@
+#include "Prefetcher.hpp"
+#include "DramTiming.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+PrefetchUnit::PrefetchUnit(const PrefetchConfig& config, DramTiming* dram)
+    : config(config), loads(0), stores(0), bufferHits(0), demandMisses(0), issued(0), useful(0), late(0), unused(0),
+      dram(dram), table(TABLE_ENTRIES, TableEntry{0, false, 0, 0, 0}), useClock(0) {
+    buffer.reserve(config.bufferLines);
+}
+
+PrefetchUnit::Line* PrefetchUnit::find(uint32_t line) {
+    for (Line& entry : buffer) {
+        if (entry.line == line)
+            return &entry;
+    }
+    return nullptr;
+}
+
+PrefetchUnit::Line& PrefetchUnit::allocate(uint32_t line) {
+    if (buffer.size() < config.bufferLines) {
+        buffer.push_back(Line{line, 0, 0, false});
+        return buffer.back();
+    }
+    Line& victim = *std::min_element(buffer.begin(), buffer.end(),
+                                     [](const Line& a, const Line& b) { return a.lastUse < b.lastUse; });
+    if (victim.prefetched)
+        unused++;
+    victim = Line{line, 0, 0, false};
+    return victim;
+}
+
+uint32_t PrefetchUnit::memoryLatency(uint32_t address, bool write, uint64_t cycle) {
+    return dram ? dram->access(address, write, cycle) : std::max(1u, config.missLatency);
+}
+
+void PrefetchUnit::prefetch(uint32_t line, uint64_t cycle) {
+    if (find(line))
+        return;
+    issued++;
+    uint64_t readyAt = cycle + memoryLatency(line * LINE_BYTES, false, cycle);
+    Line& entry = allocate(line);
+    entry.readyAt = readyAt;
+    entry.lastUse = ++useClock;
+    entry.prefetched = true;
+}
+
+void PrefetchUnit::trainStride(int32_t pc, uint32_t address, uint64_t cycle) {
+    TableEntry& entry = table[(static_cast<uint32_t>(pc) >> 2) % TABLE_ENTRIES];
+    if (!entry.valid || entry.pc != pc) {
+        entry = TableEntry{pc, true, address, 0, 0};
+        return;
+    }
+    int32_t stride = static_cast<int32_t>(address - entry.lastAddress);
+    if (stride == entry.stride) {
+        entry.confidence = std::min(entry.confidence + 1, 3u);
+    } else {
+        entry.confidence = entry.confidence > 0 ? entry.confidence - 1 : 0;
+        if (entry.confidence == 0)
+            entry.stride = stride;
+    }
+    entry.lastAddress = address;
+    if (entry.confidence < 2 || entry.stride == 0)
+        return;
+    uint32_t line = address / LINE_BYTES;
+    for (uint32_t k = 1; k <= config.degree; k++) {
+        uint32_t target = (address + static_cast<uint32_t>(entry.stride) * k) / LINE_BYTES;
+        if (target != line)
+            prefetch(target, cycle);
+    }
+}
+
+uint32_t PrefetchUnit::access(int32_t pc, uint32_t address, bool write, uint64_t cycle) {
+    uint32_t line = address / LINE_BYTES;
+    uint32_t latency = 1;
+    bool trigger = false;  // The next-line prefetcher follows misses and first uses
+    if (write) {
+        stores++;
+        latency = memoryLatency(address, true, cycle);
+    } else {
+        loads++;
+        Line* entry = find(line);
+        if (entry) {
+            bufferHits++;
+            if (entry->prefetched) {
+                useful++;
+                if (entry->readyAt > cycle)
+                    late++;
+                entry->prefetched = false;
+                trigger = true;
+            }
+            latency = entry->readyAt > cycle ? static_cast<uint32_t>(entry->readyAt - cycle) : 1;
+            entry->lastUse = ++useClock;
+        } else {
+            demandMisses++;
+            trigger = true;
+            latency = memoryLatency(address, false, cycle);
+            Line& allocated = allocate(line);
+            allocated.readyAt = cycle + latency;
+            allocated.lastUse = ++useClock;
+        }
+    }
+    if (config.stride)
+        trainStride(pc, address, cycle);
+    if (config.nextLine && trigger) {
+        for (uint32_t k = 1; k <= config.degree; k++)
+            prefetch(line + k, cycle);
+    }
+    return latency;
+}
+
+void PrefetchUnit::printSummary(std::ostream& out) const {
+    if (loads + stores == 0)
+        return;
+    out << "Prefetch buffer (" << config.bufferLines << " lines of " << LINE_BYTES << " bytes, "
+        << (config.nextLine && config.stride ? "next-line and stride" : config.nextLine ? "next-line"
+            : config.stride ? "stride" : "no")
+        << " prefetch, degree " << config.degree << "): " << loads << " loads, " << bufferHits << " buffer hits, "
+        << demandMisses << " misses; " << issued << " prefetches, " << useful << " useful (" << late << " late), "
+        << unused << " evicted unused" << std::endl;
+    if (issued == 0)
+        return;
+    out << "Prefetch accuracy " << std::fixed << std::setprecision(1) << 100.0 * useful / issued << "%, coverage "
+        << (useful + demandMisses > 0 ? 100.0 * useful / (useful + demandMisses) : 0.0) << "%, timeliness "
+        << (useful > 0 ? 100.0 * (useful - late) / useful : 0.0) << "%" << std::defaultfloat << std::endl;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+class DramTiming;
+
+struct PrefetchConfig {
+    bool nextLine;         // Fetch the lines after a missed or first-used prefetched line
+    bool stride;           // PC-indexed reference prediction table
+    uint32_t bufferLines;  // Lines the prefetch buffer holds
+    uint32_t degree;       // Lines, or strides, fetched ahead per trigger
+    uint32_t missLatency;  // Cycles memory takes for a line when there is no DRAM model
+
+    PrefetchConfig() : nextLine(false), stride(false), bufferLines(16), degree(1), missLatency(20) {}
+};
+
+// A prefetch buffer in front of the data memory (--prefetch), and the
+// prefetchers that fill it from the addresses loads and stores compute.
+//
+// The buffer is a fully associative LRU set of LINE_BYTES lines, only timing:
+// the data itself stays in Memory. A load that finds its line takes one
+// cycle, or until the line arrives if it is still in flight; any other load
+// waits missLatency cycles, or for the DRAM model when one is given, and
+// brings its line in. Stores write through to memory at its latency and do
+// not allocate.
+//
+// The next-line prefetcher fetches the 'degree' lines after a line that
+// missed or whose prefetch was just used. The stride prefetcher keeps a
+// TABLE_ENTRIES entry reference prediction table indexed by the pc of the
+// load or store: the last address, the stride between the last two and a
+// two-bit confidence. Once the same stride repeated twice it fetches the
+// lines 'degree' strides ahead. Prefetches go to the DRAM model as reads,
+// so they compete with demand accesses for its banks and bus.
+//
+// A prefetched line is useful if a load uses it before it is evicted, and
+// late if that load still had to wait for it. Accuracy is useful / issued,
+// coverage useful / (useful + demand misses), timeliness the useful ones
+// that were not late.
+class PrefetchUnit {
+public:
+    static const uint32_t LINE_BYTES = 64;
+    static const uint32_t TABLE_ENTRIES = 64;
+
+    // 'dram' times the lines brought in, nullptr for a flat missLatency
+    PrefetchUnit(const PrefetchConfig& config, DramTiming* dram);
+
+    // Cycles from 'cycle' until a load or store made in MEM then is done (at
+    // least 1); trains the prefetchers and issues what they predict
+    uint32_t access(int32_t pc, uint32_t address, bool write, uint64_t cycle);
+    void printSummary(std::ostream& out) const;
+
+    PrefetchConfig config;
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t bufferHits;    // Loads that found their line, prefetched or brought in by an earlier miss
+    uint64_t demandMisses;
+    uint64_t issued;        // Prefetches sent to memory
+    uint64_t useful;
+    uint64_t late;
+    uint64_t unused;        // Prefetched lines evicted before any load used them
+
+private:
+    struct Line {
+        uint32_t line;
+        uint64_t readyAt;
+        uint64_t lastUse;
+        bool prefetched;  // Brought in by a prefetch and not used yet
+    };
+    struct TableEntry {
+        int32_t pc;
+        bool valid;
+        uint32_t lastAddress;
+        int32_t stride;
+        uint32_t confidence;
+    };
+
+    DramTiming* dram;
+    std::vector<Line> buffer;
+    std::vector<TableEntry> table;
+    uint64_t useClock;
+
+    Line* find(uint32_t line);
+    Line& allocate(uint32_t line);
+    uint32_t memoryLatency(uint32_t address, bool write, uint64_t cycle);
+    void prefetch(uint32_t line, uint64_t cycle);
+    void trainStride(int32_t pc, uint32_t address, uint64_t cycle);
+};
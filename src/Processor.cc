@@ -1,4 +1,8 @@
 #include "Processor.hpp"
+#include "MappedFile.hpp"
+#include "ProgramLoader.hpp"
+#include "RiscVDisassembler.hpp"
+#include "DiagramRenderer.hpp"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -6,6 +10,8 @@
 #include <algorithm>
 #include <cstdlib>
 #include <cassert>
+#include <charconv>
+#include <filesystem>
 #include <string.h>
 
 // ---------------------- Helper Functions ----------------------
@@ -147,6 +153,38 @@ ControlSignals NoForwardingProcessor::decodeControlSignals(uint32_t instruction)
             signals.regWrite = true;
             signals.aluSrc = true;
             break;
+
+        case 0x2F:  // RV32A: address in rs1 (immediate 0), rd gets the old word or the SC result
+            if (!isAtomicInstruction(instruction)) {
+                std::cerr << "Unknown atomic instruction: 0x" << std::hex << instruction << std::dec << std::endl;
+                signals.illegal_instruction = true;
+                break;
+            }
+            signals.regWrite = true;
+            signals.memRead = true;
+            signals.memWrite = (instruction >> 27) != AMO_LR;
+            signals.memToReg = true;
+            signals.aluSrc = true;
+            break;
+
+        case 0x57:  // OP-V, and the vector forms of LOAD-FP/STORE-FP
+        case 0x07:
+        case 0x27:  // Only vsetvl* and vmv.x.s write x[rd]; loads and stores go through vectorAccess() in MEM
+            if (!isVectorInstruction(instruction)) {
+                std::cerr << "Unknown vector instruction: 0x" << std::hex << instruction << std::dec << std::endl;
+                signals.illegal_instruction = true;
+                break;
+            }
+            signals.regWrite = vectorWritesScalar(instruction);
+            signals.aluSrc = true;
+            break;
+
+        case 0x73:  // SYSTEM: only ECALL, whose a0 the system call writes at WB
+            if (!isEcall(instruction)) {
+                std::cerr << "Unknown system instruction: 0x" << std::hex << instruction << std::dec << std::endl;
+                signals.illegal_instruction = true;
+            }
+            break;
             
         default:
             std::cerr << "Unknown opcode: 0x" << std::hex << opcode << std::endl;
@@ -186,7 +224,15 @@ int32_t NoForwardingProcessor::executeALU(int32_t a, int32_t b, uint32_t aluOp)
 // ---------------------- Pipeline Matrix Helpers ----------------------
 // Record a stage value for an instruction row at a given cycle.
 void NoForwardingProcessor::recordStage(int instrIndex, int cycle, PipelineStage stage) {
-    if (instrIndex < 0 || instrIndex >= matrixRows || cycle < 0 || cycle >= matrixCols)
+    if (instrIndex < 0 || cycle < 0)
+        return;
+    if (eventTrace)
+        eventTrace->stage(instrIndex, cycle, stage);
+    if (foldDiagram)
+        diagramFolder.record(instrIndex, cycle, stage);
+    if (loopExtrapolator.capturing)
+        loopExtrapolator.captureStage(instrIndex, cycle, stage);
+    if (instrIndex >= matrixRows || cycle >= matrixCols)
         return;
     // Check if there's only one element and it's SPACE
     if ( pipelineMatrix3D[instrIndex][cycle][0] == SPACE ) {
@@ -196,15 +242,190 @@ void NoForwardingProcessor::recordStage(int instrIndex, int cycle, PipelineStage
         // Append the new stage to the existing vector
         pipelineMatrix3D[instrIndex][cycle].push_back(stage);
     }
-    
+}
+
+void NoForwardingProcessor::recordCommit(int cycle) {
+    CommitRecord commit;
+    commit.cycle = cycle;
+    commit.pc = memwb.pc;
+    commit.flags = 0;
+    commit.rd = memwb.rd;
+    commit.rdValue = 0;
+    commit.memAddress = static_cast<uint32_t>(memwb.aluResult);
+    commit.memData = 0;
+    if (memwb.controls.regWrite && memwb.rd != 0) {
+        commit.flags |= COMMIT_HAS_RD;
+        commit.rdValue = memwb.controls.memToReg ? memwb.readData : memwb.aluResult;
+    }
+    if (memwb.controls.memRead) {
+        commit.flags |= COMMIT_LOAD;
+        commit.memData = memwb.readData;
+    } else if (memwb.controls.memWrite) {
+        // The value the store wrote, cut to its width; with a store buffer it
+        // may not have reached memory yet
+        commit.flags |= COMMIT_STORE;
+        uint32_t funct3 = (memwb.instruction >> 12) & 0x7;
+        commit.memData = (funct3 == 0x0) ? (memwb.storeData & 0xFF)
+                       : (funct3 == 0x1) ? (memwb.storeData & 0xFFFF)
+                                         : memwb.storeData;
+    }
+    eventTrace->commit(commit);
 }
 
 // Return the index of an instruction correspondin to pc in instructionStrings.
 // (Assumes instructions are in program order.)
 int NoForwardingProcessor::getInstructionIndex(int32_t index) const {
-    if (index < 0 || (index/4) >= static_cast<int32_t>(instructionStrings.size()))
+    if (index < textBase || ((index - textBase)/4) >= static_cast<int32_t>(instructionStrings.size()))
         return -1;
-    return static_cast<int>(index / 4);
+    return static_cast<int>((index - textBase) / 4);
+}
+
+// ---------------------- Data Memory Access ----------------------
+int32_t NoForwardingProcessor::loadData(uint32_t funct3, uint32_t address) {
+    uint32_t bytes = StoreBuffer::accessBytes(funct3);
+    uint32_t covered = storeBuffer ? storeBuffer->coverage(address, bytes) : 0;
+    if (covered != 0) {
+        // The unsigned load of the same width gives the raw bytes under the buffered ones
+        uint32_t raw = 0;
+        uint32_t unsignedFunct3 = bytes == 1 ? 0x4 : bytes == 2 ? 0x5 : 0x2;
+        if (covered != (1u << bytes) - 1)
+            raw = static_cast<uint32_t>(interconnect ? interconnect->load(hartId, unsignedFunct3, address)
+                                                     : dataMemory.load(unsignedFunct3, address));
+        return storeBuffer->forward(funct3, address, raw);
+    }
+    return interconnect ? interconnect->load(hartId, funct3, address) : dataMemory.load(funct3, address);
+}
+
+void NoForwardingProcessor::storeData(uint32_t funct3, uint32_t address, int32_t value) {
+    if (storeBuffer)
+        storeBuffer->push(exmem.pc, funct3, address, value, true);
+    else if (interconnect)
+        interconnect->store(hartId, funct3, address, value);
+    else
+        dataMemory.store(funct3, address, value);
+}
+
+int32_t NoForwardingProcessor::atomicAccess(uint32_t instruction, uint32_t address, int32_t operand) {
+    if (interconnect)
+        return interconnect->atomic(hartId, instruction, address, operand);
+    bool stored = false;
+    return executeAtomic(dataMemory, reservation, instruction, address, operand, stored);
+}
+
+void NoForwardingProcessor::vectorAccess(uint32_t instruction, uint32_t address, int32_t stride) {
+    if (interconnect)
+        interconnect->vectorTransfer(hartId, vector, instruction, address, stride);
+    else
+        vector.transfer(instruction, address, stride, dataMemory);
+}
+
+bool NoForwardingProcessor::occupyStage(uint32_t& cyclesLeft, uint32_t cycles) {
+    if (cyclesLeft == 0)
+        cyclesLeft = cycles;
+    return --cyclesLeft > 0;
+}
+
+bool NoForwardingProcessor::occupyMemoryStage(const VectorUnit& unit, int cycle) {
+    if (storeBuffer)
+        drainStoreBuffer(static_cast<uint64_t>(cycle));
+    if (exmem.isEmpty)
+        return false;
+    if (memCyclesLeft > 0 || (!dram && !prefetcher && !storeBuffer && !mmu))
+        return occupyStage(memCyclesLeft, unit.memoryCycles(exmem.instruction));
+    uint32_t opcode = exmem.instruction & 0x7F;
+    bool vectorAccess = isVectorMemoryAccess(exmem.instruction);
+    if (!exmem.controls.memRead && !exmem.controls.memWrite && !vectorAccess)
+        return occupyStage(memCyclesLeft, 1);
+    bool write = (opcode == 0x23 || opcode == 0x27) && !exmem.controls.memRead;
+    uint32_t address = static_cast<uint32_t>(exmem.aluResult);
+    if (storeBuffer) {
+        if ((opcode == 0x2F || vectorAccess) && !storeBuffer->empty()) {
+            storeBuffer->drainWaitCycles++;
+            return true;
+        }
+        if (opcode == 0x23 && storeBuffer->full()) {
+            storeBuffer->fullStallCycles++;
+            return true;
+        }
+    }
+    // The D-TLB is looked up once the access can go; memory sees it after the walk
+    uint32_t walk = mmu ? mmu->translate(address, false, static_cast<uint64_t>(cycle)) : 0;
+    uint64_t start = static_cast<uint64_t>(cycle) + walk;
+    if (storeBuffer) {
+        if (opcode == 0x23)
+            return occupyStage(memCyclesLeft, 1 + walk);
+        if (opcode == 0x03) {
+            uint32_t bytes = StoreBuffer::accessBytes((exmem.instruction >> 12) & 0x7);
+            uint32_t covered = storeBuffer->coverage(address, bytes);
+            if (covered == (1u << bytes) - 1) {
+                storeBuffer->forwardedLoads++;
+                return occupyStage(memCyclesLeft, 1 + walk);
+            }
+            if (covered != 0)
+                storeBuffer->partialLoads++;
+        }
+    }
+    // The first element of a vector access waits for memory, the rest stream behind it
+    uint32_t latency = 1;
+    if (prefetcher)
+        latency = prefetcher->access(exmem.pc, address, write, start);
+    else if (dram)
+        latency = dram->access(address, write, start);
+    return occupyStage(memCyclesLeft, unit.memoryCycles(exmem.instruction) + walk + latency - 1);
+}
+
+bool NoForwardingProcessor::occupyFetchStage(int cycle) {
+    if (!mmu)
+        return false;
+    if (fetchCyclesLeft == 0) {
+        if (stall)
+            return false;
+        fetchCyclesLeft = 1 + mmu->translate(static_cast<uint32_t>(pc), true, static_cast<uint64_t>(cycle));
+    }
+    return --fetchCyclesLeft > 0;
+}
+
+void NoForwardingProcessor::drainStoreBuffer(uint64_t cycle) {
+    while (!storeBuffer->empty()) {
+        StoreBuffer::Entry& head = storeBuffer->entries.front();
+        if (!head.draining) {
+            head.draining = true;
+            head.doneAt = cycle + (prefetcher ? prefetcher->access(head.pc, head.address, true, cycle)
+                                   : dram ? dram->access(head.address, true, cycle) : 1);
+        }
+        if (head.doneAt > cycle)
+            return;
+        if (head.writesMemory) {
+            uint32_t funct3 = head.bytes == 1 ? 0x0 : head.bytes == 2 ? 0x1 : 0x2;
+            if (interconnect)
+                interconnect->store(hartId, funct3, head.address, static_cast<int32_t>(head.value));
+            else
+                dataMemory.store(funct3, head.address, static_cast<int32_t>(head.value));
+        }
+        storeBuffer->entries.pop_front();
+        storeBuffer->drained++;
+    }
+}
+
+void NoForwardingProcessor::flushStoreBuffer() {
+    if (!storeBuffer)
+        return;
+    for (StoreBuffer::Entry& entry : storeBuffer->entries) {
+        entry.draining = true;
+        entry.doneAt = 0;
+    }
+    drainStoreBuffer(0);
+}
+
+bool NoForwardingProcessor::commitSyscall(int cycle) {
+    syscallPending = false;
+    flushStoreBuffer();
+    if (syscalls.handle(*this, static_cast<uint64_t>(cycle)))
+        return true;
+    std::cout << "Program exited with code " << syscalls.exitCode << " at PC: " << memwb.pc << std::endl;
+    std::cout << "----------------------> Breaking the simulation" << std::endl;
+    halted = true;
+    return false;
 }
 
 // ---------------------- Register Usage Tracker Functions ----------------------
@@ -232,7 +453,23 @@ void NoForwardingProcessor::clearRegisterUsage(uint32_t regNum) {
 // ---------------------- Constructor/Destructor ----------------------
 NoForwardingProcessor::NoForwardingProcessor() : 
     pc(0), 
+    textBase(0),
+    entryPC(0),
     stall(false),
+    recordDiagram(true),
+    extrapolateLoops(false),
+    eventTrace(nullptr),
+    foldDiagram(false),
+    criticalPath(nullptr),
+    intervalSampler(nullptr),
+    interconnect(nullptr),
+    hartId(0),
+    halted(false),
+    exCyclesLeft(0),
+    memCyclesLeft(0),
+    fetchCyclesLeft(0),
+    exHeld(false),
+    syscallPending(false),
     regUsageTracker(32)  // Initialize register usage tracker with 32 empty vectors
 {
     // No need to initialize regInUse array anymore
@@ -285,7 +522,7 @@ bool NoForwardingProcessor::loadInstructions(const std::string& filename) {
                   
         uint32_t instruction = std::stoul(hexCode, nullptr, 16);
         instructionMemory.push_back(instruction);
-        instructionStrings.push_back(instructionDesc);
+        instructionStrings.push_back(instructionArena.store(instructionDesc));
     }
     
     std::cout << "Loaded " << instructionMemory.size() << " instructions. Instruction strings size: " 
@@ -293,6 +530,114 @@ bool NoForwardingProcessor::loadInstructions(const std::string& filename) {
     return !instructionMemory.empty();
 }
 
+bool NoForwardingProcessor::loadInstructionsFast(const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+
+    const char* begin = reinterpret_cast<const char*>(file.data());
+    const char* end = begin + file.size();
+
+    // Size everything up front so the parse loop never reallocates; the arena gets
+    // one block as large as the file, which bounds the total description text.
+    size_t lineCount = 0;
+    for (const char* p = begin; p < end; lineCount++) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        p = eol ? eol + 1 : end;
+    }
+    instructionMemory.reserve(instructionMemory.size() + lineCount);
+    instructionStrings.reserve(instructionStrings.size() + lineCount);
+    instructionArena.reserve(file.size());
+
+    size_t lineNumber = 0;
+    size_t malformedLines = 0;
+    const char* line = begin;
+    while (line < end) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (!eol)
+            eol = end;
+        lineNumber++;
+
+        // Trim leading whitespace.
+        const char* p = line;
+        while (p < eol && (*p == ' ' || *p == '\t'))
+            p++;
+        line = (eol < end) ? eol + 1 : end;
+        if (p == eol)
+            continue;
+
+        // Ensure the line has at least 8 characters for the hex code.
+        if (eol - p < 8) {
+            std::cerr << "Warning: line " << lineNumber << " does not contain enough characters for a valid hex code: "
+                      << std::string_view(p, eol - p) << std::endl;
+            continue;
+        }
+
+        // The first 8 characters are the hex code, an optional 0x prefix is accepted like std::stoul does
+        const char* hexBegin = p;
+        const char* hexEnd = p + 8;
+        const char* digits = hexBegin;
+        if (digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X'))
+            digits += 2;
+        uint32_t instruction = 0;
+        std::from_chars_result parsed = std::from_chars(digits, hexEnd, instruction, 16);
+        // Short codes padded with blanks inside the 8 columns ("2830383 lb ...") are valid
+        const char* rest = parsed.ptr;
+        while (rest < hexEnd && (*rest == ' ' || *rest == '\t'))
+            rest++;
+        if (parsed.ec != std::errc() || rest != hexEnd) {
+            std::cerr << "Error: line " << lineNumber << ": invalid hex code \""
+                      << std::string_view(hexBegin, 8) << "\"" << std::endl;
+            malformedLines++;
+            continue;
+        }
+
+        // The rest of the line is the instruction description, trimmed on both sides
+        const char* descBegin = hexEnd;
+        while (descBegin < eol && (*descBegin == ' ' || *descBegin == '\t'))
+            descBegin++;
+        const char* descEnd = eol;
+        while (descEnd > descBegin && (descEnd[-1] == ' ' || descEnd[-1] == '\t' || descEnd[-1] == '\r'))
+            descEnd--;
+
+        // If instruction description is empty, use hexCode.
+        std::string_view instructionDesc = (descBegin < descEnd) ? std::string_view(descBegin, descEnd - descBegin)
+                                                                 : std::string_view(hexBegin, 8);
+        instructionMemory.push_back(instruction);
+        instructionStrings.push_back(instructionArena.store(instructionDesc));
+    }
+
+    if (malformedLines > 0) {
+        std::cerr << "Error: " << malformedLines << " malformed line(s) in " << filename << std::endl;
+        return false;
+    }
+    std::cout << "Loaded " << instructionMemory.size() << " instructions from " << filename << std::endl;
+    return !instructionMemory.empty();
+}
+
+bool NoForwardingProcessor::loadProgram(const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+
+    if (ProgramLoader::isElf(file))
+        return ProgramLoader::loadElf(*this, file, filename);
+
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    if (filename.find_last_of('.') != std::string::npos && extension == "bin")
+        return ProgramLoader::loadFlatBinary(*this, file, filename);
+
+    file.close();
+    return loadInstructionsFast(filename);
+}
+
+void NoForwardingProcessor::materializeInstructionStrings() {
+    for (size_t i = 0; i < instructionStrings.size(); i++) {
+        if (instructionStrings[i].empty())
+            instructionStrings[i] = instructionArena.store(disassembleInstruction(instructionMemory[i]));
+    }
+}
+
 // ---------------------- Hazard Detection ----------------------
 bool NoForwardingProcessor::detect_hazard(bool hazard, uint32_t opcode, uint32_t rs1, uint32_t rs2) {
     // Instructions with no source register dependencies
@@ -313,26 +658,43 @@ bool NoForwardingProcessor::detect_hazard(bool hazard, uint32_t opcode, uint32_t
     // Instructions with both rs1 and rs2 dependencies
     else if (opcode == 0x33 || // R-type ALU
                 opcode == 0x23 || // STORE
-                opcode == 0x63) { // BRANCH
+                opcode == 0x63 || // BRANCH
+                opcode == 0x2F) { // Atomics (address and operand)
         // Check both rs1 and rs2 for hazards
         hazard = ((rs1 != 0 && isRegisterUsedBy(rs1)) || (rs2 != 0 && isRegisterUsedBy(rs2)));
     }
+    // Vector instructions read rs1, rs2, both or neither depending on the form
+    else if (opcode == 0x57 || opcode == 0x07 || opcode == 0x27) {
+        uint32_t sources[2];
+        int count = vectorScalarSources(ifid.instruction, sources);
+        hazard = false;
+        for (int i = 0; i < count; i++)
+            hazard = hazard || (sources[i] != 0 && isRegisterUsedBy(sources[i]));
+    }
     return hazard;
 }
 
 // ---------------------- Run Simulation ----------------------
-void NoForwardingProcessor::run(int cycles) {
+void NoForwardingProcessor::resetPipeline(int cycles) {
     // Reset pipeline state.
-    pc = 0;
+    pc = entryPC;
     stall = false;
+    halted = false;
     ifid.isEmpty = true;
     idex.isEmpty = true;
     exmem.isEmpty = true;
     memwb.isEmpty = true;
     Imm_valid = true;
+    exCyclesLeft = 0;
+    memCyclesLeft = 0;
+    fetchCyclesLeft = 0;
+    exHeld = false;
+    syscallPending = false;
+    traceVector.reset(vector.vlen(), vector.lanes());  // runTrace() starts from the reset vl and vtype
 
-    // Allocate the pipeline matrix.
-    matrixRows = static_cast<int>(instructionStrings.size());
+    // Allocate the pipeline matrix. With recording off it stays empty and
+    // recordStage() drops every stage on its bounds check.
+    matrixRows = recordDiagram ? static_cast<int>(instructionStrings.size()) : 0;
     matrixCols = cycles;
 
     // Resize the outer vector to have matrixRows elements
@@ -346,9 +708,27 @@ void NoForwardingProcessor::run(int cycles) {
             pipelineMatrix3D[i][j].push_back(SPACE);
         }
     }
-    
+    if (foldDiagram)
+        diagramFolder.reset(static_cast<int>(instructionStrings.size()), cycles);
+}
+
+void NoForwardingProcessor::run(int cycles) {
+    beginRun(cycles);
+    runCycles(0, cycles);
+}
+
+void NoForwardingProcessor::beginRun(int cycles) {
+    resetPipeline(cycles);
+    if (extrapolateLoops)
+        loopExtrapolator.reset(this);
+}
+
+void NoForwardingProcessor::runCycles(int firstCycle, int lastCycle) {
+    if (halted)
+        return;
+
     // Simulation loop.
-    for (int cycle = 0; cycle < cycles; cycle++) {
+    for (int cycle = firstCycle; cycle < lastCycle; cycle++) {
         std::cout << "========== Starting Cycle " << cycle << " ==========" << std::endl;
         bool branchTaken = false;
         int32_t branchTarget = 0;  // Changed to signed 32-bit
@@ -359,69 +739,62 @@ void NoForwardingProcessor::run(int cycles) {
             int idx = getInstructionIndex(memwb.pc);
             if (idx != -1)
                 recordStage(idx, cycle, WB);
+            if (eventTrace)
+                recordCommit(cycle);
+            if (criticalPath)
+                criticalPath->commit(cycle, memwb.pc, memwb.instruction);
+            if (intervalSampler)
+                intervalSampler->commit(cycle, memwb.pc, memwb.instruction);
             if (memwb.controls.regWrite && memwb.rd != 0) {
                 int32_t writeData = memwb.controls.memToReg ? memwb.readData : memwb.aluResult;
                 registers.write(memwb.rd, writeData);
                 clearRegisterUsage(memwb.rd);       
                 std::cout << "         Written " << writeData << " to register x" << memwb.rd << std::endl;
             }
+            if (isEcall(memwb.instruction) && !commitSyscall(cycle))
+                return;
         }
         else {
             std::cout << "Cycle " << cycle << " - WB: No instruction" << std::endl;
         }
         
         // -------------------- MEM Stage --------------------
-        if (!exmem.isEmpty) {
+        // A vector load or store keeps MEM until all of its elements have moved, and
+        // with --dram or --prefetch every access until memory returns its data
+        bool memHeld = occupyMemoryStage(vector, cycle);
+        if (memHeld) {
+            std::cout << "Cycle " << cycle << " - MEM: Processing " << exmem.instructionString << " at PC: " << exmem.pc
+                      << " (" << memCyclesLeft << " more cycle(s))" << std::endl;
+            recordStage(getInstructionIndex(exmem.pc), cycle, MEM);
+            memwb.isEmpty = true;
+        }
+        else if (!exmem.isEmpty) {
             std::cout << "Cycle " << cycle << " - MEM: Processing " << exmem.instructionString << " at PC: " << exmem.pc << std::endl;
             int idx = getInstructionIndex(exmem.pc);
             if (idx != -1)
                 recordStage(idx, cycle, MEM);
-            if (exmem.controls.memRead) {
-                // Determine the type of load based on the funct3 field
-                uint32_t funct3 = (exmem.instruction >> 12) & 0x7;
-                switch (funct3) {
-                    case 0x0: // LB - Load Byte (sign-extended)
-                        memwb.readData = static_cast<int8_t>(dataMemory.readByte(exmem.aluResult));
-                        break;
-                    case 0x1: // LH - Load Half-word (sign-extended)
-                        memwb.readData = dataMemory.readHalfWord(exmem.aluResult);
-                        break;
-                    case 0x2: // LW - Load Word
-                        memwb.readData = dataMemory.readWord(exmem.aluResult);
-                        break;
-                    case 0x4: // LBU - Load Byte (zero-extended)
-                        memwb.readData = dataMemory.readByte(exmem.aluResult);
-                        break;
-                    case 0x5: // LHU - Load Half-word (zero-extended)
-                        memwb.readData = static_cast<uint16_t>(dataMemory.readHalfWord(exmem.aluResult) & 0xFFFF);
-                        break;
-                    default: // Default to word for unknown types
-                        memwb.readData = dataMemory.readWord(exmem.aluResult);
-                        break;
+            // Width and extension come from funct3 (see Memory::load/store)
+            uint32_t funct3 = (exmem.instruction >> 12) & 0x7;
+            if ((exmem.instruction & 0x7F) == 0x2F) {
+                memwb.readData = atomicAccess(exmem.instruction, exmem.aluResult, exmem.readData2);
+                std::cout << "         Atomic access at address " << exmem.aluResult << " operand: " << exmem.readData2
+                          << " result: " << memwb.readData << std::endl;
+            } else if (isVectorMemoryAccess(exmem.instruction)) {
+                vectorAccess(exmem.instruction, exmem.aluResult, exmem.readData2);
+                std::cout << "         Vector access of " << vector.vl << " element(s) at address " << exmem.aluResult << std::endl;
+            } else {
+                if (exmem.controls.memRead) {
+                    memwb.readData = loadData(funct3, exmem.aluResult);
+                    std::cout << "         Read from memory at address " << exmem.aluResult << " data: " << memwb.readData << std::endl;
                 }
-                std::cout << "         Read from memory at address " << exmem.aluResult << " data: " << memwb.readData << std::endl;
-            }
-            if (exmem.controls.memWrite) {
-                // Determine the type of store based on the funct3 field
-                uint32_t funct3 = (exmem.instruction >> 12) & 0x7;
-                switch (funct3) {
-                    case 0x0: // SB - Store Byte
-                        dataMemory.writeByte(exmem.aluResult, exmem.readData2 & 0xFF);
-                        break;
-                    case 0x1: // SH - Store Half-word
-                        dataMemory.writeHalfWord(exmem.aluResult, exmem.readData2 & 0xFFFF);
-                        break;
-                    case 0x2: // SW - Store Word
-                        dataMemory.writeWord(exmem.aluResult, exmem.readData2);
-                        break;
-                    default: // Default to word for unknown types
-                        dataMemory.writeWord(exmem.aluResult, exmem.readData2);
-                        break;
+                if (exmem.controls.memWrite) {
+                    storeData(funct3, exmem.aluResult, exmem.readData2);
+                    std::cout << "         Wrote " << exmem.readData2 << " to memory at address " << exmem.aluResult << "---> Funt3: "<< funct3 << std::endl;
                 }
-                std::cout << "         Wrote " << exmem.readData2 << " to memory at address " << exmem.aluResult << "---> Funt3: "<< funct3 << std::endl;
             }
             memwb.pc = exmem.pc;
             memwb.aluResult = exmem.aluResult;
+            memwb.storeData = exmem.readData2;
             memwb.rd = exmem.rd;
             memwb.controls = exmem.controls;
             memwb.instruction = exmem.instruction;
@@ -434,7 +807,21 @@ void NoForwardingProcessor::run(int cycles) {
         }
         
         // -------------------- EX Stage --------------------
-        if (!idex.isEmpty) {
+        // EX waits while MEM is held, and a vector instruction stays as many cycles as its elements take
+        if (memHeld) {
+            if (!idex.isEmpty) {
+                std::cout << "Cycle " << cycle << " - EX: " << idex.instructionString << " at PC: " << idex.pc
+                          << " waits for MEM" << std::endl;
+                recordStage(getInstructionIndex(idex.pc), cycle, EX);
+            }
+        }
+        else if (!idex.isEmpty && occupyStage(exCyclesLeft, vector.executeCycles(idex.instruction))) {
+            std::cout << "Cycle " << cycle << " - EX: Processing " << idex.instructionString << " at PC: " << idex.pc
+                      << " (" << exCyclesLeft << " more cycle(s))" << std::endl;
+            recordStage(getInstructionIndex(idex.pc), cycle, EX);
+            exmem.isEmpty = true;
+        }
+        else if (!idex.isEmpty) {
             std::cout << "Cycle " << cycle << " - EX: Processing " << idex.instructionString << " at PC: " << idex.pc << std::endl;
             int idx = getInstructionIndex(idex.pc);
             if (idx != -1)
@@ -460,6 +847,10 @@ void NoForwardingProcessor::run(int cycles) {
                 exmem.aluResult = idex.aluResult;
                 std::cout << "         Setting return address (PC+4): " << exmem.aluResult << std::endl;
             }
+            else if (isVectorInstruction(idex.instruction)) {
+                exmem.aluResult = vector.execute(idex.instruction, aluOp1, idex.readData2);
+                std::cout << "         Vector instruction, vl = " << vector.vl << std::endl;
+            }
             // Only handle ALU operations here, branch/jump is already handled in ID stage
             else {
                 exmem.aluResult = executeALU(aluOp1, aluOp2, idex.controls.aluOp);
@@ -479,6 +870,8 @@ void NoForwardingProcessor::run(int cycles) {
             std::cout << "Cycle " << cycle << " - EX: No instruction" << std::endl;
         }
         
+        exHeld = !idex.isEmpty && (memHeld || exCyclesLeft > 0);
+
         // -------------------- ID Stage --------------------
         if (!ifid.isEmpty) {
             std::cout << "Cycle " << cycle << " - ID: Processing " << ifid.instructionString << " at PC: " << ifid.pc << std::endl;
@@ -501,6 +894,8 @@ void NoForwardingProcessor::run(int cycles) {
             bool hazard = false;
             
             hazard = detect_hazard(hazard, opcode, rs1, rs2);
+            hazard = hazard || exHeld;  // EX still has its instruction
+            hazard = hazard || syscallPending;  // An ECALL has to commit first
             
             //  If no hazards not detected
             if (!hazard) {
@@ -512,6 +907,7 @@ void NoForwardingProcessor::run(int cycles) {
                         std::cout<<"Invalid Immediate value at PC: "<< ifid.pc <<std::endl;
                         std::cout<<"Instruction: "<<ifid.instructionString<<std::endl;
                         std::cout<<"----------------------> Breaking the simulation"<<std::endl;
+                        halted = true;
                         return;
                     }
                 }
@@ -531,6 +927,10 @@ void NoForwardingProcessor::run(int cycles) {
                 idex.rs2 = rs2;
                 idex.rd = rd;
                 idex.controls = decodeControlSignals(instruction);
+                if (!idex.controls.illegal_instruction && !vector.accepts(instruction)) {
+                    std::cerr << "Vector instruction not allowed with vtype 0x" << std::hex << vector.vtype << std::dec << std::endl;
+                    idex.controls.illegal_instruction = true;
+                }
                 idex.instruction = ifid.instruction;
                 idex.instructionString = ifid.instructionString;
                 idex.isEmpty = false;
@@ -539,16 +939,19 @@ void NoForwardingProcessor::run(int cycles) {
                     std::cout<<"Illegal instruction detected at PC: "<< ifid.pc <<std::endl;
                     std::cout<<"Instruction: "<<ifid.instructionString<<std::endl;
                     std::cout<<"----------------------> Breaking the simulation"<<std::endl;
+                    halted = true;
                     return;
                 }
                 if (idex.controls.regWrite && rd != 0) {                          
                     addRegisterUsage(rd);
                     std::cout << "         Marking register x" << rd << " as busy "<< " size: "<< regUsageTracker[rd].size() << std::endl;
                 }
+                syscallPending = isEcall(instruction);
             }
             else {
                 stall = true;
-                idex.isEmpty = true;
+                if (!exHeld)
+                    idex.isEmpty = true;
                 std::cout << "         Hazard detected: Stalling pipeline." << std::endl;
                 if (rs1 != 0 && isRegisterUsedBy(rs1))
                     std::cout << "         Register x" << rs1 << " is in use"<< " size: "<< regUsageTracker[rd].size() << std::endl;
@@ -558,20 +961,29 @@ void NoForwardingProcessor::run(int cycles) {
             }
         }
         else {
-            idex.isEmpty = true;
+            if (!exHeld)
+                idex.isEmpty = true;
             std::cout << "Cycle " << cycle << " - ID: No instruction" << std::endl;
         }
         
         // -------------------- IF Stage --------------------
         std::cout << "Stall: " << stall << "; pc: " << pc << "; instructionMemory.size(): " << instructionMemory.size() << std::endl;
-        if (!stall && (pc / 4 < static_cast<int32_t>(instructionMemory.size()))) {  // Adjusted for signed pc
-            ifid.instruction = instructionMemory[pc / 4];
+        int fetchIdx = getInstructionIndex(pc);
+        // With --sv32 a fetch that misses the I-TLB waits in IF for the page walk
+        bool fetchHeld = fetchIdx != -1 && occupyFetchStage(cycle);
+        if (fetchHeld) {
+            if (!stall)
+                ifid.isEmpty = true;
+            recordStage(fetchIdx, cycle, IF);
+            std::cout << "Cycle " << cycle << " - IF: Page walk for PC: " << pc << " (" << fetchCyclesLeft
+                      << " more cycle(s))" << std::endl;
+        }
+        else if (!stall && fetchIdx != -1) {  // pc is relative to textBase
+            ifid.instruction = instructionMemory[fetchIdx];
             ifid.pc = pc;
-            ifid.instructionString = instructionStrings[pc / 4];
+            ifid.instructionString = instructionStrings[fetchIdx];
             ifid.isEmpty = false;
-            int idx = getInstructionIndex(ifid.pc);
-            if (idx != -1)
-                recordStage(idx, cycle, IF);
+            recordStage(fetchIdx, cycle, IF);
             std::cout << "Cycle " << cycle << " - IF: Fetched " << ifid.instructionString << " at PC: " << pc << std::endl;
             pc += 4;
         }
@@ -591,28 +1003,214 @@ void NoForwardingProcessor::run(int cycles) {
             pc = branchTarget;
             // If we have a branch/jump in ID, we only need to flush IF stage
             ifid.isEmpty = true;
+            fetchCyclesLeft = 0;  // A page walk for the wrong path is dropped
             std::cout << "         Flushing pipeline due to branch/jump" << std::endl;
         }
         if (stall) {
             stall = false;
         }
         
+        std::cout << "========== Ending Cycle " << cycle << " ==========" << std::endl << std::endl;
+        // A page walk found the page table region full
+        if (mmu && mmu->exhausted) {
+            std::cout << "----------------------> Breaking the simulation" << std::endl;
+            halted = true;
+            return;
+        }
+
+        // A taken backward branch ends a loop iteration; steady-state iterations are skipped
+        if (extrapolateLoops)
+            cycle += loopExtrapolator.endOfCycle(cycle, lastCycle, branchTaken && branchTarget <= idex.pc);
+    }
+}
+
+// ---------------------- Trace-Driven Run ----------------------
+bool NoForwardingProcessor::issueFromTrace(TraceSource& trace, bool& branchTaken, int32_t& branchTarget) {
+    RetiredInstruction retired;
+    if (!trace.next(retired)) {
+        if (trace.endStatus == STEP_ILLEGAL) {
+            std::cout << "Illegal instruction detected at PC: " << ifid.pc << std::endl;
+            std::cout << "Instruction: " << ifid.instructionString << std::endl;
+        } else if (trace.endStatus == STEP_BAD_OFFSET) {
+            std::cout << "Invalid Immediate value at PC: " << ifid.pc << std::endl;
+            std::cout << "Instruction: " << ifid.instructionString << std::endl;
+        } else if (trace.endStatus == STEP_EXIT) {
+            std::cout << "Program exited, end of trace at PC: " << ifid.pc << std::endl;
+        } else {
+            std::cout << "End of trace reached at PC: " << ifid.pc << std::endl;
+        }
+        std::cout << "----------------------> Breaking the simulation" << std::endl;
+        return false;
+    }
+    if (retired.pc != ifid.pc) {
+        std::cerr << "Error: trace record for PC " << retired.pc << " does not match the instruction at PC "
+                  << ifid.pc << std::endl;
+        return false;
+    }
+
+    uint32_t instruction = ifid.instruction;
+    uint32_t opcode = instruction & 0x7F;
+    if (opcode == 0x63 || opcode == 0x67 || opcode == 0x6F) {
+        branchTaken = retired.taken;
+        branchTarget = retired.nextPc;
+        if (branchTaken)
+            std::cout << "         Branch/jump taken to PC: " << branchTarget << std::endl;
+    }
+    idex.readData1 = retired.rs1Value;
+    idex.readData2 = retired.rs2Value;
+    idex.aluResult = retired.result;
+    idex.pc = ifid.pc;
+    idex.imm = extractImmediate(instruction, opcode);
+    idex.rs1 = (instruction >> 15) & 0x1F;
+    idex.rs2 = (instruction >> 20) & 0x1F;
+    idex.rd = (instruction >> 7) & 0x1F;
+    idex.controls = decodeControlSignals(instruction);
+    idex.instruction = instruction;
+    idex.instructionString = ifid.instructionString;
+    idex.isEmpty = false;
+    return true;
+}
+
+void NoForwardingProcessor::runTrace(int cycles, TraceSource& trace) {
+    resetPipeline(cycles);
+
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        std::cout << "========== Starting Cycle " << cycle << " ==========" << std::endl;
+        bool branchTaken = false;
+        int32_t branchTarget = 0;
+
+        // -------------------- WB Stage --------------------
+        if (!memwb.isEmpty) {
+            std::cout << "Cycle " << cycle << " - WB: Processing " << memwb.instructionString << " at PC: " << memwb.pc << std::endl;
+            recordStage(getInstructionIndex(memwb.pc), cycle, WB);
+            if (criticalPath)
+                criticalPath->commit(cycle, memwb.pc, memwb.instruction);
+            if (intervalSampler)
+                intervalSampler->commit(cycle, memwb.pc, memwb.instruction);
+            if (memwb.controls.regWrite && memwb.rd != 0)
+                clearRegisterUsage(memwb.rd);
+            if (isEcall(memwb.instruction))
+                syscallPending = false;  // The producer already made the system call
+        }
+
+        // -------------------- MEM Stage --------------------
+        bool memHeld = occupyMemoryStage(traceVector, cycle);
+        if (memHeld) {
+            recordStage(getInstructionIndex(exmem.pc), cycle, MEM);
+            memwb.isEmpty = true;
+        }
+        else if (!exmem.isEmpty) {
+            std::cout << "Cycle " << cycle << " - MEM: Processing " << exmem.instructionString << " at PC: " << exmem.pc << std::endl;
+            recordStage(getInstructionIndex(exmem.pc), cycle, MEM);
+            // Only the timing of a buffered store is known, memory is the functional model's
+            if (storeBuffer && (exmem.instruction & 0x7F) == 0x23)
+                storeBuffer->push(exmem.pc, (exmem.instruction >> 12) & 0x7, exmem.aluResult, exmem.readData2, false);
+            memwb.pc = exmem.pc;
+            memwb.aluResult = exmem.aluResult;
+            memwb.storeData = exmem.readData2;
+            memwb.rd = exmem.rd;
+            memwb.controls = exmem.controls;
+            memwb.instruction = exmem.instruction;
+            memwb.instructionString = exmem.instructionString;
+            memwb.isEmpty = false;
+        }
+        else {
+            memwb.isEmpty = true;
+        }
+
+        // -------------------- EX Stage --------------------
+        if (memHeld) {
+            if (!idex.isEmpty)
+                recordStage(getInstructionIndex(idex.pc), cycle, EX);
+        }
+        else if (!idex.isEmpty && occupyStage(exCyclesLeft, traceVector.executeCycles(idex.instruction))) {
+            recordStage(getInstructionIndex(idex.pc), cycle, EX);
+            exmem.isEmpty = true;
+        }
+        else if (!idex.isEmpty) {
+            std::cout << "Cycle " << cycle << " - EX: Processing " << idex.instructionString << " at PC: " << idex.pc << std::endl;
+            recordStage(getInstructionIndex(idex.pc), cycle, EX);
+            // vl and vtype change in EX, as in run()
+            if (isVectorInstruction(idex.instruction))
+                traceVector.replayConfiguration(idex.instruction, idex.readData2, idex.aluResult);
+            exmem.pc = idex.pc;
+            exmem.aluResult = idex.aluResult;
+            exmem.readData2 = idex.readData2;
+            exmem.rd = idex.rd;
+            exmem.controls = idex.controls;
+            exmem.instruction = idex.instruction;
+            exmem.instructionString = idex.instructionString;
+            exmem.isEmpty = false;
+        }
+        else {
+            exmem.isEmpty = true;
+        }
+
+        exHeld = !idex.isEmpty && (memHeld || exCyclesLeft > 0);
+
+        // -------------------- ID Stage --------------------
+        if (!ifid.isEmpty) {
+            std::cout << "Cycle " << cycle << " - ID: Processing " << ifid.instructionString << " at PC: " << ifid.pc << std::endl;
+            recordStage(getInstructionIndex(ifid.pc), cycle, ID);
+            uint32_t opcode = ifid.instruction & 0x7F;
+            uint32_t rd  = (ifid.instruction >> 7) & 0x1F;
+            uint32_t rs1 = (ifid.instruction >> 15) & 0x1F;
+            uint32_t rs2 = (ifid.instruction >> 20) & 0x1F;
+
+            if (!exHeld && !syscallPending && !detect_hazard(false, opcode, rs1, rs2)) {
+                if (!issueFromTrace(trace, branchTaken, branchTarget))
+                    return;
+                if (idex.controls.regWrite && rd != 0)
+                    addRegisterUsage(rd);
+                syscallPending = isEcall(ifid.instruction);
+            }
+            else {
+                stall = true;
+                if (!exHeld)
+                    idex.isEmpty = true;
+                std::cout << "         Hazard detected: Stalling pipeline." << std::endl;
+            }
+        }
+        else {
+            if (!exHeld)
+                idex.isEmpty = true;
+        }
+
+        // -------------------- IF Stage --------------------
+        int fetchIdx = getInstructionIndex(pc);
+        if (!stall && fetchIdx != -1) {
+            ifid.instruction = instructionMemory[fetchIdx];
+            ifid.pc = pc;
+            ifid.instructionString = instructionStrings[fetchIdx];
+            ifid.isEmpty = false;
+            recordStage(fetchIdx, cycle, IF);
+            std::cout << "Cycle " << cycle << " - IF: Fetched " << ifid.instructionString << " at PC: " << pc << std::endl;
+            pc += 4;
+        }
+        else if (stall) {
+            recordStage(fetchIdx, cycle, IF);
+        }
+        else {
+            ifid.isEmpty = true;
+        }
+
+        // -------------------- End-of-Cycle Processing --------------------
+        if (branchTaken) {
+            pc = branchTarget;
+            ifid.isEmpty = true;
+        }
+        stall = false;
+
         std::cout << "========== Ending Cycle " << cycle << " ==========" << std::endl << std::endl;
     }
 }
 
 // ---------------------- Print Pipeline Diagram ----------------------
-void NoForwardingProcessor::printPipelineDiagram(std::string& filename, bool isforwardcpu) {
-    // Create outputfiles directory if it doesn't exist - one level above srcs directory
+std::string diagramOutputFilename(const std::string& filename, bool isforwardcpu, const std::string& suffix) {
+    // Create outputfiles directory if it doesn't exist
     std::string outputDir = "../outputfiles";
-    
-    #ifdef _WIN32
-    // Windows-specific directory creation
-    system(("mkdir " + outputDir + " 2>nul").c_str());
-    #else
-    // Linux/Unix directory creation
-    system(("mkdir -p " + outputDir).c_str());
-    #endif
+    std::error_code dirError;
+    std::filesystem::create_directories(outputDir, dirError);  // Errors show up when opening the file
     
     // Get base filename without directory path
     std::string baseFilename = filename.substr(filename.find_last_of("/\\") + 1);
@@ -621,87 +1219,44 @@ void NoForwardingProcessor::printPipelineDiagram(std::string& filename, bool isf
     if (lastDotPos != std::string::npos) {
         baseFilename = baseFilename.substr(0, lastDotPos);
     }
-    std::string outputFilename;
-    // Output file name will be in outputfiles folder with _no_forward_out.txt appended
-    if (!isforwardcpu)
-        outputFilename = outputDir + "/" + baseFilename + "_noforward_out.txt";
-    else
-        outputFilename = outputDir + "/" + baseFilename + "_forward_out.txt";
-        
-    std::ofstream outFile(outputFilename);
+    return outputDir + "/" + baseFilename + (isforwardcpu ? "_forward" : "_noforward") + suffix;
+}
+
+void NoForwardingProcessor::printPipelineDiagram(std::string& filename, bool isforwardcpu) {
+    // Output file name will be in outputfiles folder with _noforward_out.txt or _forward_out.txt appended
+    std::string outputFilename = diagramOutputFilename(filename, isforwardcpu, outputTag + "_out.txt");
+    std::FILE* outFile = std::fopen(outputFilename.c_str(), "w");
     
-    if (!outFile.is_open()) {
+    if (!outFile) {
         std::cerr << "Error: Unable to open " << outputFilename << " for writing" << std::endl;
         return;
     }
     
     std::cout << "Writing pipeline diagram to " << outputFilename << std::endl;
-    
-    // Find the longest instruction string to determine column width
-    size_t maxInstrLength = 0;
-    for (const auto& instr : instructionStrings) {
-        std::string cleanInstr = instr;
-        cleanInstr.erase(std::remove(cleanInstr.begin(), cleanInstr.end(), '\n'), cleanInstr.end());
-        cleanInstr.erase(std::remove(cleanInstr.begin(), cleanInstr.end(), '\r'), cleanInstr.end());
-        maxInstrLength = std::max(maxInstrLength, cleanInstr.length());
-    }
-    
-    // Set a minimum width for the instruction column (at least 20 characters)
-    const size_t instrColumnWidth = std::max(maxInstrLength, static_cast<size_t>(20));
 
-    // Print header with fixed width
-    outFile << std::left << std::setw(instrColumnWidth) << "Instruction";
-    for (int i = 0; i < matrixCols; i++) {
-        outFile << ";" << i;
-    }
-    outFile << std::endl;
-    
-    // For each instruction (row), print the stage per cycle with fixed width
-    for (int i = 0; i < matrixRows; i++) {  
-        std::string instr = instructionStrings[i];
-        // Clean the instruction text
-        instr.erase(std::remove(instr.begin(), instr.end(), '\n'), instr.end());
-        instr.erase(std::remove(instr.begin(), instr.end(), '\r'), instr.end());
-        
-        // Print the instruction with fixed width
-        outFile << std::left << std::setw(instrColumnWidth) << instr;
-        
-        PipelineStage prevStage = SPACE;
-        // Print each cycle's stage
-        for (int j = 0; j < matrixCols; j++) {
-            // Get all stages for this instruction in this cycle
-            const std::vector<PipelineStage>& stages = pipelineMatrix3D[i][j];
-            // Start with a comma for CSV format
-            outFile << ";";
-            
-            // If there are no stages or only SPACE, print empty cell
-            if (stages.size() == 1 && stages[0] == SPACE) {
-                outFile << "  "; // Print spaces for empty cell
-                prevStage = SPACE;
-                continue;
-            }
-            
-            // Print first stage and stall if previous stage is same as current stage
-            if (stages.size()==1){
-                if (stages[0]==prevStage && stages[0]!=SPACE)
-                    outFile << "-";
-                else
-                    outFile << stageToString(stages[0]);
-                prevStage = stages[0];
-            }
-            else{
-                // Print stages in reverse format if there are multiple stages
-                outFile << stageToString(stages[stages.size()-1]);
-                for (int k = stages.size()-2; k >= 0; k--) {
-                    outFile<<"/"<<stageToString(stages[k]);
-                }
-                prevStage = SPACE;
-            }
-        }
-        
-        outFile << std::endl;
+    // Binary images are loaded without text, disassemble only now that it is needed
+    materializeInstructionStrings();
+
+    // Rows are formatted into large byte buffers (see DiagramRenderer.hpp)
+    bool ok = writePipelineDiagram(outFile, instructionStrings, pipelineMatrix3D, matrixRows, matrixCols);
+    if (std::fclose(outFile) != 0 || !ok)
+        std::cerr << "Error: Unable to write " << outputFilename << std::endl;
+}
+
+void NoForwardingProcessor::printFoldedDiagram(std::string& filename, bool isforwardcpu) {
+    std::string outputFilename = diagramOutputFilename(filename, isforwardcpu, outputTag + "_folded.txt");
+    std::FILE* outFile = std::fopen(outputFilename.c_str(), "w");
+    if (!outFile) {
+        std::cerr << "Error: Unable to open " << outputFilename << " for writing" << std::endl;
+        return;
     }
-    outFile.close();
+    materializeInstructionStrings();
+    diagramFolder.fold();
+    std::cout << "Writing folded pipeline diagram to " << outputFilename << " (" << diagramFolder.distinctCycles()
+              << " distinct cycles, " << diagramFolder.blockCount() << " repeat blocks)" << std::endl;
+    bool ok = diagramFolder.writeFolded(outFile, instructionStrings);
+    if (std::fclose(outFile) != 0 || !ok)
+        std::cerr << "Error: Unable to write " << outputFilename << std::endl;
 }
 
 // New function to evaluate branch conditions
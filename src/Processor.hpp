@@ -2,45 +2,41 @@
 #include "Register.hpp"
 #include "Memory.hpp"
 #include "PipelineStages.hpp"  // if you still use your old pipeline register structs
+#include "StringArena.hpp"
+#include "LoopExtrapolator.hpp"
+#include "InstructionTrace.hpp"
+#include "EventTrace.hpp"
+#include "FoldedDiagram.hpp"
+#include "CriticalPath.hpp"
+#include "IntervalSampler.hpp"
+#include "Interconnect.hpp"
+#include "VectorUnit.hpp"
+#include "DramTiming.hpp"
+#include "Prefetcher.hpp"
+#include "StoreBuffer.hpp"
+#include "Mmu.hpp"
+#include "Syscalls.hpp"
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdlib>     // for malloc/free
 #include <cstring>     // for memset
 
-// Enumeration for pipeline stages.
-// We use STALL to indicate either a stall or an empty cell.
-enum PipelineStage {
-    SPACE=0,  // Empty cell in the pipeline diagram
-    STALL,
-    SLASH, 
-    IF,
-    ID,
-    EX,
-    MEM,
-    WB
-};
-
-// Helper function to convert enum value to printable string.
-inline const char* stageToString(PipelineStage stage) {
-    switch (stage) {
-        case IF:   return "IF";
-        case ID:   return "ID";
-        case EX:   return "EX";
-        case MEM:  return "MEM";
-        case WB:   return "WB";
-        case SLASH: return "/";
-        case STALL: return "-";
-        default:   return "  ";
-    }
-}
+// Output file in the outputfiles folder, one level above the srcs directory:
+// <input name without extension>_forward<suffix> or _noforward<suffix>
+std::string diagramOutputFilename(const std::string& filename, bool isforwardcpu, const std::string& suffix);
 
 class NoForwardingProcessor {
 public:
     int32_t pc;  // Changed to signed 32-bit
+    int32_t textBase;  // Address of instructionMemory[0] (0 for text programs)
+    int32_t entryPC;   // pc the simulation starts from
     RegisterFile registers;
     Memory dataMemory;
     std::vector<uint32_t> instructionMemory;
-    std::vector<std::string> instructionStrings;
+    std::vector<std::string_view> instructionStrings;  // Views into instructionArena
+    StringArena instructionArena;
     
     // Pipeline registers (structs defined in PipelineStages.hpp)
     IFIDRegister ifid;
@@ -55,6 +51,35 @@ public:
     int matrixCols;   // equal to the number of cycles (set when run() is called)
     bool Imm_valid;
     bool stall;
+    bool recordDiagram;  // false skips the rows x cycles matrix for long runs
+    bool extrapolateLoops;  // Skip steady-state loop iterations functionally (see LoopExtrapolator)
+    LoopExtrapolator loopExtrapolator;
+    EventTraceWriter* eventTrace;  // Binary stage/commit event trace, nullptr when off
+    bool foldDiagram;  // Collect the diagram folded by loop iterations instead of as a matrix
+    DiagramFolder diagramFolder;
+    CriticalPathAnalyzer* criticalPath;  // Fed with every commit for --critical-path, nullptr when off
+    IntervalSampler* intervalSampler;    // Fed with every commit for --interval-stats/--bbv, nullptr when off
+    Interconnect* interconnect;  // Shared memory of a multi-hart run (see MultiHart.hpp), nullptr for a single hart
+    int hartId;
+    Reservation reservation;     // LR.W reservation, kept by the interconnect when memory is shared
+    bool halted;                 // An illegal instruction, bad offset or the exit system call stopped the run
+    VectorUnit vector;           // Vector registers, vl and vtype (RVV subset, see VectorUnit.hpp)
+    VectorUnit traceVector;      // vl and vtype as the trace went, for the timing of runTrace()
+    // Latency of the data accesses in MEM: the DRAM channel of --dram and the
+    // prefetch buffer of --prefetch in front of it, empty when memory takes one cycle
+    std::unique_ptr<DramTiming> dram;
+    std::unique_ptr<PrefetchUnit> prefetcher;
+    std::unique_ptr<StoreBuffer> storeBuffer;  // --store-buffer, stores go straight to memory without it
+    std::unique_ptr<Sv32Mmu> mmu;  // TLBs and page walks of --sv32, addresses are used as they are without it
+    // Cycles the instruction in EX/MEM still needs: a vector instruction holds
+    // its stage, and everything behind it, until they are done
+    uint32_t exCyclesLeft;
+    uint32_t memCyclesLeft;
+    uint32_t fetchCyclesLeft;    // IF waits for the page walk of an I-TLB miss
+    bool exHeld;                 // EX kept its instruction this cycle, so ID does not issue
+    SyscallEmulator syscalls;    // System calls of the program (see Syscalls.hpp)
+    bool syscallPending;         // An ECALL is past ID: nothing younger issues until it commits
+    std::string outputTag;       // Inserted before _out.txt/_folded.txt, "_hart<n>" in multi-hart runs
     
     // Advanced register usage tracking: vector of vectors to track which instruction uses each register
     // First dimension is register number (0-31), second dimension is variable-length list of instruction IDs
@@ -76,6 +101,10 @@ public:
     // 'instrIndex' is the row index (the instruction’s program order index)
     // 'cycle' is the current cycle.
     void recordStage(int instrIndex, int cycle, PipelineStage stage);
+    // Commit record for the instruction in memwb, written to the event trace at WB
+    void recordCommit(int cycle);
+    // true when recordStage() output goes anywhere (matrix, event trace or folded diagram)
+    bool recordsStages() const { return matrixRows > 0 || eventTrace || foldDiagram; }
     
     // Helper: returns the index of the given pc in that stage
     int getInstructionIndex(int32_t index) const;
@@ -89,11 +118,64 @@ public:
     // New helper function to clear register usage when instruction completes
     void clearRegisterUsage(uint32_t regNum);
     
+    // MEM stage data accesses: loads and stores by funct3, and the RV32A
+    // instructions, which return the value for rd. They go to dataMemory, or
+    // through the interconnect when memory is shared. With a store buffer,
+    // stores are buffered and loads see the buffered bytes.
+    int32_t loadData(uint32_t funct3, uint32_t address);
+    void storeData(uint32_t funct3, uint32_t address, int32_t value);
+    int32_t atomicAccess(uint32_t instruction, uint32_t address, int32_t operand);
+    void vectorAccess(uint32_t instruction, uint32_t address, int32_t stride);
+    // Counts one cycle of an instruction that keeps its stage 'cycles' cycles;
+    // true while it needs more of them
+    bool occupyStage(uint32_t& cyclesLeft, uint32_t cycles);
+    // Timing of MEM for the cycle: drains the store buffer, then does
+    // occupyStage() for the instruction in exmem, if any, with the cycles its
+    // access takes: the elements of a vector load or store, plus the latency
+    // of the prefetch buffer or DRAM for a load, store or atomic when they are
+    // set, and the D-TLB walk with --sv32. The access is timed once, in the
+    // cycle the instruction enters MEM;
+    // a store waiting for a free store buffer entry, or an atomic or vector
+    // access for the buffer to drain, holds MEM until then.
+    bool occupyMemoryStage(const VectorUnit& unit, int cycle);
+    // IF counterpart for --sv32: true while the fetch at pc waits for the page
+    // walk of an I-TLB miss. A fetch is translated once, when IF is not stalled.
+    bool occupyFetchStage(int cycle);
+    // Writes the oldest buffered stores whose drain completed by 'cycle' and
+    // starts the next one
+    void drainStoreBuffer(uint64_t cycle);
+    // Writes everything still in the store buffer to memory, at the end of a run
+    void flushStoreBuffer();
+    // WB of an ECALL: the buffered stores go to memory, then the system call
+    // is made. False when it was exit, which stops the run.
+    bool commitSyscall(int cycle);
+
     // Hazard detector
     bool detect_hazard(bool hazard, uint32_t opcode, uint32_t rs1, uint32_t rs2);
     NoForwardingProcessor();
-    ~NoForwardingProcessor();  // Destructor to free memory
+    virtual ~NoForwardingProcessor();  // Destructor to free memory
     bool loadInstructions(const std::string& filename);
-    virtual void run(int cycles);
+    // Same text format as loadInstructions, parsed straight out of a memory mapping
+    // without echoing every line; malformed lines are reported with their line number
+    bool loadInstructionsFast(const std::string& filename);
+    // Picks the loader from the file contents: ELF, flat .bin image, or the text hex listing
+    bool loadProgram(const std::string& filename);
+    // Fills in disassembly for instructions loaded from a binary image
+    void materializeInstructionStrings();
+    // Resets pc and the latches and allocates the pipeline matrix for a run
+    void resetPipeline(int cycles);
+    // run() is beginRun() and runCycles() over the whole run; a multi-hart run
+    // calls runCycles() once per quantum
+    void run(int cycles);
+    virtual void beginRun(int cycles);
+    // Simulates cycles firstCycle .. lastCycle - 1, nothing once halted
+    virtual void runCycles(int firstCycle, int lastCycle);
+    // Timing-only run: instructions are not executed, values and branch outcomes
+    // come from the trace. Produces the same diagram as run() for the same execution.
+    virtual void runTrace(int cycles, TraceSource& trace);
+    // ID stage of runTrace: takes the next record for the instruction in ifid and
+    // moves it to idex. Returns false when the trace ends or does not match the program.
+    bool issueFromTrace(TraceSource& trace, bool& branchTaken, int32_t& branchTarget);
     void printPipelineDiagram(std::string& InputFile, bool isforwardcpu); // Print pipeline diagram to file
+    void printFoldedDiagram(std::string& InputFile, bool isforwardcpu);   // Same, folded (_folded.txt)
 };
@@ -0,0 +1,140 @@
+#include "ProgramLoader.hpp"
+#include "MappedFile.hpp"
+#include "Processor.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// ELF constants we need, spelled out so that no system <elf.h> is required
+const uint8_t ELF_CLASS32 = 1;
+const uint8_t ELF_DATA_LSB = 1;
+const uint16_t ELF_MACHINE_RISCV = 243;
+const uint32_t ELF_PT_LOAD = 1;
+const uint32_t ELF_PF_X = 0x1;
+const size_t ELF32_HEADER_SIZE = 52;
+const size_t ELF32_PHDR_SIZE = 32;
+
+uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t read32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+struct ProgramHeader {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+};
+
+ProgramHeader readProgramHeader(const uint8_t* p) {
+    ProgramHeader ph;
+    ph.type   = read32(p);
+    ph.offset = read32(p + 4);
+    ph.vaddr  = read32(p + 8);
+    ph.filesz = read32(p + 16);
+    ph.memsz  = read32(p + 20);
+    ph.flags  = read32(p + 24);
+    return ph;
+}
+
+// Copy little-endian words into instruction memory in one pass, the trailing
+// partial word (if any) is ignored.
+void fillInstructionMemory(NoForwardingProcessor& processor, const uint8_t* bytes, size_t length) {
+    size_t words = length / 4;
+    processor.instructionMemory.resize(words);
+    for (size_t i = 0; i < words; i++)
+        processor.instructionMemory[i] = read32(bytes + 4 * i);
+    // Disassembly is generated lazily when a diagram is requested
+    processor.instructionStrings.assign(words, std::string_view());
+}
+
+} // namespace
+
+bool ProgramLoader::isElf(const MappedFile& file) {
+    const uint8_t* d = file.data();
+    return file.size() >= 4 && d[0] == 0x7F && d[1] == 'E' && d[2] == 'L' && d[3] == 'F';
+}
+
+bool ProgramLoader::loadElf(NoForwardingProcessor& processor, const MappedFile& file, const std::string& filename) {
+    const uint8_t* image = file.data();
+    size_t imageSize = file.size();
+    if (!isElf(file) || imageSize < ELF32_HEADER_SIZE) {
+        std::cerr << "Error: " << filename << " is not an ELF file" << std::endl;
+        return false;
+    }
+    if (image[4] != ELF_CLASS32 || image[5] != ELF_DATA_LSB || read16(image + 18) != ELF_MACHINE_RISCV) {
+        std::cerr << "Error: " << filename << " is not a little-endian RV32 ELF executable" << std::endl;
+        return false;
+    }
+
+    uint32_t entry = read32(image + 24);
+    uint32_t phoff = read32(image + 28);
+    uint16_t phentsize = read16(image + 42);
+    uint16_t phnum = read16(image + 44);
+    if (phentsize < ELF32_PHDR_SIZE || phoff > imageSize ||
+        static_cast<size_t>(phnum) * phentsize > imageSize - phoff) {
+        std::cerr << "Error: " << filename << " has a corrupt program header table" << std::endl;
+        return false;
+    }
+
+    bool haveText = false;
+    uint32_t imageEnd = 0;
+    for (uint16_t i = 0; i < phnum; i++) {
+        ProgramHeader ph = readProgramHeader(image + phoff + static_cast<size_t>(i) * phentsize);
+        if (ph.type != ELF_PT_LOAD)
+            continue;
+        if (ph.offset > imageSize || ph.filesz > imageSize - ph.offset || ph.filesz > ph.memsz) {
+            std::cerr << "Error: " << filename << " has a segment outside the file" << std::endl;
+            return false;
+        }
+
+        // Every loadable segment lives in data memory, code included, so that
+        // constants placed in .text/.rodata can be read by loads.
+        processor.dataMemory.writeBlock(ph.vaddr, image + ph.offset, ph.filesz);
+        if (ph.memsz > ph.filesz)
+            processor.dataMemory.clearBlock(ph.vaddr + ph.filesz, ph.memsz - ph.filesz);
+        imageEnd = std::max(imageEnd, ph.vaddr + ph.memsz);
+
+        // Prefer the executable segment that contains the entry point
+        bool containsEntry = entry >= ph.vaddr && entry - ph.vaddr < ph.filesz;
+        if ((ph.flags & ELF_PF_X) && (!haveText || containsEntry)) {
+            fillInstructionMemory(processor, image + ph.offset, ph.filesz);
+            processor.textBase = static_cast<int32_t>(ph.vaddr);
+            haveText = true;
+        }
+        std::cout << "  Segment at 0x" << std::hex << ph.vaddr << std::dec << ": " << ph.filesz
+                  << " bytes from file, " << ph.memsz << " bytes in memory"
+                  << ((ph.flags & ELF_PF_X) ? " (code)" : "") << std::endl;
+    }
+
+    if (!haveText) {
+        std::cerr << "Error: " << filename << " has no executable segment" << std::endl;
+        return false;
+    }
+    processor.entryPC = static_cast<int32_t>(entry);
+    processor.syscalls.setImageEnd(imageEnd);
+    std::cout << "Loaded " << processor.instructionMemory.size() << " instructions from ELF " << filename
+              << ", entry PC: 0x" << std::hex << entry << std::dec << std::endl;
+    return !processor.instructionMemory.empty();
+}
+
+bool ProgramLoader::loadFlatBinary(NoForwardingProcessor& processor, const MappedFile& file,
+                                   const std::string& filename, uint32_t baseAddress) {
+    if (file.size() < 4) {
+        std::cerr << "Error: " << filename << " does not contain a single instruction word" << std::endl;
+        return false;
+    }
+    fillInstructionMemory(processor, file.data(), file.size());
+    processor.dataMemory.writeBlock(baseAddress, file.data(), file.size());
+    processor.textBase = static_cast<int32_t>(baseAddress);
+    processor.entryPC = static_cast<int32_t>(baseAddress);
+    std::cout << "Loaded " << processor.instructionMemory.size() << " instructions from binary " << filename << std::endl;
+    return true;
+}
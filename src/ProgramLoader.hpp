@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+class NoForwardingProcessor;
+class MappedFile;
+
+// Loaders for native program images. Both map the file instead of parsing it
+// line by line: code words go straight into instructionMemory, initialised data
+// is copied into Memory a page at a time, and instructionStrings are left empty
+// so that disassembly only happens if a pipeline diagram is printed.
+class ProgramLoader {
+public:
+    static bool isElf(const MappedFile& file);
+
+    // RV32 little-endian ELF executable: every PT_LOAD segment is placed into
+    // Memory (zero filling .bss), the executable segment holding the entry point
+    // becomes instruction memory and the entry point becomes the starting pc.
+    // The program break of the system calls starts after the last segment.
+    static bool loadElf(NoForwardingProcessor& processor, const MappedFile& file, const std::string& filename);
+
+    // Raw little-endian instruction words loaded at baseAddress, which is also the entry pc.
+    static bool loadFlatBinary(NoForwardingProcessor& processor, const MappedFile& file,
+                               const std::string& filename, uint32_t baseAddress = 0);
+};
@@ -0,0 +1,201 @@
+#include "RiscVDisassembler.hpp"
+#include "VectorUnit.hpp"
+#include <cstdio>
+
+namespace {
+
+std::string reg(uint32_t index) {
+    return "x" + std::to_string(index);
+}
+
+std::string hexWord(uint32_t instruction) {
+    char buffer[9];
+    std::snprintf(buffer, sizeof(buffer), "%08x", instruction);
+    return buffer;
+}
+
+int32_t immI(uint32_t instruction) {
+    int32_t imm = instruction >> 20;
+    if (imm & 0x800) imm |= 0xFFFFF000;
+    return imm;
+}
+
+int32_t immS(uint32_t instruction) {
+    int32_t imm = ((instruction >> 25) & 0x7F) << 5;
+    imm |= (instruction >> 7) & 0x1F;
+    if (imm & 0x800) imm |= 0xFFFFF000;
+    return imm;
+}
+
+int32_t immB(uint32_t instruction) {
+    int32_t imm = ((instruction >> 31) & 0x1) << 12;
+    imm |= ((instruction >> 7) & 0x1) << 11;
+    imm |= ((instruction >> 25) & 0x3F) << 5;
+    imm |= ((instruction >> 8) & 0xF) << 1;
+    if (imm & 0x1000) imm |= 0xFFFFE000;
+    return imm;
+}
+
+int32_t immJ(uint32_t instruction) {
+    int32_t imm = ((instruction >> 31) & 0x1) << 20;
+    imm |= ((instruction >> 12) & 0xFF) << 12;
+    imm |= ((instruction >> 20) & 0x1) << 11;
+    imm |= ((instruction >> 21) & 0x3FF) << 1;
+    if (imm & 0x100000) imm |= 0xFFF00000;
+    return imm;
+}
+
+std::string vreg(uint32_t index) {
+    return "v" + std::to_string(index);
+}
+
+// "e32 m1 ta ma"; vtypes the VectorUnit does not support come out as a number
+std::string vtypeText(uint32_t vtype) {
+    static const char* lmul[8] = {"m1", "m2", "m4", "m8", nullptr, "mf8", "mf4", "mf2"};
+    uint32_t vsew = (vtype >> 3) & 0x7;
+    if ((vtype & ~0xFFu) != 0 || vsew > 2 || !lmul[vtype & 0x7])
+        return std::to_string(vtype);
+    return "e" + std::to_string(8u << vsew) + " " + lmul[vtype & 0x7] + ((vtype & 0x40) ? " ta" : " tu") +
+           ((vtype & 0x80) ? " ma" : " mu");
+}
+
+// The RVV subset of VectorUnit.hpp, operands in assembler order ("vadd.vv v3 v1 v2")
+std::string disassembleVector(uint32_t instruction, VectorOp op, VectorOperand operand) {
+    uint32_t rd  = (instruction >> 7) & 0x1F;
+    uint32_t rs1 = (instruction >> 15) & 0x1F;
+    uint32_t rs2 = (instruction >> 20) & 0x1F;
+    switch (op) {
+        case VOP_SETVLI:
+            return "vsetvli " + reg(rd) + " " + reg(rs1) + " " + vtypeText((instruction >> 20) & 0x7FF);
+        case VOP_SETIVLI:
+            return "vsetivli " + reg(rd) + " " + std::to_string(rs1) + " " + vtypeText((instruction >> 20) & 0x3FF);
+        case VOP_SETVL:
+            return "vsetvl " + reg(rd) + " " + reg(rs1) + " " + reg(rs2);
+        case VOP_LOAD:
+        case VOP_STORE: {
+            bool strided = ((instruction >> 26) & 0x3) == 2;
+            std::string name = std::string(op == VOP_LOAD ? "vl" : "vs") + (strided ? "se" : "e") +
+                               std::to_string(VectorUnit::memoryElementBytes(instruction) * 8) + ".v";
+            return name + " " + vreg(rd) + " " + reg(rs1) + (strided ? " " + reg(rs2) : "");
+        }
+        case VOP_MV_X_S:
+            return "vmv.x.s " + reg(rd) + " " + vreg(rs2);
+        case VOP_MV_S_X:
+            return "vmv.s.x " + vreg(rd) + " " + reg(rs1);
+        default:
+            break;
+    }
+    if (op >= VOP_REDSUM) {
+        static const char* names[8] = {"vredsum", "vredand", "vredor", "vredxor", "vredminu", "vredmin", "vredmaxu", "vredmax"};
+        return std::string(names[op - VOP_REDSUM]) + ".vs " + vreg(rd) + " " + vreg(rs2) + " " + vreg(rs1);
+    }
+    std::string source = (operand == VOPERAND_VV) ? vreg(rs1) : (operand == VOPERAND_VX) ? reg(rs1)
+                       : std::to_string(static_cast<int32_t>(rs1 << 27) >> 27);
+    const char* suffix = (operand == VOPERAND_VV) ? ".vv " : (operand == VOPERAND_VX) ? ".vx " : ".vi ";
+    switch (op) {
+        case VOP_MOVE: return std::string("vmv.v.") + (suffix + 2) + vreg(rd) + " " + source;
+        case VOP_MACC: return std::string("vmacc") + suffix + vreg(rd) + " " + source + " " + vreg(rs2);
+        case VOP_ADD:  return std::string("vadd") + suffix + vreg(rd) + " " + vreg(rs2) + " " + source;
+        case VOP_SUB:  return std::string("vsub") + suffix + vreg(rd) + " " + vreg(rs2) + " " + source;
+        case VOP_RSUB: return std::string("vrsub") + suffix + vreg(rd) + " " + vreg(rs2) + " " + source;
+        default:       return std::string("vmul") + suffix + vreg(rd) + " " + vreg(rs2) + " " + source;
+    }
+}
+
+} // namespace
+
+std::string disassembleInstruction(uint32_t instruction) {
+    uint32_t opcode = instruction & 0x7F;
+    uint32_t rd     = (instruction >> 7) & 0x1F;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+    uint32_t rs1    = (instruction >> 15) & 0x1F;
+    uint32_t rs2    = (instruction >> 20) & 0x1F;
+    uint32_t funct7 = (instruction >> 25) & 0x7F;
+
+    switch (opcode) {
+        case 0x33: {  // R-type
+            static const char* base[8] = {"add", "sll", "slt", "sltu", "xor", "srl", "or", "and"};
+            static const char* mext[8] = {"mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu"};
+            const char* name = nullptr;
+            if (funct7 == 0x01)
+                name = mext[funct3];
+            else if (funct7 == 0x20 && funct3 == 0x0)
+                name = "sub";
+            else if (funct7 == 0x20 && funct3 == 0x5)
+                name = "sra";
+            else if (funct7 == 0x00)
+                name = base[funct3];
+            if (!name)
+                break;
+            return std::string(name) + " " + reg(rd) + " " + reg(rs1) + " " + reg(rs2);
+        }
+        case 0x13: {  // I-type ALU
+            static const char* names[8] = {"addi", "slli", "slti", "sltiu", "xori", "srli", "ori", "andi"};
+            std::string name = names[funct3];
+            int32_t imm = immI(instruction);
+            if (funct3 == 0x1 || funct3 == 0x5) {
+                if (funct3 == 0x5 && ((instruction >> 30) & 0x1))
+                    name = "srai";
+                imm = rs2;  // shamt
+            }
+            return name + " " + reg(rd) + " " + reg(rs1) + " " + std::to_string(imm);
+        }
+        case 0x03: {  // LOAD
+            static const char* names[8] = {"lb", "lh", "lw", nullptr, "lbu", "lhu", nullptr, nullptr};
+            if (!names[funct3])
+                break;
+            return std::string(names[funct3]) + " " + reg(rd) + " " + std::to_string(immI(instruction)) + " " + reg(rs1);
+        }
+        case 0x23: {  // STORE
+            static const char* names[8] = {"sb", "sh", "sw", nullptr, nullptr, nullptr, nullptr, nullptr};
+            if (!names[funct3])
+                break;
+            return std::string(names[funct3]) + " " + reg(rs2) + " " + std::to_string(immS(instruction)) + " " + reg(rs1);
+        }
+        case 0x63: {  // BRANCH
+            static const char* names[8] = {"beq", "bne", nullptr, nullptr, "blt", "bge", "bltu", "bgeu"};
+            if (!names[funct3])
+                break;
+            return std::string(names[funct3]) + " " + reg(rs1) + " " + reg(rs2) + " " + std::to_string(immB(instruction));
+        }
+        case 0x6F:  // JAL
+            return "jal " + reg(rd) + " " + std::to_string(immJ(instruction));
+        case 0x67:  // JALR
+            return "jalr " + reg(rd) + " " + reg(rs1) + " " + std::to_string(immI(instruction));
+        case 0x37:  // LUI
+        case 0x17: {  // AUIPC
+            char buffer[16];
+            std::snprintf(buffer, sizeof(buffer), "0x%x", instruction >> 12);
+            return std::string(opcode == 0x37 ? "lui " : "auipc ") + reg(rd) + " " + buffer;
+        }
+        case 0x2F: {  // AMO, word only; aq/rl are not shown
+            static const char* names[32] = {
+                "amoadd.w", "amoswap.w", "lr.w", "sc.w", "amoxor.w", nullptr, nullptr, nullptr,
+                "amoor.w", nullptr, nullptr, nullptr, "amoand.w", nullptr, nullptr, nullptr,
+                "amomin.w", nullptr, nullptr, nullptr, "amomax.w", nullptr, nullptr, nullptr,
+                "amominu.w", nullptr, nullptr, nullptr, "amomaxu.w", nullptr, nullptr, nullptr};
+            uint32_t funct5 = instruction >> 27;
+            if (funct3 != 0x2 || !names[funct5] || (funct5 == 0x02 && rs2 != 0))
+                break;
+            if (funct5 == 0x02)
+                return std::string(names[funct5]) + " " + reg(rd) + " " + reg(rs1);
+            return std::string(names[funct5]) + " " + reg(rd) + " " + reg(rs2) + " " + reg(rs1);
+        }
+        case 0x57:  // OP-V, vector loads and stores
+        case 0x07:
+        case 0x27: {
+            VectorOperand operand;
+            VectorOp op = decodeVectorOp(instruction, operand);
+            if (op == VOP_NONE)
+                break;
+            return disassembleVector(instruction, op, operand);
+        }
+        case 0x73:  // SYSTEM, only ECALL is executed
+            if (instruction == 0x00000073)
+                return "ecall";
+            break;
+        default:
+            break;
+    }
+    return hexWord(instruction);
+}
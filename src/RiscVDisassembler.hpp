@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Turns an RV32IMA machine word, or one of the RVV subset (see VectorUnit.hpp),
+// into the textual form used by the input files, e.g. "addi x5 x0 0",
+// "lw x6 0 x6", "sw x10 8 x11", "beq x6 x0 12", "vle32.v v1 x11".
+// Words that are not recognised come back as their 8 digit hex code.
+std::string disassembleInstruction(uint32_t instruction);
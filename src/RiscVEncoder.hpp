@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+
+// Instruction encoders for the RV32IM formats, the inverse of extractImmediate()
+// and the field extraction done in the ID stage. Immediates are given as the
+// signed byte offset / value the instruction carries.
+
+inline uint32_t encodeR(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+    return (funct7 << 25) | ((rs2 & 0x1F) << 20) | ((rs1 & 0x1F) << 15) | ((funct3 & 0x7) << 12) |
+           ((rd & 0x1F) << 7) | (opcode & 0x7F);
+}
+
+inline uint32_t encodeI(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+    return ((static_cast<uint32_t>(imm) & 0xFFF) << 20) | ((rs1 & 0x1F) << 15) | ((funct3 & 0x7) << 12) |
+           ((rd & 0x1F) << 7) | (opcode & 0x7F);
+}
+
+inline uint32_t encodeS(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 5) & 0x7F) << 25) | ((rs2 & 0x1F) << 20) | ((rs1 & 0x1F) << 15) | ((funct3 & 0x7) << 12) |
+           ((u & 0x1F) << 7) | 0x23;
+}
+
+inline uint32_t encodeB(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 12) & 0x1) << 31) | (((u >> 5) & 0x3F) << 25) | ((rs2 & 0x1F) << 20) | ((rs1 & 0x1F) << 15) |
+           ((funct3 & 0x7) << 12) | (((u >> 1) & 0xF) << 8) | (((u >> 11) & 0x1) << 7) | 0x63;
+}
+
+// 'upper' is the 20-bit value placed in bits 31:12
+inline uint32_t encodeU(uint32_t upper, uint32_t rd, uint32_t opcode) {
+    return ((upper & 0xFFFFF) << 12) | ((rd & 0x1F) << 7) | (opcode & 0x7F);
+}
+
+inline uint32_t encodeJ(int32_t imm, uint32_t rd) {
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 20) & 0x1) << 31) | (((u >> 1) & 0x3FF) << 21) | (((u >> 11) & 0x1) << 20) |
+           (((u >> 12) & 0xFF) << 12) | ((rd & 0x1F) << 7) | 0x6F;
+}
+
+// Offset ranges of the PC-relative formats
+inline bool fitsBranchOffset(int32_t offset) { return offset >= -4096 && offset <= 4094 && (offset & 1) == 0; }
+inline bool fitsJumpOffset(int32_t offset) { return offset >= -(1 << 20) && offset < (1 << 20) && (offset & 1) == 0; }
@@ -0,0 +1,530 @@
+// Stall-aware static instruction scheduler.
+//
+//   scheduler <input_file> <num_cycles> [-o output] [--pipeline forward|noforward]
+//             [--reg r=v] [--mem-bin addr=file] [--mem-hex addr=file]
+//
+// Reads a text program with loadInstructions, splits it into basic blocks at
+// branch/jump targets and after every branch or jump, and list-schedules each
+// block against the stall table of the chosen pipeline (default forward).
+// Branches, jumps, AUIPC and unknown words keep their place; everything between
+// them may move as long as register and memory dependences are kept. Branch
+// and jump offsets are recomputed from the new positions. The result is
+// written in the input format (default ../outputfiles/<name>_scheduled.txt).
+//
+// Both programs are then executed functionally to check that they end in the
+// same state, and simulated for <num_cycles> cycles on both pipelines to
+// compare the predicted stall savings with the simulated ones.
+#include "ForwardingProcessor.hpp"
+#include "RiscVDisassembler.hpp"
+#include "RiscVEncoder.hpp"
+#include "SimOptions.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Latency model. Stall cycles of a consumer that would otherwise leave ID
+// 'distance' cycles after its producer, for distances 1-3 (none beyond),
+// measured on the two pipelines: forwarding covers everything but a load
+// feeding the next instruction and a result feeding a branch or JALR in ID;
+// without forwarding the consumer waits for the producer's WB, except for the
+// JAL link register, which is ready earlier.
+enum ProducerClass { PRODUCER_ALU, PRODUCER_LOAD, PRODUCER_JAL, PRODUCER_CLASSES };
+enum ConsumerClass { CONSUMER_EX, CONSUMER_ID, CONSUMER_CLASSES };
+const int MAX_STALL_DISTANCE = 3;
+
+struct PipelineModel {
+    const char* name;
+    int stalls[PRODUCER_CLASSES][CONSUMER_CLASSES][MAX_STALL_DISTANCE];
+};
+
+const PipelineModel FORWARD_MODEL = {"forward", {{{0, 0, 0}, {1, 0, 0}},     // ALU
+                                                 {{1, 0, 0}, {2, 0, 0}},     // load
+                                                 {{0, 0, 0}, {0, 0, 0}}}};   // JAL
+const PipelineModel NOFORWARD_MODEL = {"noforward", {{{2, 1, 0}, {2, 1, 0}},
+                                                     {{2, 1, 0}, {2, 1, 0}},
+                                                     {{1, 0, 0}, {1, 0, 0}}}};
+const PipelineModel* const MODELS[2] = {&FORWARD_MODEL, &NOFORWARD_MODEL};
+
+struct Decoded {
+    uint32_t word;
+    int sourceCount;
+    uint32_t sources[2];
+    uint32_t dest;           // 0 when nothing is written
+    ProducerClass producer;
+    ConsumerClass consumer;
+    bool load;
+    bool store;
+    bool control;            // Ends a basic block
+    bool pinned;             // Keeps its position
+};
+
+Decoded decode(uint32_t word) {
+    Decoded d;
+    d.word = word;
+    uint32_t opcode = word & 0x7F;
+    uint32_t rd = (word >> 7) & 0x1F;
+    uint32_t rs1 = (word >> 15) & 0x1F;
+    uint32_t rs2 = (word >> 20) & 0x1F;
+    d.sourceCount = 0;
+    d.dest = 0;
+    d.producer = (opcode == 0x03 || opcode == 0x2F) ? PRODUCER_LOAD : (opcode == 0x6F) ? PRODUCER_JAL : PRODUCER_ALU;
+    d.consumer = (opcode == 0x63 || opcode == 0x67) ? CONSUMER_ID : CONSUMER_EX;
+    d.load = (opcode == 0x03 || opcode == 0x2F);
+    d.store = (opcode == 0x23 || opcode == 0x2F);
+    d.control = (opcode == 0x63 || opcode == 0x67 || opcode == 0x6F);
+    // AUIPC depends on its own address, atomics order the other harts' accesses
+    d.pinned = d.control || opcode == 0x17 || opcode == 0x2F;
+    switch (opcode) {
+        case 0x33:
+        case 0x23:
+        case 0x63:
+        case 0x2F:
+            d.sources[d.sourceCount++] = rs1;
+            d.sources[d.sourceCount++] = rs2;
+            break;
+        case 0x13:
+        case 0x03:
+        case 0x67:
+            d.sources[d.sourceCount++] = rs1;
+            break;
+        case 0x37:
+        case 0x17:
+        case 0x6F:
+            break;
+        default:
+            d.pinned = true;
+            break;
+    }
+    if (opcode == 0x33 || opcode == 0x13 || opcode == 0x03 || opcode == 0x67 || opcode == 0x6F ||
+        opcode == 0x37 || opcode == 0x17 || opcode == 0x2F)
+        d.dest = rd;
+    return d;
+}
+
+// Issue timing of a straight-line sequence under a model
+struct Timeline {
+    int64_t lastIssue;
+    int64_t writeCycle[32];
+    ProducerClass writeClass[32];
+
+    Timeline() : lastIssue(-1) {
+        std::fill(writeCycle, writeCycle + 32, INT64_MIN / 2);
+        std::fill(writeClass, writeClass + 32, PRODUCER_ALU);
+    }
+    int stallFor(const PipelineModel& model, const Decoded& d) const {
+        int stall = 0;
+        for (int i = 0; i < d.sourceCount; i++) {
+            uint32_t reg = d.sources[i];
+            int64_t distance = lastIssue + 1 - writeCycle[reg];
+            if (reg == 0 || distance > MAX_STALL_DISTANCE)
+                continue;
+            stall = std::max(stall, model.stalls[writeClass[reg]][d.consumer][distance - 1]);
+        }
+        return stall;
+    }
+    int issue(const PipelineModel& model, const Decoded& d) {
+        int stall = stallFor(model, d);
+        lastIssue += 1 + stall;
+        if (d.dest != 0) {
+            writeCycle[d.dest] = lastIssue;
+            writeClass[d.dest] = d.producer;
+        }
+        return stall;
+    }
+};
+
+int predictStalls(const PipelineModel& model, const std::vector<Decoded>& code, const std::vector<size_t>& order,
+                  size_t first, size_t last) {
+    Timeline timeline;
+    int stalls = 0;
+    for (size_t i = first; i < last; i++)
+        stalls += timeline.issue(model, code[order[i]]);
+    return stalls;
+}
+
+bool dependsOn(const Decoded& later, const Decoded& earlier) {
+    for (int i = 0; i < later.sourceCount; i++) {
+        if (later.sources[i] != 0 && later.sources[i] == earlier.dest)
+            return true;  // RAW
+    }
+    if (later.dest != 0) {
+        if (later.dest == earlier.dest)
+            return true;  // WAW
+        for (int i = 0; i < earlier.sourceCount; i++) {
+            if (earlier.sources[i] == later.dest)
+                return true;  // WAR
+        }
+    }
+    // Loads may pass loads, nothing passes a store
+    return (later.store && (earlier.load || earlier.store)) || (later.load && earlier.store);
+}
+
+// List-schedules the movable instructions in 'order'[first, last) in place.
+// 'timeline' holds the issue state of the block so far and is advanced.
+void scheduleSegment(const PipelineModel& model, const std::vector<Decoded>& code, std::vector<size_t>& order,
+                     size_t first, size_t last, Timeline& timeline) {
+    size_t count = last - first;
+    std::vector<std::vector<size_t>> successors(count);
+    std::vector<int> pending(count, 0);
+    for (size_t j = 0; j < count; j++) {
+        for (size_t i = 0; i < j; i++) {
+            if (dependsOn(code[order[first + j]], code[order[first + i]])) {
+                successors[i].push_back(j);
+                pending[j]++;
+            }
+        }
+    }
+    // Height: the longest chain of adjacent-issue stalls to the end of the segment
+    std::vector<int> height(count, 0);
+    for (size_t i = count; i-- > 0;) {
+        const Decoded& producer = code[order[first + i]];
+        for (size_t j : successors[i]) {
+            const Decoded& consumer = code[order[first + j]];
+            int latency = 1 + ((producer.dest != 0) ? model.stalls[producer.producer][consumer.consumer][0] : 0);
+            height[i] = std::max(height[i], height[j] + latency);
+        }
+    }
+
+    std::vector<size_t> scheduled;
+    std::vector<bool> done(count, false);
+    while (scheduled.size() < count) {
+        // Fewest stalls now, then the longest chain behind it, then program order
+        size_t best = count;
+        int bestStall = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (done[i] || pending[i] != 0)
+                continue;
+            int stall = timeline.stallFor(model, code[order[first + i]]);
+            if (best == count || stall < bestStall || (stall == bestStall && height[i] > height[best])) {
+                best = i;
+                bestStall = stall;
+            }
+        }
+        done[best] = true;
+        scheduled.push_back(order[first + best]);
+        timeline.issue(model, code[order[first + best]]);
+        for (size_t j : successors[best])
+            pending[j]--;
+    }
+    std::copy(scheduled.begin(), scheduled.end(), order.begin() + static_cast<std::ptrdiff_t>(first));
+}
+
+struct Block {
+    size_t first;
+    size_t last;
+};
+
+struct SimulatedRun {
+    uint64_t committed;
+    uint64_t stalls;
+};
+
+std::string outputFilename(const std::string& inputFile) {
+    std::string base = inputFile.substr(inputFile.find_last_of("/\\") + 1);
+    size_t dot = base.find_last_of('.');
+    if (dot != std::string::npos)
+        base = base.substr(0, dot);
+    std::error_code dirError;
+    std::filesystem::create_directories("../outputfiles", dirError);
+    return "../outputfiles/" + base + "_scheduled.txt";
+}
+
+template <typename Processor>
+bool simulate(const std::string& program, const SimOptions& options, SimulatedRun& result) {
+    Processor processor;
+    if (!processor.loadInstructions(program) || !applyPreloads(processor, options))
+        return false;
+    CriticalPathAnalyzer analyzer;
+    processor.recordDiagram = false;
+    processor.criticalPath = &analyzer;
+    processor.run(options.cycles);
+    result.committed = analyzer.instructions;
+    result.stalls = analyzer.stallCycles();
+    return true;
+}
+
+// Functional run up to the first block boundary after 'instructionLimit'
+// instructions or after 'maxBlockEntries' block entries, and never past
+// 'hardLimit' instructions (an indirect jump may loop without ever reaching a
+// leader, which only static targets are). The executed stream is
+// also issued through both latency models (a taken branch or jump adds its
+// flush bubble); predicted[m] gets model m's stall cycles over the first
+// thresholds[m] instructions.
+struct FunctionalRun {
+    RegisterFile registers;
+    std::map<uint32_t, int32_t> stores;   // Final word at every stored address
+    uint64_t instructions;
+    uint64_t blockEntries;
+    StepStatus status;
+    uint64_t predicted[2];
+};
+
+bool runFunctional(const std::string& program, const SimOptions& options, const std::vector<int>& blockOf,
+                   uint64_t instructionLimit, uint64_t maxBlockEntries, uint64_t hardLimit,
+                   const uint64_t thresholds[2], FunctionalRun& run) {
+    NoForwardingProcessor processor;
+    if (!processor.loadInstructions(program) || !applyPreloads(processor, options))
+        return false;
+    FunctionalCore core(processor);
+    int32_t pc = processor.entryPC;
+    run.instructions = 0;
+    run.blockEntries = 0;
+    run.status = STEP_OK;
+    Timeline timelines[2];
+    uint64_t stalls[2] = {0, 0};
+    run.predicted[0] = run.predicted[1] = 0;
+    while (true) {
+        size_t index = static_cast<size_t>(pc - processor.textBase) / 4;
+        if (pc >= processor.textBase && index < blockOf.size() && (index == 0 || blockOf[index] != blockOf[index - 1])) {
+            if (run.instructions >= instructionLimit || run.blockEntries == maxBlockEntries)
+                break;
+            run.blockEntries++;
+        }
+        if (run.instructions >= hardLimit)
+            break;
+        RetiredInstruction retired;
+        run.status = core.step(pc, retired);
+        if (run.status != STEP_OK)
+            break;
+        run.instructions++;
+        Decoded d = decode(retired.instruction);
+        for (int m = 0; m < 2; m++) {
+            stalls[m] += static_cast<uint64_t>(timelines[m].issue(*MODELS[m], d));
+            if (retired.taken)
+                timelines[m].lastIssue++;
+            if (run.instructions == thresholds[m])
+                run.predicted[m] = stalls[m];
+        }
+        if (d.store)
+            run.stores[static_cast<uint32_t>(retired.result) & ~3u] = 0;
+    }
+    for (int m = 0; m < 2; m++) {
+        if (run.instructions < thresholds[m])
+            run.predicted[m] = stalls[m];
+    }
+    run.registers = processor.registers;
+    for (std::map<uint32_t, int32_t>::iterator it = run.stores.begin(); it != run.stores.end(); ++it)
+        it->second = processor.dataMemory.readWord(it->first);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // -o and --pipeline are the scheduler's own, the preloads go to parseSimOptions. The
+    // simulated runs follow the latency tables of the flat memory, so no other
+    // simulator option applies
+    std::string outputFile;
+    const PipelineModel* model = &FORWARD_MODEL;
+    std::vector<char*> simArgs(1, argv[0]);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "-o" || arg == "--pipeline") && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (arg == "-o") {
+                outputFile = value;
+            } else if (value == "forward" || value == "noforward") {
+                model = (value == "forward") ? &FORWARD_MODEL : &NOFORWARD_MODEL;
+            } else {
+                std::cerr << "Error: unknown pipeline " << value << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        bool preload = arg == "--reg" || arg == "--mem-bin" || arg == "--mem-hex";
+        if (preload && i + 1 < argc) {
+            simArgs.push_back(argv[i++]);
+        } else if (!preload && arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Error: the scheduler does not support " << arg << std::endl;
+            return 1;
+        }
+        simArgs.push_back(argv[i]);
+    }
+    SimOptions options;
+    if (!parseSimOptions(static_cast<int>(simArgs.size()), simArgs.data(), options)) {
+        std::cerr << "Usage: " << argv[0] << " <input_file> <num_cycles> [-o output] [--pipeline forward|noforward]"
+                  << " [--reg r=v] [--mem-bin addr=file] [--mem-hex addr=file]" << std::endl;
+        return 1;
+    }
+    if (outputFile.empty())
+        outputFile = outputFilename(options.inputFile);
+
+    // The loaders and simulators log to stdout; only the report is wanted
+    std::cout.setstate(std::ios_base::failbit);
+    NoForwardingProcessor program;
+    if (!program.loadInstructions(options.inputFile)) {
+        std::cout.clear();
+        std::cerr << "Failed to load instructions from " << options.inputFile << std::endl;
+        return 1;
+    }
+    size_t count = program.instructionMemory.size();
+    std::vector<Decoded> code;
+    code.reserve(count);
+    for (uint32_t word : program.instructionMemory)
+        code.push_back(decode(word));
+
+    // Leaders: the entry, every in-text branch/jump target and every instruction after a branch or jump
+    std::vector<bool> leader(count + 1, false);
+    leader[0] = true;
+    leader[count] = true;
+    std::vector<int64_t> target(count, -1);
+    for (size_t i = 0; i < count; i++) {
+        if (!code[i].control)
+            continue;
+        leader[i + 1] = true;
+        uint32_t opcode = code[i].word & 0x7F;
+        if (opcode == 0x67)
+            continue;
+        int32_t offset = program.extractImmediate(code[i].word, opcode);
+        int64_t index = static_cast<int64_t>(i) + offset / 4;
+        if (offset % 4 == 0 && index >= 0 && index < static_cast<int64_t>(count)) {
+            target[i] = index;
+            leader[static_cast<size_t>(index)] = true;
+        }
+    }
+    std::vector<Block> blocks;
+    std::vector<int> blockOf(count, 0);
+    for (size_t i = 0; i < count; i++) {
+        if (leader[i])
+            blocks.push_back(Block{i, i});
+        blocks.back().last = i + 1;
+        blockOf[i] = static_cast<int>(blocks.size() - 1);
+    }
+
+    // Schedule every block; keep the original order where the model sees no gain
+    std::vector<size_t> original(count), order(count);
+    for (size_t i = 0; i < count; i++)
+        original[i] = order[i] = i;
+    size_t changedBlocks = 0;
+    for (Block& block : blocks) {
+        Timeline timeline;
+        size_t segment = block.first;
+        for (size_t i = block.first; i <= block.last; i++) {
+            if (i < block.last && !code[i].pinned)
+                continue;
+            if (i > segment)
+                scheduleSegment(*model, code, order, segment, i, timeline);
+            if (i < block.last)
+                timeline.issue(*model, code[i]);
+            segment = i + 1;
+        }
+        if (predictStalls(*model, code, order, block.first, block.last) >=
+            predictStalls(*model, code, original, block.first, block.last)) {
+            std::copy(original.begin() + static_cast<std::ptrdiff_t>(block.first),
+                      original.begin() + static_cast<std::ptrdiff_t>(block.last),
+                      order.begin() + static_cast<std::ptrdiff_t>(block.first));
+        } else {
+            changedBlocks++;
+        }
+    }
+
+    // Emit, recomputing the offsets of in-text branch and jump targets
+    std::vector<size_t> position(count);
+    for (size_t i = 0; i < count; i++)
+        position[order[i]] = i;
+    std::string text;
+    size_t rewritten = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t from = order[i];
+        uint32_t word = code[from].word;
+        if (target[from] >= 0) {
+            int32_t offset = static_cast<int32_t>((static_cast<int64_t>(position[static_cast<size_t>(target[from])]) -
+                                                   static_cast<int64_t>(i)) * 4);
+            uint32_t opcode = word & 0x7F;
+            uint32_t updated = (opcode == 0x63)
+                ? encodeB(offset, (word >> 20) & 0x1F, (word >> 15) & 0x1F, (word >> 12) & 0x7)
+                : encodeJ(offset, (word >> 7) & 0x1F);
+            if ((opcode == 0x63 && !fitsBranchOffset(offset)) || (opcode == 0x6F && !fitsJumpOffset(offset))) {
+                std::cout.clear();
+                std::cerr << "Error: branch at line " << from + 1 << " cannot reach its target after scheduling"
+                          << std::endl;
+                return 1;
+            }
+            if (updated != word) {
+                word = updated;
+                rewritten++;
+            }
+        }
+        char hex[16];
+        std::snprintf(hex, sizeof(hex), "%08x ", word);
+        text += hex;
+        if (word == code[from].word && !program.instructionStrings[from].empty())
+            text.append(program.instructionStrings[from].data(), program.instructionStrings[from].size());
+        else
+            text += disassembleInstruction(word);
+        text += '\n';
+    }
+    std::ofstream out(outputFile);
+    if (!out.is_open() || !(out << text)) {
+        std::cout.clear();
+        std::cerr << "Error: Unable to write " << outputFile << std::endl;
+        return 1;
+    }
+    out.close();
+
+    // Simulate both programs on both pipelines
+    SimulatedRun simulated[2][2];  // [model][original, scheduled]
+    bool ok = simulate<ForwardingProcessor>(options.inputFile, options, simulated[0][0]) &&
+              simulate<ForwardingProcessor>(outputFile, options, simulated[0][1]) &&
+              simulate<NoForwardingProcessor>(options.inputFile, options, simulated[1][0]) &&
+              simulate<NoForwardingProcessor>(outputFile, options, simulated[1][1]);
+
+    // Functional check over at least the instructions the longest simulation
+    // committed; predictions cover the instructions each simulation committed
+    uint64_t limit = 0;
+    uint64_t thresholds[2][2];  // [program][model]
+    for (int m = 0; m < 2; m++) {
+        for (int s = 0; s < 2; s++) {
+            limit = std::max(limit, simulated[m][s].committed);
+            thresholds[s][m] = simulated[m][s].committed;
+        }
+    }
+    FunctionalRun before, after;
+    ok = ok && runFunctional(options.inputFile, options, blockOf, limit, ~0ull, limit + blockOf.size(), thresholds[0],
+                             before) &&
+         runFunctional(outputFile, options, blockOf, ~0ull, before.blockEntries,
+                       before.instructions + (before.status == STEP_OK ? 0 : 1), thresholds[1], after);
+    std::cout.clear();
+    if (!ok) {
+        std::cerr << "Error: unable to simulate " << options.inputFile << " and " << outputFile << std::endl;
+        return 1;
+    }
+
+    bool same = before.instructions == after.instructions && before.status == after.status && before.stores == after.stores;
+    for (uint32_t reg = 1; reg < 32; reg++)
+        same = same && before.registers.read(reg) == after.registers.read(reg);
+
+    std::cout << "Scheduled " << count << " instructions in " << blocks.size() << " basic blocks for the "
+              << model->name << " pipeline: " << changedBlocks << " blocks reordered, " << rewritten
+              << " branch offsets rewritten" << std::endl;
+    std::cout << "Wrote " << outputFile << std::endl;
+    std::cout << "Functional check (" << before.instructions << " instructions): "
+              << (same ? "registers and memory match" : "MISMATCH") << std::endl;
+    // Stall cycles over the instructions each simulation committed in <num_cycles> cycles
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-10s %-10s %12s %12s %12s", "pipeline", "program", "committed", "predicted",
+                  "simulated");
+    std::cout << line << std::endl;
+    for (int m = 0; m < 2; m++) {
+        long long predicted[2], stalls[2];
+        for (int s = 0; s < 2; s++) {
+            predicted[s] = static_cast<long long>((s ? after : before).predicted[m]);
+            stalls[s] = static_cast<long long>(simulated[m][s].stalls);
+            std::snprintf(line, sizeof(line), "%-10s %-10s %12llu %12lld %12lld", MODELS[m]->name,
+                          s ? "scheduled" : "original", static_cast<unsigned long long>(simulated[m][s].committed),
+                          predicted[s], stalls[s]);
+            std::cout << line << std::endl;
+        }
+        std::snprintf(line, sizeof(line), "%-10s %-10s %12s %12lld %12lld", MODELS[m]->name, "saved", "",
+                      predicted[0] - predicted[1], stalls[0] - stalls[1]);
+        std::cout << line << std::endl;
+    }
+    return same ? 0 : 1;
+}
@@ -0,0 +1,904 @@
+#include "SimOptions.hpp"
+#include "CriticalPath.hpp"
+#include "EventTrace.hpp"
+#include "IntervalSampler.hpp"
+#include "Interconnect.hpp"
+#include "InstructionTrace.hpp"
+#include "LockstepBatch.hpp"
+#include "MappedFile.hpp"
+#include "Processor.hpp"
+#include "TranslationCache.hpp"
+#include "VectorUnit.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+namespace {
+
+// Accepts decimal, 0x-prefixed hex and a leading minus sign
+bool parseNumber(std::string_view text, int64_t& value) {
+    bool negative = false;
+    if (!text.empty() && text[0] == '-') {
+        negative = true;
+        text.remove_prefix(1);
+    }
+    int base = 10;
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        text.remove_prefix(2);
+    }
+    uint64_t magnitude = 0;
+    std::from_chars_result parsed = std::from_chars(text.data(), text.data() + text.size(), magnitude, base);
+    if (text.empty() || parsed.ec != std::errc() || parsed.ptr != text.data() + text.size())
+        return false;
+    value = negative ? -static_cast<int64_t>(magnitude) : static_cast<int64_t>(magnitude);
+    return true;
+}
+
+bool parseAddress(std::string_view text, uint32_t& address) {
+    int64_t value = 0;
+    if (!parseNumber(text, value) || value < 0 || value > 0xFFFFFFFFLL)
+        return false;
+    address = static_cast<uint32_t>(value);
+    return true;
+}
+
+// x0-x31 or the ABI names (zero, ra, sp, gp, tp, t0-t6, s0-s11, fp, a0-a7)
+bool parseRegister(std::string_view name, uint32_t& reg) {
+    static const char* abiNames[32] = {
+        "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+        "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+    if (name.size() > 1 && name[0] == 'x') {
+        int64_t index = 0;
+        if (parseNumber(name.substr(1), index) && index >= 0 && index < 32) {
+            reg = static_cast<uint32_t>(index);
+            return true;
+        }
+        return false;
+    }
+    if (name == "fp") {
+        reg = 8;
+        return true;
+    }
+    for (uint32_t i = 0; i < 32; i++) {
+        if (name == abiNames[i]) {
+            reg = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// --reg, --mem-bin and --mem-hex, on the command line or in a --batch data set
+bool parsePreload(const std::string& arg, const std::string& value, std::vector<RegisterPreload>& registerPreloads,
+                  std::vector<MemoryImage>& memoryImages) {
+    size_t eq = value.find('=');
+    if (eq == std::string::npos) {
+        std::cerr << "Error: " << arg << " expects <target>=<value>, got " << value << std::endl;
+        return false;
+    }
+    std::string_view target(value.data(), eq);
+    std::string rhs = value.substr(eq + 1);
+    if (arg == "--reg") {
+        RegisterPreload preload;
+        int64_t number = 0;
+        if (!parseRegister(target, preload.reg) || !parseNumber(rhs, number) ||
+            number < INT32_MIN || number > static_cast<int64_t>(UINT32_MAX)) {
+            std::cerr << "Error: invalid register preload " << value << std::endl;
+            return false;
+        }
+        preload.value = static_cast<int32_t>(static_cast<uint32_t>(number));
+        registerPreloads.push_back(preload);
+        return true;
+    }
+    MemoryImage image;
+    if (!parseAddress(target, image.address) || rhs.empty()) {
+        std::cerr << "Error: invalid memory image " << value << std::endl;
+        return false;
+    }
+    image.filename = rhs;
+    image.isHex = (arg == "--mem-hex");
+    memoryImages.push_back(image);
+    return true;
+}
+
+// One data set per line in the preload syntax, e.g. "--reg a1=5 --mem-hex 0x1000=set5.hex";
+// '#' starts a comment and blank lines are skipped
+bool loadDataSets(const std::string& filename, std::vector<DataSet>& dataSets) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "Error: Unable to open batch file " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream tokens(line);
+        std::string arg, value;
+        DataSet dataSet;
+        bool empty = true;
+        while (tokens >> arg) {
+            empty = false;
+            if ((arg != "--reg" && arg != "--mem-bin" && arg != "--mem-hex") || !(tokens >> value) ||
+                !parsePreload(arg, value, dataSet.registerPreloads, dataSet.memoryImages)) {
+                std::cerr << "Error: " << filename << " line " << lineNumber << ": expected --reg, --mem-bin or --mem-hex"
+                          << std::endl;
+                return false;
+            }
+        }
+        if (!empty)
+            dataSets.push_back(std::move(dataSet));
+    }
+    return true;
+}
+
+bool hasBinExtension(const std::string& filename) {
+    return filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+}
+
+// Hex image: whitespace separated 32-bit words (0x prefix optional), '#' starts a comment
+bool loadHexImage(Memory& memory, uint32_t address, const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+    const char* p = reinterpret_cast<const char*>(file.data());
+    const char* end = p + file.size();
+    std::vector<uint8_t> bytes;
+    bytes.reserve(file.size() / 2);
+    size_t lineNumber = 1;
+    while (p < end) {
+        char c = *p;
+        if (c == '\n') {
+            lineNumber++;
+            p++;
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == ',') {
+            p++;
+        } else if (c == '#') {
+            while (p < end && *p != '\n')
+                p++;
+        } else {
+            if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+                p += 2;
+            uint32_t word = 0;
+            std::from_chars_result parsed = std::from_chars(p, end, word, 16);
+            if (parsed.ec != std::errc() || (parsed.ptr < end && !std::isspace(static_cast<unsigned char>(*parsed.ptr))
+                                             && *parsed.ptr != ',' && *parsed.ptr != '#')) {
+                std::cerr << "Error: " << filename << " line " << lineNumber << ": invalid hex word" << std::endl;
+                return false;
+            }
+            p = parsed.ptr;
+            // Little-endian
+            bytes.push_back(word & 0xFF);
+            bytes.push_back((word >> 8) & 0xFF);
+            bytes.push_back((word >> 16) & 0xFF);
+            bytes.push_back((word >> 24) & 0xFF);
+        }
+    }
+    memory.writeBlock(address, bytes.data(), bytes.size());
+    std::cout << "Loaded " << bytes.size() / 4 << " words from " << filename << " at address 0x"
+              << std::hex << address << std::dec << std::endl;
+    return true;
+}
+
+bool loadBinaryImage(Memory& memory, uint32_t address, const std::string& filename) {
+    // Images of at least a page at a page aligned address are mapped copy-on-write
+    // instead of copied; everything else goes through a bulk page copy.
+    MappedFile file;
+    bool zeroCopy = (address & Memory::PAGE_MASK) == 0;
+    if (!file.open(filename, zeroCopy))
+        return false;
+    size_t size = file.size();
+    if (zeroCopy && size >= Memory::PAGE_SIZE) {
+        memory.mapImage(address, std::move(file));
+    } else {
+        memory.writeBlock(address, file.data(), size);
+    }
+    std::cout << "Loaded " << size << " bytes from " << filename << " at address 0x"
+              << std::hex << address << std::dec << (zeroCopy && size >= Memory::PAGE_SIZE ? " (mapped)" : "")
+              << std::endl;
+    return true;
+}
+
+bool writeMemoryDump(const Memory& memory, const MemoryDump& dump, const std::string& filename) {
+    std::vector<uint8_t> bytes(dump.length);
+    memory.readBlock(dump.address, bytes.data(), bytes.size());
+
+    if (hasBinExtension(filename)) {
+        std::ofstream out(filename, std::ios::binary);
+        if (!out.is_open() || !out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size())) {
+            std::cerr << "Error: Unable to write memory dump " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Hex words in the --mem-hex format so a dump can be fed back in
+    std::string text;
+    text.reserve(dump.length / 4 * 9 + 64);
+    char line[32];
+    std::snprintf(line, sizeof(line), "# 0x%08x %u bytes\n", dump.address, dump.length);
+    text += line;
+    for (uint32_t offset = 0; offset < dump.length; offset += 4) {
+        uint32_t word = 0;
+        for (uint32_t b = 0; b < 4 && offset + b < dump.length; b++)
+            word |= static_cast<uint32_t>(bytes[offset + b]) << (8 * b);
+        std::snprintf(line, sizeof(line), "%08x\n", word);
+        text += line;
+    }
+    if (filename == "-") {
+        // Dumps are still wanted on stdout in --quiet mode
+        std::ios_base::iostate state = std::cout.rdstate();
+        std::cout.clear();
+        std::cout << text << std::flush;
+        std::cout.setstate(state);
+        return true;
+    }
+    std::ofstream out(filename);
+    if (!out.is_open() || !(out << text)) {
+        std::cerr << "Error: Unable to write memory dump " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <input_file> <num_cycles> [options]" << std::endl
+              << "  <input_file> is a text hex listing, an RV32 ELF executable or a flat .bin image" << std::endl
+              << "Options:" << std::endl
+              << "  --reg <reg>=<value>           Preload a register, e.g. --reg x10=0x1000 or --reg a1=64" << std::endl
+              << "  --mem-bin <addr>=<file>       Place a raw binary image in memory at addr" << std::endl
+              << "  --mem-hex <addr>=<file>       Place whitespace separated hex words in memory at addr" << std::endl
+              << "  --dump <addr>:<bytes>=<file>  Write a memory region after the run" << std::endl
+              << "                                (.bin file gets raw bytes, otherwise hex words, - for stdout)" << std::endl
+              << "  --quiet                       Do not print the cycle by cycle log" << std::endl
+              << "  --no-diagram                  Do not record or write the pipeline diagram" << std::endl
+              << "  --fold                        Write the diagram folded by loop iterations (_folded.txt, see unfold)" << std::endl
+              << "  --extrapolate                 Detect steady-state loops and skip repeated iterations" << std::endl
+              << "  --trace-driven                Execute functionally in a producer thread, timing consumes the trace" << std::endl
+              << "  --trace-out <file>            Trace-driven run that also saves the instruction trace" << std::endl
+              << "  --trace-in <file>             Replay a saved trace through the timing pipeline" << std::endl
+              << "  --event-trace <file>          Write the compact binary stage/commit event trace (read with tracetool)" << std::endl
+              << "  --critical-path <file>        Write the critical path analysis of the run (- for stdout)" << std::endl
+              << "  --interval <n>                Committed instructions per interval (default 10000)" << std::endl
+              << "  --interval-stats <file>       Write CPI, stalls and branch flushes per interval as CSV (- for stdout)" << std::endl
+              << "  --bbv <file>                  Write per-interval basic-block vectors in SimPoint format" << std::endl
+              << "  --harts <n>                   Run n harts on one shared memory, tp (x4) holds the hart id (max 64)" << std::endl
+              << "  --quantum <cycles>            Cycles the harts run between synchronizations (default 100)" << std::endl
+              << "  --host-threads <n>            Host threads for the harts (default one per core, 1 is deterministic)" << std::endl
+              << "  --functional                  Only execute, up to <num_cycles> instructions, through the translation cache" << std::endl
+              << "  --jit                         Functional run with hot blocks compiled to x86-64 code" << std::endl
+              << "  --batch <file>                Functional run of every data set in file (one line of --reg/--mem-bin/" << std::endl
+              << "                                --mem-hex options each) in SIMD lockstep, dumps get a _lane<n> suffix" << std::endl
+              << "  --vlen <bits>                 Vector register width, a power of two from 32 to 65536 (default 128)" << std::endl
+              << "  --vector-lanes <n>            32-bit lanes of the vector datapath (default 4)" << std::endl
+              << "  --smt <policy>                Two hardware threads (tp = 0, 1) share the pipeline, fetching by" << std::endl
+              << "                                round-robin or icount; the diagram goes to _smt_out.txt" << std::endl
+              << "  --dram <policy>               MEM waits for a DRAM channel with open or closed page policy" << std::endl
+              << "  --dram-banks <n>              DRAM banks, a power of two (default 8, implies --dram)" << std::endl
+              << "  --dram-row <bytes>            DRAM row buffer size, a power of two (default 2048, implies --dram)" << std::endl
+              << "  --dram-timing <t>             tRCD,tCAS,tRP[,tBurst] in cycles (default 14,14,14,4, implies --dram)" << std::endl
+              << "  --prefetch <kinds>            Prefetch buffer in front of memory, filled by next-line, stride," << std::endl
+              << "                                next-line,stride or none (demand misses only)" << std::endl
+              << "  --prefetch-buffer <lines>     64-byte lines in the prefetch buffer (default 16)" << std::endl
+              << "  --prefetch-degree <n>         Lines or strides prefetched ahead (default 1)" << std::endl
+              << "  --miss-latency <cycles>       Cycles a prefetch buffer miss takes without --dram (default 20)" << std::endl
+              << "                                (the last three imply a buffer, by default with --prefetch none)" << std::endl
+              << "  --store-buffer <entries>      Stores retire into a store buffer that drains in the background" << std::endl
+              << "  --sv32 <page size>            Translate fetches and data accesses through TLBs and Sv32 page tables" << std::endl
+              << "                                with 4k pages or 4m megapages (identity mapped on first touch)" << std::endl
+              << "  --itlb <entries>[,<ways>]     I-TLB size and ways, fully associative without (default 16,4, implies --sv32)" << std::endl
+              << "  --dtlb <entries>[,<ways>]     D-TLB size and ways, fully associative without (default 32,4, implies --sv32)" << std::endl
+              << "  --walk-latency <cycles>       Cycles per PTE read without --dram (default 10, implies --sv32)" << std::endl
+              << "  --page-tables <addr>          Page aligned address of the page tables (default 0xffc00000, implies --sv32)" << std::endl
+              << "  --arg <value>                 Append an argument to the program's argv, once per argument" << std::endl
+              << "                                (ELF programs always get a stack with argc, argv and envp)" << std::endl
+              << "  --program-input <file>        Read the program's stdin (fd 0) from file" << std::endl
+              << "  --program-output <file>       Write the program's stdout and stderr to file instead of the host's" << std::endl;
+}
+
+bool parseSimOptions(int argc, char** argv, SimOptions& options) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (arg == "--quiet") {
+            options.quiet = true;
+            continue;
+        }
+        if (arg == "--no-diagram") {
+            options.recordDiagram = false;
+            continue;
+        }
+        if (arg == "--extrapolate") {
+            options.extrapolate = true;
+            continue;
+        }
+        if (arg == "--fold") {
+            options.foldDiagram = true;
+            continue;
+        }
+        if (arg == "--trace-driven") {
+            options.traceDriven = true;
+            continue;
+        }
+        if (arg == "--functional" || arg == "--jit") {
+            options.functional = true;
+            options.jit = options.jit || arg == "--jit";
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << arg << " expects an argument" << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--event-trace") {
+            options.eventTrace = value;
+            continue;
+        }
+        if (arg == "--critical-path") {
+            options.criticalPath = value;
+            continue;
+        }
+        if (arg == "--interval-stats" || arg == "--bbv") {
+            (arg == "--bbv" ? options.bbv : options.intervalStats) = value;
+            continue;
+        }
+        if (arg == "--interval") {
+            int64_t length = 0;
+            if (!parseNumber(value, length) || length <= 0) {
+                std::cerr << "Error: invalid interval length " << value << std::endl;
+                return false;
+            }
+            options.intervalLength = static_cast<uint64_t>(length);
+            continue;
+        }
+        if (arg == "--harts" || arg == "--quantum" || arg == "--host-threads") {
+            int64_t number = 0;
+            int64_t maximum = (arg == "--harts") ? Interconnect::MAX_HARTS : INT32_MAX;
+            if (!parseNumber(value, number) || number <= 0 || number > maximum) {
+                std::cerr << "Error: invalid " << arg.substr(2) << " count " << value << std::endl;
+                return false;
+            }
+            (arg == "--harts" ? options.harts : arg == "--quantum" ? options.quantum : options.hostThreads) =
+                static_cast<int>(number);
+            continue;
+        }
+        if (arg == "--vlen") {
+            int64_t bits = 0;
+            if (!parseNumber(value, bits) || bits < VectorUnit::MIN_VLEN || bits > VectorUnit::MAX_VLEN ||
+                (bits & (bits - 1)) != 0) {
+                std::cerr << "Error: invalid vector length " << value << std::endl;
+                return false;
+            }
+            options.vlen = static_cast<uint32_t>(bits);
+            continue;
+        }
+        if (arg == "--vector-lanes") {
+            int64_t lanes = 0;
+            if (!parseNumber(value, lanes) || lanes <= 0 || lanes > 1024) {
+                std::cerr << "Error: invalid vector lane count " << value << std::endl;
+                return false;
+            }
+            options.vectorLanes = static_cast<uint32_t>(lanes);
+            continue;
+        }
+        if (arg == "--smt") {
+            if (value != "round-robin" && value != "icount") {
+                std::cerr << "Error: invalid SMT fetch policy " << value << " (round-robin or icount)" << std::endl;
+                return false;
+            }
+            options.smt = true;
+            options.icountFetch = value == "icount";
+            continue;
+        }
+        if (arg == "--dram") {
+            if (value != "open" && value != "closed") {
+                std::cerr << "Error: invalid DRAM page policy " << value << " (open or closed)" << std::endl;
+                return false;
+            }
+            options.dramTiming = true;
+            options.dram.openRow = value == "open";
+            continue;
+        }
+        if (arg == "--dram-banks" || arg == "--dram-row") {
+            int64_t number = 0;
+            int64_t maximum = (arg == "--dram-banks") ? 1024 : (1 << 20);
+            if (!parseNumber(value, number) || number <= 0 || number > maximum || (number & (number - 1)) != 0) {
+                std::cerr << "Error: invalid " << (arg == "--dram-banks" ? "DRAM bank count " : "DRAM row size ") << value
+                          << std::endl;
+                return false;
+            }
+            (arg == "--dram-banks" ? options.dram.banks : options.dram.rowBytes) = static_cast<uint32_t>(number);
+            options.dramTiming = true;
+            continue;
+        }
+        if (arg == "--dram-timing") {
+            uint32_t* fields[4] = {&options.dram.tRCD, &options.dram.tCAS, &options.dram.tRP, &options.dram.tBurst};
+            std::string_view rest(value);
+            size_t count = 0;
+            bool valid = true;
+            while (valid && count < 4) {
+                size_t comma = rest.find(',');
+                int64_t number = 0;
+                valid = parseNumber(rest.substr(0, comma), number) && number >= 0 && number <= 10000;
+                if (valid)
+                    *fields[count++] = static_cast<uint32_t>(number);
+                if (comma == std::string_view::npos)
+                    break;
+                rest.remove_prefix(comma + 1);
+            }
+            if (!valid || count < 3 || rest.find(',') != std::string_view::npos) {
+                std::cerr << "Error: invalid DRAM timing " << value << " (tRCD,tCAS,tRP[,tBurst])" << std::endl;
+                return false;
+            }
+            options.dramTiming = true;
+            continue;
+        }
+        if (arg == "--prefetch") {
+            if (value != "none" && value != "next-line" && value != "stride" && value != "next-line,stride" &&
+                value != "stride,next-line") {
+                std::cerr << "Error: invalid prefetcher " << value << " (none, next-line, stride or next-line,stride)"
+                          << std::endl;
+                return false;
+            }
+            options.prefetchBuffer = true;
+            options.prefetch.nextLine = value.find("next-line") != std::string::npos;
+            options.prefetch.stride = value.find("stride") != std::string::npos;
+            continue;
+        }
+        if (arg == "--prefetch-buffer" || arg == "--prefetch-degree" || arg == "--miss-latency") {
+            int64_t number = 0;
+            int64_t maximum = (arg == "--prefetch-buffer") ? 1024 : (arg == "--prefetch-degree") ? 16 : 10000;
+            if (!parseNumber(value, number) || number <= 0 || number > maximum) {
+                std::cerr << "Error: invalid " << arg.substr(2) << " " << value << std::endl;
+                return false;
+            }
+            (arg == "--prefetch-buffer" ? options.prefetch.bufferLines
+             : arg == "--prefetch-degree" ? options.prefetch.degree : options.prefetch.missLatency) =
+                static_cast<uint32_t>(number);
+            options.prefetchBuffer = true;
+            continue;
+        }
+        if (arg == "--store-buffer") {
+            int64_t entries = 0;
+            if (!parseNumber(value, entries) || entries <= 0 || entries > 256) {
+                std::cerr << "Error: invalid store buffer size " << value << std::endl;
+                return false;
+            }
+            options.storeBufferEntries = static_cast<uint32_t>(entries);
+            continue;
+        }
+        if (arg == "--sv32") {
+            if (value != "4k" && value != "4m") {
+                std::cerr << "Error: invalid Sv32 page size " << value << " (4k or 4m)" << std::endl;
+                return false;
+            }
+            options.sv32 = true;
+            options.mmu.megapages = value == "4m";
+            continue;
+        }
+        if (arg == "--itlb" || arg == "--dtlb") {
+            size_t comma = value.find(',');
+            int64_t entries = 0;
+            int64_t ways = 0;
+            bool valid = parseNumber(std::string_view(value).substr(0, comma), entries) && entries > 0 && entries <= 4096;
+            ways = entries;
+            if (valid && comma != std::string::npos)
+                valid = parseNumber(std::string_view(value).substr(comma + 1), ways) && ways > 0 && entries % ways == 0;
+            if (!valid) {
+                std::cerr << "Error: invalid TLB " << value << " (<entries>[,<ways>], ways dividing entries)" << std::endl;
+                return false;
+            }
+            (arg == "--itlb" ? options.mmu.itlb : options.mmu.dtlb) =
+                TlbConfig(static_cast<uint32_t>(entries), static_cast<uint32_t>(ways));
+            options.sv32 = true;
+            continue;
+        }
+        if (arg == "--walk-latency") {
+            int64_t cycles = 0;
+            if (!parseNumber(value, cycles) || cycles < 0 || cycles > 10000) {
+                std::cerr << "Error: invalid walk latency " << value << std::endl;
+                return false;
+            }
+            options.mmu.walkLatency = static_cast<uint32_t>(cycles);
+            options.sv32 = true;
+            continue;
+        }
+        if (arg == "--page-tables") {
+            if (!parseAddress(value, options.mmu.pageTableBase) || (options.mmu.pageTableBase & Memory::PAGE_MASK) != 0 ||
+                options.mmu.pageTableBase > 0xFFC00000u) {
+                std::cerr << "Error: invalid page table address " << value << " (page aligned, 4 MiB below the top)"
+                          << std::endl;
+                return false;
+            }
+            options.sv32 = true;
+            continue;
+        }
+        if (arg == "--arg") {
+            options.programArgs.push_back(value);
+            continue;
+        }
+        if (arg == "--program-input" || arg == "--program-output") {
+            (arg == "--program-input" ? options.programInput : options.programOutput) = value;
+            continue;
+        }
+        if (arg == "--trace-out" || arg == "--trace-in") {
+            (arg == "--trace-out" ? options.traceOut : options.traceIn) = value;
+            options.traceDriven = true;
+            continue;
+        }
+        if (arg == "--batch") {
+            options.batchFile = value;
+            options.functional = true;
+            continue;
+        }
+        if (arg == "--reg" || arg == "--mem-bin" || arg == "--mem-hex") {
+            if (!parsePreload(arg, value, options.registerPreloads, options.memoryImages))
+                return false;
+            continue;
+        }
+        size_t eq = value.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << "Error: " << arg << " expects <target>=<value>, got " << value << std::endl;
+            return false;
+        }
+        std::string_view target(value.data(), eq);
+        std::string rhs = value.substr(eq + 1);
+
+        if (arg == "--dump") {
+            MemoryDump dump;
+            size_t colon = target.find(':');
+            if (colon == std::string_view::npos || !parseAddress(target.substr(0, colon), dump.address) ||
+                !parseAddress(target.substr(colon + 1), dump.length) || rhs.empty()) {
+                std::cerr << "Error: invalid memory dump " << value << std::endl;
+                return false;
+            }
+            if (dump.length > MemoryDump::MAX_LENGTH ||
+                static_cast<uint64_t>(dump.address) + dump.length > (1ull << 32)) {
+                std::cerr << "Error: invalid memory dump length " << value
+                          << " (at most 64 MiB, ending inside the 32-bit address space)" << std::endl;
+                return false;
+            }
+            dump.filename = rhs;
+            options.memoryDumps.push_back(dump);
+        } else {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (positional.size() != 2)
+        return false;
+    options.inputFile = positional[0];
+    int64_t cycles = 0;
+    if (!parseNumber(positional[1], cycles) || cycles < 0 || cycles > INT32_MAX) {
+        std::cerr << "Error: invalid cycle count " << positional[1] << std::endl;
+        return false;
+    }
+    options.cycles = static_cast<int>(cycles);
+    // Only hart 0 would have the redirected streams
+    if (options.harts > 1 && (!options.programInput.empty() || !options.programOutput.empty())) {
+        std::cerr << "Error: --program-input and --program-output do not combine with --harts" << std::endl;
+        return false;
+    }
+    // The per-run analyses and the trace-driven pipeline follow one hart
+    if (options.harts > 1 && (options.extrapolate || options.traceDriven || !options.eventTrace.empty() ||
+                              !options.criticalPath.empty() || !options.intervalStats.empty() || !options.bbv.empty())) {
+        std::cerr << "Error: --harts does not combine with --extrapolate, trace, critical path or interval options"
+                  << std::endl;
+        return false;
+    }
+    // The SMT pipeline is a timing run of its own
+    if (options.smt && (options.harts > 1 || options.functional || options.foldDiagram || options.extrapolate ||
+                        options.traceDriven || !options.eventTrace.empty() || !options.criticalPath.empty() ||
+                        !options.intervalStats.empty() || !options.bbv.empty())) {
+        std::cerr << "Error: --smt does not combine with --harts, --functional, --fold, --extrapolate, trace, critical path"
+                  << " or interval options" << std::endl;
+        return false;
+    }
+    // The memory models serve one pipeline, and the loop extrapolator does not know their state
+    bool memoryTiming = options.dramTiming || options.prefetchBuffer || options.storeBufferEntries > 0 || options.sv32;
+    if (memoryTiming && (options.harts > 1 || options.extrapolate)) {
+        std::cerr << "Error: --dram, --prefetch, --store-buffer and --sv32 do not combine with --harts or --extrapolate"
+                  << std::endl;
+        return false;
+    }
+    // The analyses derive the ID stalls from the commit cycles, which only holds while MEM never stalls
+    if (memoryTiming && (!options.criticalPath.empty() || !options.intervalStats.empty() || !options.bbv.empty())) {
+        std::cerr << "Error: --dram, --prefetch, --store-buffer and --sv32 do not combine with critical path or interval"
+                  << " options" << std::endl;
+        return false;
+    }
+    // The walker writes the page tables into the memory a trace producer is executing on
+    if (options.sv32 && (options.smt || options.traceDriven)) {
+        std::cerr << "Error: --sv32 does not combine with --smt or trace options" << std::endl;
+        return false;
+    }
+    // The SMT threads access memory through their own bus
+    if (options.storeBufferEntries > 0 && options.smt) {
+        std::cerr << "Error: --store-buffer does not combine with --smt" << std::endl;
+        return false;
+    }
+    // Nothing is timed in a functional run
+    if (options.functional && (options.harts > 1 || options.extrapolate || options.traceDriven || memoryTiming ||
+                               !options.eventTrace.empty() || !options.criticalPath.empty() ||
+                               !options.intervalStats.empty() || !options.bbv.empty())) {
+        std::cerr << "Error: --functional does not combine with pipeline options" << std::endl;
+        return false;
+    }
+    // The lanes share one decode and run no compiled code
+    if (!options.batchFile.empty() && options.jit) {
+        std::cerr << "Error: --batch does not combine with --jit" << std::endl;
+        return false;
+    }
+    if (options.functional)
+        options.recordDiagram = false;
+    return true;
+}
+
+void applyRunSettings(NoForwardingProcessor& processor, const SimOptions& options) {
+    // A folded diagram is collected cycle by cycle, the matrix is not needed
+    processor.recordDiagram = options.recordDiagram && !options.foldDiagram;
+    processor.foldDiagram = options.recordDiagram && options.foldDiagram;
+    processor.extrapolateLoops = options.extrapolate;
+    processor.vector.reset(options.vlen, options.vectorLanes);
+    processor.dram.reset(options.dramTiming ? new DramTiming(options.dram) : nullptr);
+    processor.prefetcher.reset(options.prefetchBuffer ? new PrefetchUnit(options.prefetch, processor.dram.get()) : nullptr);
+    processor.storeBuffer.reset(options.storeBufferEntries > 0 ? new StoreBuffer(options.storeBufferEntries) : nullptr);
+    processor.mmu.reset(options.sv32 ? new Sv32Mmu(options.mmu, processor.dataMemory, processor.dram.get()) : nullptr);
+    // A failed stream skips formatting entirely, which is most of the logging cost
+    if (options.quiet)
+        std::cout.setstate(std::ios_base::failbit);
+}
+
+void setupProgramStack(NoForwardingProcessor& processor, Memory& memory, const SimOptions& options) {
+    if (processor.syscalls.imageEnd != 0 || !options.programArgs.empty()) {
+        std::vector<std::string> args(1, options.inputFile);
+        args.insert(args.end(), options.programArgs.begin(), options.programArgs.end());
+        processor.syscalls.setupStack(processor, memory, args);
+    }
+}
+
+bool applyPreloads(NoForwardingProcessor& processor, const SimOptions& options) {
+    setupProgramStack(processor, processor.dataMemory, options);
+    if (!processor.syscalls.redirect(options.programInput, options.programOutput))
+        return false;
+    for (const RegisterPreload& preload : options.registerPreloads) {
+        processor.registers.write(preload.reg, preload.value);
+        std::cout << "Preloaded x" << preload.reg << " = " << preload.value << std::endl;
+    }
+    for (const MemoryImage& image : options.memoryImages) {
+        bool loaded = image.isHex ? loadHexImage(processor.dataMemory, image.address, image.filename)
+                                  : loadBinaryImage(processor.dataMemory, image.address, image.filename);
+        if (!loaded)
+            return false;
+    }
+    // The walker owns the table region and clears the tables it builds there
+    if (options.sv32 && processor.dataMemory.allocated(options.mmu.pageTableBase, Sv32Mmu::TABLE_REGION_SIZE)) {
+        std::cerr << "Error: the page tables at 0x" << std::hex << options.mmu.pageTableBase << std::dec
+                  << " overlap the program or a preloaded image, move them with --page-tables" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+bool runPipeline(NoForwardingProcessor& processor, const SimOptions& options) {
+    if (!options.traceDriven) {
+        processor.run(options.cycles);
+        return true;
+    }
+
+    if (!options.traceIn.empty()) {
+        TraceFileReader reader;
+        if (!reader.open(options.traceIn))
+            return false;
+        std::cout << "Replaying " << reader.recordCount() << " trace records from " << options.traceIn << std::endl;
+        processor.runTrace(options.cycles, reader);
+        return true;
+    }
+
+    // No more instructions than cycles can issue, so that bounds the producer
+    TraceFileWriter writer;
+    if (!options.traceOut.empty() && !writer.open(options.traceOut))
+        return false;
+    FunctionalTraceSource source(processor, static_cast<uint64_t>(options.cycles),
+                                 writer.isOpen() ? &writer : nullptr);
+    processor.runTrace(options.cycles, source);
+    source.finish();
+    std::cout << "Functional model executed " << source.produced() << " instructions" << std::endl;
+    if (!writer.close()) {
+        std::cerr << "Error: Unable to write trace file " << options.traceOut << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// runPipeline with the event trace writer attached for --event-trace
+bool runTraced(NoForwardingProcessor& processor, const SimOptions& options) {
+    if (options.eventTrace.empty())
+        return runPipeline(processor, options);
+
+    EventTraceWriter writer;
+    processor.materializeInstructionStrings();
+    if (!writer.open(options.eventTrace, processor.instructionStrings, processor.textBase, options.cycles))
+        return false;
+    processor.eventTrace = &writer;
+    bool ok = runPipeline(processor, options);
+    processor.eventTrace = nullptr;
+    if (!writer.close()) {
+        std::cerr << "Error: Unable to write event trace " << options.eventTrace << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << writer.bytesWritten() << " byte event trace to " << options.eventTrace << std::endl;
+    return ok;
+}
+
+// runTraced with the critical path analyzer attached for --critical-path
+bool runAnalyzed(NoForwardingProcessor& processor, const SimOptions& options) {
+    if (options.criticalPath.empty())
+        return runTraced(processor, options);
+
+    CriticalPathAnalyzer analyzer;
+    processor.criticalPath = &analyzer;
+    bool ok = runTraced(processor, options);
+    processor.criticalPath = nullptr;
+    processor.materializeInstructionStrings();
+    if (!analyzer.writeReport(options.criticalPath, processor.instructionStrings, processor.textBase, options.cycles))
+        return false;
+    if (options.criticalPath != "-")
+        std::cout << "Wrote critical path analysis of " << analyzer.instructions << " instructions to "
+                  << options.criticalPath << std::endl;
+    return ok;
+}
+
+// --functional: the program runs through the translation cache, <num_cycles> is the instruction limit
+// By StepStatus
+const char* const STOP_REASONS[] = {"instruction limit", "pc left the program", "illegal instruction",
+                                    "misaligned branch offset", "program exited"};
+
+bool runFunctional(NoForwardingProcessor& processor, const SimOptions& options) {
+    TranslationCache cache(processor);
+    if (options.jit && !cache.enableJit())
+        std::cerr << "Warning: no JIT for this host, the run is interpreted" << std::endl;
+    int32_t pc = processor.entryPC;
+    uint64_t executed = 0;
+    StepStatus status = cache.run(pc, static_cast<uint64_t>(options.cycles), executed);
+    processor.pc = pc;
+    std::cout << "Functional run executed " << executed << " instructions, stopped at PC " << pc << " ("
+              << STOP_REASONS[status] << ")" << std::endl;
+    std::cout << "Translated " << cache.translatedBlocks << " blocks of " << cache.translatedInstructions
+              << " instructions, " << cache.blockEntries << " block entries (" << cache.chainedEntries << " chained)"
+              << std::endl;
+    if (options.jit)
+        std::cout << "Compiled " << cache.compiledBlocks << " blocks to native code, " << cache.nativeEntries
+                  << " block entries ran natively" << std::endl;
+    return true;
+}
+
+// "out.hex" becomes "out_lane3.hex", stdout stays stdout
+std::string laneFilename(const std::string& filename, size_t lane) {
+    if (filename == "-")
+        return filename;
+    size_t slash = filename.find_last_of('/');
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = filename.size();
+    return filename.substr(0, dot) + "_lane" + std::to_string(lane) + filename.substr(dot);
+}
+
+bool runBatch(NoForwardingProcessor& processor, const SimOptions& options) {
+    std::vector<DataSet> dataSets;
+    if (!loadDataSets(options.batchFile, dataSets))
+        return false;
+    if (dataSets.empty()) {
+        std::cerr << "Error: no data sets in " << options.batchFile << std::endl;
+        return false;
+    }
+
+    // The command line preloads are already in the processor, each lane adds its own
+    LockstepBatch batch(processor, dataSets.size());
+    for (size_t lane = 0; lane < dataSets.size(); lane++) {
+        for (const RegisterPreload& preload : dataSets[lane].registerPreloads)
+            batch.writeRegister(lane, preload.reg, preload.value);
+        for (const MemoryImage& image : dataSets[lane].memoryImages) {
+            bool loaded = image.isHex ? loadHexImage(batch.memory(lane), image.address, image.filename)
+                                      : loadBinaryImage(batch.memory(lane), image.address, image.filename);
+            if (!loaded)
+                return false;
+        }
+    }
+
+    batch.run(static_cast<uint64_t>(options.cycles));
+    std::cout << "Batch of " << batch.lanes() << " data sets executed " << batch.laneInstructions
+              << " instructions in " << batch.issued << " lockstep issues ("
+              << (batch.issued ? static_cast<double>(batch.laneInstructions) / batch.issued : 0.0)
+              << " lanes each), " << batch.divergences << " divergent branches" << std::endl;
+    bool ok = true;
+    for (size_t lane = 0; lane < batch.lanes(); lane++) {
+        std::cout << "Lane " << lane << ": executed " << batch.executed(lane) << " instructions, stopped at PC "
+                  << batch.pc(lane) << " (" << STOP_REASONS[batch.status(lane)] << "), a0 = "
+                  << batch.readRegister(lane, 10) << std::endl;
+        for (const MemoryDump& dump : options.memoryDumps)
+            ok = writeMemoryDump(batch.memory(lane), dump, laneFilename(dump.filename, lane)) && ok;
+    }
+    return ok;
+}
+
+// runAnalyzed with the interval sampler attached for --interval-stats/--bbv
+bool runSampled(NoForwardingProcessor& processor, const SimOptions& options) {
+    // Vector instructions spend several cycles in EX and MEM, which the analyses cannot see
+    if ((!options.criticalPath.empty() || !options.intervalStats.empty() || !options.bbv.empty()) &&
+        std::any_of(processor.instructionMemory.begin(), processor.instructionMemory.end(), isVectorInstruction)) {
+        std::cerr << "Error: the critical path and interval options do not support vector programs" << std::endl;
+        return false;
+    }
+    if (options.intervalStats.empty() && options.bbv.empty())
+        return runAnalyzed(processor, options);
+
+    IntervalSampler sampler;
+    if (!sampler.open(options.intervalStats, options.bbv, options.intervalLength))
+        return false;
+    sampler.keepHistory = options.extrapolate;
+    processor.intervalSampler = &sampler;
+    bool ok = runAnalyzed(processor, options);
+    processor.intervalSampler = nullptr;
+    if (!sampler.close(options.cycles)) {
+        std::cerr << "Error: Unable to write the interval statistics" << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << sampler.intervals << " intervals of " << options.intervalLength << " instructions ("
+              << sampler.basicBlocks() << " basic blocks)" << std::endl;
+    return ok;
+}
+
+} // namespace
+
+bool runSimulation(NoForwardingProcessor& processor, const SimOptions& options) {
+    if (!options.batchFile.empty())
+        return runBatch(processor, options);
+    bool ok = options.functional ? runFunctional(processor, options) : runSampled(processor, options);
+    processor.flushStoreBuffer();
+    printMemoryStats(processor);
+    processor.syscalls.printSummary(std::cout);
+    const VectorUnit& vector = processor.vector;
+    if (vector.executed > 0)
+        std::cout << "Vector unit (VLEN " << vector.vlen() << ", " << vector.lanes() << " lanes): " << vector.executed
+                  << " instructions, " << vector.elements << " elements" << std::endl;
+    return ok;
+}
+
+void printMemoryStats(const NoForwardingProcessor& processor) {
+    if (processor.storeBuffer)
+        processor.storeBuffer->printSummary(std::cout);
+    if (processor.prefetcher)
+        processor.prefetcher->printSummary(std::cout);
+    if (processor.mmu)
+        processor.mmu->printSummary(std::cout);
+    if (processor.dram)
+        processor.dram->printSummary(std::cout);
+}
+
+bool writeMemoryDumps(const NoForwardingProcessor& processor, const SimOptions& options) {
+    // A batched run wrote the dumps of its lanes itself
+    if (!options.batchFile.empty())
+        return true;
+    bool ok = true;
+    for (const MemoryDump& dump : options.memoryDumps)
+        ok = writeMemoryDump(processor.dataMemory, dump, dump.filename) && ok;
+    return ok;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "DramTiming.hpp"
+#include "Mmu.hpp"
+#include "Prefetcher.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Memory;
+class NoForwardingProcessor;
+
+struct RegisterPreload {
+    uint32_t reg;
+    int32_t value;
+};
+
+struct MemoryImage {
+    uint32_t address;
+    std::string filename;
+    bool isHex;  // Whitespace separated hex words instead of raw bytes
+};
+
+// One line of a --batch file: the preloads of one lane
+struct DataSet {
+    std::vector<RegisterPreload> registerPreloads;
+    std::vector<MemoryImage> memoryImages;
+};
+
+struct MemoryDump {
+    static constexpr uint32_t MAX_LENGTH = 64u << 20;  // Bytes one dump may cover
+
+    uint32_t address;
+    uint32_t length;
+    std::string filename;  // ".bin" gets raw bytes, anything else hex words, "-" is stdout
+};
+
+// Command line shared by the forward and noforward simulators:
+//   <input_file> <num_cycles> [--reg r=v] [--mem-bin addr=file] [--mem-hex addr=file] [--dump addr:len=file]
+//                             [--quiet] [--no-diagram] [--fold] [--extrapolate]
+//                             [--trace-driven] [--trace-out file] [--trace-in file] [--event-trace file]
+//                             [--critical-path file] [--interval n] [--interval-stats file] [--bbv file]
+//                             [--harts n] [--quantum cycles] [--host-threads n] [--functional] [--jit]
+//                             [--batch file] [--vlen bits] [--vector-lanes n] [--smt round-robin|icount]
+//                             [--dram open|closed] [--dram-banks n] [--dram-row bytes] [--dram-timing rcd,cas,rp[,burst]]
+//                             [--prefetch none|next-line|stride|next-line,stride] [--prefetch-buffer lines]
+//                             [--prefetch-degree n] [--miss-latency cycles] [--store-buffer entries]
+//                             [--sv32 4k|4m] [--itlb entries[,ways]] [--dtlb entries[,ways]] [--walk-latency cycles]
+//                             [--page-tables addr] [--arg value] [--program-input file] [--program-output file]
+struct SimOptions {
+    std::string inputFile;
+    int cycles;
+    bool quiet;          // Drop the per-cycle log on stdout
+    bool recordDiagram;  // Build and write the pipeline diagram
+    bool foldDiagram;    // Write it folded by loop iterations instead
+    bool extrapolate;    // Skip steady-state loop iterations
+    bool traceDriven;    // Timing pipeline fed by a functional producer thread
+    std::string traceOut;  // Save the functional trace (implies traceDriven)
+    std::string traceIn;   // Replay a saved trace instead of executing
+    std::string eventTrace;  // Binary stage/commit event trace (see EventTrace.hpp)
+    std::string criticalPath;  // Critical path report (see CriticalPath.hpp), - for stdout
+    uint64_t intervalLength;   // Committed instructions per interval
+    std::string intervalStats;  // Per-interval CPI and stalls (see IntervalSampler.hpp), - for stdout
+    std::string bbv;            // Per-interval basic-block vectors, SimPoint format
+    int harts;                  // Processors sharing the data memory (see MultiHart.hpp)
+    int quantum;                // Cycles the harts run between synchronizations
+    int hostThreads;            // Host threads running the harts, 0 picks one per core
+    bool functional;            // Architectural run of up to <num_cycles> instructions, no pipeline (see TranslationCache.hpp)
+    bool jit;                   // Compile hot blocks of the functional run to native code (implies functional)
+    std::string batchFile;      // Data sets run in lockstep, one per line (see LockstepBatch.hpp, implies functional)
+    uint32_t vlen;              // Vector register width in bits (see VectorUnit.hpp)
+    uint32_t vectorLanes;       // 32-bit lanes of the vector datapath, sets the timing of vector instructions
+    bool smt;                   // Two hardware threads sharing the pipeline (see SmtProcessor.hpp)
+    bool icountFetch;           // SMT fetch by ICOUNT instead of round-robin
+    bool dramTiming;            // Loads, stores and atomics take the latency of a DRAM channel (see DramTiming.hpp)
+    DramConfig dram;
+    bool prefetchBuffer;        // Loads go through a prefetch buffer in front of memory (see Prefetcher.hpp)
+    PrefetchConfig prefetch;
+    uint32_t storeBufferEntries;  // Stores drain through a store buffer of this many entries, 0 for none (see StoreBuffer.hpp)
+    bool sv32;                  // Fetches and data accesses are translated through TLBs and page tables (see Mmu.hpp)
+    MmuConfig mmu;
+    std::vector<std::string> programArgs;  // argv[1..] of the program, argv[0] is the input file (see Syscalls.hpp)
+    std::string programInput;   // fd 0 of the program instead of the host stdin
+    std::string programOutput;  // fds 1 and 2 of the program instead of the host stdout and stderr
+    std::vector<RegisterPreload> registerPreloads;
+    std::vector<MemoryImage> memoryImages;
+    std::vector<MemoryDump> memoryDumps;
+
+    SimOptions() : cycles(0), quiet(false), recordDiagram(true), foldDiagram(false), extrapolate(false), traceDriven(false),
+                   intervalLength(10000), harts(1), quantum(100), hostThreads(0),
+                   functional(false), jit(false), vlen(128), vectorLanes(4), smt(false), icountFetch(false), dramTiming(false),
+                   prefetchBuffer(false), storeBufferEntries(0), sv32(false) {}
+};
+
+void printUsage(const char* program);
+bool parseSimOptions(int argc, char** argv, SimOptions& options);
+
+// Quiet mode, diagram recording, loop extrapolation, the vector unit and the memory timing models,
+// applied before the run
+void applyRunSettings(NoForwardingProcessor& processor, const SimOptions& options);
+// Counters of the DRAM, prefetch, store buffer and Sv32 models of the run, if there were any
+void printMemoryStats(const NoForwardingProcessor& processor);
+
+// Applied after the program is loaded, so images may overlay ELF data sections. ELF
+// programs, and any program given --arg, first get the stack and argv of Syscalls.hpp.
+bool applyPreloads(NoForwardingProcessor& processor, const SimOptions& options);
+// The stack and argv of an ELF program or one given --arg, built in 'memory'
+void setupProgramStack(NoForwardingProcessor& processor, Memory& memory, const SimOptions& options);
+// Runs the detailed pipeline, the trace-driven timing pipeline when a trace option is given,
+// or only the architectural execution for --functional
+bool runSimulation(NoForwardingProcessor& processor, const SimOptions& options);
+bool writeMemoryDumps(const NoForwardingProcessor& processor, const SimOptions& options);
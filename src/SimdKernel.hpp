@@ -0,0 +1,14 @@
+#pragma once
+
+// SIMD kernels are built twice, for AVX2 and for the SSE2 baseline, and the
+// loader picks the one the host runs. Mark them SIMD_KERNEL.
+#if defined(__x86_64__) && defined(__GNUC__) && defined(__linux__)
+#define SIMD_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define SIMD_KERNEL
+#endif
+
+// The 256-bit vectors of the kernels are only passed between inline functions
+// of the file that includes this, so whatever ABI the baseline build gives
+// them does not matter
+#pragma GCC diagnostic ignored "-Wpsabi"
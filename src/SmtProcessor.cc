@@ -0,0 +1,446 @@
+#include "SmtProcessor.hpp"
+#include "DiagramRenderer.hpp"
+#include "InstructionDecode.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+const char* threadTag(int thread) {
+    return thread == 0 ? "[T0] " : "[T1] ";
+}
+
+} // namespace
+
+SmtProcessor::SmtProcessor(bool forwarding, FetchPolicy policy) :
+    NoForwardingProcessor(),
+    forwarding(forwarding),
+    fetchPolicy(policy),
+    nextFetch(0),
+    nextIssue(0)
+{
+}
+
+SmtProcessor::~SmtProcessor() {
+}
+
+void SmtProcessor::beginRun(int cycles) {
+    resetPipeline(cycles);
+    // One row per thread and instruction instead of per instruction
+    int instructions = static_cast<int>(instructionStrings.size());
+    matrixRows = recordDiagram ? THREADS * instructions : 0;
+    pipelineMatrix3D.assign(static_cast<size_t>(matrixRows),
+                            std::vector<std::vector<PipelineStage>>(static_cast<size_t>(matrixCols),
+                                                                    std::vector<PipelineStage>(1, SPACE)));
+
+    bus.reset(new Interconnect(dataMemory, THREADS));
+    for (int t = 0; t < THREADS; t++) {
+        HardwareThread& thread = threads[t];
+        thread.pc = entryPC;
+        thread.registers = registers;
+        thread.registers.write(4, t);
+        thread.writers.fill(0);
+        thread.readyMask = 0;
+        thread.vector.reset(vector.vlen(), vector.lanes());
+        thread.queued = 0;
+        thread.stopped = false;
+        thread.lastCommit = -1;
+        thread.fetched = 0;
+        thread.flushed = 0;
+        thread.retired = 0;
+        thread.hazardCycles = 0;
+        thread.yieldCycles = 0;
+    }
+    nextFetch = 0;
+    nextIssue = 0;
+}
+
+int SmtProcessor::row(int thread, int32_t instructionPc) const {
+    int idx = getInstructionIndex(instructionPc);
+    return idx < 0 ? -1 : thread * static_cast<int>(instructionStrings.size()) + idx;
+}
+
+bool SmtProcessor::hasHazard(const HardwareThread& thread, uint32_t instruction) const {
+    uint32_t opcode = instruction & 0x7F;
+    bool resolvedInId = opcode == 0x63 || opcode == 0x67;
+    uint32_t sources[2];
+    int count = sourceRegisters(instruction, sources);
+    for (int i = 0; i < count; i++) {
+        if (sources[i] == 0)
+            continue;
+        if (thread.writers[sources[i]] > 0)
+            return true;
+        if (resolvedInId && (thread.readyMask & (1u << sources[i])))
+            return true;
+    }
+    return false;
+}
+
+void SmtProcessor::release(HardwareThread& thread, uint32_t rd, bool forwarded) {
+    if (thread.writers[rd] > 0)
+        thread.writers[rd]--;
+    if (forwarded)
+        thread.readyMask |= 1u << rd;
+}
+
+int SmtProcessor::inFlight(int thread) const {
+    return threads[thread].queued + (!idex.isEmpty && idex.thread == thread ? 1 : 0) +
+           (!exmem.isEmpty && exmem.thread == thread ? 1 : 0);
+}
+
+bool SmtProcessor::finished(int thread) const {
+    const HardwareThread& state = threads[thread];
+    if (state.queued > 0 || (!state.stopped && getInstructionIndex(state.pc) != -1))
+        return false;
+    return !((!idex.isEmpty && idex.thread == thread) || (!exmem.isEmpty && exmem.thread == thread) ||
+             (!memwb.isEmpty && memwb.thread == thread));
+}
+
+// -1 when no thread can take a fetch: a thread needs room in its queue and a pc inside the program
+int SmtProcessor::pickFetchThread() const {
+    int picked = -1;
+    for (int i = 0; i < THREADS; i++) {
+        int t = (nextFetch + i) % THREADS;
+        const HardwareThread& thread = threads[t];
+        if (thread.stopped || thread.queued == FETCH_QUEUE || getInstructionIndex(thread.pc) == -1)
+            continue;
+        if (picked == -1 || (fetchPolicy == FETCH_ICOUNT && inFlight(t) < inFlight(picked)))
+            picked = t;
+        if (fetchPolicy == FETCH_ROUND_ROBIN)
+            break;
+    }
+    return picked;
+}
+
+void SmtProcessor::runCycles(int firstCycle, int lastCycle) {
+    for (int cycle = firstCycle; cycle < lastCycle; cycle++) {
+        std::cout << "========== Starting Cycle " << cycle << " ==========" << std::endl;
+        for (HardwareThread& thread : threads)
+            thread.readyMask = 0;
+
+        // -------------------- WB Stage --------------------
+        if (!memwb.isEmpty) {
+            HardwareThread& thread = threads[memwb.thread];
+            std::cout << "Cycle " << cycle << " - WB: " << threadTag(memwb.thread) << "Processing "
+                      << memwb.instructionString << " at PC: " << memwb.pc << std::endl;
+            recordStage(row(memwb.thread, memwb.pc), cycle, WB);
+            thread.retired++;
+            thread.lastCommit = cycle;
+            // The forwarding pipeline wrote the result in EX or MEM
+            if (!forwarding && memwb.controls.regWrite && memwb.rd != 0) {
+                int32_t writeData = memwb.controls.memToReg ? memwb.readData : memwb.aluResult;
+                thread.registers.write(memwb.rd, writeData);
+                release(thread, memwb.rd, false);
+                std::cout << "         Written " << writeData << " to register x" << memwb.rd << std::endl;
+            }
+        }
+        else {
+            std::cout << "Cycle " << cycle << " - WB: No instruction" << std::endl;
+        }
+
+        // -------------------- MEM Stage --------------------
+        bool memHeld = occupyMemoryStage(threads[exmem.thread].vector, cycle);
+        if (memHeld) {
+            std::cout << "Cycle " << cycle << " - MEM: " << threadTag(exmem.thread) << "Processing "
+                      << exmem.instructionString << " at PC: " << exmem.pc << " (" << memCyclesLeft
+                      << " more cycle(s))" << std::endl;
+            recordStage(row(exmem.thread, exmem.pc), cycle, MEM);
+            memwb.isEmpty = true;
+        }
+        else if (!exmem.isEmpty) {
+            HardwareThread& thread = threads[exmem.thread];
+            std::cout << "Cycle " << cycle << " - MEM: " << threadTag(exmem.thread) << "Processing "
+                      << exmem.instructionString << " at PC: " << exmem.pc << std::endl;
+            recordStage(row(exmem.thread, exmem.pc), cycle, MEM);
+            uint32_t funct3 = (exmem.instruction >> 12) & 0x7;
+            uint32_t address = static_cast<uint32_t>(exmem.aluResult);
+            if ((exmem.instruction & 0x7F) == 0x2F) {
+                memwb.readData = bus->atomic(exmem.thread, exmem.instruction, address, exmem.readData2);
+                std::cout << "         Atomic access at address " << exmem.aluResult << " result: " << memwb.readData << std::endl;
+            } else if (isVectorMemoryAccess(exmem.instruction)) {
+                bus->vectorTransfer(exmem.thread, thread.vector, exmem.instruction, address, exmem.readData2);
+                std::cout << "         Vector access of " << thread.vector.vl << " element(s) at address " << exmem.aluResult << std::endl;
+            } else {
+                if (exmem.controls.memRead) {
+                    memwb.readData = bus->load(exmem.thread, funct3, address);
+                    std::cout << "         Read from memory at address " << exmem.aluResult << " data: " << memwb.readData << std::endl;
+                }
+                if (exmem.controls.memWrite) {
+                    bus->store(exmem.thread, funct3, address, exmem.readData2);
+                    std::cout << "         Wrote " << exmem.readData2 << " to memory at address " << exmem.aluResult << std::endl;
+                }
+            }
+            memwb.pc = exmem.pc;
+            memwb.aluResult = exmem.aluResult;
+            memwb.storeData = exmem.readData2;
+            memwb.rd = exmem.rd;
+            memwb.controls = exmem.controls;
+            memwb.instruction = exmem.instruction;
+            memwb.instructionString = exmem.instructionString;
+            memwb.thread = exmem.thread;
+            memwb.isEmpty = false;
+            if (forwarding && memwb.controls.memToReg && memwb.controls.regWrite && memwb.rd != 0) {
+                thread.registers.write(memwb.rd, memwb.readData);
+                release(thread, memwb.rd, true);
+                std::cout << "         Written " << memwb.readData << " to register x" << memwb.rd << std::endl;
+            }
+        }
+        else {
+            memwb.isEmpty = true;
+            std::cout << "Cycle " << cycle << " - MEM: No instruction" << std::endl;
+        }
+
+        // -------------------- EX Stage --------------------
+        if (memHeld) {
+            if (!idex.isEmpty) {
+                std::cout << "Cycle " << cycle << " - EX: " << threadTag(idex.thread) << idex.instructionString
+                          << " at PC: " << idex.pc << " waits for MEM" << std::endl;
+                recordStage(row(idex.thread, idex.pc), cycle, EX);
+            }
+        }
+        else if (!idex.isEmpty &&
+                 occupyStage(exCyclesLeft, threads[idex.thread].vector.executeCycles(idex.instruction))) {
+            std::cout << "Cycle " << cycle << " - EX: " << threadTag(idex.thread) << "Processing "
+                      << idex.instructionString << " at PC: " << idex.pc << " (" << exCyclesLeft
+                      << " more cycle(s))" << std::endl;
+            recordStage(row(idex.thread, idex.pc), cycle, EX);
+            exmem.isEmpty = true;
+        }
+        else if (!idex.isEmpty) {
+            HardwareThread& thread = threads[idex.thread];
+            std::cout << "Cycle " << cycle << " - EX: " << threadTag(idex.thread) << "Processing "
+                      << idex.instructionString << " at PC: " << idex.pc << std::endl;
+            recordStage(row(idex.thread, idex.pc), cycle, EX);
+            uint32_t opcode = idex.instruction & 0x7F;
+            if (opcode == 0x17)       // AUIPC
+                exmem.aluResult = idex.pc + idex.imm;
+            else if (opcode == 0x37)  // LUI
+                exmem.aluResult = idex.imm;
+            else if (opcode == 0x67 || opcode == 0x6F)  // Return address, set in ID
+                exmem.aluResult = idex.aluResult;
+            else if (isVectorInstruction(idex.instruction))
+                exmem.aluResult = thread.vector.execute(idex.instruction, idex.readData1, idex.readData2);
+            else
+                exmem.aluResult = executeALU(idex.readData1, idex.controls.aluSrc ? idex.imm : idex.readData2,
+                                             idex.controls.aluOp);
+            std::cout << "         ALU operation result: " << exmem.aluResult << std::endl;
+
+            exmem.pc = idex.pc;
+            exmem.readData2 = idex.readData2;
+            exmem.rd = idex.rd;
+            exmem.controls = idex.controls;
+            exmem.instruction = idex.instruction;
+            exmem.instructionString = idex.instructionString;
+            exmem.thread = idex.thread;
+            exmem.isEmpty = false;
+            // JAL wrote its link register in ID already
+            if (forwarding && exmem.controls.regWrite && exmem.rd != 0 && !exmem.controls.memToReg && opcode != 0x6F) {
+                thread.registers.write(exmem.rd, exmem.aluResult);
+                release(thread, exmem.rd, true);
+                std::cout << "         Written " << exmem.aluResult << " to register x" << exmem.rd << std::endl;
+            }
+        }
+        else {
+            exmem.isEmpty = true;
+            std::cout << "Cycle " << cycle << " - EX: No instruction" << std::endl;
+        }
+
+        exHeld = !idex.isEmpty && (memHeld || exCyclesLeft > 0);
+
+        // -------------------- ID Stage --------------------
+        // Every queue head shows ID and the rest of the queue waits in IF; the
+        // first head without a hazard, in issue order, moves to EX
+        int issued = -1;
+        for (int i = 0; i < THREADS; i++) {
+            int t = (nextIssue + i) % THREADS;
+            HardwareThread& thread = threads[t];
+            if (thread.queued == 0)
+                continue;
+            const IFIDRegister& head = thread.queue[0];
+            std::cout << "Cycle " << cycle << " - ID: " << threadTag(t) << "Processing "
+                      << head.instructionString << " at PC: " << head.pc << std::endl;
+            recordStage(row(t, head.pc), cycle, ID);
+            for (int q = 1; q < thread.queued; q++)
+                recordStage(row(t, thread.queue[q].pc), cycle, IF);
+            if (exHeld || hasHazard(thread, head.instruction)) {
+                thread.hazardCycles++;
+                std::cout << "         Hazard detected: " << threadTag(t) << "waits in ID" << std::endl;
+            } else if (issued != -1) {
+                thread.yieldCycles++;
+                std::cout << "         " << threadTag(t) << "waits for " << threadTag(issued) << "to issue" << std::endl;
+            } else {
+                issued = t;
+            }
+        }
+
+        bool branchTaken = false;
+        int32_t branchTarget = 0;
+        if (issued != -1) {
+            HardwareThread& thread = threads[issued];
+            IFIDRegister ifid = thread.queue[0];
+            for (int q = 1; q < thread.queued; q++)
+                thread.queue[q - 1] = thread.queue[q];
+            thread.queued--;
+            uint32_t instruction = ifid.instruction;
+            uint32_t opcode = instruction & 0x7F;
+            uint32_t rd  = (instruction >> 7) & 0x1F;
+            uint32_t rs1 = (instruction >> 15) & 0x1F;
+            uint32_t rs2 = (instruction >> 20) & 0x1F;
+            int32_t imm = extractImmediate(instruction, opcode);
+            int32_t rs1Value = thread.registers.read(rs1);
+            int32_t rs2Value = thread.registers.read(rs2);
+
+            ControlSignals controls = decodeControlSignals(instruction);
+            if (!controls.illegal_instruction && !thread.vector.accepts(instruction)) {
+                std::cerr << "Vector instruction not allowed with vtype 0x" << std::hex << thread.vector.vtype << std::dec << std::endl;
+                controls.illegal_instruction = true;
+            }
+            if (isEcall(instruction)) {
+                std::cerr << "System calls are not emulated with --smt" << std::endl;
+                controls.illegal_instruction = true;
+            }
+            if (!controls.illegal_instruction && (opcode == 0x63 || opcode == 0x67 || opcode == 0x6F))
+                branchTaken = handleBranchAndJump(opcode, instruction, rs1Value, imm, ifid.pc, rs2Value, branchTarget);
+            if (controls.illegal_instruction || !Imm_valid) {
+                std::cout << (controls.illegal_instruction ? "Illegal instruction" : "Invalid Immediate value")
+                          << " detected at PC: " << ifid.pc << std::endl;
+                std::cout << "Instruction: " << ifid.instructionString << std::endl;
+                std::cout << "----------------------> Stopping thread " << issued << std::endl;
+                thread.stopped = true;
+                thread.queued = 0;
+                branchTaken = false;
+                Imm_valid = true;
+                idex.isEmpty = true;
+            } else {
+                idex.aluResult = ifid.pc + 4;  // Return address of JAL/JALR
+                idex.readData1 = rs1Value;
+                idex.readData2 = rs2Value;
+                idex.pc = ifid.pc;
+                idex.imm = imm;
+                idex.rs1 = rs1;
+                idex.rs2 = rs2;
+                idex.rd = rd;
+                idex.controls = controls;
+                idex.instruction = instruction;
+                idex.instructionString = ifid.instructionString;
+                idex.thread = issued;
+                idex.isEmpty = false;
+                if (controls.regWrite && rd != 0) {
+                    // The forwarding pipeline writes the JAL link register right away
+                    if (forwarding && opcode == 0x6F) {
+                        thread.registers.write(rd, idex.aluResult);
+                        std::cout << "         Written " << idex.aluResult << " to register x" << rd << std::endl;
+                    } else {
+                        thread.writers[rd]++;
+                        std::cout << "         Marking register x" << rd << " as busy" << std::endl;
+                    }
+                }
+            }
+            nextIssue = (issued + 1) % THREADS;
+        }
+        else if (!exHeld) {
+            idex.isEmpty = true;
+        }
+
+        // -------------------- IF Stage --------------------
+        int fetched = pickFetchThread();
+        if (fetched != -1) {
+            HardwareThread& thread = threads[fetched];
+            int fetchIdx = getInstructionIndex(thread.pc);
+            IFIDRegister& slot = thread.queue[thread.queued++];
+            slot.instruction = instructionMemory[fetchIdx];
+            slot.pc = thread.pc;
+            slot.instructionString = instructionStrings[fetchIdx];
+            slot.isEmpty = false;
+            thread.fetched++;
+            recordStage(row(fetched, thread.pc), cycle, IF);
+            std::cout << "Cycle " << cycle << " - IF: " << threadTag(fetched) << "Fetched "
+                      << slot.instructionString << " at PC: " << thread.pc << std::endl;
+            thread.pc += 4;
+            nextFetch = (fetched + 1) % THREADS;
+        }
+        else {
+            std::cout << "Cycle " << cycle << " - IF: No instruction fetched" << std::endl;
+        }
+
+        // -------------------- End-of-Cycle Processing --------------------
+        if (branchTaken) {
+            HardwareThread& thread = threads[issued];
+            thread.pc = branchTarget;
+            // Whatever the thread has queued, this cycle's fetch included, is on the wrong path
+            if (thread.queued > 0) {
+                thread.flushed += static_cast<uint64_t>(thread.queued);
+                thread.queued = 0;
+                std::cout << "         Flushing " << threadTag(issued) << "fetch queue due to branch/jump" << std::endl;
+            }
+        }
+
+        std::cout << "========== Ending Cycle " << cycle << " ==========" << std::endl << std::endl;
+    }
+}
+
+void SmtProcessor::printThreadDiagram(const std::string& filename, bool isforwardcpu) {
+    std::string outputFilename = diagramOutputFilename(filename, isforwardcpu, outputTag + "_smt_out.txt");
+    std::FILE* outFile = std::fopen(outputFilename.c_str(), "w");
+    if (!outFile) {
+        std::cerr << "Error: Unable to open " << outputFilename << " for writing" << std::endl;
+        return;
+    }
+    std::cout << "Writing pipeline diagram to " << outputFilename << std::endl;
+    materializeInstructionStrings();
+
+    // The labels are the instructions with the thread in front
+    StringArena labelArena;
+    std::vector<std::string_view> labels;
+    labels.reserve(static_cast<size_t>(matrixRows));
+    for (int t = 0; t < THREADS && matrixRows > 0; t++) {
+        for (std::string_view instruction : instructionStrings)
+            labels.push_back(labelArena.store("T" + std::to_string(t) + " " + std::string(instruction)));
+    }
+    bool ok = writePipelineDiagram(outFile, labels, pipelineMatrix3D, matrixRows, matrixCols);
+    if (std::fclose(outFile) != 0 || !ok)
+        std::cerr << "Error: Unable to write " << outputFilename << std::endl;
+}
+
+bool runSmt(const SimOptions& options, bool isforwardcpu) {
+    SmtProcessor processor(isforwardcpu, options.icountFetch ? SmtProcessor::FETCH_ICOUNT : SmtProcessor::FETCH_ROUND_ROBIN);
+    std::string filename = options.inputFile;
+    if (!processor.loadProgram(filename)) {
+        std::cerr << "Failed to load instructions from file: " << filename << std::endl;
+        return false;
+    }
+    if (!applyPreloads(processor, options)) {
+        std::cerr << "Failed to apply register/memory preloads" << std::endl;
+        return false;
+    }
+    applyRunSettings(processor, options);
+    processor.run(options.cycles);
+
+    // Throughput over the cycles until both threads drained, or the whole run
+    int cycles = options.cycles;
+    if (processor.finished(0) && processor.finished(1))
+        cycles = std::max(processor.threads[0].lastCommit, processor.threads[1].lastCommit) + 1;
+    std::cout << "SMT pipeline, " << (options.icountFetch ? "ICOUNT" : "round-robin") << " fetch, "
+              << (isforwardcpu ? "forwarding" : "no forwarding") << ", " << cycles << " cycles" << std::endl;
+    uint64_t total = 0;
+    for (int t = 0; t < SmtProcessor::THREADS; t++) {
+        const SmtProcessor::HardwareThread& thread = processor.threads[t];
+        total += thread.retired;
+        std::cout << "Thread " << t << (thread.stopped ? " (stopped)" : "") << ": " << thread.retired
+                  << " instructions, IPC " << std::fixed << std::setprecision(3)
+                  << (cycles > 0 ? static_cast<double>(thread.retired) / cycles : 0.0) << std::defaultfloat;
+        if (processor.finished(t))
+            std::cout << ", done at cycle " << thread.lastCommit;
+        std::cout << "; " << thread.fetched << " fetched, " << thread.flushed << " flushed, " << thread.hazardCycles
+                  << " hazard cycles, " << thread.yieldCycles << " cycles yielding ID" << std::endl;
+    }
+    std::cout << "Total: " << total << " instructions, throughput IPC " << std::fixed << std::setprecision(3)
+              << (cycles > 0 ? static_cast<double>(total) / cycles : 0.0) << std::defaultfloat << std::endl;
+    printMemoryStats(processor);
+
+    if (options.recordDiagram)
+        processor.printThreadDiagram(filename, isforwardcpu);
+    return writeMemoryDumps(processor, options);
+}
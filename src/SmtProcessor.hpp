@@ -0,0 +1,81 @@
+#pragma once
+#include "Processor.hpp"
+#include "SimOptions.hpp"
+#include <array>
+#include <memory>
+#include <string>
+
+// Two-way simultaneous multithreading (--smt <policy>): two hardware threads,
+// each with its own pc, registers, scoreboard and vector unit, share the IF,
+// ID, EX, MEM and WB stages of one pipeline. Both run the loaded program from
+// the entry point with the preloaded registers and tp (x4) = thread id, the
+// way the harts of a multi-hart run tell themselves apart, on the one data
+// memory; LR/SC reservations are kept per thread.
+//
+// Each thread has a fetch queue of FETCH_QUEUE instructions in place of the
+// IF/ID latch. Every cycle IF fetches one instruction for a thread whose queue
+// has room: round-robin takes turns, ICOUNT picks the thread with the fewest
+// instructions queued or in EX and MEM (turns break ties). ID issues one
+// instruction per cycle from the head of a queue whose instruction has no
+// hazard, alternating when both could go. A thread stalled on a register or
+// refetching after a taken branch, which empties its queue, thus leaves its
+// slots to the other. Hazards follow the rules of the non-forwarding pipeline
+// (a result is read the cycle it is written back), or with 'forwarding' those
+// of ForwardingProcessor: an ALU result is read the cycle after EX and a load
+// the cycle after MEM, by branches and JALR (resolved in ID) a cycle later.
+//
+// An illegal instruction or bad branch offset stops only its own thread. The
+// diagram has a row per thread and instruction, tagged T0/T1, and is written
+// to <input>_forward_smt_out.txt or _noforward_smt_out.txt.
+class SmtProcessor : public NoForwardingProcessor {
+public:
+    static const int THREADS = 2;
+    static const int FETCH_QUEUE = 2;
+    enum FetchPolicy { FETCH_ROUND_ROBIN, FETCH_ICOUNT };
+
+    struct HardwareThread {
+        int32_t pc;
+        RegisterFile registers;
+        std::array<uint32_t, 32> writers;  // Issued instructions that have not yet made each register readable
+        uint32_t readyMask;   // Registers forwarded this cycle, which a branch or JALR in ID only sees next cycle
+        VectorUnit vector;
+        IFIDRegister queue[FETCH_QUEUE];  // Fetched instructions, oldest first; queue[0] is in ID
+        int queued;
+        bool stopped;         // Illegal instruction or bad offset, nothing more is fetched
+        int lastCommit;       // Cycle of its last WB, -1 before the first one
+        uint64_t fetched;
+        uint64_t flushed;     // Fetched instructions dropped after a taken branch or jump of the thread
+        uint64_t retired;
+        uint64_t hazardCycles;  // Cycles its instruction in ID waited for a register or for EX
+        uint64_t yieldCycles;   // Cycles it could have issued but the other thread did
+    };
+
+    SmtProcessor(bool forwarding, FetchPolicy policy);
+    ~SmtProcessor();
+
+    void beginRun(int cycles) override;
+    void runCycles(int firstCycle, int lastCycle) override;
+    // True once the thread stopped, or ran off the end of the program, and drained
+    bool finished(int thread) const;
+    // The diagram with a T0/T1 row per instruction (_smt_out.txt)
+    void printThreadDiagram(const std::string& filename, bool isforwardcpu);
+
+    HardwareThread threads[THREADS];
+    bool forwarding;
+    FetchPolicy fetchPolicy;
+
+private:
+    std::unique_ptr<Interconnect> bus;  // Thread-tagged data accesses and the reservations
+    int nextFetch;   // Thread whose turn it is at IF
+    int nextIssue;   // Thread that goes first at ID when both can issue
+
+    int row(int thread, int32_t instructionPc) const;
+    bool hasHazard(const HardwareThread& thread, uint32_t instruction) const;
+    void release(HardwareThread& thread, uint32_t rd, bool forwarded);
+    int inFlight(int thread) const;
+    int pickFetchThread() const;
+};
+
+// Loads the program and runs it on an SmtProcessor, then prints the IPC of
+// each thread and the throughput of the pipeline
+bool runSmt(const SimOptions& options, bool isforwardcpu);
@@ -0,0 +1,51 @@
+#include "StoreBuffer.hpp"
+#include <algorithm>
+#include <ostream>
+
+StoreBuffer::StoreBuffer(uint32_t capacity)
+    : capacity(capacity), stores(0), drained(0), forwardedLoads(0), partialLoads(0), fullStallCycles(0),
+      drainWaitCycles(0), maxOccupancy(0) {}
+
+void StoreBuffer::push(int32_t pc, uint32_t funct3, uint32_t address, int32_t value, bool writesMemory) {
+    entries.push_back(Entry{pc, address, accessBytes(funct3), static_cast<uint32_t>(value), writesMemory, false, 0});
+    stores++;
+    maxOccupancy = std::max<uint64_t>(maxOccupancy, entries.size());
+}
+
+uint32_t StoreBuffer::coverage(uint32_t address, uint32_t bytes) const {
+    uint32_t mask = 0;
+    for (const Entry& entry : entries) {
+        for (uint32_t i = 0; i < bytes; i++) {
+            if (address + i - entry.address < entry.bytes)
+                mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+int32_t StoreBuffer::forward(uint32_t funct3, uint32_t address, uint32_t raw) const {
+    uint32_t bytes = accessBytes(funct3);
+    for (const Entry& entry : entries) {
+        for (uint32_t i = 0; i < bytes; i++) {
+            uint32_t offset = address + i - entry.address;
+            if (offset < entry.bytes)
+                raw = (raw & ~(0xFFu << (8 * i))) | (((entry.value >> (8 * offset)) & 0xFF) << (8 * i));
+        }
+    }
+    switch (funct3) {
+        case 0x0: return static_cast<int8_t>(raw & 0xFF);     // LB
+        case 0x1: return static_cast<int16_t>(raw & 0xFFFF);  // LH
+        case 0x4: return static_cast<int32_t>(raw & 0xFF);    // LBU
+        case 0x5: return static_cast<int32_t>(raw & 0xFFFF);  // LHU
+        default:  return static_cast<int32_t>(raw);           // LW
+    }
+}
+
+void StoreBuffer::printSummary(std::ostream& out) const {
+    if (stores == 0 && forwardedLoads + partialLoads == 0)
+        return;
+    out << "Store buffer (" << capacity << " entries): " << stores << " stores, " << drained << " drained, "
+        << forwardedLoads << " loads forwarded, " << partialLoads << " partly forwarded, " << fullStallCycles
+        << " cycles stalled on a full buffer, " << drainWaitCycles << " cycles waiting for it to drain, at most "
+        << maxOccupancy << " entries in use" << std::endl;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+
+// Store buffer between MEM and the data memory (--store-buffer n).
+//
+// A store leaves MEM in one cycle into the buffer, unless all 'capacity'
+// entries are taken, in which case it waits in MEM. The oldest entry drains
+// to memory in the background, one at a time, at the latency of the memory
+// model in use (one cycle without --dram or --prefetch), and memory is only
+// written when it does. A load takes the bytes that buffered stores of any
+// width (SB/SH/SW) wrote, the youngest winning, and the rest from memory: if
+// the stores cover all of its bytes it is forwarded in one cycle, otherwise
+// it waits for memory and the bytes are merged. Atomics and vector accesses
+// go to memory directly and wait in MEM until the buffer is empty.
+class StoreBuffer {
+public:
+    struct Entry {
+        int32_t pc;
+        uint32_t address;
+        uint32_t bytes;     // 1, 2 or 4
+        uint32_t value;
+        bool writesMemory;  // False for the timing-only stores of a trace-driven run
+        bool draining;
+        uint64_t doneAt;    // Cycle the write to memory completes, once draining
+    };
+
+    explicit StoreBuffer(uint32_t capacity);
+
+    bool full() const { return entries.size() >= capacity; }
+    bool empty() const { return entries.empty(); }
+    void push(int32_t pc, uint32_t funct3, uint32_t address, int32_t value, bool writesMemory);
+    // Mask of the bytes of an access (bit i for address + i) that buffered stores wrote
+    uint32_t coverage(uint32_t address, uint32_t bytes) const;
+    // Load result for funct3 from 'raw', the little-endian bytes memory holds,
+    // with the buffered bytes laid over them and then extended
+    int32_t forward(uint32_t funct3, uint32_t address, uint32_t raw) const;
+    void printSummary(std::ostream& out) const;
+
+    // Bytes a load or store with this funct3 accesses
+    static uint32_t accessBytes(uint32_t funct3) { return (funct3 & 0x3) == 0 ? 1 : (funct3 & 0x3) == 1 ? 2 : 4; }
+
+    uint32_t capacity;
+    std::deque<Entry> entries;  // Oldest first
+    uint64_t stores;
+    uint64_t drained;
+    uint64_t forwardedLoads;  // Every byte came from the buffer
+    uint64_t partialLoads;    // Some bytes came from the buffer, the rest from memory
+    uint64_t fullStallCycles;  // Cycles a store waited in MEM for a free entry
+    uint64_t drainWaitCycles;  // Cycles an atomic or vector access waited for the buffer to empty
+    uint64_t maxOccupancy;
+};
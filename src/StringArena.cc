@@ -0,0 +1,31 @@
+#include "StringArena.hpp"
+#include <algorithm>
+#include <cstring>
+
+StringArena::StringArena() : cursor(nullptr), remaining(0) {}
+
+void StringArena::reserve(size_t bytes) {
+    if (bytes <= remaining)
+        return;
+    size_t blockSize = std::max(bytes, DEFAULT_BLOCK_SIZE);
+    blocks.emplace_back(new char[blockSize]);
+    cursor = blocks.back().get();
+    remaining = blockSize;
+}
+
+std::string_view StringArena::store(std::string_view text) {
+    if (text.empty())
+        return std::string_view();
+    reserve(text.size());
+    std::memcpy(cursor, text.data(), text.size());
+    std::string_view stored(cursor, text.size());
+    cursor += text.size();
+    remaining -= text.size();
+    return stored;
+}
+
+void StringArena::clear() {
+    blocks.clear();
+    cursor = nullptr;
+    remaining = 0;
+}
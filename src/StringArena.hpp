@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only storage for instruction text. Every stored string is returned as
+// a std::string_view that stays valid until clear(), so the program listing,
+// the pipeline latches and the diagram can all share one copy of the text
+// instead of allocating a std::string per instruction per stage.
+class StringArena {
+private:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cursor;
+    size_t remaining;
+
+public:
+    StringArena();
+
+    // Make sure the next 'bytes' bytes of stores land in one contiguous block
+    void reserve(size_t bytes);
+    std::string_view store(std::string_view text);
+    void clear();
+};
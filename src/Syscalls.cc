@@ -0,0 +1,226 @@
+#include "Syscalls.hpp"
+#include "Processor.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// RISC-V Linux system call numbers
+const uint32_t SYS_CLOSE = 57;
+const uint32_t SYS_READ = 63;
+const uint32_t SYS_WRITE = 64;
+const uint32_t SYS_EXIT = 93;
+const uint32_t SYS_EXIT_GROUP = 94;
+const uint32_t SYS_CLOCK_GETTIME = 113;
+const uint32_t SYS_GETTIMEOFDAY = 169;
+const uint32_t SYS_BRK = 214;
+const uint32_t SYS_CLOCK_GETTIME64 = 403;
+
+// errno values, returned negated
+const int32_t ERROR_BADF = 9;
+const int32_t ERROR_FAULT = 14;
+const int32_t ERROR_NOSYS = 38;
+
+const uint64_t NANOSECONDS = 1000000000ull;
+const uint32_t WRITE_CHUNK = 4096;   // Bytes of a write copied out of guest memory at a time
+
+// A buffer of 'count' bytes at 'buffer' that runs past the 32-bit address space
+bool outsideMemory(uint32_t buffer, uint32_t count) {
+    return static_cast<uint64_t>(buffer) + count > (1ull << 32);
+}
+
+// Byte accesses of the kernel side, through the interconnect when memory is shared
+uint8_t readByte(NoForwardingProcessor& cpu, uint32_t address) {
+    return static_cast<uint8_t>(cpu.interconnect ? cpu.interconnect->load(cpu.hartId, 0x4, address)
+                                                 : cpu.dataMemory.readByte(address));
+}
+
+void writeWord(NoForwardingProcessor& cpu, uint32_t address, uint32_t value) {
+    if (cpu.interconnect)
+        cpu.interconnect->store(cpu.hartId, 0x2, address, static_cast<int32_t>(value));
+    else
+        cpu.dataMemory.writeWord(address, static_cast<int32_t>(value));
+}
+
+} // namespace
+
+SyscallEmulator::SyscallEmulator()
+    : imageEnd(0), programBreak(DEFAULT_BREAK), exited(false), exitCode(0), calls(0), bytesRead(0), bytesWritten(0),
+      heapBase(DEFAULT_BREAK), breakLimit(STACK_TOP - STACK_SIZE), stackTop(STACK_TOP) {}
+
+void SyscallEmulator::setImageEnd(uint32_t address) {
+    imageEnd = address;
+    heapBase = (address + Memory::PAGE_MASK) & ~Memory::PAGE_MASK;
+    programBreak = heapBase;
+}
+
+void SyscallEmulator::setHart(int hart, int harts) {
+    stackTop = STACK_TOP - static_cast<uint32_t>(hart) * STACK_SIZE;
+    uint32_t heapTop = STACK_TOP - static_cast<uint32_t>(harts) * STACK_SIZE;
+    uint32_t slice = heapTop > heapBase ? ((heapTop - heapBase) / static_cast<uint32_t>(harts)) & ~Memory::PAGE_MASK : 0;
+    heapBase += static_cast<uint32_t>(hart) * slice;
+    programBreak = heapBase;
+    breakLimit = heapBase + slice;
+}
+
+bool SyscallEmulator::redirect(const std::string& input, const std::string& output) {
+    if (!input.empty()) {
+        inputFile.reset(new std::ifstream(input, std::ios::binary));
+        if (!inputFile->is_open()) {
+            std::cerr << "Error: Unable to open program input " << input << std::endl;
+            return false;
+        }
+    }
+    if (!output.empty()) {
+        outputFile.reset(new std::ofstream(output, std::ios::binary));
+        if (!outputFile->is_open()) {
+            std::cerr << "Error: Unable to open program output " << output << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void SyscallEmulator::setupStack(NoForwardingProcessor& cpu, Memory& memory, const std::vector<std::string>& args) {
+    uint32_t sp = stackTop;
+    std::vector<uint32_t> pointers;
+    for (const std::string& arg : args) {
+        sp -= static_cast<uint32_t>(arg.size() + 1);
+        memory.writeBlock(sp, reinterpret_cast<const uint8_t*>(arg.c_str()), arg.size() + 1);
+        pointers.push_back(sp);
+    }
+    // argc, argv[0..argc-1], NULL, envp NULL, auxv AT_NULL pair
+    uint32_t words = static_cast<uint32_t>(pointers.size()) + 5;
+    sp = (sp - words * 4) & ~15u;
+    memory.clearBlock(sp, words * 4);
+    memory.writeWord(sp, static_cast<int32_t>(pointers.size()));
+    for (size_t i = 0; i < pointers.size(); i++)
+        memory.writeWord(sp + 4 + static_cast<uint32_t>(i) * 4, static_cast<int32_t>(pointers[i]));
+    cpu.registers.write(2, static_cast<int32_t>(sp));
+    cpu.registers.write(10, static_cast<int32_t>(pointers.size()));
+    cpu.registers.write(11, static_cast<int32_t>(sp + 4));
+    std::cout << "Stack at 0x" << std::hex << sp << std::dec << " with " << pointers.size() << " argument(s), break at 0x"
+              << std::hex << programBreak << std::dec << std::endl;
+}
+
+int32_t SyscallEmulator::read(NoForwardingProcessor& cpu, int32_t fd, uint32_t buffer, uint32_t count) {
+    if (fd != 0)
+        return -ERROR_BADF;
+    if (outsideMemory(buffer, count))
+        return -ERROR_FAULT;
+    std::istream& in = inputFile ? static_cast<std::istream&>(*inputFile) : std::cin;
+    // Like a terminal, a read returns at the end of a line
+    uint32_t done = 0;
+    char c = 0;
+    while (done < count && in.get(c)) {
+        if (cpu.interconnect)
+            cpu.interconnect->store(cpu.hartId, 0x0, buffer + done, c);
+        else
+            cpu.dataMemory.writeByte(buffer + done, static_cast<uint8_t>(c));
+        done++;
+        if (c == '\n')
+            break;
+    }
+    bytesRead += done;
+    return static_cast<int32_t>(done);
+}
+
+int32_t SyscallEmulator::write(NoForwardingProcessor& cpu, int32_t fd, uint32_t buffer, uint32_t count) {
+    if (fd != 1 && fd != 2)
+        return -ERROR_BADF;
+    if (outsideMemory(buffer, count))
+        return -ERROR_FAULT;
+    // Straight into the stream buffer for stdout: the program's output is still
+    // wanted when --quiet or a multi-hart run has failed cout, and harts write at once
+    std::streambuf* out = outputFile ? outputFile->rdbuf() : fd == 2 ? std::cerr.rdbuf() : std::cout.rdbuf();
+    std::cout.flush();
+    char chunk[WRITE_CHUNK];
+    for (uint32_t done = 0; done < count;) {
+        uint32_t size = std::min(count - done, WRITE_CHUNK);
+        for (uint32_t i = 0; i < size; i++)
+            chunk[i] = static_cast<char>(readByte(cpu, buffer + done + i));
+        out->sputn(chunk, size);
+        done += size;
+    }
+    out->pubsync();
+    bytesWritten += count;
+    return static_cast<int32_t>(count);
+}
+
+int32_t SyscallEmulator::brk(uint32_t address) {
+    // brk(0), or an address outside the heap, returns the break unchanged
+    if (address >= heapBase && address <= breakLimit)
+        programBreak = address;
+    return static_cast<int32_t>(programBreak);
+}
+
+bool SyscallEmulator::handle(NoForwardingProcessor& cpu, uint64_t now) {
+    if (exited)
+        return false;
+    calls++;
+    uint32_t number = static_cast<uint32_t>(cpu.registers.read(17));
+    int32_t a0 = cpu.registers.read(10);
+    uint32_t a1 = static_cast<uint32_t>(cpu.registers.read(11));
+    uint32_t a2 = static_cast<uint32_t>(cpu.registers.read(12));
+    int32_t result = 0;
+    switch (number) {
+        case SYS_EXIT:
+        case SYS_EXIT_GROUP:
+            exited = true;
+            exitCode = a0;
+            std::cout << "         System call exit(" << a0 << ")" << std::endl;
+            return false;
+        case SYS_READ:
+            result = read(cpu, a0, a1, a2);
+            break;
+        case SYS_WRITE:
+            result = write(cpu, a0, a1, a2);
+            break;
+        case SYS_CLOSE:
+            result = (a0 >= 0 && a0 <= 2) ? 0 : -ERROR_BADF;
+            break;
+        case SYS_BRK:
+            result = brk(static_cast<uint32_t>(a0));
+            break;
+        // A NULL time pointer is skipped, as Linux does for gettimeofday
+        case SYS_CLOCK_GETTIME:     // struct timespec of 32-bit fields
+            if (a1 != 0) {
+                writeWord(cpu, a1, static_cast<uint32_t>(now / NANOSECONDS));
+                writeWord(cpu, a1 + 4, static_cast<uint32_t>(now % NANOSECONDS));
+            }
+            break;
+        case SYS_CLOCK_GETTIME64:   // 64-bit tv_sec, then 64-bit tv_nsec
+            if (a1 != 0) {
+                writeWord(cpu, a1, static_cast<uint32_t>(now / NANOSECONDS));
+                writeWord(cpu, a1 + 4, static_cast<uint32_t>((now / NANOSECONDS) >> 32));
+                writeWord(cpu, a1 + 8, static_cast<uint32_t>(now % NANOSECONDS));
+                writeWord(cpu, a1 + 12, 0);
+            }
+            break;
+        case SYS_GETTIMEOFDAY:      // struct timeval of 32-bit fields
+            if (a0 != 0) {
+                writeWord(cpu, static_cast<uint32_t>(a0), static_cast<uint32_t>(now / NANOSECONDS));
+                writeWord(cpu, static_cast<uint32_t>(a0) + 4, static_cast<uint32_t>(now % NANOSECONDS / 1000));
+            }
+            break;
+        default:
+            if (std::find(warned.begin(), warned.end(), number) == warned.end()) {
+                std::cerr << "Warning: unsupported system call " << number << ", returning -ENOSYS" << std::endl;
+                warned.push_back(number);
+            }
+            result = -ERROR_NOSYS;
+            break;
+    }
+    cpu.registers.write(10, result);
+    std::cout << "         System call " << number << " returned " << result << std::endl;
+    return true;
+}
+
+void SyscallEmulator::printSummary(std::ostream& out) const {
+    if (calls == 0)
+        return;
+    out << "System calls: " << calls << ", " << bytesRead << " bytes read, " << bytesWritten << " bytes written";
+    if (exited)
+        out << ", exit code " << exitCode;
+    out << std::endl;
+}
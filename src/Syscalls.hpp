@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Memory;
+class NoForwardingProcessor;
+
+const uint32_t ECALL_INSTRUCTION = 0x00000073;
+
+inline bool isEcall(uint32_t instruction) {
+    return instruction == ECALL_INSTRUCTION;
+}
+
+// System calls of the program, emulated the way a proxy kernel does.
+//
+// ECALL takes the call number in a7 and the arguments in a0-a5, and returns
+// its result in a0, negative errno values for errors, with the RISC-V Linux
+// numbers newlib and picolibc use:
+//   exit (93), exit_group (94)          stop the program with the code in a0
+//   read (63), write (64), close (57)   fd 0 is the host stdin, 1 and 2 stdout
+//                                       and stderr, or the files given with
+//                                       --program-input/--program-output; a
+//                                       buffer past the end of the 32-bit
+//                                       address space returns -EFAULT
+//   brk (214)                           moves the program break (sbrk is brk in libc)
+//   clock_gettime (113), clock_gettime64 (403), gettimeofday (169)
+//                                       simulated time: the core runs at 1 GHz,
+//                                       so a cycle (an instruction in functional
+//                                       runs) is a nanosecond; a NULL time
+//                                       pointer is not written
+// Anything else returns -ENOSYS, with a warning the first time.
+//
+// The pipelines handle ECALL at WB, once everything older has committed, and
+// do not issue anything younger until then. Functional execution handles it
+// when it executes.
+class SyscallEmulator {
+public:
+    static constexpr uint32_t STACK_TOP = 0x80000000u;
+    static constexpr uint32_t STACK_SIZE = 8u << 20;          // brk stops below it
+    static constexpr uint32_t DEFAULT_BREAK = 0x10000000u;    // For programs that are not ELF images
+
+    SyscallEmulator();
+
+    // Performs the system call in the registers of 'cpu' at simulated time
+    // 'now' and writes a0. Returns false once the program has exited.
+    bool handle(NoForwardingProcessor& cpu, uint64_t now);
+
+    // Copies 'args' (argv[0] first) into 'memory' below the stack top and
+    // builds argc, argv, an empty envp and auxv at sp as the Linux ABI lays
+    // them out; sp, a0 (argc) and a1 (argv) of 'cpu' point to them
+    void setupStack(NoForwardingProcessor& cpu, Memory& memory, const std::vector<std::string>& args);
+    // Sends fds 1 and 2 to 'output' and reads fd 0 from 'input' instead of
+    // the host streams; empty names keep the host streams
+    bool redirect(const std::string& input, const std::string& output);
+    // The loaded image ends at 'address': the break starts at the next page
+    void setImageEnd(uint32_t address);
+    // Hart 'hart' of 'harts' sharing one memory: its stack top is STACK_SIZE
+    // below the previous hart's, and its break moves in its own slice of the
+    // heap. Called after setImageEnd
+    void setHart(int hart, int harts);
+    void printSummary(std::ostream& out) const;
+
+    uint32_t imageEnd;       // End of the ELF image, 0 for other programs
+    uint32_t programBreak;
+    bool exited;
+    int32_t exitCode;
+    uint64_t calls;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+
+private:
+    std::unique_ptr<std::ifstream> inputFile;
+    std::unique_ptr<std::ofstream> outputFile;
+    uint32_t heapBase;             // The break never goes below it
+    uint32_t breakLimit;           // nor above it
+    uint32_t stackTop;
+    std::vector<uint32_t> warned;  // Unsupported call numbers already reported
+
+    int32_t read(NoForwardingProcessor& cpu, int32_t fd, uint32_t buffer, uint32_t count);
+    int32_t write(NoForwardingProcessor& cpu, int32_t fd, uint32_t buffer, uint32_t count);
+    int32_t brk(uint32_t address);
+};
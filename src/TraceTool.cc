@@ -0,0 +1,283 @@
+// Reader for the binary pipeline event traces written with --event-trace.
+//
+//   tracetool <trace> [--format diagram|csv|commits] [--cycles A:B] [--pc A:B] [-o file]
+//
+// diagram  the printPipelineDiagram layout (byte-identical for the full range)
+// csv      one line per stage event: cycle,pc,instruction,stage
+// commits  one line per committed instruction: cycle,pc,instruction,rd,value,mem,address,data
+//
+// Ranges are inclusive, either end may be left out ("100:" or ":0x40"). With
+// the index at the end of the trace only the blocks of the requested window are
+// decoded, so a slice of a long run renders in milliseconds.
+#include "DiagramRenderer.hpp"
+#include "EventTrace.hpp"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Range {
+    int64_t first;
+    int64_t last;
+    Range() : first(LLONG_MIN), last(LLONG_MAX) {}
+    bool contains(int64_t value) const { return value >= first && value <= last; }
+};
+
+bool parseBound(const std::string& text, int64_t& value) {
+    const char* begin = text.c_str();
+    const char* stop = begin + text.size();
+    int base = 10;
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        begin += 2;
+        base = 16;
+    }
+    std::from_chars_result parsed = std::from_chars(begin, stop, value, base);
+    return parsed.ec == std::errc() && parsed.ptr == stop;
+}
+
+bool parseRange(const std::string& text, Range& range) {
+    size_t colon = text.find(':');
+    if (colon == std::string::npos)
+        return parseBound(text, range.first) && parseBound(text, range.last);
+    std::string first = text.substr(0, colon), last = text.substr(colon + 1);
+    return (first.empty() || parseBound(first, range.first)) && (last.empty() || parseBound(last, range.last));
+}
+
+// Writes 'text' as one CSV field
+void appendField(std::string& out, const std::string& text) {
+    if (text.find_first_of(",\"") == std::string::npos) {
+        out += text;
+        return;
+    }
+    out += '"';
+    for (char c : text) {
+        if (c == '"')
+            out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+// Row numbers covering the PC range, clamped to the program
+void rowsForPcs(const EventTraceReader& reader, const Range& pcRange, int& firstRow, int& lastRow) {
+    int64_t rows = static_cast<int64_t>(reader.instructionStrings.size());
+    int64_t first = 0, last = rows - 1;
+    if (pcRange.first > reader.textBase)
+        first = (pcRange.first - reader.textBase + 3) / 4;
+    if (pcRange.last < reader.textBase + 4 * rows)
+        last = (pcRange.last < reader.textBase) ? -1 : (pcRange.last - reader.textBase) / 4;
+    firstRow = static_cast<int>(std::min(first, rows));
+    lastRow = static_cast<int>(std::max<int64_t>(last, -1));
+}
+
+// Passes 'visit' every event that may fall in the cycle and row window. With an
+// index decoding starts at the block holding 'firstCycle', stops after
+// 'lastCycle' and skips blocks without any of the rows; callers still filter.
+template <typename Visit>
+void scanEvents(EventTraceReader& reader, int64_t firstCycle, int64_t lastCycle, int firstRow, int lastRow, Visit visit) {
+    int rows = static_cast<int>(reader.instructionStrings.size());
+    bool rowFiltered = reader.hasIndex() && (firstRow > 0 || lastRow < rows - 1);
+    size_t blocks = reader.blockCount();
+    size_t block = reader.blockForCycle(static_cast<int>(std::clamp<int64_t>(firstCycle, 0, INT_MAX)));
+    TraceEvent event;
+    for (; block < blocks && static_cast<int64_t>(reader.blockCycle(block)) <= lastCycle; block++) {
+        if (rowFiltered) {
+            bool found = false;
+            for (int row = firstRow; row <= lastRow && !found; row++)
+                found = reader.blockHasRow(block, row);
+            if (!found)
+                continue;
+        }
+        reader.seekBlock(block);
+        // Without an index events are not known to be in cycle order, read them all
+        if (!reader.hasIndex()) {
+            while (reader.next(event))
+                visit(event);
+            return;
+        }
+        int64_t nextBlockCycle = (block + 1 < blocks) ? static_cast<int64_t>(reader.blockCycle(block + 1)) : LLONG_MAX;
+        while (reader.next(event) && event.cycle < nextBlockCycle) {
+            if (event.cycle > lastCycle)
+                return;
+            visit(event);
+        }
+    }
+}
+
+struct Cell {
+    int cycle;
+    std::vector<PipelineStage> stages;  // In recordStage order
+};
+
+bool writeDiagram(EventTraceReader& reader, const Range& cycleRange, const Range& pcRange, std::FILE* out) {
+    int rows = static_cast<int>(reader.instructionStrings.size());
+    int firstCycle = static_cast<int>(std::max<int64_t>(cycleRange.first, 0));
+    int lastCycle = static_cast<int>(std::min<int64_t>(cycleRange.last, reader.cycles - 1));
+
+    // Cells of the selected rows; the cycle before the window decides whether
+    // the first cell of a row prints as "-"
+    std::vector<std::vector<Cell>> cells(rows);
+    int firstRow = 0, lastRow = -1;
+    rowsForPcs(reader, pcRange, firstRow, lastRow);
+    scanEvents(reader, firstCycle - 1, lastCycle, firstRow, lastRow, [&](const TraceEvent& event) {
+        if (event.kind != TraceEvent::STAGE || event.row < firstRow || event.row > lastRow ||
+            event.cycle < firstCycle - 1 || event.cycle > lastCycle)
+            return;
+        std::vector<Cell>& rowCells = cells[event.row];
+        if (rowCells.empty() || rowCells.back().cycle != event.cycle) {
+            rowCells.push_back(Cell());
+            rowCells.back().cycle = event.cycle;
+        }
+        rowCells.back().stages.push_back(event.stage);
+    });
+
+    std::vector<std::string_view> instructions(reader.instructionStrings.begin(), reader.instructionStrings.end());
+    size_t width = diagramColumnWidth(instructions);
+    std::string line;
+    appendDiagramHeader(line, width, firstCycle, lastCycle);
+    std::fwrite(line.data(), 1, line.size(), out);
+
+    for (int row = firstRow; row <= lastRow; row++) {
+        std::vector<Cell>& rowCells = cells[row];
+        std::stable_sort(rowCells.begin(), rowCells.end(),
+                         [](const Cell& a, const Cell& b) { return a.cycle < b.cycle; });
+        line.clear();
+        appendInstructionColumn(line, instructions[row], width);
+        PipelineStage prevStage = SPACE;
+        size_t next = 0;
+        if (next < rowCells.size() && rowCells[next].cycle == firstCycle - 1) {
+            const std::vector<PipelineStage>& stages = rowCells[next].stages;
+            prevStage = (stages.size() == 1) ? stages[0] : SPACE;
+            next++;
+        }
+        for (int cycle = firstCycle; cycle <= lastCycle; cycle++) {
+            if (next < rowCells.size() && rowCells[next].cycle == cycle) {
+                const std::vector<PipelineStage>& stages = rowCells[next++].stages;
+                appendDiagramCell(line, stages.data(), stages.size(), prevStage);
+            } else {
+                appendDiagramCell(line, nullptr, 0, prevStage);
+            }
+        }
+        line += '\n';
+        std::fwrite(line.data(), 1, line.size(), out);
+    }
+    return true;
+}
+
+void writeEvents(EventTraceReader& reader, const Range& cycleRange, const Range& pcRange, bool commits, std::FILE* out) {
+    std::string text = commits ? "cycle,pc,instruction,rd,value,mem,address,data\n" : "cycle,pc,instruction,stage\n";
+    int rows = static_cast<int>(reader.instructionStrings.size());
+    int firstRow = 0, lastRow = -1;
+    rowsForPcs(reader, pcRange, firstRow, lastRow);
+    scanEvents(reader, cycleRange.first, cycleRange.last, firstRow, lastRow, [&](const TraceEvent& event) {
+        if ((event.kind == TraceEvent::COMMIT) != commits || !cycleRange.contains(event.cycle))
+            return;
+        int64_t pc = commits ? event.commit.pc : static_cast<int64_t>(reader.textBase) + 4 * static_cast<int64_t>(event.row);
+        if (!pcRange.contains(pc))
+            return;
+        int row = static_cast<int>((pc - reader.textBase) / 4);
+        text += std::to_string(event.cycle);
+        text += ',';
+        text += std::to_string(pc);
+        text += ',';
+        if (row >= 0 && row < rows)
+            appendField(text, reader.instructionStrings[row]);
+        text += ',';
+        if (!commits) {
+            text += stageToString(event.stage);
+        } else {
+            const CommitRecord& commit = event.commit;
+            if (commit.flags & COMMIT_HAS_RD) {
+                text += 'x';
+                text += std::to_string(commit.rd);
+                text += ',';
+                text += std::to_string(commit.rdValue);
+            } else {
+                text += ',';
+            }
+            text += ',';
+            if (commit.flags & (COMMIT_LOAD | COMMIT_STORE)) {
+                text += (commit.flags & COMMIT_LOAD) ? "load," : "store,";
+                text += std::to_string(commit.memAddress);
+                text += ',';
+                text += std::to_string(commit.memData);
+            } else {
+                text += ",,";
+            }
+        }
+        text += '\n';
+        if (text.size() >= (1 << 20)) {
+            std::fwrite(text.data(), 1, text.size(), out);
+            text.clear();
+        }
+    });
+    std::fwrite(text.data(), 1, text.size(), out);
+}
+
+void printToolUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <trace> [--format diagram|csv|commits] [--cycles A:B] [--pc A:B] [-o file]" << std::endl
+              << "  diagram  pipeline diagram in the printPipelineDiagram layout (default)" << std::endl
+              << "  csv      stage events: cycle,pc,instruction,stage" << std::endl
+              << "  commits  commit log: cycle,pc,instruction,rd,value,mem,address,data" << std::endl
+              << "  Ranges are inclusive, decimal or 0x hex, and may be open (\"100:\", \":0x40\")" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printToolUsage(argv[0]);
+        return 1;
+    }
+    std::string traceFile = argv[1];
+    std::string format = "diagram";
+    std::string outputFile;
+    Range cycleRange, pcRange;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printToolUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        bool ok = true;
+        if (arg == "--format")
+            format = value;
+        else if (arg == "--cycles")
+            ok = parseRange(value, cycleRange);
+        else if (arg == "--pc")
+            ok = parseRange(value, pcRange);
+        else if (arg == "-o")
+            outputFile = value;
+        else
+            ok = false;
+        if (!ok || (format != "diagram" && format != "csv" && format != "commits")) {
+            printToolUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    EventTraceReader reader;
+    if (!reader.open(traceFile))
+        return 1;
+    std::FILE* out = outputFile.empty() ? stdout : std::fopen(outputFile.c_str(), "w");
+    if (!out) {
+        std::cerr << "Error: Unable to open " << outputFile << " for writing" << std::endl;
+        return 1;
+    }
+    if (format == "diagram")
+        writeDiagram(reader, cycleRange, pcRange, out);
+    else
+        writeEvents(reader, cycleRange, pcRange, format == "commits", out);
+    if (reader.truncated())
+        std::cerr << "Warning: " << traceFile << " ends without an end marker, the run did not finish" << std::endl;
+    bool ok = std::fflush(out) == 0;
+    if (out != stdout)
+        ok = (std::fclose(out) == 0) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,426 @@
+#include "TranslationCache.hpp"
+#include "Interconnect.hpp"
+#include "JitCompiler.hpp"
+#include "Processor.hpp"
+#include <algorithm>
+
+// Architectural state the handlers work on; registers are copied in and out
+// of the RegisterFile once per run()
+struct TranslationCache::Machine {
+    int32_t regs[33];  // x0..x31, then the sink for writes to x0
+    Memory* memory;
+    Reservation* reservation;
+};
+
+namespace {
+
+typedef TranslationCache::Machine Machine;
+typedef TranslationCache::Op Op;
+
+const uint8_t SINK_REGISTER = 32;
+
+// NoForwardingProcessor::executeALU with the operation fixed at translation time
+template <uint32_t AluOp>
+inline int32_t alu(int32_t a, int32_t b) {
+    switch (AluOp) {
+        case 0:  return a + b;
+        case 1:  return a - b;
+        case 2:  return a << (b & 0x1F);
+        case 3:  return (a < b) ? 1 : 0;
+        case 4:  return (static_cast<uint32_t>(a) < static_cast<uint32_t>(b)) ? 1 : 0;
+        case 5:  return a ^ b;
+        case 6:  return static_cast<uint32_t>(a) >> (b & 0x1F);
+        case 7:  return a >> (b & 0x1F);
+        case 8:  return a | b;
+        case 9:  return a & b;
+        case 10: return a * b;
+        case 11: return static_cast<int64_t>(a) * static_cast<int64_t>(b) >> 32;
+        case 12: return static_cast<int64_t>(a) * static_cast<uint64_t>(b) >> 32;
+        case 13: return static_cast<uint64_t>(static_cast<uint32_t>(a)) * static_cast<uint64_t>(static_cast<uint32_t>(b)) >> 32;
+        case 14: return (b == 0) ? -1 : (a / b);
+        case 15: return (b == 0) ? -1 : (static_cast<uint32_t>(a) / static_cast<uint32_t>(b));
+        case 16: return (b == 0) ? a : (a % b);
+        case 17: return (b == 0) ? a : (static_cast<uint32_t>(a) % static_cast<uint32_t>(b));
+        default: return 0;
+    }
+}
+
+template <uint32_t AluOp>
+void aluRegister(Machine& m, const Op& op) {
+    m.regs[op.rd] = alu<AluOp>(m.regs[op.rs1], m.regs[op.rs2]);
+}
+
+template <uint32_t AluOp>
+void aluImmediate(Machine& m, const Op& op) {
+    m.regs[op.rd] = alu<AluOp>(m.regs[op.rs1], op.imm);
+}
+
+// LUI, AUIPC and ALU operations executeALU does not know (which give 0)
+void setConstant(Machine& m, const Op& op) {
+    m.regs[op.rd] = op.imm;
+}
+
+void loadByte(Machine& m, const Op& op) {
+    m.regs[op.rd] = static_cast<int8_t>(m.memory->readByte(static_cast<uint32_t>(m.regs[op.rs1] + op.imm)));
+}
+
+void loadHalf(Machine& m, const Op& op) {
+    m.regs[op.rd] = m.memory->readHalfWord(static_cast<uint32_t>(m.regs[op.rs1] + op.imm));
+}
+
+void loadWord(Machine& m, const Op& op) {
+    m.regs[op.rd] = m.memory->readWord(static_cast<uint32_t>(m.regs[op.rs1] + op.imm));
+}
+
+void loadByteUnsigned(Machine& m, const Op& op) {
+    m.regs[op.rd] = m.memory->readByte(static_cast<uint32_t>(m.regs[op.rs1] + op.imm));
+}
+
+void loadHalfUnsigned(Machine& m, const Op& op) {
+    m.regs[op.rd] = static_cast<uint16_t>(m.memory->readHalfWord(static_cast<uint32_t>(m.regs[op.rs1] + op.imm)) & 0xFFFF);
+}
+
+void storeByte(Machine& m, const Op& op) {
+    m.memory->writeByte(static_cast<uint32_t>(m.regs[op.rs1] + op.imm), m.regs[op.rs2] & 0xFF);
+}
+
+void storeHalf(Machine& m, const Op& op) {
+    m.memory->writeHalfWord(static_cast<uint32_t>(m.regs[op.rs1] + op.imm), m.regs[op.rs2] & 0xFFFF);
+}
+
+void storeWord(Machine& m, const Op& op) {
+    m.memory->writeWord(static_cast<uint32_t>(m.regs[op.rs1] + op.imm), m.regs[op.rs2]);
+}
+
+void atomic(Machine& m, const Op& op) {
+    bool stored = false;
+    m.regs[op.rd] = executeAtomic(*m.memory, *m.reservation, op.instruction, static_cast<uint32_t>(m.regs[op.rs1]),
+                                  m.regs[op.rs2], stored);
+}
+
+const TranslationCache::Handler REGISTER_HANDLERS[18] = {
+    aluRegister<0>,  aluRegister<1>,  aluRegister<2>,  aluRegister<3>,  aluRegister<4>,  aluRegister<5>,
+    aluRegister<6>,  aluRegister<7>,  aluRegister<8>,  aluRegister<9>,  aluRegister<10>, aluRegister<11>,
+    aluRegister<12>, aluRegister<13>, aluRegister<14>, aluRegister<15>, aluRegister<16>, aluRegister<17>};
+
+const TranslationCache::Handler IMMEDIATE_HANDLERS[18] = {
+    aluImmediate<0>,  aluImmediate<1>,  aluImmediate<2>,  aluImmediate<3>,  aluImmediate<4>,  aluImmediate<5>,
+    aluImmediate<6>,  aluImmediate<7>,  aluImmediate<8>,  aluImmediate<9>,  aluImmediate<10>, aluImmediate<11>,
+    aluImmediate<12>, aluImmediate<13>, aluImmediate<14>, aluImmediate<15>, aluImmediate<16>, aluImmediate<17>};
+
+// As in FunctionalCore::step()
+bool branchTaken(uint32_t funct3, int32_t a, int32_t b) {
+    switch (funct3) {
+        case 0x0: return a == b;
+        case 0x1: return a != b;
+        case 0x4: return a < b;
+        case 0x5: return a >= b;
+        case 0x6: return static_cast<uint32_t>(a) < static_cast<uint32_t>(b);
+        case 0x7: return static_cast<uint32_t>(a) >= static_cast<uint32_t>(b);
+        default:  return false;
+    }
+}
+
+} // namespace
+
+TranslationCache::TranslationCache(NoForwardingProcessor& cpu)
+    : translatedBlocks(0), translatedInstructions(0), blockEntries(0), chainedEntries(0), nativeEntries(0),
+      compiledBlocks(0), cpu(cpu), core(cpu), translatedTextSize(0) {
+}
+
+TranslationCache::~TranslationCache() {
+}
+
+bool TranslationCache::enableJit() {
+    if (!JitCompiler::available())
+        return false;
+    jit.reset(new JitCompiler);
+    return true;
+}
+
+void TranslationCache::flush() {
+    ops.clear();
+    blocks.clear();
+    blockAt.assign(cpu.instructionMemory.size(), NO_BLOCK);
+    translatedCode = cpu.instructionMemory;
+    translatedTextSize = cpu.instructionStrings.size();
+}
+
+int32_t TranslationCache::blockFor(size_t index) {
+    int32_t block = blockAt[index];
+    return block != NO_BLOCK ? block : translate(index);
+}
+
+int32_t TranslationCache::lookup(int32_t pc, StepStatus& status) {
+    int index = cpu.getInstructionIndex(pc);
+    if (index == -1) {
+        status = STEP_OUT_OF_TEXT;
+        return NO_BLOCK;
+    }
+    status = STEP_OK;
+    if ((pc - cpu.textBase) % 4 != 0)
+        return NO_BLOCK;  // Executed by the FunctionalCore
+    return blockFor(static_cast<size_t>(index));
+}
+
+int32_t TranslationCache::translate(size_t index) {
+    Block block;
+    block.firstIndex = index;
+    block.firstOp = ops.size();
+    block.bodyLength = 0;
+    block.exit = EXIT_FALLTHROUGH;
+    block.status = STEP_OK;
+    block.next[0] = block.next[1] = NO_BLOCK;
+    block.jalrPc = 0;
+    block.entries = 0;
+    block.native = nullptr;
+
+    // getInstructionIndex() bounds the text by instructionStrings
+    size_t textSize = std::min(cpu.instructionStrings.size(), cpu.instructionMemory.size());
+    for (size_t i = index; i < textSize && block.bodyLength < MAX_BLOCK_LENGTH; i++) {
+        uint32_t instruction = cpu.instructionMemory[i];
+        uint32_t opcode = instruction & 0x7F;
+        bool legal = false;
+        switch (opcode) {
+            case 0x33: case 0x13: case 0x03: case 0x23: case 0x63:
+            case 0x6F: case 0x67: case 0x37: case 0x17:
+                legal = true;
+                break;
+            case 0x2F:
+                legal = isAtomicInstruction(instruction);
+                break;
+            case 0x57: case 0x07: case 0x27:
+                legal = isVectorInstruction(instruction);  // vtype is checked when it runs
+                break;
+            case 0x73:
+                legal = isEcall(instruction);
+                break;
+            default:
+                break;
+        }
+        if (!legal) {
+            block.exit = EXIT_FAULT;
+            block.status = STEP_ILLEGAL;
+            break;
+        }
+
+        int32_t pc = cpu.textBase + static_cast<int32_t>(i * 4);
+        uint32_t rd = (instruction >> 7) & 0x1F;
+        Op op;
+        op.rd = static_cast<uint8_t>(rd == 0 ? SINK_REGISTER : rd);
+        op.rs1 = static_cast<uint8_t>((instruction >> 15) & 0x1F);
+        op.rs2 = static_cast<uint8_t>((instruction >> 20) & 0x1F);
+        op.aluOp = 0;
+        op.imm = cpu.extractImmediate(instruction, opcode);
+        op.instruction = instruction;
+        op.handler = nullptr;
+
+        bool isControl = (opcode == 0x63 || opcode == 0x6F || opcode == 0x67);
+        if (isControl) {
+            if (op.imm % 4 != 0) {
+                block.exit = EXIT_FAULT;
+                block.status = STEP_BAD_OFFSET;
+            } else {
+                block.exit = (opcode == 0x63) ? EXIT_BRANCH : (opcode == 0x6F) ? EXIT_JAL : EXIT_JALR;
+                block.exitOp = op;
+            }
+            break;
+        }
+        if (isVectorInstruction(instruction)) {
+            // Loads and stores have vd where rd would be
+            if (!vectorWritesScalar(instruction))
+                op.rd = SINK_REGISTER;
+            block.exit = EXIT_VECTOR;
+            block.exitOp = op;
+            break;
+        }
+        if (isEcall(instruction)) {
+            block.exit = EXIT_SYSCALL;
+            block.exitOp = op;
+            break;
+        }
+
+        uint32_t funct3 = (instruction >> 12) & 0x7;
+        switch (opcode) {
+            case 0x33:
+            case 0x13: {
+                uint32_t aluOp = cpu.decodeControlSignals(instruction).aluOp;
+                op.aluOp = static_cast<uint8_t>(aluOp < 18 ? aluOp : 18);
+                if (aluOp < 18) {
+                    op.handler = (opcode == 0x33) ? REGISTER_HANDLERS[aluOp] : IMMEDIATE_HANDLERS[aluOp];
+                } else {
+                    op.handler = setConstant;
+                    op.imm = 0;
+                }
+                break;
+            }
+            case 0x03:
+                op.handler = (funct3 == 0x0) ? loadByte : (funct3 == 0x1) ? loadHalf : (funct3 == 0x4) ? loadByteUnsigned
+                           : (funct3 == 0x5) ? loadHalfUnsigned : loadWord;
+                break;
+            case 0x23:
+                op.handler = (funct3 == 0x0) ? storeByte : (funct3 == 0x1) ? storeHalf : storeWord;
+                break;
+            case 0x37:
+                op.handler = setConstant;
+                break;
+            case 0x17:
+                op.handler = setConstant;
+                op.imm = pc + op.imm;
+                break;
+            default:  // 0x2F
+                op.handler = atomic;
+                break;
+        }
+        ops.push_back(op);
+        block.bodyLength++;
+    }
+
+    translatedBlocks++;
+    translatedInstructions += block.bodyLength + (block.exit == EXIT_FALLTHROUGH || block.exit == EXIT_FAULT ? 0 : 1);
+    int32_t id = static_cast<int32_t>(blocks.size());
+    blocks.push_back(block);
+    blockAt[index] = id;
+    return id;
+}
+
+StepStatus TranslationCache::run(int32_t& pc, uint64_t limit, uint64_t& executed) {
+    if (cpu.instructionStrings.size() != translatedTextSize || cpu.instructionMemory != translatedCode)
+        flush();
+
+    Machine machine;
+    for (uint32_t reg = 0; reg < 32; reg++)
+        machine.regs[reg] = cpu.registers.read(reg);
+    machine.regs[SINK_REGISTER] = 0;
+    machine.memory = &cpu.dataMemory;
+    machine.reservation = &cpu.reservation;
+
+    uint64_t remaining = limit;
+    StepStatus status = STEP_OK;
+    int32_t current = lookup(pc, status);
+    while (remaining > 0) {
+        if (current == NO_BLOCK) {
+            if (status != STEP_OK)
+                break;
+            // A pc between instructions: one step on the RegisterFile
+            for (uint32_t reg = 1; reg < 32; reg++)
+                cpu.registers.write(reg, machine.regs[reg]);
+            RetiredInstruction retired;
+            status = core.step(pc, retired);
+            for (uint32_t reg = 1; reg < 32; reg++)
+                machine.regs[reg] = cpu.registers.read(reg);
+            if (status != STEP_OK)
+                break;
+            remaining--;
+            current = lookup(pc, status);
+            continue;
+        }
+
+        blockEntries++;
+        Block& block = blocks[static_cast<size_t>(current)];
+        const Op* op = ops.data() + block.firstOp;
+        int32_t blockPc = cpu.textBase + static_cast<int32_t>(block.firstIndex * 4);
+        if (block.bodyLength >= remaining) {
+            // The limit ends the run inside the block
+            for (uint64_t i = 0; i < remaining; i++)
+                op[i].handler(machine, op[i]);
+            pc = blockPc + static_cast<int32_t>(remaining * 4);
+            remaining = 0;
+            break;
+        }
+        int nativeTaken = -1;
+        if (block.native) {
+            nativeTaken = block.native(machine.regs, machine.memory);
+            nativeEntries++;
+        } else {
+            for (uint32_t i = 0; i < block.bodyLength; i++)
+                op[i].handler(machine, op[i]);
+            if (jit && ++block.entries == JIT_THRESHOLD) {
+                block.native = jit->compile(op, block.bodyLength, block.exit == EXIT_BRANCH ? &block.exitOp : nullptr);
+                compiledBlocks += block.native ? 1 : 0;
+            }
+        }
+        remaining -= block.bodyLength;
+
+        int32_t exitPc = blockPc + static_cast<int32_t>(block.bodyLength * 4);
+        const Op& exit = block.exitOp;
+        int slot = 0;
+        int32_t target = exitPc;
+        switch (block.exit) {
+            case EXIT_FALLTHROUGH:
+                slot = 1;
+                break;
+            case EXIT_FAULT:
+                status = block.status;
+                break;
+            case EXIT_BRANCH:
+                if (nativeTaken >= 0 ? nativeTaken != 0
+                                     : branchTaken((exit.instruction >> 12) & 0x7, machine.regs[exit.rs1], machine.regs[exit.rs2])) {
+                    target = exitPc + exit.imm;
+                } else {
+                    target = exitPc + 4;
+                    slot = 1;
+                }
+                remaining--;
+                break;
+            case EXIT_JAL:
+                machine.regs[exit.rd] = exitPc + 4;
+                target = exitPc + exit.imm;
+                remaining--;
+                break;
+            case EXIT_JALR:
+                target = machine.regs[exit.rs1] + exit.imm;  // Read before the link is written
+                machine.regs[exit.rd] = exitPc + 4;
+                remaining--;
+                break;
+            case EXIT_VECTOR: {
+                VectorUnit& vector = cpu.vector;
+                if (!vector.accepts(exit.instruction)) {
+                    status = STEP_ILLEGAL;
+                    break;
+                }
+                int32_t result = vector.execute(exit.instruction, machine.regs[exit.rs1], machine.regs[exit.rs2]);
+                if (isVectorMemoryAccess(exit.instruction))
+                    vector.transfer(exit.instruction, static_cast<uint32_t>(result), machine.regs[exit.rs2], *machine.memory);
+                machine.regs[exit.rd] = result;
+                target = exitPc + 4;
+                slot = 1;
+                remaining--;
+                break;
+            }
+            case EXIT_SYSCALL:
+                // The system call reads its arguments from the RegisterFile and returns a0 there
+                for (uint32_t reg = 1; reg < 32; reg++)
+                    cpu.registers.write(reg, machine.regs[reg]);
+                if (!cpu.syscalls.handle(cpu, executed + limit - remaining))
+                    status = STEP_EXIT;
+                machine.regs[10] = cpu.registers.read(10);
+                target = exitPc + 4;
+                slot = 1;
+                remaining--;
+                break;
+        }
+        pc = target;
+        if (status != STEP_OK)
+            break;
+
+        int32_t next = block.next[slot];
+        if (next != NO_BLOCK && (block.exit != EXIT_JALR || block.jalrPc == target)) {
+            chainedEntries++;
+            current = next;
+            continue;
+        }
+        int32_t from = current;
+        current = lookup(target, status);
+        // 'block' may have moved if lookup() translated
+        if (current != NO_BLOCK) {
+            blocks[static_cast<size_t>(from)].next[slot] = current;
+            blocks[static_cast<size_t>(from)].jalrPc = target;
+        }
+    }
+
+    for (uint32_t reg = 1; reg < 32; reg++)
+        cpu.registers.write(reg, machine.regs[reg]);
+    executed += limit - remaining;
+    return status;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "FunctionalCore.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class JitCompiler;
+class Memory;
+class NoForwardingProcessor;
+
+// Functional execution through a basic-block translation cache (--functional).
+//
+// The first time a block is entered its instructions are decoded once into an
+// array of operations, each bound to a handler specialized for the opcode,
+// ALU operation and access width, so executing it is a call per instruction
+// with no decoding left. A block ends at a branch, jump, vector instruction or
+// ECALL, an instruction that cannot execute or after MAX_BLOCK_LENGTH instructions.
+// Blocks are chained: every block remembers the block each of its exits led to
+// last time, so steady-state execution goes from block to block without a lookup.
+//
+// Results and statuses are those of FunctionalCore::step() (ALU operations
+// follow decodeControlSignals/executeALU), on the processor's registers,
+// dataMemory and reservation. Code comes from instructionMemory, which the
+// stores of the program do not reach, so translations only go stale when
+// instructionMemory itself is changed between runs. run() compares it with the
+// code it translated and starts over if it differs.
+//
+// With enableJit(), blocks entered JIT_THRESHOLD times are compiled to native
+// code (see JitCompiler.hpp) and run that way from then on.
+class TranslationCache {
+public:
+    explicit TranslationCache(NoForwardingProcessor& cpu);
+    ~TranslationCache();
+
+    // false when the host has no code generator
+    bool enableJit();
+
+    // Executes from 'pc' until 'limit' instructions have run or one fails, and
+    // advances 'pc' and 'executed'. On failure pc is that of the failing instruction,
+    // after the exit system call that of the next one.
+    StepStatus run(int32_t& pc, uint64_t limit, uint64_t& executed);
+
+    void flush();
+
+    uint64_t translatedBlocks;   // Translations made, retranslations after a flush included
+    uint64_t translatedInstructions;
+    uint64_t blockEntries;
+    uint64_t chainedEntries;     // Block entries that followed a chain link
+    uint64_t nativeEntries;      // Block entries that ran compiled code
+    uint64_t compiledBlocks;
+
+    struct Machine;
+    struct Op;
+    typedef void (*Handler)(Machine& machine, const Op& op);
+    // Compiled block body over Machine::regs; returns 1 when the block's branch is taken
+    typedef int (*NativeBlock)(int32_t* regs, Memory* memory);
+
+    // One pre-decoded instruction. Register fields index Machine::regs, where
+    // a write to x0 goes to a slot nobody reads.
+    struct Op {
+        Handler handler;
+        uint8_t rd;
+        uint8_t rs1;
+        uint8_t rs2;
+        uint8_t aluOp;        // decodeControlSignals() ALU operation of register/immediate ALU instructions
+        int32_t imm;          // Immediate, or the result for LUI/AUIPC
+        uint32_t instruction;
+    };
+
+private:
+    static constexpr uint32_t MAX_BLOCK_LENGTH = 256;
+    static constexpr int32_t NO_BLOCK = -1;
+    static constexpr uint32_t JIT_THRESHOLD = 16;
+
+    enum ExitKind {
+        EXIT_FALLTHROUGH,  // Length limit or end of text: continue at the next instruction
+        EXIT_BRANCH,
+        EXIT_JAL,
+        EXIT_JALR,
+        EXIT_VECTOR,       // A vector instruction, executed on the processor's VectorUnit; continues after it
+        EXIT_SYSCALL,      // ECALL, made on the processor's SyscallEmulator; continues after it unless it was exit
+        EXIT_FAULT         // The next instruction fails with 'status' without executing
+    };
+
+    struct Block {
+        size_t firstIndex;  // instructionMemory index of the first instruction
+        size_t firstOp;     // Body in ops[firstOp, firstOp + bodyLength)
+        uint32_t bodyLength;
+        ExitKind exit;
+        Op exitOp;          // The branch, jump, vector instruction or ECALL for those exits
+        StepStatus status;  // For EXIT_FAULT
+        int32_t next[2];    // Chained blocks: [0] taken/jump target, [1] fall through
+        int32_t jalrPc;     // Last JALR target, next[0] is its block
+        uint32_t entries;   // Until it is compiled
+        NativeBlock native; // nullptr while interpreted
+    };
+
+    NoForwardingProcessor& cpu;
+    FunctionalCore core;                  // For pcs that are not instruction aligned
+    std::vector<Op> ops;
+    std::vector<Block> blocks;
+    std::vector<int32_t> blockAt;         // instructionMemory index -> block starting there
+    std::vector<uint32_t> translatedCode; // instructionMemory as it was when translated
+    size_t translatedTextSize;            // And the number of instructions getInstructionIndex() accepts
+    std::unique_ptr<JitCompiler> jit;     // nullptr unless enabled
+
+    int32_t blockFor(size_t index);
+    int32_t translate(size_t index);
+    // Block of the instruction at 'pc', or NO_BLOCK with 'status' set
+    int32_t lookup(int32_t pc, StepStatus& status);
+};
@@ -0,0 +1,34 @@
+// Expands a folded pipeline diagram (--fold) back into the full layout the
+// simulators write to *_out.txt, byte for byte.
+//
+//   unfold <name>_folded.txt [-o <name>_out.txt]      (default: stdout)
+#include "FoldedDiagram.hpp"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    if (argc != 2 && !(argc == 4 && std::string(argv[2]) == "-o")) {
+        std::cerr << "Usage: " << argv[0] << " <folded diagram> [-o output]" << std::endl;
+        return 1;
+    }
+    DiagramFolder folder;
+    std::vector<std::string> instructionStrings;
+    if (!folder.readFolded(argv[1], instructionStrings))
+        return 1;
+
+    std::FILE* out = (argc == 4) ? std::fopen(argv[3], "w") : stdout;
+    if (!out) {
+        std::cerr << "Error: Unable to open " << argv[3] << " for writing" << std::endl;
+        return 1;
+    }
+    std::vector<std::string_view> views(instructionStrings.begin(), instructionStrings.end());
+    bool ok = folder.writeExpanded(out, views);
+    ok = (std::fflush(out) == 0) && ok;
+    if (out != stdout)
+        ok = (std::fclose(out) == 0) && ok;
+    if (!ok)
+        std::cerr << "Error: Unable to write the expanded diagram" << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,513 @@
+#include "VectorUnit.hpp"
+#include "Memory.hpp"
+#include "SimdKernel.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// Element loops work on 32 bytes of elements at a time, loaded and stored with
+// memcpy since register groups have no alignment to rely on
+const uint32_t CHUNK_BYTES = 32;
+
+template <typename T>
+struct Chunk {
+    typedef T Type __attribute__((vector_size(CHUNK_BYTES)));
+};
+
+// d[i] = OP(d[i], a[i], b[i]) with a = vs2 and b = vs1 or the scalar operand.
+// Works for single elements and for chunks; unsigned types wrap like the hardware.
+template <VectorOp OP, typename V>
+inline V elementOp(const V& d, const V& a, const V& b) {
+    switch (OP) {
+        case VOP_ADD:  return a + b;
+        case VOP_SUB:  return a - b;
+        case VOP_RSUB: return b - a;
+        case VOP_MUL:  return a * b;
+        case VOP_MACC: return d + a * b;
+        default:       return b;  // VOP_MOVE
+    }
+}
+
+// Narrow scalars are promoted to int by C++, so they are multiplied as uint32_t
+template <VectorOp OP, typename T>
+inline T scalarOp(T d, T a, T b) {
+    return static_cast<T>(elementOp<OP, uint32_t>(d, a, b));
+}
+
+template <typename T, VectorOp OP, bool SCALAR>
+inline void elementLoop(uint8_t* d, const uint8_t* a, const uint8_t* b, T scalar, uint32_t count) {
+    typedef typename Chunk<T>::Type V;
+    const uint32_t perChunk = CHUNK_BYTES / sizeof(T);
+    const V splat = V{} + scalar;
+    uint32_t i = 0;
+    for (; i + perChunk <= count; i += perChunk) {
+        size_t offset = static_cast<size_t>(i) * sizeof(T);
+        V vd, va, vb;
+        std::memcpy(&vd, d + offset, sizeof(V));
+        std::memcpy(&va, a + offset, sizeof(V));
+        if (SCALAR)
+            vb = splat;
+        else
+            std::memcpy(&vb, b + offset, sizeof(V));
+        vd = elementOp<OP>(vd, va, vb);
+        std::memcpy(d + offset, &vd, sizeof(V));
+    }
+    for (; i < count; i++) {
+        size_t offset = static_cast<size_t>(i) * sizeof(T);
+        T ed, ea, eb = scalar;
+        std::memcpy(&ed, d + offset, sizeof(T));
+        std::memcpy(&ea, a + offset, sizeof(T));
+        if (!SCALAR)
+            std::memcpy(&eb, b + offset, sizeof(T));
+        ed = scalarOp<OP>(ed, ea, eb);
+        std::memcpy(d + offset, &ed, sizeof(T));
+    }
+}
+
+template <typename T, VectorOp OP>
+inline void elementLoop(uint8_t* d, const uint8_t* a, const uint8_t* b, uint32_t scalar, uint32_t count) {
+    if (b)
+        elementLoop<T, OP, false>(d, a, b, static_cast<T>(scalar), count);
+    else
+        elementLoop<T, OP, true>(d, a, b, static_cast<T>(scalar), count);
+}
+
+template <typename T>
+inline void elementwiseTyped(VectorOp op, uint8_t* d, const uint8_t* a, const uint8_t* b, uint32_t scalar, uint32_t count) {
+    switch (op) {
+        case VOP_ADD:  elementLoop<T, VOP_ADD>(d, a, b, scalar, count); break;
+        case VOP_SUB:  elementLoop<T, VOP_SUB>(d, a, b, scalar, count); break;
+        case VOP_RSUB: elementLoop<T, VOP_RSUB>(d, a, b, scalar, count); break;
+        case VOP_MUL:  elementLoop<T, VOP_MUL>(d, a, b, scalar, count); break;
+        case VOP_MACC: elementLoop<T, VOP_MACC>(d, a, b, scalar, count); break;
+        default:       elementLoop<T, VOP_MOVE>(d, a, b, scalar, count); break;
+    }
+}
+
+// Elementwise arithmetic and moves on 'count' elements of 'sew' bits; b is
+// nullptr for the .vx and .vi forms
+SIMD_KERNEL void elementwise(VectorOp op, uint32_t sew, uint8_t* d, const uint8_t* a, const uint8_t* b,
+                             uint32_t scalar, uint32_t count) {
+    switch (sew) {
+        case 8:  elementwiseTyped<uint8_t>(op, d, a, b, scalar, count); break;
+        case 16: elementwiseTyped<uint16_t>(op, d, a, b, scalar, count); break;
+        default: elementwiseTyped<uint32_t>(op, d, a, b, scalar, count); break;
+    }
+}
+
+template <VectorOp OP, typename V>
+inline V combine(const V& a, const V& b) {
+    switch (OP) {
+        case VOP_REDSUM: return a + b;
+        case VOP_REDAND: return a & b;
+        case VOP_REDOR:  return a | b;
+        case VOP_REDXOR: return a ^ b;
+        case VOP_REDMINU:
+        case VOP_REDMIN: return a < b ? a : b;  // T is signed for the signed ones
+        default:         return a > b ? a : b;
+    }
+}
+
+template <VectorOp OP, typename T>
+inline T identity() {
+    switch (OP) {
+        case VOP_REDAND:
+        case VOP_REDMINU:
+        case VOP_REDMIN: return std::numeric_limits<T>::max() | (OP == VOP_REDAND ? std::numeric_limits<T>::min() : 0);
+        case VOP_REDMAX: return std::numeric_limits<T>::min();
+        default:         return 0;
+    }
+}
+
+template <typename T, VectorOp OP>
+inline uint32_t reduceLoop(const uint8_t* a, uint32_t count, uint32_t initial) {
+    typedef typename Chunk<T>::Type V;
+    const uint32_t perChunk = CHUNK_BYTES / sizeof(T);
+    V accumulator = V{} + identity<OP, T>();
+    uint32_t i = 0;
+    for (; i + perChunk <= count; i += perChunk) {
+        V va;
+        std::memcpy(&va, a + static_cast<size_t>(i) * sizeof(T), sizeof(V));
+        accumulator = combine<OP>(accumulator, va);
+    }
+    T result = static_cast<T>(initial);
+    for (uint32_t lane = 0; lane < perChunk; lane++)
+        result = static_cast<T>(combine<OP, T>(result, accumulator[lane]));
+    for (; i < count; i++) {
+        T element;
+        std::memcpy(&element, a + static_cast<size_t>(i) * sizeof(T), sizeof(T));
+        result = static_cast<T>(combine<OP, T>(result, element));
+    }
+    return static_cast<uint32_t>(result);
+}
+
+// Signed reductions run on the signed type of the element width
+template <typename U, typename S>
+inline uint32_t reduceTyped(VectorOp op, const uint8_t* a, uint32_t count, uint32_t initial) {
+    switch (op) {
+        case VOP_REDSUM:  return reduceLoop<U, VOP_REDSUM>(a, count, initial);
+        case VOP_REDAND:  return reduceLoop<U, VOP_REDAND>(a, count, initial);
+        case VOP_REDOR:   return reduceLoop<U, VOP_REDOR>(a, count, initial);
+        case VOP_REDXOR:  return reduceLoop<U, VOP_REDXOR>(a, count, initial);
+        case VOP_REDMINU: return reduceLoop<U, VOP_REDMINU>(a, count, initial);
+        case VOP_REDMIN:  return reduceLoop<S, VOP_REDMIN>(a, count, initial);
+        case VOP_REDMAXU: return reduceLoop<U, VOP_REDMAXU>(a, count, initial);
+        default:          return reduceLoop<S, VOP_REDMAX>(a, count, initial);
+    }
+}
+
+// Reduction of 'count' elements of 'sew' bits into 'initial' (vs1[0]),
+// returned zero extended to 32 bits
+SIMD_KERNEL uint32_t reduce(VectorOp op, uint32_t sew, const uint8_t* a, uint32_t count, uint32_t initial) {
+    switch (sew) {
+        case 8:  return reduceTyped<uint8_t, int8_t>(op, a, count, initial) & 0xFF;
+        case 16: return reduceTyped<uint16_t, int16_t>(op, a, count, initial) & 0xFFFF;
+        default: return reduceTyped<uint32_t, int32_t>(op, a, count, initial);
+    }
+}
+
+bool isReduction(VectorOp op) {
+    return op >= VOP_REDSUM && op <= VOP_REDMAX;
+}
+
+uint32_t ceilLog2(uint32_t value) {
+    uint32_t levels = 0;
+    while ((1u << levels) < value)
+        levels++;
+    return levels;
+}
+
+} // namespace
+
+VectorOp decodeVectorOp(uint32_t instruction, VectorOperand& operand) {
+    uint32_t opcode = instruction & 0x7F;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+    uint32_t funct6 = instruction >> 26;
+    bool unmasked = (instruction >> 25) & 0x1;
+    uint32_t vs2 = (instruction >> 20) & 0x1F;
+    uint32_t vs1 = (instruction >> 15) & 0x1F;
+    operand = VOPERAND_VV;
+
+    if (opcode == 0x07 || opcode == 0x27) {
+        // The vector widths of LOAD-FP/STORE-FP; no segments (nf), mew or indexed forms
+        uint32_t mop = (instruction >> 26) & 0x3;
+        if ((funct3 != 0x0 && funct3 != 0x5 && funct3 != 0x6) || (instruction >> 28) != 0 || !unmasked)
+            return VOP_NONE;
+        if ((mop == 0 && vs2 == 0) || mop == 2)
+            return opcode == 0x07 ? VOP_LOAD : VOP_STORE;
+        return VOP_NONE;
+    }
+    if (opcode != 0x57)
+        return VOP_NONE;
+
+    if (funct3 == 0x7) {
+        if ((instruction >> 31) == 0)
+            return VOP_SETVLI;
+        if ((instruction >> 30) == 0x3)
+            return VOP_SETIVLI;
+        return (instruction >> 25) == 0x40 ? VOP_SETVL : VOP_NONE;
+    }
+    if (!unmasked)
+        return VOP_NONE;
+    switch (funct3) {
+        case 0x0:  // OPIVV
+        case 0x4:  // OPIVX
+        case 0x3:  // OPIVI
+            operand = (funct3 == 0x0) ? VOPERAND_VV : (funct3 == 0x4) ? VOPERAND_VX : VOPERAND_VI;
+            switch (funct6) {
+                case 0x00: return VOP_ADD;
+                case 0x02: return (funct3 == 0x3) ? VOP_NONE : VOP_SUB;
+                case 0x03: return (funct3 == 0x0) ? VOP_NONE : VOP_RSUB;
+                case 0x17: return (vs2 == 0) ? VOP_MOVE : VOP_NONE;  // vmv.v.*, the unmasked vmerge
+                default:   return VOP_NONE;
+            }
+        case 0x2:  // OPMVV
+            if (funct6 <= 0x07)
+                return static_cast<VectorOp>(VOP_REDSUM + funct6);
+            switch (funct6) {
+                case 0x10: return (vs1 == 0) ? VOP_MV_X_S : VOP_NONE;
+                case 0x25: return VOP_MUL;
+                case 0x2D: return VOP_MACC;
+                default:   return VOP_NONE;
+            }
+        case 0x6:  // OPMVX
+            operand = VOPERAND_VX;
+            switch (funct6) {
+                case 0x10: return (vs2 == 0) ? VOP_MV_S_X : VOP_NONE;
+                case 0x25: return VOP_MUL;
+                case 0x2D: return VOP_MACC;
+                default:   return VOP_NONE;
+            }
+        default:
+            return VOP_NONE;
+    }
+}
+
+int vectorScalarSources(uint32_t instruction, uint32_t sources[2]) {
+    VectorOperand operand;
+    VectorOp op = decodeVectorOp(instruction, operand);
+    uint32_t rs1 = (instruction >> 15) & 0x1F;
+    uint32_t rs2 = (instruction >> 20) & 0x1F;
+    int count = 0;
+    switch (op) {
+        case VOP_SETVLI:
+            sources[count++] = rs1;
+            break;
+        case VOP_SETVL:
+            sources[count++] = rs1;
+            sources[count++] = rs2;
+            break;
+        case VOP_LOAD:
+        case VOP_STORE:
+            sources[count++] = rs1;
+            if (((instruction >> 26) & 0x3) == 2)
+                sources[count++] = rs2;  // Stride
+            break;
+        case VOP_MV_S_X:
+            sources[count++] = rs1;
+            break;
+        default:
+            if (operand == VOPERAND_VX && op != VOP_NONE)
+                sources[count++] = rs1;
+            break;
+    }
+    return count;
+}
+
+bool vectorWritesScalar(uint32_t instruction) {
+    VectorOperand operand;
+    VectorOp op = decodeVectorOp(instruction, operand);
+    return op == VOP_SETVLI || op == VOP_SETIVLI || op == VOP_SETVL || op == VOP_MV_X_S;
+}
+
+VectorUnit::VectorUnit() : executed(0), elements(0) {
+    reset(128, 4);
+}
+
+void VectorUnit::reset(uint32_t vlen, uint32_t lanes) {
+    vlenb = vlen / 8;
+    datapathLanes = lanes;
+    registers.assign(static_cast<size_t>(vlenb) * 32, 0);
+    vl = 0;
+    vtype = VTYPE_VILL;
+    executed = 0;
+    elements = 0;
+}
+
+int VectorUnit::lmulLog2() const {
+    int vlmul = static_cast<int>(vtype & 0x7);
+    return vlmul < 4 ? vlmul : vlmul - 8;
+}
+
+uint32_t VectorUnit::validType(uint32_t type) const {
+    uint32_t vsew = (type >> 3) & 0x7;
+    uint32_t vlmul = type & 0x7;
+    if ((type & ~0xFFu) != 0 || vsew > 2 || vlmul == 4)
+        return VTYPE_VILL;
+    // Fractional LMUL needs SEW <= LMUL * ELEN
+    int lmul = vlmul < 4 ? static_cast<int>(vlmul) : static_cast<int>(vlmul) - 8;
+    if (lmul < 0 && static_cast<int>(vsew) + 3 > 5 + lmul)
+        return VTYPE_VILL;
+    return type;
+}
+
+uint32_t VectorUnit::vlmax(uint32_t type) const {
+    if (type & VTYPE_VILL)
+        return 0;
+    int vlmul = static_cast<int>(type & 0x7);
+    int lmul = vlmul < 4 ? vlmul : vlmul - 8;
+    uint32_t bits = lmul >= 0 ? vlen() << lmul : vlen() >> -lmul;
+    return bits / (8u << ((type >> 3) & 0x7));
+}
+
+uint32_t VectorUnit::readElement(uint32_t reg, uint32_t index, uint32_t bytes) const {
+    const uint8_t* element = &registers[static_cast<size_t>(reg) * vlenb + static_cast<size_t>(index) * bytes];
+    switch (bytes) {
+        case 1: return *element;
+        case 2: { uint16_t value; std::memcpy(&value, element, 2); return value; }
+        default: { uint32_t value; std::memcpy(&value, element, 4); return value; }
+    }
+}
+
+void VectorUnit::writeElement(uint32_t reg, uint32_t index, uint32_t bytes, uint32_t value) {
+    uint8_t* element = &registers[static_cast<size_t>(reg) * vlenb + static_cast<size_t>(index) * bytes];
+    switch (bytes) {
+        case 1: *element = static_cast<uint8_t>(value); break;
+        case 2: { uint16_t narrow = static_cast<uint16_t>(value); std::memcpy(element, &narrow, 2); break; }
+        default: std::memcpy(element, &value, 4); break;
+    }
+}
+
+bool VectorUnit::accepts(uint32_t instruction) const {
+    VectorOperand operand;
+    VectorOp op = decodeVectorOp(instruction, operand);
+    if (op == VOP_NONE || op == VOP_SETVLI || op == VOP_SETIVLI || op == VOP_SETVL)
+        return true;
+    if (vtype & VTYPE_VILL)
+        return false;
+
+    uint32_t vd = (instruction >> 7) & 0x1F;
+    uint32_t vs1 = (instruction >> 15) & 0x1F;
+    uint32_t vs2 = (instruction >> 20) & 0x1F;
+    int lmul = lmulLog2();
+    if (op == VOP_LOAD || op == VOP_STORE) {
+        // EMUL = EEW / SEW * LMUL has to be a legal LMUL as well
+        int eewLog2 = static_cast<int>(ceilLog2(memoryElementBytes(instruction) * 8));
+        int emul = eewLog2 - static_cast<int>(ceilLog2(sew())) + lmul;
+        return emul >= -3 && emul <= 3 && (emul <= 0 || vd % (1u << emul) == 0);
+    }
+    uint32_t groupSize = lmul > 0 ? 1u << lmul : 1;
+    if (op == VOP_MV_X_S || op == VOP_MV_S_X)
+        return true;
+    if (isReduction(op))
+        return vs2 % groupSize == 0;  // vd and vs1 are single registers
+    if (vd % groupSize != 0 || (op != VOP_MOVE && vs2 % groupSize != 0))
+        return false;
+    return operand != VOPERAND_VV || vs1 % groupSize == 0;
+}
+
+int32_t VectorUnit::execute(uint32_t instruction, int32_t rs1Value, int32_t rs2Value) {
+    VectorOperand operand;
+    VectorOp op = decodeVectorOp(instruction, operand);
+    uint32_t rd = (instruction >> 7) & 0x1F;
+    uint32_t rs1 = (instruction >> 15) & 0x1F;
+    uint32_t vs2 = (instruction >> 20) & 0x1F;
+    executed++;
+
+    switch (op) {
+        case VOP_SETVLI:
+        case VOP_SETIVLI:
+        case VOP_SETVL: {
+            uint32_t type = (op == VOP_SETVL) ? static_cast<uint32_t>(rs2Value)
+                          : (op == VOP_SETVLI) ? (instruction >> 20) & 0x7FF : (instruction >> 20) & 0x3FF;
+            // AVL: the immediate, rs1, VLMAX when rs1 is x0, or the current vl when rd is x0 as well
+            uint32_t avl = (op == VOP_SETIVLI) ? rs1 : (rs1 != 0) ? static_cast<uint32_t>(rs1Value)
+                         : (rd != 0) ? UINT32_MAX : vl;
+            vtype = validType(type);
+            vl = std::min(avl, vlmax(vtype));
+            return static_cast<int32_t>(vl);
+        }
+        case VOP_LOAD:
+        case VOP_STORE:
+            elements += vl;
+            return rs1Value;
+        case VOP_MV_X_S: {
+            // Element 0 whatever vl is, sign extended
+            uint32_t shift = 32 - sew();
+            elements++;
+            return static_cast<int32_t>(readElement(vs2, 0, sew() / 8) << shift) >> shift;
+        }
+        case VOP_MV_S_X:
+            if (vl > 0) {
+                writeElement(rd, 0, sew() / 8, static_cast<uint32_t>(rs1Value));
+                elements++;
+            }
+            return 0;
+        default:
+            break;
+    }
+
+    elements += vl;
+    if (vl == 0)
+        return 0;
+    if (isReduction(op)) {
+        uint32_t result = reduce(op, sew(), group(vs2), vl, readElement(rs1, 0, sew() / 8));
+        writeElement(rd, 0, sew() / 8, result);
+        return 0;
+    }
+    // .vi immediates are sign extended simm5
+    uint32_t scalar = (operand == VOPERAND_VX) ? static_cast<uint32_t>(rs1Value)
+                    : static_cast<uint32_t>(static_cast<int32_t>(rs1 << 27) >> 27);
+    elementwise(op, sew(), group(rd), group(vs2), operand == VOPERAND_VV ? group(rs1) : nullptr, scalar, vl);
+    return 0;
+}
+
+uint32_t VectorUnit::memoryElementBytes(uint32_t instruction) {
+    switch ((instruction >> 12) & 0x7) {
+        case 0x0: return 1;
+        case 0x5: return 2;
+        default:  return 4;
+    }
+}
+
+uint32_t VectorUnit::elementAddress(uint32_t instruction, uint32_t address, int32_t stride, uint32_t element) {
+    uint32_t step = ((instruction >> 26) & 0x3) == 2 ? static_cast<uint32_t>(stride) : memoryElementBytes(instruction);
+    return address + element * step;
+}
+
+void VectorUnit::transfer(uint32_t instruction, uint32_t address, int32_t stride, Memory& memory) {
+    uint32_t bytes = memoryElementBytes(instruction);
+    uint32_t reg = (instruction >> 7) & 0x1F;
+    bool store = (instruction & 0x7F) == 0x27;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (((instruction >> 26) & 0x3) == 0) {
+        if (store)
+            memory.writeBlock(address, group(reg), static_cast<size_t>(vl) * bytes);
+        else
+            memory.readBlock(address, group(reg), static_cast<size_t>(vl) * bytes);
+        return;
+    }
+#endif
+    for (uint32_t i = 0; i < vl; i++) {
+        uint32_t elementAddress = VectorUnit::elementAddress(instruction, address, stride, i);
+        if (store) {
+            uint32_t value = readElement(reg, i, bytes);
+            switch (bytes) {
+                case 1: memory.writeByte(elementAddress, static_cast<uint8_t>(value)); break;
+                case 2: memory.writeHalfWord(elementAddress, static_cast<int16_t>(value)); break;
+                default: memory.writeWord(elementAddress, static_cast<int32_t>(value)); break;
+            }
+        } else {
+            uint32_t value = (bytes == 1) ? memory.readByte(elementAddress)
+                           : (bytes == 2) ? static_cast<uint16_t>(memory.readHalfWord(elementAddress))
+                                          : static_cast<uint32_t>(memory.readWord(elementAddress));
+            writeElement(reg, i, bytes, value);
+        }
+    }
+}
+
+uint32_t VectorUnit::executeCycles(uint32_t instruction) const {
+    uint32_t opcode = instruction & 0x7F;
+    if (opcode != 0x57)
+        return 1;
+    VectorOperand operand;
+    VectorOp op = decodeVectorOp(instruction, operand);
+    if (op == VOP_NONE || op == VOP_SETVLI || op == VOP_SETIVLI || op == VOP_SETVL || op == VOP_MV_X_S ||
+        op == VOP_MV_S_X || (vtype & VTYPE_VILL))
+        return 1;
+    uint32_t perCycle = std::max(1u, datapathLanes * 32 / sew());
+    uint32_t cycles = std::max(1u, (vl + perCycle - 1) / perCycle);
+    // The lane results of a reduction go through an adder tree
+    if (isReduction(op))
+        cycles += ceilLog2(std::min(perCycle, std::max(vl, 1u)));
+    return cycles;
+}
+
+uint32_t VectorUnit::memoryCycles(uint32_t instruction) const {
+    uint32_t opcode = instruction & 0x7F;
+    if ((opcode != 0x07 && opcode != 0x27) || !isVectorInstruction(instruction))
+        return 1;
+    if (((instruction >> 26) & 0x3) == 2)
+        return std::max(1u, vl);  // One element a cycle
+    uint32_t bytes = vl * memoryElementBytes(instruction);
+    uint32_t perCycle = datapathLanes * 4;
+    return std::max(1u, (bytes + perCycle - 1) / perCycle);
+}
+
+void VectorUnit::replayConfiguration(uint32_t instruction, int32_t rs2Value, int32_t newVl) {
+    VectorOperand operand;
+    VectorOp op = decodeVectorOp(instruction, operand);
+    // The result of a vector load or store is its address, not a vl
+    if (op != VOP_SETVLI && op != VOP_SETIVLI && op != VOP_SETVL)
+        return;
+    uint32_t type = (op == VOP_SETVL) ? static_cast<uint32_t>(rs2Value)
+                  : (op == VOP_SETVLI) ? (instruction >> 20) & 0x7FF : (instruction >> 20) & 0x3FF;
+    vtype = validType(type);
+    vl = static_cast<uint32_t>(newVl);
+}
+
+bool VectorUnit::sameState(const VectorUnit& other) const {
+    return vl == other.vl && vtype == other.vtype && registers == other.registers;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Memory;
+
+// RVV subset: vsetvli/vsetivli/vsetvl, unit-stride and strided loads and stores
+// (vle/vlse/vse/vsse 8, 16 and 32), vadd/vsub/vrsub, vmul, vmacc, vmv.v.*,
+// vmv.x.s/vmv.s.x and the single-width integer reductions vred*.vs. ELEN is 32,
+// every instruction is unmasked (vm=1) and tails are left undisturbed, which
+// both tail policies allow.
+enum VectorOp {
+    VOP_NONE = 0,
+    VOP_SETVLI, VOP_SETIVLI, VOP_SETVL,
+    VOP_LOAD, VOP_STORE,
+    VOP_ADD, VOP_SUB, VOP_RSUB, VOP_MUL, VOP_MACC, VOP_MOVE,
+    VOP_MV_X_S, VOP_MV_S_X,
+    VOP_REDSUM, VOP_REDAND, VOP_REDOR, VOP_REDXOR, VOP_REDMINU, VOP_REDMIN, VOP_REDMAXU, VOP_REDMAX
+};
+
+// Operand forms of the arithmetic: vs1, rs1 or the 5-bit immediate
+enum VectorOperand { VOPERAND_VV, VOPERAND_VX, VOPERAND_VI };
+
+// VOP_NONE for anything outside the subset
+VectorOp decodeVectorOp(uint32_t instruction, VectorOperand& operand);
+
+inline bool isVectorInstruction(uint32_t instruction) {
+    uint32_t opcode = instruction & 0x7F;
+    if (opcode != 0x57 && opcode != 0x07 && opcode != 0x27)
+        return false;
+    VectorOperand operand;
+    return decodeVectorOp(instruction, operand) != VOP_NONE;
+}
+
+inline bool isVectorMemoryAccess(uint32_t instruction) {
+    return ((instruction & 0x7F) == 0x07 || (instruction & 0x7F) == 0x27) && isVectorInstruction(instruction);
+}
+
+// Scalar registers a vector instruction reads, as detect_hazard() needs them
+int vectorScalarSources(uint32_t instruction, uint32_t sources[2]);
+// vsetvl* and vmv.x.s write x[rd]
+bool vectorWritesScalar(uint32_t instruction);
+
+// Vector register file and configuration of one hart, with the element loops
+// done on host vectors, and the occupancy of the pipeline's EX and MEM stages.
+//
+// Registers are VLEN bits each and stored back to back, so a register group
+// (LMUL > 1) is one run of bytes and element i of a group is at i * SEW/8 from
+// its first register. Elements are in host byte order; unit-stride transfers
+// copy memory straight in and out on little-endian hosts.
+//
+// Timing: EX works on 'lanes' 32-bit lanes a cycle (lanes * 32/SEW elements),
+// reductions add one cycle per level of the lane tree. MEM moves 'lanes' words
+// a cycle for unit stride and one element a cycle for strided accesses.
+// Everything else takes one cycle, as the scalar pipeline does.
+class VectorUnit {
+public:
+    static constexpr uint32_t ELEN = 32;
+    static constexpr uint32_t MIN_VLEN = 32;
+    static constexpr uint32_t MAX_VLEN = 65536;
+    static constexpr uint32_t VTYPE_VILL = 0x80000000u;
+
+    VectorUnit();
+
+    // Clears every register and sets vl = 0 with vill, as at reset. 'vlen' is a
+    // power of two from MIN_VLEN to MAX_VLEN.
+    void reset(uint32_t vlen, uint32_t lanes);
+    uint32_t vlen() const { return vlenb * 8; }
+    uint32_t lanes() const { return datapathLanes; }
+
+    uint32_t vl;
+    uint32_t vtype;
+
+    // Whether the current vtype allows the instruction: no vill, register groups
+    // aligned to LMUL (EMUL for loads and stores). vsetvl* and non-vector
+    // instructions are always allowed.
+    bool accepts(uint32_t instruction) const;
+
+    // EX: vsetvl*, arithmetic and moves; loads and stores only take their
+    // address. Returns the value for rd: the new vl, element 0 for vmv.x.s, or
+    // the address (rs1) of a load or store.
+    int32_t execute(uint32_t instruction, int32_t rs1Value, int32_t rs2Value);
+    // MEM: a load or store at 'address'; strided ones step by 'stride' (rs2)
+    void transfer(uint32_t instruction, uint32_t address, int32_t stride, Memory& memory);
+
+    // Elements a load or store moves, their width and where each one is
+    uint32_t memoryElements() const { return vl; }
+    static uint32_t memoryElementBytes(uint32_t instruction);
+    static uint32_t elementAddress(uint32_t instruction, uint32_t address, int32_t stride, uint32_t element);
+
+    // Cycles the instruction keeps EX or MEM busy with the current vl and vtype
+    uint32_t executeCycles(uint32_t instruction) const;
+    uint32_t memoryCycles(uint32_t instruction) const;
+
+    // For timing from a trace: the vl and vtype a retired vsetvl* set, 'newVl' being its result.
+    // Any other instruction leaves them alone.
+    void replayConfiguration(uint32_t instruction, int32_t rs2Value, int32_t newVl);
+
+    bool sameState(const VectorUnit& other) const;  // vl, vtype and every register
+
+    uint64_t executed;  // Vector instructions executed
+    uint64_t elements;  // Elements they operated on or moved
+
+private:
+    uint32_t vlenb;
+    uint32_t datapathLanes;
+    std::vector<uint8_t> registers;  // 32 * vlenb bytes
+
+    uint32_t sew() const { return 8u << ((vtype >> 3) & 0x7); }
+    int lmulLog2() const;             // -3 .. 3
+    uint32_t vlmax(uint32_t type) const;
+    uint32_t validType(uint32_t type) const;  // 'type', or VTYPE_VILL when it is not supported
+    uint8_t* group(uint32_t reg) { return &registers[static_cast<size_t>(reg) * vlenb]; }
+    // Element 'index' of 'bytes' bytes from register 'reg' on, zero extended
+    uint32_t readElement(uint32_t reg, uint32_t index, uint32_t bytes) const;
+    void writeElement(uint32_t reg, uint32_t index, uint32_t bytes, uint32_t value);
+};
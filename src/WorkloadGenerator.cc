@@ -0,0 +1,408 @@
+// Synthetic workload generator for scaling tests.
+//
+// Emits valid RV32IM programs either as a text listing in the loadInstructions
+// format ("<hex> <assembly>" per line) or, for a .bin output name, as a flat
+// binary image. Every kind takes a size and/or iteration count so the dynamic
+// instruction count can be scaled from a few hundred to many millions.
+//
+// Kinds:
+//   straight  - long straight-line code with a configurable instruction mix
+//   loops     - a nest of counted loops around an ALU body
+//   ptrchase  - builds a linked ring in memory, then chases it
+//   stride    - strided load/add/store sweeps over an array
+//   branchy   - data-dependent branches driven by a linear congruential generator
+//   muldiv    - dependent chains of MUL/DIV/REM
+//
+// Data lives at the global pointer (x3 = 0x10000000, set by RegisterFile), so
+// no register or memory preloads are needed to run the output.
+#include "RiscVDisassembler.hpp"
+#include "RiscVEncoder.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Registers used by the generated code. x1-x4 keep their ABI roles untouched.
+const uint32_t ZERO = 0;
+const uint32_t GP = 3;           // Data base address, preset to 0x10000000
+const uint32_t FIRST_TEMP = 5;   // Straight-line code draws from x5..x27
+const uint32_t LAST_TEMP = 27;
+const uint32_t COUNTER_BASE = 28;  // Loop counters x28..x31 (innermost first)
+
+struct GeneratorOptions {
+    std::string kind;
+    std::string output;
+    uint64_t size;        // Static size: instructions, nodes or array words depending on kind
+    uint64_t iterations;  // Trip count of the outer loop / number of sweeps
+    uint32_t depth;       // Loop nest depth (loops)
+    uint32_t stride;      // Element stride in words (stride), node spacing in bytes (ptrchase)
+    uint32_t seed;
+    // Straight-line mix weights
+    uint32_t aluWeight, loadWeight, storeWeight, mulDivWeight, branchWeight;
+
+    GeneratorOptions() : size(1000), iterations(1000), depth(3), stride(1), seed(1),
+                         aluWeight(6), loadWeight(2), storeWeight(1), mulDivWeight(1), branchWeight(1) {}
+};
+
+// Collects instruction words and resolves branch labels
+class ProgramBuilder {
+private:
+    std::vector<uint32_t> words;
+
+public:
+    size_t here() const { return words.size(); }
+    void emit(uint32_t word) { words.push_back(word); }
+    const std::vector<uint32_t>& program() const { return words; }
+
+    void addi(uint32_t rd, uint32_t rs1, int32_t imm) { emit(encodeI(imm, rs1, 0x0, rd, 0x13)); }
+    void slli(uint32_t rd, uint32_t rs1, uint32_t shamt) { emit(encodeI(shamt & 0x1F, rs1, 0x1, rd, 0x13)); }
+    void add(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(encodeR(0x00, rs2, rs1, 0x0, rd, 0x33)); }
+    void mul(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(encodeR(0x01, rs2, rs1, 0x0, rd, 0x33)); }
+    void rem(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(encodeR(0x01, rs2, rs1, 0x6, rd, 0x33)); }
+    void lw(uint32_t rd, int32_t imm, uint32_t rs1) { emit(encodeI(imm, rs1, 0x2, rd, 0x03)); }
+    void sw(uint32_t rs2, int32_t imm, uint32_t rs1) { emit(encodeS(imm, rs2, rs1, 0x2)); }
+
+    // li pseudo instruction: lui+addi, or a single addi for small values
+    void li(uint32_t rd, int32_t value) {
+        if (value >= -2048 && value < 2048) {
+            addi(rd, ZERO, value);
+            return;
+        }
+        uint32_t upper = (static_cast<uint32_t>(value) + 0x800) >> 12;
+        int32_t lower = value - static_cast<int32_t>(upper << 12);
+        emit(encodeU(upper, rd, 0x37));
+        if (lower != 0)
+            addi(rd, rd, lower);
+    }
+
+    // Branch back to 'target' while rs1 != rs2, using beq+jal if the body is
+    // too long for a 13-bit branch offset
+    void branchBackNotEqual(uint32_t rs1, uint32_t rs2, size_t target) {
+        int32_t offset = static_cast<int32_t>(target - here()) * 4;
+        if (fitsBranchOffset(offset)) {
+            emit(encodeB(offset, rs2, rs1, 0x1));
+            return;
+        }
+        emit(encodeB(8, rs2, rs1, 0x0));  // beq over the jump when done
+        emit(encodeJ(static_cast<int32_t>(target - here()) * 4, ZERO));
+    }
+
+    // Forward branch whose target is filled in by patchForward()
+    size_t forwardBranch(uint32_t funct3, uint32_t rs1, uint32_t rs2) {
+        emit(encodeB(0, rs2, rs1, funct3));
+        return here() - 1;
+    }
+
+    void patchForward(size_t branchIndex) {
+        int32_t offset = static_cast<int32_t>(here() - branchIndex) * 4;
+        uint32_t word = words[branchIndex];
+        words[branchIndex] = encodeB(offset, (word >> 20) & 0x1F, (word >> 15) & 0x1F, (word >> 12) & 0x7);
+    }
+};
+
+uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+uint32_t randomTemp(uint32_t& state) {
+    return FIRST_TEMP + nextRandom(state) % (LAST_TEMP - FIRST_TEMP + 1);
+}
+
+// --------------------------- Workload kinds ---------------------------
+
+void generateStraight(ProgramBuilder& b, const GeneratorOptions& o) {
+    uint32_t state = o.seed ? o.seed : 1;
+    uint32_t total = o.aluWeight + o.loadWeight + o.storeWeight + o.mulDivWeight + o.branchWeight;
+    if (total == 0)
+        total = 1;
+    // Give the temporaries distinct non-zero values first
+    for (uint32_t r = FIRST_TEMP; r <= LAST_TEMP; r++)
+        b.addi(r, ZERO, static_cast<int32_t>(r * 37 - 500));
+
+    for (uint64_t i = 0; i < o.size; i++) {
+        uint32_t pick = nextRandom(state) % total;
+        uint32_t rd = randomTemp(state), rs1 = randomTemp(state), rs2 = randomTemp(state);
+        int32_t wordOffset = static_cast<int32_t>(nextRandom(state) % 512) * 4;  // within 2 KiB of gp
+        if (pick < o.aluWeight) {
+            static const uint32_t aluFunct3[] = {0x0, 0x4, 0x6, 0x7, 0x1, 0x5};
+            uint32_t funct3 = aluFunct3[nextRandom(state) % 6];
+            if (nextRandom(state) & 1) {
+                int32_t imm = (funct3 == 0x1 || funct3 == 0x5) ? static_cast<int32_t>(nextRandom(state) % 32)
+                                                               : static_cast<int32_t>(nextRandom(state) % 4096) - 2048;
+                b.emit(encodeI(imm, rs1, funct3, rd, 0x13));
+            } else {
+                uint32_t funct7 = (funct3 == 0x0 && (nextRandom(state) & 1)) ? 0x20 : 0x00;  // add or sub
+                b.emit(encodeR(funct7, rs2, rs1, funct3, rd, 0x33));
+            }
+        } else if (pick < o.aluWeight + o.loadWeight) {
+            b.lw(rd, wordOffset, GP);
+        } else if (pick < o.aluWeight + o.loadWeight + o.storeWeight) {
+            b.sw(rs2, wordOffset, GP);
+        } else if (pick < o.aluWeight + o.loadWeight + o.storeWeight + o.mulDivWeight) {
+            b.emit(encodeR(0x01, rs2, rs1, nextRandom(state) % 8, rd, 0x33));
+        } else {
+            // Short forward branch over one instruction, taken or not depending on data
+            size_t branch = b.forwardBranch(nextRandom(state) & 1 ? 0x4 : 0x1, rs1, rs2);
+            b.addi(rd, rd, 1);
+            b.patchForward(branch);
+        }
+    }
+}
+
+void generateLoops(ProgramBuilder& b, const GeneratorOptions& o) {
+    uint32_t depth = o.depth < 1 ? 1 : (o.depth > 4 ? 4 : o.depth);
+    int32_t trips = static_cast<int32_t>(o.iterations < 1 ? 1 : o.iterations);
+    std::vector<size_t> heads(depth);
+
+    b.li(5, 0);   // Accumulators
+    b.li(6, 1);
+    // Open loops outermost first; counter register COUNTER_BASE + level
+    for (uint32_t level = depth; level-- > 0;) {
+        b.li(COUNTER_BASE + level, trips);
+        heads[level] = b.here();
+    }
+    // Body: a small dependent ALU chain plus a load/store pair
+    for (uint64_t i = 0; i < (o.size < 1 ? 1 : o.size); i++) {
+        b.add(5, 5, 6);
+        b.addi(6, 6, 3);
+        if (i % 4 == 3) {
+            b.sw(5, static_cast<int32_t>((i % 64) * 4), GP);
+            b.lw(7, static_cast<int32_t>((i % 64) * 4), GP);
+        }
+    }
+    // Close loops innermost first; inner counters are re-armed at each outer head
+    for (uint32_t level = 0; level < depth; level++) {
+        b.addi(COUNTER_BASE + level, COUNTER_BASE + level, -1);
+        b.branchBackNotEqual(COUNTER_BASE + level, ZERO, heads[level]);
+    }
+}
+
+void generatePointerChase(ProgramBuilder& b, const GeneratorOptions& o) {
+    int32_t nodes = static_cast<int32_t>(o.size < 2 ? 2 : (o.size > 1000000 ? 1000000 : o.size));
+    uint32_t shift = 3;  // Node spacing 8 bytes by default, --stride gives log2 of the spacing
+    if (o.stride > 1) {
+        shift = 0;
+        while ((1u << shift) < o.stride && shift < 16)
+            shift++;
+    }
+    // Visit order i -> (i + step) % nodes with step coprime to nodes, so the ring covers every node
+    int32_t step = nodes / 2 + 1;
+    auto gcd = [](int32_t a, int32_t c) { while (c) { int32_t t = a % c; a = c; c = t; } return a; };
+    while (gcd(step, nodes) != 1)
+        step++;
+
+    // Build: mem[gp + (i << shift)] = gp + (((i + step) % nodes) << shift)
+    b.li(5, 0);          // i
+    b.li(6, nodes);
+    b.li(7, step);
+    size_t build = b.here();
+    b.add(8, 5, 7);
+    b.rem(8, 8, 6);
+    b.slli(8, 8, shift);
+    b.add(8, 8, GP);
+    b.slli(9, 5, shift);
+    b.add(9, 9, GP);
+    b.sw(8, 0, 9);
+    b.addi(5, 5, 1);
+    b.branchBackNotEqual(5, 6, build);
+
+    // Chase: follow the ring for iterations * nodes hops
+    b.emit(encodeI(0, GP, 0x0, 10, 0x13));  // addi x10 gp 0
+    b.li(11, static_cast<int32_t>(o.iterations < 1 ? 1 : o.iterations));
+    size_t outer = b.here();
+    b.li(12, nodes);
+    size_t chase = b.here();
+    b.lw(10, 0, 10);
+    b.addi(12, 12, -1);
+    b.branchBackNotEqual(12, ZERO, chase);
+    b.addi(11, 11, -1);
+    b.branchBackNotEqual(11, ZERO, outer);
+}
+
+void generateStride(ProgramBuilder& b, const GeneratorOptions& o) {
+    int32_t words = static_cast<int32_t>(o.size < 1 ? 1 : (o.size > 4000000 ? 4000000 : o.size));
+    int32_t strideBytes = static_cast<int32_t>((o.stride < 1 ? 1 : o.stride) * 4);
+    int32_t elements = (words + (strideBytes / 4) - 1) / (strideBytes / 4);
+
+    b.li(11, static_cast<int32_t>(o.iterations < 1 ? 1 : o.iterations));
+    b.li(13, strideBytes);
+    size_t sweep = b.here();
+    b.emit(encodeI(0, GP, 0x0, 10, 0x13));  // addi x10 gp 0
+    b.li(12, elements);
+    size_t element = b.here();
+    b.lw(5, 0, 10);
+    b.addi(5, 5, 1);
+    b.sw(5, 0, 10);
+    b.add(10, 10, 13);
+    b.addi(12, 12, -1);
+    b.branchBackNotEqual(12, ZERO, element);
+    b.addi(11, 11, -1);
+    b.branchBackNotEqual(11, ZERO, sweep);
+}
+
+void generateBranchy(ProgramBuilder& b, const GeneratorOptions& o) {
+    b.li(5, static_cast<int32_t>(o.seed ? o.seed : 1));  // LCG state
+    b.li(6, 1103515245);
+    b.li(7, 0);  // Taken counters
+    b.li(8, 0);
+    b.li(9, 0);
+    b.li(11, static_cast<int32_t>(o.iterations < 1 ? 1 : o.iterations));
+    size_t head = b.here();
+    b.mul(5, 5, 6);
+    b.addi(5, 5, 1234);
+    // Three data-dependent branches on different bits of the state
+    for (uint32_t bit = 0; bit < 3; bit++) {
+        b.emit(encodeI(6 + static_cast<int32_t>(bit) * 3, 5, 0x5, 12, 0x13));  // srli x12 x5 k
+        b.emit(encodeI(1, 12, 0x7, 12, 0x13));                                // andi x12 x12 1
+        size_t skip = b.forwardBranch(0x0, 12, ZERO);                          // beq x12 x0 skip
+        b.addi(7 + bit, 7 + bit, 1);
+        b.patchForward(skip);
+    }
+    b.addi(11, 11, -1);
+    b.branchBackNotEqual(11, ZERO, head);
+}
+
+void generateMulDiv(ProgramBuilder& b, const GeneratorOptions& o) {
+    b.li(5, 12345);
+    b.li(6, 7);
+    b.li(7, 3);
+    b.li(11, static_cast<int32_t>(o.iterations < 1 ? 1 : o.iterations));
+    size_t head = b.here();
+    for (uint64_t i = 0; i < (o.size < 1 ? 1 : o.size); i++) {
+        b.mul(5, 5, 6);
+        b.emit(encodeR(0x01, 7, 5, 0x4, 8, 0x33));  // div x8 x5 x7
+        b.emit(encodeR(0x01, 6, 8, 0x6, 9, 0x33));  // rem x9 x8 x6
+        b.emit(encodeR(0x01, 9, 5, 0x3, 10, 0x33)); // mulhu x10 x5 x9
+        b.add(5, 5, 9);
+        b.addi(5, 5, 1);
+    }
+    b.addi(11, 11, -1);
+    b.branchBackNotEqual(11, ZERO, head);
+}
+
+// --------------------------- Output ---------------------------
+
+bool writeProgram(const std::vector<uint32_t>& program, const std::string& filename) {
+    bool binary = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+    std::FILE* out = (filename == "-") ? stdout : std::fopen(filename.c_str(), binary ? "wb" : "w");
+    if (!out) {
+        std::cerr << "Error: Unable to open " << filename << " for writing" << std::endl;
+        return false;
+    }
+    // Large stdio buffer, outputs reach hundreds of megabytes
+    std::vector<char> buffer(1 << 20);
+    std::setvbuf(out, buffer.data(), _IOFBF, buffer.size());
+
+    if (binary) {
+        for (uint32_t word : program) {
+            unsigned char bytes[4] = {static_cast<unsigned char>(word), static_cast<unsigned char>(word >> 8),
+                                      static_cast<unsigned char>(word >> 16), static_cast<unsigned char>(word >> 24)};
+            std::fwrite(bytes, 1, 4, out);
+        }
+    } else {
+        for (uint32_t word : program)
+            std::fprintf(out, "%08x %s\n", word, disassembleInstruction(word).c_str());
+    }
+    bool ok = std::fflush(out) == 0;
+    if (out != stdout)
+        ok = (std::fclose(out) == 0) && ok;
+    return ok;
+}
+
+void printGeneratorUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <kind> -o <file> [options]" << std::endl
+              << "  kinds: straight, loops, ptrchase, stride, branchy, muldiv" << std::endl
+              << "  -o <file>          Output file, .bin writes a flat binary, - writes text to stdout" << std::endl
+              << "  --size N           straight: instructions, loops/muldiv: body repeats," << std::endl
+              << "                     ptrchase: nodes, stride: array words (default 1000)" << std::endl
+              << "  --iterations N     Outer trip count / number of sweeps or rounds (default 1000)" << std::endl
+              << "  --depth D          Loop nest depth for loops, 1-4 (default 3)" << std::endl
+              << "  --stride S         stride: element stride in words, ptrchase: node spacing in bytes" << std::endl
+              << "  --mix a:l:s:m:b    straight: weights of ALU, load, store, MUL/DIV, branch (default 6:2:1:1:1)" << std::endl
+              << "  --seed N           Random seed (default 1)" << std::endl;
+}
+
+bool parseMix(const std::string& text, GeneratorOptions& o) {
+    unsigned a, l, s, m, b;
+    if (std::sscanf(text.c_str(), "%u:%u:%u:%u:%u", &a, &l, &s, &m, &b) != 5)
+        return false;
+    o.aluWeight = a;
+    o.loadWeight = l;
+    o.storeWeight = s;
+    o.mulDivWeight = m;
+    o.branchWeight = b;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    GeneratorOptions options;
+    if (argc < 2) {
+        printGeneratorUsage(argv[0]);
+        return 1;
+    }
+    options.kind = argv[1];
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printGeneratorUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "-o")
+            options.output = value;
+        else if (arg == "--size")
+            options.size = std::strtoull(value.c_str(), nullptr, 0);
+        else if (arg == "--iterations")
+            options.iterations = std::strtoull(value.c_str(), nullptr, 0);
+        else if (arg == "--depth")
+            options.depth = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 0));
+        else if (arg == "--stride")
+            options.stride = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 0));
+        else if (arg == "--seed")
+            options.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 0));
+        else if (arg == "--mix" && parseMix(value, options))
+            continue;
+        else {
+            printGeneratorUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.output.empty()) {
+        printGeneratorUsage(argv[0]);
+        return 1;
+    }
+
+    ProgramBuilder builder;
+    if (options.kind == "straight")
+        generateStraight(builder, options);
+    else if (options.kind == "loops")
+        generateLoops(builder, options);
+    else if (options.kind == "ptrchase")
+        generatePointerChase(builder, options);
+    else if (options.kind == "stride")
+        generateStride(builder, options);
+    else if (options.kind == "branchy")
+        generateBranchy(builder, options);
+    else if (options.kind == "muldiv")
+        generateMulDiv(builder, options);
+    else {
+        std::cerr << "Error: unknown workload kind " << options.kind << std::endl;
+        printGeneratorUsage(argv[0]);
+        return 1;
+    }
+
+    if (!writeProgram(builder.program(), options.output))
+        return 1;
+    std::cerr << "Generated " << options.kind << " workload: " << builder.program().size()
+              << " instructions -> " << options.output << std::endl;
+    return 0;
+}